@@ -0,0 +1,117 @@
+//
+// Created by hanke on 2024/5/8.
+//
+
+#ifndef INFERNETO_BENCH_CONV_SHAPES_HPP
+#define INFERNETO_BENCH_CONV_SHAPES_HPP
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace infer_neto {
+    /// 模型中一个卷积层的形状
+    struct ConvShape {
+        std::string name;
+        uint32_t in_channels = 0;
+        uint32_t out_channels = 0;
+        uint32_t input_h = 0;
+        uint32_t input_w = 0;
+        uint32_t kernel_h = 0;
+        uint32_t kernel_w = 0;
+        uint32_t padding_h = 0;
+        uint32_t padding_w = 0;
+        uint32_t stride_h = 1;
+        uint32_t stride_w = 1;
+        uint32_t groups = 1;
+
+        bool SameShape(const ConvShape &other) const {
+            return in_channels == other.in_channels && out_channels == other.out_channels &&
+                   input_h == other.input_h && input_w == other.input_w &&
+                   kernel_h == other.kernel_h && kernel_w == other.kernel_w &&
+                   padding_h == other.padding_h && padding_w == other.padding_w &&
+                   stride_h == other.stride_h && stride_w == other.stride_w && groups == other.groups;
+        }
+    };
+
+    /// 解析形如 (3,3) 或 (1,64,56,56)f32 的整数列表
+    inline std::vector<uint32_t> ParseIntTuple(const std::string &value) {
+        std::vector<uint32_t> result;
+        const size_t begin = value.find('(');
+        const size_t end = value.find(')');
+        if (begin == std::string::npos || end == std::string::npos) {
+            return result;
+        }
+        std::stringstream stream(value.substr(begin + 1, end - begin - 1));
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            result.push_back(std::stoul(item));
+        }
+        return result;
+    }
+
+    /**
+     * 从pnnx的param文件中读取所有卷积层的形状，形状相同的卷积层只保留第一个
+     * 只解析文本描述，不需要对应的bin权重文件
+     * @param param_path param文件的路径
+     * @return 卷积层形状的列表，文件打开失败时为空
+     */
+    inline std::vector<ConvShape> LoadConvShapes(const std::string &param_path) {
+        std::vector<ConvShape> shapes;
+        std::ifstream file(param_path);
+        std::string line;
+        while (std::getline(file, line)) {
+            std::stringstream stream(line);
+            std::string type;
+            stream >> type;
+            if (type != "nn.Conv2d") {
+                continue;
+            }
+            ConvShape shape;
+            stream >> shape.name;
+            std::string token;
+            bool input_found = false;
+            while (stream >> token) {
+                const size_t eq = token.find('=');
+                if (eq == std::string::npos) {
+                    continue;
+                }
+                const std::string key = token.substr(0, eq);
+                const std::vector<uint32_t> &values = ParseIntTuple(token.substr(eq + 1));
+                if (key == "in_channels") {
+                    shape.in_channels = std::stoul(token.substr(eq + 1));
+                } else if (key == "out_channels") {
+                    shape.out_channels = std::stoul(token.substr(eq + 1));
+                } else if (key == "groups") {
+                    shape.groups = std::stoul(token.substr(eq + 1));
+                } else if (key == "kernel_size" && values.size() == 2) {
+                    shape.kernel_h = values.at(0);
+                    shape.kernel_w = values.at(1);
+                } else if (key == "padding" && values.size() == 2) {
+                    shape.padding_h = values.at(0);
+                    shape.padding_w = values.at(1);
+                } else if (key == "stride" && values.size() == 2) {
+                    shape.stride_h = values.at(0);
+                    shape.stride_w = values.at(1);
+                } else if (key.front() == '#' && !input_found && values.size() == 4) {
+                    // 第一个操作数是卷积的输入，形状为 (n,c,h,w)
+                    shape.input_h = values.at(2);
+                    shape.input_w = values.at(3);
+                    input_found = true;
+                }
+            }
+
+            bool duplicated = false;
+            for (const ConvShape &existed : shapes) {
+                duplicated |= existed.SameShape(shape);
+            }
+            if (!duplicated) {
+                shapes.push_back(shape);
+            }
+        }
+        return shapes;
+    }
+}
+
+#endif //INFERNETO_BENCH_CONV_SHAPES_HPP
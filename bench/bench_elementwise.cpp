@@ -0,0 +1,65 @@
+//
+// Created by hanke on 2024/5/15.
+//
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include "data/cpu/elementwise.hpp"
+#include "data/cpu/tensor.hpp"
+
+using namespace infer_neto;
+
+/**
+ * ResNet18中各层激活的元素数量 (channels * h * w)
+ */
+static void ResNet18ActivationSizes(benchmark::internal::Benchmark *b) {
+    b->ArgNames({"N"});
+    b->Arg(64 * 112 * 112);
+    b->Arg(64 * 56 * 56);
+    b->Arg(128 * 28 * 28);
+    b->Arg(256 * 14 * 14);
+    b->Arg(512 * 7 * 7);
+}
+
+// 改写前SigmoidLayer中的标量实现，作为对照
+static void BM_SigmoidScalar(benchmark::State &state) {
+    Tensor<float> input(uint32_t(state.range(0)));
+    Tensor<float> output(uint32_t(state.range(0)));
+    input.Rand();
+    for (auto _ : state) {
+        const float *x = input.raw_ptr();
+        float *y = output.raw_ptr();
+        for (uint32_t i = 0; i < input.size(); ++i) {
+            y[i] = 1 / (1.f + std::exp(-x[i]));
+        }
+        benchmark::DoNotOptimize(output.raw_ptr());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0) * 2 * sizeof(float));
+}
+
+static void BM_Sigmoid(benchmark::State &state) {
+    Tensor<float> input(uint32_t(state.range(0)));
+    Tensor<float> output(uint32_t(state.range(0)));
+    input.Rand();
+    for (auto _ : state) {
+        ElementwiseUnary(UnaryOp::kSigmoid, input.raw_ptr(), output.raw_ptr(), input.size());
+        benchmark::DoNotOptimize(output.raw_ptr());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0) * 2 * sizeof(float));
+}
+
+static void BM_ElementAdd(benchmark::State &state) {
+    Tensor<float> input1(uint32_t(state.range(0)));
+    Tensor<float> input2(uint32_t(state.range(0)));
+    Tensor<float> output(uint32_t(state.range(0)));
+    input1.Rand();
+    input2.Rand();
+    for (auto _ : state) {
+        ElementwiseBinary(BinaryOp::kAdd, input1.raw_ptr(), input2.raw_ptr(), output.raw_ptr(), input1.size());
+        benchmark::DoNotOptimize(output.raw_ptr());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0) * 3 * sizeof(float));
+}
+
+BENCHMARK(BM_SigmoidScalar)->Apply(ResNet18ActivationSizes)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Sigmoid)->Apply(ResNet18ActivationSizes)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ElementAdd)->Apply(ResNet18ActivationSizes)->Unit(benchmark::kMicrosecond);
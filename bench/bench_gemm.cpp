@@ -0,0 +1,48 @@
+//
+// Created by hanke on 2024/5/6.
+//
+#include <benchmark/benchmark.h>
+#include "data/cpu/tensor.hpp"
+
+using namespace infer_neto;
+
+/**
+ * ResNet18中各层对应的矩阵乘法形状
+ * 卷积层: M = out_c, K = in_c * kh * kw, N = out_h * out_w
+ * 全连接层: M = 1, K = in_features, N = out_features
+ */
+static void ResNet18GemmShapes(benchmark::internal::Benchmark *b) {
+    b->ArgNames({"M", "N", "K"});
+    b->Args({64, 112 * 112, 3 * 7 * 7});     // conv1 7x7 s2
+    b->Args({64, 56 * 56, 64 * 3 * 3});      // layer1 3x3
+    b->Args({128, 28 * 28, 64 * 3 * 3});     // layer2.0.conv1 3x3 s2
+    b->Args({128, 28 * 28, 128 * 3 * 3});    // layer2 3x3
+    b->Args({128, 28 * 28, 64});             // layer2.0.downsample 1x1 s2
+    b->Args({256, 14 * 14, 128 * 3 * 3});    // layer3.0.conv1 3x3 s2
+    b->Args({256, 14 * 14, 256 * 3 * 3});    // layer3 3x3
+    b->Args({256, 14 * 14, 128});            // layer3.0.downsample 1x1 s2
+    b->Args({512, 7 * 7, 256 * 3 * 3});      // layer4.0.conv1 3x3 s2
+    b->Args({512, 7 * 7, 512 * 3 * 3});      // layer4 3x3
+    b->Args({512, 7 * 7, 256});              // layer4.0.downsample 1x1 s2
+    b->Args({1, 1000, 512});                 // fc
+}
+
+static void BM_Gemm(benchmark::State &state) {
+    const uint32_t m = state.range(0);
+    const uint32_t n = state.range(1);
+    const uint32_t k = state.range(2);
+    Tensor<float> a(m, k);
+    Tensor<float> b(k, n);
+    a.Rand();
+    b.Rand();
+    for (auto _ : state) {
+        Tensor<float> c = a.Gemm(b);
+        benchmark::DoNotOptimize(c.raw_ptr());
+    }
+    // 以 G/s 为单位输出每秒浮点运算次数
+    state.counters["FLOPS"] = benchmark::Counter(2.0 * m * n * k,
+                                                 benchmark::Counter::kIsIterationInvariantRate,
+                                                 benchmark::Counter::OneK::kIs1000);
+}
+
+BENCHMARK(BM_Gemm)->Apply(ResNet18GemmShapes)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,61 @@
+//
+// Created by hanke on 2024/5/11.
+//
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include "node/details/convolution.hpp"
+
+using namespace infer_neto;
+
+/**
+ * 分组卷积在im2col和直接卷积两种方式下的前向耗时
+ * 参数依次为输入通道、输出通道、分组数、输入尺寸、步长、计算方式
+ */
+static void BM_GroupConv(benchmark::State &state) {
+    const uint32_t in_c = state.range(0);
+    const uint32_t out_c = state.range(1);
+    const uint32_t groups = state.range(2);
+    const uint32_t input_size = state.range(3);
+    const uint32_t stride = state.range(4);
+    const auto algorithm = ConvAlgorithm(state.range(5));
+
+    ConvolutionLayer layer(out_c, in_c, 3, 3, 1, 1, stride, stride, groups, true);
+    std::vector<float> weights(size_t(out_c) * in_c / groups * 9);
+    for (size_t i = 0; i < weights.size(); ++i) {
+        weights.at(i) = std::sin(float(i)) * 0.1f;
+    }
+    layer.set_weights(weights);
+    layer.set_bias(std::vector<float>(out_c, 0.1f));
+    layer.set_algorithm(algorithm);
+    layer.InitIm2ColWeight();
+
+    std::vector<sftensor> inputs(1);
+    inputs.at(0) = std::make_shared<Tensor<float>>(in_c, input_size, input_size);
+    inputs.at(0)->Rand();
+    std::vector<sftensor> outputs(1);
+    for (auto _ : state) {
+        layer.Forward(inputs, outputs);
+        benchmark::DoNotOptimize(outputs.at(0)->raw_ptr());
+    }
+}
+
+static void GroupConvShapes(benchmark::internal::Benchmark *b) {
+    b->ArgNames({"in_c", "out_c", "groups", "size", "stride", "algo"});
+    const std::vector<std::vector<int64_t>> shapes = {
+            {32, 32, 32, 112, 1},     // MobileNet 深度可分离卷积
+            {144, 144, 144, 56, 2},
+            {384, 384, 384, 14, 1},
+            {64, 64, 8, 56, 1},       // 每组8个通道
+            {128, 128, 32, 28, 1},    // 每组4个通道 (ResNeXt)
+            {256, 256, 4, 14, 1},     // 每组64个通道
+    };
+    for (const auto &shape : shapes) {
+        for (int64_t algorithm : {int64_t(ConvAlgorithm::kIm2ColGemm), int64_t(ConvAlgorithm::kDirect)}) {
+            std::vector<int64_t> args = shape;
+            args.push_back(algorithm);
+            b->Args(args);
+        }
+    }
+}
+
+BENCHMARK(BM_GroupConv)->Apply(GroupConvShapes)->Unit(benchmark::kMicrosecond);
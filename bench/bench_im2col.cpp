@@ -0,0 +1,87 @@
+//
+// Created by hanke on 2024/5/8.
+//
+#include <benchmark/benchmark.h>
+#include "bench_conv_shapes.hpp"
+#include "data/cpu/im2col.hpp"
+#include "data/cpu/tensor.hpp"
+
+using namespace infer_neto;
+
+/**
+ * 改写前ConvolutionLayer::Im2Col的实现，作为对照
+ * 每次调用都分配新的矩阵，并逐元素通过at()读写
+ */
+static Tensor<float> LegacyIm2Col(const Tensor<float> &input, const ConvShape &shape,
+                                  uint32_t output_h, uint32_t output_w) {
+    const uint32_t row_len = shape.kernel_h * shape.kernel_w;
+    Tensor<float> input_matrix(shape.in_channels * row_len, output_h * output_w);
+    const uint32_t input_padded_h = shape.input_h + 2 * shape.padding_h;
+    const uint32_t input_padded_w = shape.input_w + 2 * shape.padding_w;
+    for (uint32_t ic = 0; ic < shape.in_channels; ++ic) {
+        uint32_t current_col = 0;
+        for (uint32_t r = 0; r < input_padded_h - shape.kernel_h + 1; r += shape.stride_h) {
+            for (uint32_t w = 0; w < input_padded_w - shape.kernel_w + 1; w += shape.stride_w) {
+                for (uint32_t kh = 0; kh < shape.kernel_h; ++kh) {
+                    for (uint32_t kw = 0; kw < shape.kernel_w; ++kw) {
+                        const uint32_t col_index = kh * shape.kernel_w + kw;
+                        float val = 0.f;
+                        if (r + kh >= shape.padding_h && w + kw >= shape.padding_w &&
+                            r + kh < shape.input_h + shape.padding_h && w + kw < shape.input_w + shape.padding_w) {
+                            val = input.at(ic, r + kh - shape.padding_h, w + kw - shape.padding_w);
+                        }
+                        input_matrix.at(0, col_index + ic * row_len, current_col) = val;
+                    }
+                }
+                current_col++;
+            }
+        }
+    }
+    return input_matrix;
+}
+
+static void BM_Im2ColLegacy(benchmark::State &state, const ConvShape &shape) {
+    const uint32_t output_h = ConvOutputSize(shape.input_h, shape.kernel_h, shape.padding_h, shape.stride_h);
+    const uint32_t output_w = ConvOutputSize(shape.input_w, shape.kernel_w, shape.padding_w, shape.stride_w);
+    Tensor<float> input(shape.in_channels, shape.input_h, shape.input_w);
+    input.Rand();
+    for (auto _ : state) {
+        Tensor<float> matrix = LegacyIm2Col(input, shape, output_h, output_w);
+        benchmark::DoNotOptimize(matrix.raw_ptr());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * shape.in_channels * shape.kernel_h *
+                            shape.kernel_w * output_h * output_w * sizeof(float));
+}
+
+static void BM_Im2Col(benchmark::State &state, const ConvShape &shape) {
+    const uint32_t output_h = ConvOutputSize(shape.input_h, shape.kernel_h, shape.padding_h, shape.stride_h);
+    const uint32_t output_w = ConvOutputSize(shape.input_w, shape.kernel_w, shape.padding_w, shape.stride_w);
+    Tensor<float> input(shape.in_channels, shape.input_h, shape.input_w);
+    input.Rand();
+    std::vector<float> workspace(size_t(shape.in_channels) * shape.kernel_h * shape.kernel_w * output_h * output_w);
+    for (auto _ : state) {
+        Im2Col(input.raw_ptr(), shape.in_channels, shape.input_h, shape.input_w,
+               shape.kernel_h, shape.kernel_w, shape.padding_h, shape.padding_w,
+               shape.stride_h, shape.stride_w, workspace.data());
+        benchmark::DoNotOptimize(workspace.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * workspace.size() * sizeof(float));
+}
+
+// 为resnet18中每种卷积形状分别注册新旧两个版本
+static int RegisterIm2ColBenchmarks() {
+    const std::vector<ConvShape> &shapes = LoadConvShapes("../model_file/resnet18_batch1.pnnx.param");
+    for (const ConvShape &shape : shapes) {
+        const std::string label = shape.name + "/" + std::to_string(shape.in_channels) + "x" +
+                                  std::to_string(shape.input_h) + "x" + std::to_string(shape.input_w) +
+                                  "_k" + std::to_string(shape.kernel_h) + "_s" + std::to_string(shape.stride_h);
+        benchmark::RegisterBenchmark(("BM_Im2ColLegacy/" + label).c_str(), BM_Im2ColLegacy, shape)
+                ->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark(("BM_Im2Col/" + label).c_str(), BM_Im2Col, shape)
+                ->Unit(benchmark::kMicrosecond);
+    }
+    return 0;
+}
+
+static int im2col_benchmarks_registered = RegisterIm2ColBenchmarks();
@@ -0,0 +1,52 @@
+//
+// Created by hanke on 2024/5/16.
+//
+#include <benchmark/benchmark.h>
+#include "data/cpu/tensor.hpp"
+
+using namespace infer_neto;
+
+/**
+ * 全连接层权重以及特征图的转置尺寸 (rows, cols)
+ */
+static void TransposeShapes(benchmark::internal::Benchmark *b) {
+    b->ArgNames({"rows", "cols"});
+    b->Args({1000, 512});
+    b->Args({4096, 4096});
+    b->Args({3136, 64});
+}
+
+// 逐元素按步长读取的朴素实现，作为对照
+static void BM_TransposeNaive(benchmark::State &state) {
+    const uint32_t rows = state.range(0);
+    const uint32_t cols = state.range(1);
+    Tensor<float> input(rows, cols);
+    Tensor<float> output(cols, rows);
+    input.Rand();
+    for (auto _ : state) {
+        const float *src = input.raw_ptr();
+        float *dst = output.raw_ptr();
+        for (uint32_t j = 0; j < cols; ++j) {
+            for (uint32_t i = 0; i < rows; ++i) {
+                dst[j * rows + i] = src[i * cols + j];
+            }
+        }
+        benchmark::DoNotOptimize(output.raw_ptr());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * rows * cols * 2 * sizeof(float));
+}
+
+static void BM_Transpose(benchmark::State &state) {
+    const uint32_t rows = state.range(0);
+    const uint32_t cols = state.range(1);
+    Tensor<float> input(rows, cols);
+    input.Rand();
+    for (auto _ : state) {
+        Tensor<float> output = input.Transpose().Contiguous();
+        benchmark::DoNotOptimize(output.raw_ptr());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * rows * cols * 2 * sizeof(float));
+}
+
+BENCHMARK(BM_TransposeNaive)->Apply(TransposeShapes)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Transpose)->Apply(TransposeShapes)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,89 @@
+//
+// Created by hanke on 2024/5/9.
+//
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cmath>
+#include "bench_conv_shapes.hpp"
+#include "node/details/convolution.hpp"
+
+using namespace infer_neto;
+
+static std::shared_ptr<ConvolutionLayer> MakeConvLayer(const ConvShape &shape, ConvAlgorithm algorithm) {
+    auto layer = std::make_shared<ConvolutionLayer>(shape.out_channels, shape.in_channels, shape.kernel_h,
+                                                    shape.kernel_w, shape.padding_h, shape.padding_w,
+                                                    shape.stride_h, shape.stride_w, shape.groups, true);
+    std::vector<float> weights(size_t(shape.out_channels) * shape.in_channels / shape.groups *
+                               shape.kernel_h * shape.kernel_w);
+    for (size_t i = 0; i < weights.size(); ++i) {
+        weights.at(i) = std::sin(float(i)) * 0.1f;
+    }
+    layer->set_weights(weights);
+    layer->set_bias(std::vector<float>(shape.out_channels, 0.1f));
+    layer->set_algorithm(algorithm);
+    layer->InitIm2ColWeight();
+    layer->InitWinogradWeight();
+    return layer;
+}
+
+/// 多次前向的平均耗时，单位为秒
+static double AverageForwardTime(ConvolutionLayer &layer, const std::vector<sftensor> &inputs,
+                                 std::vector<sftensor> &outputs, uint32_t repeats) {
+    layer.Forward(inputs, outputs);
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < repeats; ++i) {
+        layer.Forward(inputs, outputs);
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / repeats;
+}
+
+/**
+ * 测量一个卷积层在指定计算方式下的前向耗时
+ * speedup为相对im2col方式的加速比，即每一层的加速报告
+ */
+static void BM_ConvAlgorithm(benchmark::State &state, const ConvShape &shape, ConvAlgorithm algorithm) {
+    std::vector<sftensor> inputs(1);
+    inputs.at(0) = std::make_shared<Tensor<float>>(shape.in_channels, shape.input_h, shape.input_w);
+    inputs.at(0)->Rand();
+    std::vector<sftensor> outputs(1);
+
+    std::shared_ptr<ConvolutionLayer> baseline = MakeConvLayer(shape, ConvAlgorithm::kIm2ColGemm);
+    const double baseline_time = AverageForwardTime(*baseline, inputs, outputs, 5);
+
+    std::shared_ptr<ConvolutionLayer> layer = MakeConvLayer(shape, algorithm);
+    outputs.at(0).reset();
+    layer->Forward(inputs, outputs);
+    const auto start = std::chrono::steady_clock::now();
+    for (auto _ : state) {
+        layer->Forward(inputs, outputs);
+        benchmark::DoNotOptimize(outputs.at(0)->raw_ptr());
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    state.counters["speedup"] = baseline_time / (elapsed.count() / double(state.iterations()));
+}
+
+// 为resnet18中每个步长为1的3x3卷积注册三种计算方式
+static int RegisterWinogradBenchmarks() {
+    const std::vector<std::pair<ConvAlgorithm, std::string>> algorithms = {
+            {ConvAlgorithm::kIm2ColGemm,   "im2col"},
+            {ConvAlgorithm::kWinograd2x2, "winograd2x2"},
+            {ConvAlgorithm::kWinograd4x4, "winograd4x4"}};
+    const std::vector<ConvShape> &shapes = LoadConvShapes("../model_file/resnet18_batch1.pnnx.param");
+    for (const ConvShape &shape : shapes) {
+        if (shape.kernel_h != 3 || shape.kernel_w != 3 || shape.stride_h != 1 || shape.stride_w != 1 ||
+            shape.groups != 1) {
+            continue;
+        }
+        const std::string label = shape.name + "/" + std::to_string(shape.in_channels) + "x" +
+                                  std::to_string(shape.input_h) + "x" + std::to_string(shape.input_w);
+        for (const auto &algorithm : algorithms) {
+            benchmark::RegisterBenchmark(("BM_ConvAlgorithm/" + label + "/" + algorithm.second).c_str(),
+                                         BM_ConvAlgorithm, shape, algorithm.first)
+                    ->Unit(benchmark::kMicrosecond);
+        }
+    }
+    return 0;
+}
+
+static int winograd_benchmarks_registered = RegisterWinogradBenchmarks();
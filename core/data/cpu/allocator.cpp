@@ -0,0 +1,315 @@
+//
+// Created by hanke on 2024/5/14.
+//
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#include "data/cpu/allocator.hpp"
+
+namespace infer_neto {
+    namespace {
+        /// 每个2的幂区间再细分的级数，按级取整后最多浪费25%的内存
+        constexpr size_t kSizeClassSteps = 4;
+        /// 最小一级内存块的位数，即kTensorAlignment
+        constexpr size_t kMinBlockShift = 6;
+
+        /// 线程退出时私有缓存已经析构，之后在该线程中释放的内存直接交给共享缓存
+        thread_local bool thread_caches_destroyed = false;
+
+        void *AlignedAllocate(size_t alignment, size_t bytes) {
+            // aligned_alloc要求申请的大小是对齐字节数的整数倍，大小为0时也返回一块有效的内存
+            const size_t aligned_bytes = std::max<size_t>((bytes + alignment - 1) / alignment, 1) * alignment;
+            void *ptr = std::aligned_alloc(alignment, aligned_bytes);
+            if (ptr == nullptr) {
+                throw std::bad_alloc();
+            }
+            return ptr;
+        }
+
+        void *SystemAllocate(size_t bytes) {
+            constexpr size_t huge_page = PooledTensorAllocator::kHugePageSize;
+            if (bytes < huge_page) {
+                return AlignedAllocate(kTensorAlignment, bytes);
+            }
+            const size_t huge_bytes = (bytes + huge_page - 1) / huge_page * huge_page;
+            void *ptr = AlignedAllocate(huge_page, huge_bytes);
+#ifdef MADV_HUGEPAGE
+            // 只是提示内核，不支持透明大页时忽略返回值即可
+            madvise(ptr, huge_bytes, MADV_HUGEPAGE);
+#endif
+            return ptr;
+        }
+
+        size_t SizeClassIndex(size_t bytes) {
+            if (bytes <= kTensorAlignment) {
+                return 0;
+            }
+            // 2^shift < bytes <= 2^(shift + 1)，区间内再按2^(shift - 2)分为kSizeClassSteps级
+            const size_t shift = 63 - __builtin_clzll((unsigned long long) (bytes - 1));
+            const size_t step = size_t(1) << (shift - 2);
+            const size_t sub = (bytes - (size_t(1) << shift) + step - 1) / step - 1;
+            return 1 + (shift - kMinBlockShift) * kSizeClassSteps + sub;
+        }
+
+        size_t SizeClassBytes(size_t index) {
+            if (index == 0) {
+                return kTensorAlignment;
+            }
+            const size_t shift = kMinBlockShift + (index - 1) / kSizeClassSteps;
+            const size_t sub = (index - 1) % kSizeClassSteps;
+            return (size_t(1) << shift) + (sub + 1) * (size_t(1) << (shift - 2));
+        }
+    }
+
+    void *AlignedTensorAllocator::Allocate(size_t bytes) {
+        return AlignedAllocate(kTensorAlignment, bytes);
+    }
+
+    void AlignedTensorAllocator::Deallocate(void *ptr, size_t bytes) {
+        std::free(ptr);
+    }
+
+    struct PooledTensorAllocator::Pool {
+        /// 一个线程在某个分配器上的私有缓存，持有pool保证线程退出时能把内存交还回去
+        struct ThreadCache {
+            std::shared_ptr<Pool> pool;
+            std::vector<std::vector<void *>> free_lists;
+            size_t bytes = 0;
+        };
+
+        struct ThreadCaches {
+            std::vector<ThreadCache> caches;
+
+            ~ThreadCaches() {
+                for (ThreadCache &cache: caches) {
+                    cache.pool->Flush(cache);
+                }
+                thread_caches_destroyed = true;
+            }
+        };
+
+        Pool(size_t max_bytes_held, size_t max_block_bytes, size_t thread_cache_bytes)
+                : max_bytes_held(max_bytes_held), max_block_bytes(max_block_bytes),
+                  thread_cache_bytes(thread_cache_bytes), free_lists(SizeClassIndex(max_block_bytes) + 1) {
+        }
+
+        ~Pool() {
+            for (std::vector<void *> &free_list: free_lists) {
+                for (void *ptr: free_list) {
+                    std::free(ptr);
+                }
+            }
+        }
+
+        /**
+         * 返回当前线程在该分配器上的私有缓存，线程已经退出或者内存块太大不适合私有缓存时返回空
+         */
+        ThreadCache *LocalCache(const std::shared_ptr<Pool> &self, size_t block_bytes) {
+            if (block_bytes * 4 > thread_cache_bytes || thread_caches_destroyed) {
+                return nullptr;
+            }
+            thread_local ThreadCaches local;
+            for (ThreadCache &cache: local.caches) {
+                if (cache.pool == self) {
+                    return &cache;
+                }
+            }
+            // 顺便清理已经销毁的分配器留下的私有缓存
+            for (auto iter = local.caches.begin(); iter != local.caches.end();) {
+                if (iter->pool->retired.load(std::memory_order_relaxed)) {
+                    iter->pool->Flush(*iter);
+                    iter = local.caches.erase(iter);
+                } else {
+                    ++iter;
+                }
+            }
+            local.caches.push_back({self, std::vector<std::vector<void *>>(free_lists.size()), 0});
+            return &local.caches.back();
+        }
+
+        /**
+         * 放入共享缓存，超过max_bytes_held时直接还给系统
+         */
+        void Release(void *ptr, size_t index) {
+            const size_t block_bytes = SizeClassBytes(index);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (bytes_held.load(std::memory_order_relaxed) + block_bytes <= max_bytes_held) {
+                    free_lists.at(index).push_back(ptr);
+                    bytes_held.fetch_add(block_bytes, std::memory_order_relaxed);
+                    return;
+                }
+            }
+            std::free(ptr);
+        }
+
+        /**
+         * 把私有缓存中的内存全部放回共享缓存
+         */
+        void Flush(ThreadCache &cache) {
+            bytes_held.fetch_sub(cache.bytes, std::memory_order_relaxed);
+            cache.bytes = 0;
+            for (size_t index = 0; index < cache.free_lists.size(); ++index) {
+                for (void *ptr: cache.free_lists.at(index)) {
+                    Release(ptr, index);
+                }
+                cache.free_lists.at(index).clear();
+            }
+        }
+
+        const size_t max_bytes_held;
+        const size_t max_block_bytes;
+        const size_t thread_cache_bytes;
+        std::atomic<bool> retired{false};
+
+        std::mutex mutex;
+        std::vector<std::vector<void *>> free_lists;  /// 共享缓存，按大小分级，由mutex保护
+
+        std::atomic<size_t> hits{0};
+        std::atomic<size_t> misses{0};
+        std::atomic<size_t> bytes_held{0};
+        std::atomic<size_t> bytes_in_use{0};
+    };
+
+    PooledTensorAllocator::PooledTensorAllocator(size_t max_bytes_held, size_t max_block_bytes,
+                                                 size_t thread_cache_bytes)
+            : pool_(std::make_shared<Pool>(max_bytes_held, max_block_bytes, thread_cache_bytes)) {
+    }
+
+    PooledTensorAllocator::~PooledTensorAllocator() {
+        // 其他线程的私有缓存仍然持有pool，在它们下一次查找缓存或者线程退出时归还
+        pool_->retired.store(true, std::memory_order_relaxed);
+    }
+
+    void *PooledTensorAllocator::Allocate(size_t bytes) {
+        if (bytes > pool_->max_block_bytes) {
+            pool_->misses.fetch_add(1, std::memory_order_relaxed);
+            pool_->bytes_in_use.fetch_add(bytes, std::memory_order_relaxed);
+            return SystemAllocate(bytes);
+        }
+
+        const size_t index = SizeClassIndex(bytes);
+        const size_t block_bytes = SizeClassBytes(index);
+        pool_->bytes_in_use.fetch_add(block_bytes, std::memory_order_relaxed);
+
+        void *ptr = nullptr;
+        Pool::ThreadCache *cache = pool_->LocalCache(pool_, block_bytes);
+        if (cache != nullptr && !cache->free_lists.at(index).empty()) {
+            ptr = cache->free_lists.at(index).back();
+            cache->free_lists.at(index).pop_back();
+            cache->bytes -= block_bytes;
+        } else {
+            std::lock_guard<std::mutex> lock(pool_->mutex);
+            std::vector<void *> &free_list = pool_->free_lists.at(index);
+            if (!free_list.empty()) {
+                ptr = free_list.back();
+                free_list.pop_back();
+            }
+        }
+
+        if (ptr != nullptr) {
+            pool_->bytes_held.fetch_sub(block_bytes, std::memory_order_relaxed);
+            pool_->hits.fetch_add(1, std::memory_order_relaxed);
+            return ptr;
+        }
+        pool_->misses.fetch_add(1, std::memory_order_relaxed);
+        return SystemAllocate(block_bytes);
+    }
+
+    void PooledTensorAllocator::Deallocate(void *ptr, size_t bytes) {
+        if (ptr == nullptr) {
+            return;
+        }
+        if (bytes > pool_->max_block_bytes) {
+            pool_->bytes_in_use.fetch_sub(bytes, std::memory_order_relaxed);
+            std::free(ptr);
+            return;
+        }
+
+        const size_t index = SizeClassIndex(bytes);
+        const size_t block_bytes = SizeClassBytes(index);
+        pool_->bytes_in_use.fetch_sub(block_bytes, std::memory_order_relaxed);
+
+        Pool::ThreadCache *cache = pool_->LocalCache(pool_, block_bytes);
+        if (cache != nullptr && cache->bytes + block_bytes <= pool_->thread_cache_bytes) {
+            cache->free_lists.at(index).push_back(ptr);
+            cache->bytes += block_bytes;
+            pool_->bytes_held.fetch_add(block_bytes, std::memory_order_relaxed);
+            return;
+        }
+        pool_->Release(ptr, index);
+    }
+
+    PooledTensorAllocator::Stats PooledTensorAllocator::stats() const {
+        Stats stats;
+        stats.hits = pool_->hits.load(std::memory_order_relaxed);
+        stats.misses = pool_->misses.load(std::memory_order_relaxed);
+        stats.bytes_held = pool_->bytes_held.load(std::memory_order_relaxed);
+        stats.bytes_in_use = pool_->bytes_in_use.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void PooledTensorAllocator::Trim() {
+        Pool::ThreadCache *cache = pool_->LocalCache(pool_, kTensorAlignment);
+        if (cache != nullptr) {
+            pool_->Flush(*cache);
+        }
+        std::lock_guard<std::mutex> lock(pool_->mutex);
+        for (size_t index = 0; index < pool_->free_lists.size(); ++index) {
+            std::vector<void *> &free_list = pool_->free_lists.at(index);
+            for (void *ptr: free_list) {
+                std::free(ptr);
+            }
+            pool_->bytes_held.fetch_sub(free_list.size() * SizeClassBytes(index), std::memory_order_relaxed);
+            free_list.clear();
+        }
+    }
+
+    namespace {
+        /// 当前的分配器以及替换下来的分配器，创建张量时只读取current
+        struct TensorAllocatorHolder {
+            std::mutex mutex;
+            std::shared_ptr<TensorAllocator> allocator;             /// 当前的分配器，由mutex保护
+            std::vector<std::shared_ptr<TensorAllocator>> retired;  /// 替换下来的分配器，由mutex保护
+            std::atomic<TensorAllocator *> current{nullptr};
+        };
+
+        TensorAllocatorHolder &TensorAllocatorInstance() {
+            // 有意不析构，程序退出时静态对象中的张量仍然可以把内存交还给分配器
+            static TensorAllocatorHolder *holder = []() {
+                auto *instance = new TensorAllocatorHolder();
+                instance->allocator = std::make_shared<PooledTensorAllocator>();
+                instance->current.store(instance->allocator.get(), std::memory_order_release);
+                return instance;
+            }();
+            return *holder;
+        }
+    }
+
+    std::shared_ptr<TensorAllocator> GetTensorAllocator() {
+        TensorAllocatorHolder &holder = TensorAllocatorInstance();
+        std::lock_guard<std::mutex> lock(holder.mutex);
+        return holder.allocator;
+    }
+
+    TensorAllocator *CurrentTensorAllocator() {
+        return TensorAllocatorInstance().current.load(std::memory_order_acquire);
+    }
+
+    void SetTensorAllocator(std::shared_ptr<TensorAllocator> allocator) {
+        if (allocator == nullptr) {
+            allocator = std::make_shared<PooledTensorAllocator>();
+        }
+        TensorAllocatorHolder &holder = TensorAllocatorInstance();
+        std::lock_guard<std::mutex> lock(holder.mutex);
+        holder.current.store(allocator.get(), std::memory_order_release);
+        holder.retired.push_back(std::move(holder.allocator));
+        holder.allocator = std::move(allocator);
+    }
+}
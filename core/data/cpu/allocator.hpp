@@ -0,0 +1,116 @@
+//
+// Created by hanke on 2024/5/14.
+//
+
+#ifndef INFERNETO_ALLOCATOR_HPP
+#define INFERNETO_ALLOCATOR_HPP
+#include <cstddef>
+#include <memory>
+
+namespace infer_neto {
+    /// 张量数据的对齐字节数，与缓存行大小相同，也满足AVX-512对齐读写的要求
+    constexpr size_t kTensorAlignment = 64;
+
+    /**
+     * 张量数据的分配器，可以替换为内存池等其他实现
+     */
+    class TensorAllocator {
+    public:
+        virtual ~TensorAllocator() = default;
+
+        /**
+         * 申请一块至少按kTensorAlignment对齐的内存，内容不做初始化
+         * @param bytes 需要的字节数
+         * @return 申请到的内存
+         */
+        virtual void *Allocate(size_t bytes) = 0;
+
+        /**
+         * 释放由Allocate申请的内存
+         * @param ptr 需要释放的内存
+         * @param bytes 申请时的字节数
+         */
+        virtual void Deallocate(void *ptr, size_t bytes) = 0;
+    };
+
+    /**
+     * 默认的分配器，直接向系统申请按kTensorAlignment对齐的内存
+     */
+    class AlignedTensorAllocator : public TensorAllocator {
+    public:
+        void *Allocate(size_t bytes) override;
+
+        void Deallocate(void *ptr, size_t bytes) override;
+    };
+
+    /**
+     * 带缓存的分配器，释放的内存按大小分级缓存起来供之后的张量复用，避免推理过程中反复向系统申请内存。
+     * 每个线程先在自己的缓存中查找，未命中时再去共享的缓存中查找，都没有时才向系统申请；
+     * 大于kHugePageSize的内存按大页对齐申请并提示内核使用透明大页
+     */
+    class PooledTensorAllocator : public TensorAllocator {
+    public:
+        /// 缓存的统计信息，用于确定缓存的上限
+        struct Stats {
+            size_t hits = 0;          /// 从缓存中取得内存的次数
+            size_t misses = 0;        /// 向系统申请内存的次数
+            size_t bytes_held = 0;    /// 缓存中空闲内存的字节数
+            size_t bytes_in_use = 0;  /// 已分配给张量、尚未释放的字节数
+        };
+
+        /// 使用大页的内存块大小下限
+        static constexpr size_t kHugePageSize = size_t(2) << 20;
+
+        /**
+         * 创建带缓存的分配器
+         * @param max_bytes_held 缓存中最多保留的空闲字节数，超过后释放的内存直接还给系统
+         * @param max_block_bytes 参与缓存的最大内存块，更大的申请直接交给系统
+         * @param thread_cache_bytes 每个线程私有缓存的字节数上限
+         */
+        explicit PooledTensorAllocator(size_t max_bytes_held = size_t(1) << 30,
+                                       size_t max_block_bytes = size_t(256) << 20,
+                                       size_t thread_cache_bytes = size_t(4) << 20);
+
+        ~PooledTensorAllocator() override;
+
+        void *Allocate(size_t bytes) override;
+
+        void Deallocate(void *ptr, size_t bytes) override;
+
+        /**
+         * 返回当前的统计信息
+         * @return 统计信息
+         */
+        Stats stats() const;
+
+        /**
+         * 把共享缓存和当前线程缓存中的空闲内存还给系统，其他线程的私有缓存不受影响
+         */
+        void Trim();
+
+    private:
+        struct Pool;
+        std::shared_ptr<Pool> pool_;
+    };
+
+    /**
+     * 返回当前用于创建张量的分配器
+     * @return 当前的分配器
+     */
+    std::shared_ptr<TensorAllocator> GetTensorAllocator();
+
+    /**
+     * 返回当前用于创建张量的分配器，只读取一个原子指针，不加锁也不改变引用计数，用于创建张量的热路径
+     * @return 当前的分配器，程序退出之前一直有效
+     */
+    TensorAllocator *CurrentTensorAllocator();
+
+    /**
+     * 替换创建张量时使用的分配器，已经创建的张量仍然由原来的分配器释放。默认使用PooledTensorAllocator
+     * 替换下来的分配器保留到程序退出，张量只需要记录分配器的指针
+     * @param allocator 新的分配器，为空时恢复默认的分配器
+     */
+    void SetTensorAllocator(std::shared_ptr<TensorAllocator> allocator);
+}
+
+#endif //INFERNETO_ALLOCATOR_HPP
@@ -0,0 +1,233 @@
+//
+// Created by hanke on 2024/5/11.
+//
+#include <glog/logging.h>
+#include <algorithm>
+#include <vector>
+#include <immintrin.h> // AVX指令集
+#include "data/cpu/direct_conv.hpp"
+#include "data/cpu/im2col.hpp"
+#include "data/cpu/thread_pool.hpp"
+
+namespace infer_neto {
+#if defined(__AVX__) && defined(__FMA__)
+    /// 读取 ptr[0], ptr[stride], ... , ptr[7 * stride]
+    template<bool UnitStride>
+    static inline __m256 LoadStrided(const float *ptr, uint32_t stride) {
+        if constexpr (UnitStride) {
+            return _mm256_loadu_ps(ptr);
+        } else {
+            return _mm256_set_ps(ptr[7 * stride], ptr[6 * stride], ptr[5 * stride], ptr[4 * stride],
+                                 ptr[3 * stride], ptr[2 * stride], ptr[1 * stride], ptr[0]);
+        }
+    }
+#endif
+
+    /**
+     * 计算Block个输出通道的一行输出
+     * @param padded 补零后的输入，包含in_c个 padded_h x padded_w 通道
+     * @param kernel Block个输出通道的卷积核，相邻两个输出通道相距 in_c * kernel_h * kernel_w
+     * @param output Block个输出通道在该行的起始地址，相邻两个输出通道相距 output_plane
+     * @param residual 与output对应的残差，为空时不加残差
+     * @param relu 为true时在写回前对累加器做ReLU
+     */
+    template<uint32_t Block, bool UnitStride>
+    static void DirectConvRow(const float *padded, uint32_t in_c, uint32_t padded_h, uint32_t padded_w,
+                              const float *kernel, uint32_t kernel_h, uint32_t kernel_w,
+                              uint32_t stride_w, uint32_t input_row, uint32_t output_w,
+                              const float *bias, float *output, const float *residual,
+                              uint32_t output_plane, bool relu) {
+        const uint32_t kernel_size = kernel_h * kernel_w;
+        const uint32_t kernel_stride = in_c * kernel_size;
+        const size_t channel_size = size_t(padded_h) * padded_w;
+        uint32_t ow = 0;
+#if defined(__AVX__) && defined(__FMA__)
+        const __m256 zero = _mm256_setzero_ps();
+        // 每次计算两组8个输出，增加相互独立的累加链以隐藏FMA的延迟
+        for (; ow + 16 <= output_w; ow += 16) {
+            __m256 acc0[Block], acc1[Block];
+            for (uint32_t j = 0; j < Block; ++j) {
+                acc0[j] = _mm256_set1_ps(bias ? bias[j] : 0.f);
+                acc1[j] = acc0[j];
+            }
+            for (uint32_t ic = 0; ic < in_c; ++ic) {
+                const float *channel_kernel = kernel + ic * kernel_size;
+                for (uint32_t kh = 0; kh < kernel_h; ++kh) {
+                    const float *row = padded + ic * channel_size + (input_row + kh) * padded_w + ow * stride_w;
+                    const float *weight = channel_kernel + kh * kernel_w;
+                    for (uint32_t kw = 0; kw < kernel_w; ++kw) {
+                        const __m256 value0 = LoadStrided<UnitStride>(row + kw, stride_w);
+                        const __m256 value1 = LoadStrided<UnitStride>(row + 8 * stride_w + kw, stride_w);
+                        for (uint32_t j = 0; j < Block; ++j) {
+                            const __m256 w = _mm256_broadcast_ss(weight + j * kernel_stride + kw);
+                            acc0[j] = _mm256_fmadd_ps(w, value0, acc0[j]);
+                            acc1[j] = _mm256_fmadd_ps(w, value1, acc1[j]);
+                        }
+                    }
+                }
+            }
+            for (uint32_t j = 0; j < Block; ++j) {
+                if (residual) {
+                    acc0[j] = _mm256_add_ps(acc0[j], _mm256_loadu_ps(residual + j * output_plane + ow));
+                    acc1[j] = _mm256_add_ps(acc1[j], _mm256_loadu_ps(residual + j * output_plane + ow + 8));
+                }
+                if (relu) {
+                    acc0[j] = _mm256_max_ps(acc0[j], zero);
+                    acc1[j] = _mm256_max_ps(acc1[j], zero);
+                }
+                _mm256_storeu_ps(output + j * output_plane + ow, acc0[j]);
+                _mm256_storeu_ps(output + j * output_plane + ow + 8, acc1[j]);
+            }
+        }
+        // 剩余不足16个的输出每次计算8个，最后不足8个时只写回有效部分
+        for (; ow < output_w; ow += 8) {
+            __m256 acc[Block];
+            for (uint32_t j = 0; j < Block; ++j) {
+                acc[j] = _mm256_set1_ps(bias ? bias[j] : 0.f);
+            }
+            for (uint32_t ic = 0; ic < in_c; ++ic) {
+                const float *channel_kernel = kernel + ic * kernel_size;
+                for (uint32_t kh = 0; kh < kernel_h; ++kh) {
+                    const float *row = padded + ic * channel_size + (input_row + kh) * padded_w + ow * stride_w;
+                    const float *weight = channel_kernel + kh * kernel_w;
+                    for (uint32_t kw = 0; kw < kernel_w; ++kw) {
+                        const __m256 value = LoadStrided<UnitStride>(row + kw, stride_w);
+                        for (uint32_t j = 0; j < Block; ++j) {
+                            acc[j] = _mm256_fmadd_ps(_mm256_broadcast_ss(weight + j * kernel_stride + kw), value, acc[j]);
+                        }
+                    }
+                }
+            }
+            // 最后不足8个输出时残差也只读取有效部分
+            static const int32_t mask_table[16] = {-1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0};
+            const __m256i mask = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i *>(mask_table + 8 - std::min(8u, output_w - ow)));
+            for (uint32_t j = 0; j < Block; ++j) {
+                if (residual) {
+                    acc[j] = _mm256_add_ps(acc[j], _mm256_maskload_ps(residual + j * output_plane + ow, mask));
+                }
+                if (relu) {
+                    acc[j] = _mm256_max_ps(acc[j], zero);
+                }
+            }
+            if (ow + 8 <= output_w) {
+                for (uint32_t j = 0; j < Block; ++j) {
+                    _mm256_storeu_ps(output + j * output_plane + ow, acc[j]);
+                }
+            } else {
+                for (uint32_t j = 0; j < Block; ++j) {
+                    _mm256_maskstore_ps(output + j * output_plane + ow, mask, acc[j]);
+                }
+            }
+        }
+#endif
+        for (; ow < output_w; ++ow) {
+            for (uint32_t j = 0; j < Block; ++j) {
+                float sum = bias ? bias[j] : 0.f;
+                for (uint32_t ic = 0; ic < in_c; ++ic) {
+                    const float *channel_kernel = kernel + j * kernel_stride + ic * kernel_size;
+                    for (uint32_t kh = 0; kh < kernel_h; ++kh) {
+                        const float *row = padded + ic * channel_size + (input_row + kh) * padded_w + ow * stride_w;
+                        for (uint32_t kw = 0; kw < kernel_w; ++kw) {
+                            sum += channel_kernel[kh * kernel_w + kw] * row[kw];
+                        }
+                    }
+                }
+                if (residual) {
+                    sum += residual[j * output_plane + ow];
+                }
+                output[j * output_plane + ow] = relu ? std::max(sum, 0.f) : sum;
+            }
+        }
+    }
+
+    /// 按步长选择行计算函数
+    template<uint32_t Block>
+    static void DirectConvRows(const float *padded, uint32_t in_c, uint32_t padded_h, uint32_t padded_w,
+                               const float *kernel, uint32_t kernel_h, uint32_t kernel_w,
+                               uint32_t stride_h, uint32_t stride_w, uint32_t output_h, uint32_t output_w,
+                               const float *bias, float *output, const float *residual, bool relu) {
+        const uint32_t output_plane = output_h * output_w;
+        for (uint32_t oh = 0; oh < output_h; ++oh) {
+            float *row_output = output + oh * output_w;
+            const float *row_residual = residual ? residual + oh * output_w : nullptr;
+            if (stride_w == 1) {
+                DirectConvRow<Block, true>(padded, in_c, padded_h, padded_w, kernel, kernel_h, kernel_w, stride_w,
+                                           oh * stride_h, output_w, bias, row_output, row_residual,
+                                           output_plane, relu);
+            } else {
+                DirectConvRow<Block, false>(padded, in_c, padded_h, padded_w, kernel, kernel_h, kernel_w, stride_w,
+                                            oh * stride_h, output_w, bias, row_output, row_residual,
+                                            output_plane, relu);
+            }
+        }
+    }
+
+    void DirectConv2d(const float *input, uint32_t in_c, uint32_t input_h, uint32_t input_w,
+                      const float *kernel, uint32_t out_c, uint32_t kernel_h, uint32_t kernel_w,
+                      uint32_t padding_h, uint32_t padding_w, uint32_t stride_h, uint32_t stride_w,
+                      const float *bias, float *output, const float *residual, bool relu) {
+        CHECK(input != nullptr && kernel != nullptr && output != nullptr);
+        CHECK(stride_h > 0 && stride_w > 0);
+        const uint32_t output_h = ConvOutputSize(input_h, kernel_h, padding_h, stride_h);
+        const uint32_t output_w = ConvOutputSize(input_w, kernel_w, padding_w, stride_w);
+        const uint32_t padded_h = input_h + 2 * padding_h;
+        const uint32_t padded_w = input_w + 2 * padding_w;
+
+        // 先把该组输入补零，内层循环就不需要判断边界，补零缓冲区按线程缓存
+        // 末尾多留一个向量的跨度，最后一组不足8个的输出可以整向量读取
+        thread_local std::vector<float> padded_input;
+        const size_t padded_size = size_t(in_c) * padded_h * padded_w;
+        const size_t padded_slack = 8 * stride_w + kernel_w;
+        if (padded_input.size() < padded_size + padded_slack) {
+            padded_input.resize(padded_size + padded_slack);
+        }
+        float *padded = padded_input.data();
+        for (uint32_t ic = 0; ic < in_c; ++ic) {
+            float *channel = padded + size_t(ic) * padded_h * padded_w;
+            const float *src = input + size_t(ic) * input_h * input_w;
+            std::fill(channel, channel + padding_h * padded_w, 0.f);
+            for (uint32_t ih = 0; ih < input_h; ++ih) {
+                float *row = channel + (ih + padding_h) * padded_w;
+                std::fill(row, row + padding_w, 0.f);
+                std::copy(src + ih * input_w, src + (ih + 1) * input_w, row + padding_w);
+                std::fill(row + padding_w + input_w, row + padded_w, 0.f);
+            }
+            std::fill(channel + (input_h + padding_h) * padded_w, channel + padded_h * padded_w, 0.f);
+        }
+
+        const uint32_t output_plane = output_h * output_w;
+        const uint32_t kernel_stride = in_c * kernel_h * kernel_w;
+        // 按输出通道的分块分给多个线程，补零后的输入只读，各线程共用
+        const uint32_t blocks = (out_c + kDirectConvBlock - 1) / kDirectConvBlock;
+        const size_t block_work = size_t(kDirectConvBlock) * kernel_stride * output_plane;
+        ParallelFor(blocks, ParallelGrain(block_work), [&](size_t block_begin, size_t block_end) {
+            const uint32_t oc_end = std::min(uint32_t(block_end) * kDirectConvBlock, out_c);
+            for (uint32_t oc = uint32_t(block_begin) * kDirectConvBlock; oc < oc_end; oc += kDirectConvBlock) {
+                const uint32_t block = std::min(kDirectConvBlock, out_c - oc);
+                const float *block_kernel = kernel + size_t(oc) * kernel_stride;
+                const float *block_bias = bias ? bias + oc : nullptr;
+                float *block_output = output + size_t(oc) * output_plane;
+                const float *block_residual = residual ? residual + size_t(oc) * output_plane : nullptr;
+                switch (block) {
+                    case 4:
+                        DirectConvRows<4>(padded, in_c, padded_h, padded_w, block_kernel, kernel_h, kernel_w,
+                                          stride_h, stride_w, output_h, output_w, block_bias, block_output, block_residual, relu);
+                        break;
+                    case 3:
+                        DirectConvRows<3>(padded, in_c, padded_h, padded_w, block_kernel, kernel_h, kernel_w,
+                                          stride_h, stride_w, output_h, output_w, block_bias, block_output, block_residual, relu);
+                        break;
+                    case 2:
+                        DirectConvRows<2>(padded, in_c, padded_h, padded_w, block_kernel, kernel_h, kernel_w,
+                                          stride_h, stride_w, output_h, output_w, block_bias, block_output, block_residual, relu);
+                        break;
+                    default:
+                        DirectConvRows<1>(padded, in_c, padded_h, padded_w, block_kernel, kernel_h, kernel_w,
+                                          stride_h, stride_w, output_h, output_w, block_bias, block_output, block_residual, relu);
+                        break;
+                }
+            }
+        });
+    }
+}
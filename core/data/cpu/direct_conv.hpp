@@ -0,0 +1,42 @@
+//
+// Created by hanke on 2024/5/11.
+//
+
+#ifndef INFERNETO_DIRECT_CONV_HPP
+#define INFERNETO_DIRECT_CONV_HPP
+#include <cstdint>
+
+namespace infer_neto {
+    /// 直接卷积中一次同时计算的输出通道数，这些通道共享同一次输入读取
+    constexpr uint32_t kDirectConvBlock = 4;
+
+    /// 每组的归约长度(in_c * kernel_h * kernel_w)不超过该值时，直接卷积比矩阵乘法更快
+    constexpr uint32_t kDirectConvMaxReduce = 72;
+
+    /**
+     * 单组卷积的直接计算，按输出宽度方向向量化，偏置在初始化累加器时加入
+     * 适用于深度可分离卷积(每组一个输入通道)和每组通道较少的分组卷积，这些情况下矩阵乘法的形状过小
+     * @param input 该组的输入数据，包含in_c个连续的 input_h x input_w 通道
+     * @param in_c 该组的输入通道数
+     * @param input_h 输入的高度
+     * @param input_w 输入的宽度
+     * @param kernel 该组的卷积核，按 [out_c, in_c, kernel_h, kernel_w] 连续存放
+     * @param out_c 该组的输出通道数
+     * @param kernel_h 卷积核的高度
+     * @param kernel_w 卷积核的宽度
+     * @param padding_h 上下方向的填充大小
+     * @param padding_w 左右方向的填充大小
+     * @param stride_h 上下方向的步长
+     * @param stride_w 左右方向的步长
+     * @param bias 长度为out_c的偏置，为空时不加偏置
+     * @param output 该组的输出数据，包含out_c个连续的 output_h x output_w 通道
+     * @param residual 与输出排布相同的残差，在写回前加上，不能与输出重叠，为空时不加残差
+     * @param relu 为true时在写回前对结果做ReLU
+     */
+    void DirectConv2d(const float *input, uint32_t in_c, uint32_t input_h, uint32_t input_w,
+                      const float *kernel, uint32_t out_c, uint32_t kernel_h, uint32_t kernel_w,
+                      uint32_t padding_h, uint32_t padding_w, uint32_t stride_h, uint32_t stride_w,
+                      const float *bias, float *output, const float *residual = nullptr, bool relu = false);
+}
+
+#endif //INFERNETO_DIRECT_CONV_HPP
@@ -0,0 +1,266 @@
+//
+// Created by hanke on 2024/5/15.
+//
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <immintrin.h> // AVX指令集
+#include <glog/logging.h>
+#include "data/cpu/elementwise.hpp"
+#include "data/cpu/thread_pool.hpp"
+
+namespace infer_neto {
+    /// 多线程计算时每个任务处理的元素数量
+    constexpr size_t kElementwiseBlock = size_t(1) << 14;
+
+#if defined(__AVX__) && defined(__FMA__)
+    constexpr size_t kElementwiseLanes = 8;
+    using Vec = __m256;
+
+    static inline Vec Load(const float *ptr) { return _mm256_loadu_ps(ptr); }
+
+    static inline void Store(float *ptr, Vec v) { _mm256_storeu_ps(ptr, v); }
+
+    static inline Vec Broadcast(float value) { return _mm256_set1_ps(value); }
+
+    static inline Vec Exp(Vec x) {
+        // 把x写成 n * ln2 + r，|r| <= ln2 / 2，exp(r)用多项式近似，2^n直接拼出浮点数的指数位
+        x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.3f)), _mm256_set1_ps(88.f));
+        const Vec n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)),
+                                      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        Vec r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+        r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+
+        Vec p = _mm256_set1_ps(1.9875691500e-4f);
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+        p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.f)));
+
+        const __m256i exponent = _mm256_cvtps_epi32(n);
+#if defined(__AVX2__)
+        const __m256i pow2n = _mm256_slli_epi32(_mm256_add_epi32(exponent, _mm256_set1_epi32(127)), 23);
+#else
+        // 只有AVX时没有256位的整数运算，分成两半用SSE计算
+        const __m128i bias = _mm_set1_epi32(127);
+        const __m128i low = _mm_slli_epi32(_mm_add_epi32(_mm256_castsi256_si128(exponent), bias), 23);
+        const __m128i high = _mm_slli_epi32(_mm_add_epi32(_mm256_extractf128_si256(exponent, 1), bias), 23);
+        const __m256i pow2n = _mm256_insertf128_si256(_mm256_castsi128_si256(low), high, 1);
+#endif
+        return _mm256_mul_ps(p, _mm256_castsi256_ps(pow2n));
+    }
+
+    static inline Vec Sin(Vec x) {
+        // 先按2pi归约到[-pi, pi]，再利用sin(x) = sin(pi - x)归约到[-pi/2, pi/2]，最后用泰勒多项式近似
+        const Vec k = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(0.159154943091895336f)),
+                                      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        x = _mm256_fnmadd_ps(k, _mm256_set1_ps(6.28125f), x);
+        x = _mm256_fnmadd_ps(k, _mm256_set1_ps(1.93530717958647692e-3f), x);
+
+        const Vec sign_mask = _mm256_set1_ps(-0.f);
+        const Vec sign = _mm256_and_ps(x, sign_mask);
+        Vec ax = _mm256_andnot_ps(sign_mask, x);
+        ax = _mm256_min_ps(ax, _mm256_sub_ps(_mm256_set1_ps(3.14159265358979324f), ax));
+
+        const Vec x2 = _mm256_mul_ps(ax, ax);
+        Vec p = _mm256_set1_ps(-2.50521083854417188e-8f);
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(2.75573192239858907e-6f));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(-1.98412698412698413e-4f));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(8.33333333333333333e-3f));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(-1.66666666666666667e-1f));
+        p = _mm256_mul_ps(_mm256_mul_ps(p, x2), ax);
+        return _mm256_xor_ps(_mm256_add_ps(p, ax), sign);
+    }
+
+    template<UnaryOp Op>
+    static inline Vec Apply(Vec x) {
+        if constexpr (Op == UnaryOp::kRelu) {
+            return _mm256_max_ps(x, _mm256_setzero_ps());
+        } else if constexpr (Op == UnaryOp::kSigmoid) {
+            const Vec one = _mm256_set1_ps(1.f);
+            return _mm256_div_ps(one, _mm256_add_ps(one, Exp(_mm256_sub_ps(_mm256_setzero_ps(), x))));
+        } else if constexpr (Op == UnaryOp::kExp) {
+            return Exp(x);
+        } else {
+            return Sin(x);
+        }
+    }
+
+    template<BinaryOp Op>
+    static inline Vec Apply(Vec a, Vec b) {
+        if constexpr (Op == BinaryOp::kAdd) {
+            return _mm256_add_ps(a, b);
+        } else if constexpr (Op == BinaryOp::kSub) {
+            return _mm256_sub_ps(a, b);
+        } else if constexpr (Op == BinaryOp::kMul) {
+            return _mm256_mul_ps(a, b);
+        } else {
+            return _mm256_div_ps(a, b);
+        }
+    }
+#else
+    constexpr size_t kElementwiseLanes = 1;
+    using Vec = float;
+
+    static inline Vec Load(const float *ptr) { return *ptr; }
+
+    static inline void Store(float *ptr, Vec v) { *ptr = v; }
+
+    static inline Vec Broadcast(float value) { return value; }
+
+    template<UnaryOp Op>
+    static inline Vec Apply(Vec x) {
+        if constexpr (Op == UnaryOp::kRelu) {
+            return x > 0.f ? x : 0.f;
+        } else if constexpr (Op == UnaryOp::kSigmoid) {
+            return 1.f / (1.f + std::exp(-x));
+        } else if constexpr (Op == UnaryOp::kExp) {
+            return std::exp(x);
+        } else {
+            return std::sin(x);
+        }
+    }
+
+    template<BinaryOp Op>
+    static inline Vec Apply(Vec a, Vec b) {
+        if constexpr (Op == BinaryOp::kAdd) {
+            return a + b;
+        } else if constexpr (Op == BinaryOp::kSub) {
+            return a - b;
+        } else if constexpr (Op == BinaryOp::kMul) {
+            return a * b;
+        } else {
+            return a / b;
+        }
+    }
+#endif
+
+    /**
+     * 对[0, n)中的元素调用kernel(start, count)，元素较多时按kElementwiseBlock分块并行
+     */
+    template<typename Kernel>
+    static void ParallelBlocks(size_t n, const Kernel &kernel) {
+        if (n < kElementwiseParallelThreshold) {
+            kernel(0, n);
+            return;
+        }
+        // 分块的边界对齐到kElementwiseBlock，只有最后一块带有不足一个向量的尾部
+        const size_t blocks = (n + kElementwiseBlock - 1) / kElementwiseBlock;
+        ParallelFor(blocks, 1, [n, &kernel](size_t begin, size_t end) {
+            const size_t start = begin * kElementwiseBlock;
+            kernel(start, std::min(end * kElementwiseBlock, n) - start);
+        });
+    }
+
+    /**
+     * 向量化的主循环，不足一个向量的尾部复制到临时缓冲区中用同样的指令计算，
+     * 保证同一个值无论落在主循环还是尾部结果都一致
+     */
+    template<size_t Inputs, typename Kernel>
+    static inline void VectorLoop(const float *const (&inputs)[Inputs], float *y, size_t n, const Kernel &kernel) {
+        size_t i = 0;
+        for (; i + kElementwiseLanes <= n; i += kElementwiseLanes) {
+            Vec values[Inputs];
+            for (size_t j = 0; j < Inputs; ++j) {
+                values[j] = Load(inputs[j] + i);
+            }
+            Store(y + i, kernel(values));
+        }
+        if (i < n) {
+            const size_t remain = n - i;
+            float tail[Inputs][kElementwiseLanes] = {};
+            Vec values[Inputs];
+            for (size_t j = 0; j < Inputs; ++j) {
+                std::copy(inputs[j] + i, inputs[j] + n, tail[j]);
+                values[j] = Load(tail[j]);
+            }
+            float result[kElementwiseLanes];
+            Store(result, kernel(values));
+            std::copy(result, result + remain, y + i);
+        }
+    }
+
+    template<UnaryOp Op>
+    static void UnaryKernel(const float *x, float *y, size_t n) {
+        ParallelBlocks(n, [x, y](size_t start, size_t count) {
+            const float *inputs[1] = {x + start};
+            VectorLoop(inputs, y + start, count, [](const Vec (&values)[1]) { return Apply<Op>(values[0]); });
+        });
+    }
+
+    template<BinaryOp Op>
+    static void BinaryKernel(const float *a, const float *b, float *y, size_t n) {
+        ParallelBlocks(n, [a, b, y](size_t start, size_t count) {
+            const float *inputs[2] = {a + start, b + start};
+            VectorLoop(inputs, y + start, count,
+                       [](const Vec (&values)[2]) { return Apply<Op>(values[0], values[1]); });
+        });
+    }
+
+    template<BinaryOp Op>
+    static void ScalarKernel(const float *a, float b, float *y, size_t n) {
+        const Vec scalar = Broadcast(b);
+        ParallelBlocks(n, [a, scalar, y](size_t start, size_t count) {
+            const float *inputs[1] = {a + start};
+            VectorLoop(inputs, y + start, count,
+                       [scalar](const Vec (&values)[1]) { return Apply<Op>(values[0], scalar); });
+        });
+    }
+
+    void ElementwiseUnary(UnaryOp op, const float *x, float *y, size_t n) {
+        CHECK(n == 0 || (x != nullptr && y != nullptr));
+        // 在循环外按运算种类分发，内层循环中没有分支
+        switch (op) {
+            case UnaryOp::kRelu:
+                UnaryKernel<UnaryOp::kRelu>(x, y, n);
+                break;
+            case UnaryOp::kSigmoid:
+                UnaryKernel<UnaryOp::kSigmoid>(x, y, n);
+                break;
+            case UnaryOp::kExp:
+                UnaryKernel<UnaryOp::kExp>(x, y, n);
+                break;
+            case UnaryOp::kSin:
+                UnaryKernel<UnaryOp::kSin>(x, y, n);
+                break;
+        }
+    }
+
+    void ElementwiseBinary(BinaryOp op, const float *a, const float *b, float *y, size_t n) {
+        CHECK(n == 0 || (a != nullptr && b != nullptr && y != nullptr));
+        switch (op) {
+            case BinaryOp::kAdd:
+                BinaryKernel<BinaryOp::kAdd>(a, b, y, n);
+                break;
+            case BinaryOp::kSub:
+                BinaryKernel<BinaryOp::kSub>(a, b, y, n);
+                break;
+            case BinaryOp::kMul:
+                BinaryKernel<BinaryOp::kMul>(a, b, y, n);
+                break;
+            case BinaryOp::kDiv:
+                BinaryKernel<BinaryOp::kDiv>(a, b, y, n);
+                break;
+        }
+    }
+
+    void ElementwiseScalar(BinaryOp op, const float *a, float b, float *y, size_t n) {
+        CHECK(n == 0 || (a != nullptr && y != nullptr));
+        switch (op) {
+            case BinaryOp::kAdd:
+                ScalarKernel<BinaryOp::kAdd>(a, b, y, n);
+                break;
+            case BinaryOp::kSub:
+                ScalarKernel<BinaryOp::kSub>(a, b, y, n);
+                break;
+            case BinaryOp::kMul:
+                ScalarKernel<BinaryOp::kMul>(a, b, y, n);
+                break;
+            case BinaryOp::kDiv:
+                ScalarKernel<BinaryOp::kDiv>(a, b, y, n);
+                break;
+        }
+    }
+}
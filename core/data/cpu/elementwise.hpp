@@ -0,0 +1,59 @@
+//
+// Created by hanke on 2024/5/15.
+//
+
+#ifndef INFERNETO_ELEMENTWISE_HPP
+#define INFERNETO_ELEMENTWISE_HPP
+#include <cstddef>
+
+namespace infer_neto {
+    /// 元素数量不少于该值时按块分给节点内线程池的多个线程计算，较小的张量开线程的代价比计算本身更大
+    constexpr size_t kElementwiseParallelThreshold = size_t(1) << 16;
+
+    /// 一元逐元素运算
+    enum class UnaryOp {
+        kRelu,
+        kSigmoid,
+        kExp,
+        kSin,
+    };
+
+    /// 二元逐元素运算
+    enum class BinaryOp {
+        kAdd,
+        kSub,
+        kMul,
+        kDiv,
+    };
+
+    /**
+     * 逐元素计算 y = op(x)，AVX向量化，exp、sin和sigmoid使用多项式近似，相对误差在1e-6以内
+     * @param op 运算的种类
+     * @param x 输入数据
+     * @param y 输出数据，可以与x相同
+     * @param n 元素的数量
+     */
+    void ElementwiseUnary(UnaryOp op, const float *x, float *y, size_t n);
+
+    /**
+     * 逐元素计算 y = a op b
+     * @param op 运算的种类
+     * @param a 左操作数
+     * @param b 右操作数
+     * @param y 输出数据，可以与a或b相同
+     * @param n 元素的数量
+     */
+    void ElementwiseBinary(BinaryOp op, const float *a, const float *b, float *y, size_t n);
+
+    /**
+     * 逐元素计算 y = a op b，b为广播到每个元素的标量
+     * @param op 运算的种类
+     * @param a 左操作数
+     * @param b 标量右操作数
+     * @param y 输出数据，可以与a相同
+     * @param n 元素的数量
+     */
+    void ElementwiseScalar(BinaryOp op, const float *a, float b, float *y, size_t n);
+}
+
+#endif //INFERNETO_ELEMENTWISE_HPP
@@ -0,0 +1,534 @@
+//
+// Created by hanke on 2024/5/6.
+//
+#include <glog/logging.h>
+#include <algorithm>
+#include <vector>
+#include <immintrin.h> // AVX指令集
+#include "data/cpu/gemm.hpp"
+#include "data/cpu/thread_pool.hpp"
+
+namespace infer_neto {
+    /**
+     * 将A中 mc x kc 的子块打包成若干个 kGemmMR 行的面板
+     * 每个面板内按k优先排布，不足kGemmMR行的部分补零
+     */
+    static void PackA(uint32_t mc, uint32_t kc, const float *a, uint32_t lda, float *packed_a) {
+        for (uint32_t ir = 0; ir < mc; ir += kGemmMR) {
+            const uint32_t mr = std::min(kGemmMR, mc - ir);
+            for (uint32_t l = 0; l < kc; ++l) {
+                uint32_t i = 0;
+                for (; i < mr; ++i) {
+                    packed_a[i] = a[(ir + i) * lda + l];
+                }
+                for (; i < kGemmMR; ++i) {
+                    packed_a[i] = 0.f;
+                }
+                packed_a += kGemmMR;
+            }
+        }
+    }
+
+    /**
+     * 将B中 kc x nc 的子块打包成若干个 kGemmNR 列的面板
+     * 每个面板内按k优先排布，不足kGemmNR列的部分补零
+     */
+    static void PackB(uint32_t kc, uint32_t nc, const float *b, uint32_t ldb, float *packed_b) {
+        for (uint32_t jr = 0; jr < nc; jr += kGemmNR) {
+            const uint32_t nr = std::min(kGemmNR, nc - jr);
+            for (uint32_t l = 0; l < kc; ++l) {
+                const float *b_row = b + l * ldb + jr;
+                if (nr == kGemmNR) {
+                    std::copy(b_row, b_row + kGemmNR, packed_b);
+                } else {
+                    std::copy(b_row, b_row + nr, packed_b);
+                    std::fill(packed_b + nr, packed_b + kGemmNR, 0.f);
+                }
+                packed_b += kGemmNR;
+            }
+        }
+    }
+
+    /**
+     * 与PackB相同，但B的第j列位于每行的 b_col_offsets[j] 处，用于直接读取带步长的视图
+     */
+    static void PackBGather(uint32_t kc, uint32_t nc, const float *b, uint32_t ldb,
+                            const uint32_t *b_col_offsets, float *packed_b) {
+        for (uint32_t jr = 0; jr < nc; jr += kGemmNR) {
+            const uint32_t nr = std::min(kGemmNR, nc - jr);
+            const uint32_t *offsets = b_col_offsets + jr;
+            for (uint32_t l = 0; l < kc; ++l) {
+                const float *b_row = b + l * ldb;
+                uint32_t j = 0;
+                for (; j < nr; ++j) {
+                    packed_b[j] = b_row[offsets[j]];
+                }
+                for (; j < kGemmNR; ++j) {
+                    packed_b[j] = 0.f;
+                }
+                packed_b += kGemmNR;
+            }
+        }
+    }
+
+    /**
+     * 计算 kGemmMR x kGemmNR 的输出块 C (+)= packed_a * packed_b
+     * @param kc 分块在k方向上的长度
+     * @param packed_a 打包后A的面板
+     * @param packed_b 打包后B的面板
+     * @param c 输出块的起始地址
+     * @param ldc 输出块相邻两行之间的距离
+     * @param accumulate 为true时累加到C上(k方向的后续分块)，否则覆盖C
+     * @param bias 输出块每一行的偏置，为空时不加偏置
+     * @param residual 输出块对应的残差块，为空时不加残差，只能在k方向的最后一个分块中使用
+     * @param ldr 残差块相邻两行之间的距离
+     * @param relu 为true时在写回前对结果做ReLU，只能在k方向的最后一个分块中使用
+     */
+    static void MicroKernel(uint32_t kc, const float *packed_a, const float *packed_b,
+                            float *c, uint32_t ldc, bool accumulate, const float *bias,
+                            const float *residual, uint32_t ldr, bool relu) {
+#if defined(__AVX__) && defined(__FMA__)
+        // 偏置直接作为累加器的初值
+        __m256 c00 = bias ? _mm256_broadcast_ss(bias + 0) : _mm256_setzero_ps(), c01 = c00;
+        __m256 c10 = bias ? _mm256_broadcast_ss(bias + 1) : _mm256_setzero_ps(), c11 = c10;
+        __m256 c20 = bias ? _mm256_broadcast_ss(bias + 2) : _mm256_setzero_ps(), c21 = c20;
+        __m256 c30 = bias ? _mm256_broadcast_ss(bias + 3) : _mm256_setzero_ps(), c31 = c30;
+        __m256 c40 = bias ? _mm256_broadcast_ss(bias + 4) : _mm256_setzero_ps(), c41 = c40;
+        __m256 c50 = bias ? _mm256_broadcast_ss(bias + 5) : _mm256_setzero_ps(), c51 = c50;
+        for (uint32_t l = 0; l < kc; ++l) {
+            const __m256 b0 = _mm256_loadu_ps(packed_b);
+            const __m256 b1 = _mm256_loadu_ps(packed_b + 8);
+            __m256 a = _mm256_broadcast_ss(packed_a);
+            c00 = _mm256_fmadd_ps(a, b0, c00);
+            c01 = _mm256_fmadd_ps(a, b1, c01);
+            a = _mm256_broadcast_ss(packed_a + 1);
+            c10 = _mm256_fmadd_ps(a, b0, c10);
+            c11 = _mm256_fmadd_ps(a, b1, c11);
+            a = _mm256_broadcast_ss(packed_a + 2);
+            c20 = _mm256_fmadd_ps(a, b0, c20);
+            c21 = _mm256_fmadd_ps(a, b1, c21);
+            a = _mm256_broadcast_ss(packed_a + 3);
+            c30 = _mm256_fmadd_ps(a, b0, c30);
+            c31 = _mm256_fmadd_ps(a, b1, c31);
+            a = _mm256_broadcast_ss(packed_a + 4);
+            c40 = _mm256_fmadd_ps(a, b0, c40);
+            c41 = _mm256_fmadd_ps(a, b1, c41);
+            a = _mm256_broadcast_ss(packed_a + 5);
+            c50 = _mm256_fmadd_ps(a, b0, c50);
+            c51 = _mm256_fmadd_ps(a, b1, c51);
+            packed_a += kGemmMR;
+            packed_b += kGemmNR;
+        }
+        if (accumulate) {
+            c00 = _mm256_add_ps(c00, _mm256_loadu_ps(c + 0 * ldc));
+            c01 = _mm256_add_ps(c01, _mm256_loadu_ps(c + 0 * ldc + 8));
+            c10 = _mm256_add_ps(c10, _mm256_loadu_ps(c + 1 * ldc));
+            c11 = _mm256_add_ps(c11, _mm256_loadu_ps(c + 1 * ldc + 8));
+            c20 = _mm256_add_ps(c20, _mm256_loadu_ps(c + 2 * ldc));
+            c21 = _mm256_add_ps(c21, _mm256_loadu_ps(c + 2 * ldc + 8));
+            c30 = _mm256_add_ps(c30, _mm256_loadu_ps(c + 3 * ldc));
+            c31 = _mm256_add_ps(c31, _mm256_loadu_ps(c + 3 * ldc + 8));
+            c40 = _mm256_add_ps(c40, _mm256_loadu_ps(c + 4 * ldc));
+            c41 = _mm256_add_ps(c41, _mm256_loadu_ps(c + 4 * ldc + 8));
+            c50 = _mm256_add_ps(c50, _mm256_loadu_ps(c + 5 * ldc));
+            c51 = _mm256_add_ps(c51, _mm256_loadu_ps(c + 5 * ldc + 8));
+        }
+        if (residual) {
+            c00 = _mm256_add_ps(c00, _mm256_loadu_ps(residual + 0 * ldr));
+            c01 = _mm256_add_ps(c01, _mm256_loadu_ps(residual + 0 * ldr + 8));
+            c10 = _mm256_add_ps(c10, _mm256_loadu_ps(residual + 1 * ldr));
+            c11 = _mm256_add_ps(c11, _mm256_loadu_ps(residual + 1 * ldr + 8));
+            c20 = _mm256_add_ps(c20, _mm256_loadu_ps(residual + 2 * ldr));
+            c21 = _mm256_add_ps(c21, _mm256_loadu_ps(residual + 2 * ldr + 8));
+            c30 = _mm256_add_ps(c30, _mm256_loadu_ps(residual + 3 * ldr));
+            c31 = _mm256_add_ps(c31, _mm256_loadu_ps(residual + 3 * ldr + 8));
+            c40 = _mm256_add_ps(c40, _mm256_loadu_ps(residual + 4 * ldr));
+            c41 = _mm256_add_ps(c41, _mm256_loadu_ps(residual + 4 * ldr + 8));
+            c50 = _mm256_add_ps(c50, _mm256_loadu_ps(residual + 5 * ldr));
+            c51 = _mm256_add_ps(c51, _mm256_loadu_ps(residual + 5 * ldr + 8));
+        }
+        if (relu) {
+            // 激活在结果仍在寄存器中时完成，不需要再读写一遍输出
+            const __m256 zero = _mm256_setzero_ps();
+            c00 = _mm256_max_ps(c00, zero);
+            c01 = _mm256_max_ps(c01, zero);
+            c10 = _mm256_max_ps(c10, zero);
+            c11 = _mm256_max_ps(c11, zero);
+            c20 = _mm256_max_ps(c20, zero);
+            c21 = _mm256_max_ps(c21, zero);
+            c30 = _mm256_max_ps(c30, zero);
+            c31 = _mm256_max_ps(c31, zero);
+            c40 = _mm256_max_ps(c40, zero);
+            c41 = _mm256_max_ps(c41, zero);
+            c50 = _mm256_max_ps(c50, zero);
+            c51 = _mm256_max_ps(c51, zero);
+        }
+        _mm256_storeu_ps(c + 0 * ldc, c00);
+        _mm256_storeu_ps(c + 0 * ldc + 8, c01);
+        _mm256_storeu_ps(c + 1 * ldc, c10);
+        _mm256_storeu_ps(c + 1 * ldc + 8, c11);
+        _mm256_storeu_ps(c + 2 * ldc, c20);
+        _mm256_storeu_ps(c + 2 * ldc + 8, c21);
+        _mm256_storeu_ps(c + 3 * ldc, c30);
+        _mm256_storeu_ps(c + 3 * ldc + 8, c31);
+        _mm256_storeu_ps(c + 4 * ldc, c40);
+        _mm256_storeu_ps(c + 4 * ldc + 8, c41);
+        _mm256_storeu_ps(c + 5 * ldc, c50);
+        _mm256_storeu_ps(c + 5 * ldc + 8, c51);
+#else
+        float acc[kGemmMR * kGemmNR];
+        for (uint32_t i = 0; i < kGemmMR; ++i) {
+            std::fill(acc + i * kGemmNR, acc + (i + 1) * kGemmNR, bias ? bias[i] : 0.f);
+        }
+        for (uint32_t l = 0; l < kc; ++l) {
+            for (uint32_t i = 0; i < kGemmMR; ++i) {
+                const float a = packed_a[i];
+                for (uint32_t j = 0; j < kGemmNR; ++j) {
+                    acc[i * kGemmNR + j] += a * packed_b[j];
+                }
+            }
+            packed_a += kGemmMR;
+            packed_b += kGemmNR;
+        }
+        for (uint32_t i = 0; i < kGemmMR; ++i) {
+            for (uint32_t j = 0; j < kGemmNR; ++j) {
+                float value = accumulate ? c[i * ldc + j] + acc[i * kGemmNR + j] : acc[i * kGemmNR + j];
+                if (residual) {
+                    value += residual[i * ldr + j];
+                }
+                c[i * ldc + j] = relu ? std::max(value, 0.f) : value;
+            }
+        }
+#endif
+    }
+
+    /**
+     * 将输出块写回C，只写回有效的 mr x nr 部分
+     * @param accumulate 为true时累加到C上(k方向的后续分块)，否则覆盖C
+     * @param bias 输出块每一行的偏置，为空时不加偏置
+     * @param residual 输出块对应的残差块，为空时不加残差
+     * @param ldr 残差块相邻两行之间的距离
+     * @param relu 为true时在写回前对结果做ReLU
+     */
+    static void StoreTile(const float *tile, uint32_t mr, uint32_t nr, float *c, uint32_t ldc,
+                          bool accumulate, const float *bias, const float *residual, uint32_t ldr, bool relu) {
+        for (uint32_t i = 0; i < mr; ++i) {
+            const float *tile_row = tile + i * kGemmNR;
+            float *c_row = c + i * ldc;
+            const float *residual_row = residual ? residual + i * ldr : nullptr;
+            const float bias_value = bias ? bias[i] : 0.f;
+            uint32_t j = 0;
+#if defined(__AVX__)
+            const __m256 bias_vec = _mm256_set1_ps(bias_value);
+            const __m256 zero = _mm256_setzero_ps();
+            for (; j + 8 <= nr; j += 8) {
+                __m256 value = _mm256_add_ps(_mm256_loadu_ps(tile_row + j), bias_vec);
+                if (accumulate) {
+                    value = _mm256_add_ps(value, _mm256_loadu_ps(c_row + j));
+                }
+                if (residual_row) {
+                    value = _mm256_add_ps(value, _mm256_loadu_ps(residual_row + j));
+                }
+                if (relu) {
+                    value = _mm256_max_ps(value, zero);
+                }
+                _mm256_storeu_ps(c_row + j, value);
+            }
+#endif
+            for (; j < nr; ++j) {
+                float value = tile_row[j] + bias_value;
+                if (accumulate) {
+                    value += c_row[j];
+                }
+                if (residual_row) {
+                    value += residual_row[j];
+                }
+                c_row[j] = relu ? std::max(value, 0.f) : value;
+            }
+        }
+    }
+
+    /**
+     * m为1时退化为行向量乘矩阵，按列分段后逐行流式累加，无需打包
+     */
+    static void GemvRow(uint32_t n, uint32_t k, const float *a, const float *b, uint32_t ldb, float *c,
+                        float bias, const float *residual, bool relu) {
+        const uint32_t block_n = 1024;
+        for (uint32_t jb = 0; jb < n; jb += block_n) {
+            const uint32_t nb = std::min(block_n, n - jb);
+            float *c_block = c + jb;
+            std::fill(c_block, c_block + nb, bias);
+            for (uint32_t l = 0; l < k; ++l) {
+                const float *b_row = b + l * ldb + jb;
+                const float a_value = a[l];
+                uint32_t j = 0;
+#if defined(__AVX__) && defined(__FMA__)
+                const __m256 a_vec = _mm256_set1_ps(a_value);
+                for (; j + 8 <= nb; j += 8) {
+                    const __m256 value = _mm256_fmadd_ps(a_vec, _mm256_loadu_ps(b_row + j),
+                                                         _mm256_loadu_ps(c_block + j));
+                    _mm256_storeu_ps(c_block + j, value);
+                }
+#endif
+                for (; j < nb; ++j) {
+                    c_block[j] += a_value * b_row[j];
+                }
+            }
+            // 当前列段仍在缓存中，紧接着加上残差并完成激活
+            if (residual) {
+                const float *residual_block = residual + jb;
+                for (uint32_t j = 0; j < nb; ++j) {
+                    c_block[j] += residual_block[j];
+                }
+            }
+            if (relu) {
+                for (uint32_t j = 0; j < nb; ++j) {
+                    c_block[j] = std::max(c_block[j], 0.f);
+                }
+            }
+        }
+    }
+
+    /**
+     * k为0时乘积为零，C中只剩后处理的结果
+     */
+    static void FillEpilogue(uint32_t m, uint32_t n, float *c, uint32_t ldc, const GemmEpilogue &epilogue) {
+        for (uint32_t i = 0; i < m; ++i) {
+            for (uint32_t j = 0; j < n; ++j) {
+                float value = epilogue.bias ? epilogue.bias[i] : 0.f;
+                if (epilogue.residual) {
+                    value += epilogue.residual[i * epilogue.ldr + j];
+                }
+                c[i * ldc + j] = epilogue.relu ? std::max(value, 0.f) : value;
+            }
+        }
+    }
+
+    /**
+     * 批量矩阵乘法时B和C的列按样本分段，每段补齐到kGemmNR的整数倍，保证输出块不会跨越两个样本
+     * 不分批时只有一段，宽度就是n
+     */
+    struct GemmSegments {
+        uint32_t width = 0;           /// 每个样本的列数
+        uint32_t padded_width = 0;    /// 补齐后每段的列数
+        size_t c_stride = 0;          /// 相邻两个样本的C之间的距离
+        size_t residual_stride = 0;   /// 相邻两个样本的残差之间的距离
+    };
+
+    /**
+     * 分块矩阵乘法的主循环，计算C中 [col_begin, col_end) 的列，B的打包方式由pack_b决定
+     * @param pack_b 调用形式为 pack_b(kc, nc, pc, jc, packed_b)，打包B中从第pc行、第jc列开始的 kc x nc 子块
+     * @param segments 列的分段方式
+     * @param col_begin 起始列，是kGemmNR的整数倍
+     * @param col_end 结束列，不超过所有分段补齐之后的总列数
+     */
+    template<typename PackBFunc>
+    static void SGemmBlocked(uint32_t m, uint32_t k, const float *a, uint32_t lda,
+                             float *c, uint32_t ldc, const GemmEpilogue &epilogue, const PackBFunc &pack_b,
+                             const GemmSegments &segments, uint32_t col_begin, uint32_t col_end) {
+        // 打包缓冲区按线程缓存，避免每次调用都重新申请内存
+        thread_local std::vector<float> packed_a;
+        thread_local std::vector<float> packed_b;
+        const uint32_t packed_a_size = kGemmMC * kGemmKC;
+        const uint32_t packed_b_size = kGemmKC * ((std::min(col_end - col_begin, kGemmNC) + kGemmNR - 1) /
+                                                  kGemmNR * kGemmNR);
+        if (packed_a.size() < packed_a_size) {
+            packed_a.resize(packed_a_size);
+        }
+        if (packed_b.size() < packed_b_size) {
+            packed_b.resize(packed_b_size);
+        }
+
+        alignas(32) float tile[kGemmMR * kGemmNR];
+        for (uint32_t jc = col_begin; jc < col_end; jc += kGemmNC) {
+            const uint32_t nc = std::min(kGemmNC, col_end - jc);
+            for (uint32_t pc = 0; pc < k; pc += kGemmKC) {
+                const uint32_t kc = std::min(kGemmKC, k - pc);
+                // 偏置只在k方向的第一个分块中加入，残差和激活只在最后一个分块中完成
+                const bool accumulate = pc != 0;
+                const bool last_block = pc + kc == k;
+                const float *block_bias = accumulate ? nullptr : epilogue.bias;
+                const float *block_residual = last_block ? epilogue.residual : nullptr;
+                const bool block_relu = epilogue.relu && last_block;
+                pack_b(kc, nc, pc, jc, packed_b.data());
+
+                for (uint32_t ic = 0; ic < m; ic += kGemmMC) {
+                    const uint32_t mc = std::min(kGemmMC, m - ic);
+                    PackA(mc, kc, a + ic * lda + pc, lda, packed_a.data());
+
+                    for (uint32_t jr = 0; jr < nc; jr += kGemmNR) {
+                        // 输出块所在的样本以及在样本内的列，补齐的列只参与计算不写回
+                        const uint32_t sample = (jc + jr) / segments.padded_width;
+                        const uint32_t sample_col = (jc + jr) % segments.padded_width;
+                        const uint32_t nr = std::min(std::min(kGemmNR, nc - jr), segments.width - sample_col);
+                        const float *packed_b_panel = packed_b.data() + jr * kc;
+                        float *c_sample = c + sample * segments.c_stride + sample_col;
+                        const float *residual_sample = block_residual ?
+                                                       block_residual + sample * segments.residual_stride + sample_col
+                                                                      : nullptr;
+                        for (uint32_t ir = 0; ir < mc; ir += kGemmMR) {
+                            const uint32_t mr = std::min(kGemmMR, mc - ir);
+                            const float *packed_a_panel = packed_a.data() + ir * kc;
+                            float *c_tile = c_sample + (ic + ir) * ldc;
+                            const float *tile_bias = block_bias ? block_bias + ic + ir : nullptr;
+                            const float *tile_residual = residual_sample ?
+                                                         residual_sample + (ic + ir) * epilogue.ldr : nullptr;
+                            if (mr == kGemmMR && nr == kGemmNR) {
+                                MicroKernel(kc, packed_a_panel, packed_b_panel, c_tile, ldc, accumulate, tile_bias,
+                                            tile_residual, epilogue.ldr, block_relu);
+                            } else {
+                                // 边界上的不完整块先写到临时块中，再写回有效部分
+                                MicroKernel(kc, packed_a_panel, packed_b_panel, tile, kGemmNR, false, nullptr,
+                                            nullptr, 0, false);
+                                StoreTile(tile, mr, nr, c_tile, ldc, accumulate, tile_bias,
+                                          tile_residual, epilogue.ldr, block_relu);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * 把分块矩阵乘法交给节点内的线程池，按微内核的块数较多的一边切分
+     * 按列切分时各线程只打包自己的B，按行切分时各线程只打包自己的A，输出互不重叠
+     * @param n 所有分段补齐之后的总列数
+     */
+    template<typename PackBFunc>
+    static void SGemmParallel(uint32_t m, uint32_t n, uint32_t k, const float *a, uint32_t lda,
+                              float *c, uint32_t ldc, const GemmEpilogue &epilogue, const PackBFunc &pack_b,
+                              const GemmSegments &segments) {
+        const uint32_t col_panels = (n + kGemmNR - 1) / kGemmNR;
+        const uint32_t row_panels = (m + kGemmMR - 1) / kGemmMR;
+        if (col_panels >= row_panels) {
+            ParallelFor(col_panels, ParallelGrain(size_t(m) * k * kGemmNR), [&](size_t begin, size_t end) {
+                SGemmBlocked(m, k, a, lda, c, ldc, epilogue, pack_b, segments, uint32_t(begin) * kGemmNR,
+                             std::min(uint32_t(end) * kGemmNR, n));
+            });
+            return;
+        }
+        ParallelFor(row_panels, ParallelGrain(size_t(n) * k * kGemmMR), [&](size_t begin, size_t end) {
+            const uint32_t row_begin = uint32_t(begin) * kGemmMR;
+            const uint32_t rows = std::min(uint32_t(end) * kGemmMR, m) - row_begin;
+            GemmEpilogue rows_epilogue = epilogue;
+            if (epilogue.bias) {
+                rows_epilogue.bias = epilogue.bias + row_begin;
+            }
+            if (epilogue.residual) {
+                rows_epilogue.residual = epilogue.residual + size_t(row_begin) * epilogue.ldr;
+            }
+            SGemmBlocked(rows, k, a + size_t(row_begin) * lda, lda, c + size_t(row_begin) * ldc, ldc,
+                         rows_epilogue, pack_b, segments, 0, n);
+        });
+    }
+
+    void SGemm(uint32_t m, uint32_t n, uint32_t k,
+               const float *a, uint32_t lda,
+               const float *b, uint32_t ldb,
+               float *c, uint32_t ldc,
+               const GemmEpilogue &epilogue) {
+        CHECK(a != nullptr && b != nullptr && c != nullptr);
+        if (m == 0 || n == 0) {
+            return;
+        }
+        const float *bias = epilogue.bias;
+        if (k == 0) {
+            FillEpilogue(m, n, c, ldc, epilogue);
+            return;
+        }
+        if (m == 1) {
+            // 按列分段并行，每段是向量宽度的整数倍
+            constexpr uint32_t panel = 64;
+            ParallelFor((n + panel - 1) / panel, ParallelGrain(size_t(k) * panel), [&](size_t begin, size_t end) {
+                const uint32_t col_begin = uint32_t(begin) * panel;
+                const uint32_t cols = std::min(uint32_t(end) * panel, n) - col_begin;
+                GemvRow(cols, k, a, b + col_begin, ldb, c + col_begin, bias ? bias[0] : 0.f,
+                        epilogue.residual ? epilogue.residual + col_begin : nullptr, epilogue.relu);
+            });
+            return;
+        }
+
+        GemmSegments segments;
+        segments.width = segments.padded_width = n;
+        SGemmParallel(m, n, k, a, lda, c, ldc, epilogue,
+                      [b, ldb](uint32_t kc, uint32_t nc, uint32_t pc, uint32_t jc, float *packed_b) {
+                          PackB(kc, nc, b + pc * ldb + jc, ldb, packed_b);
+                      }, segments);
+    }
+
+    void SGemmGatherB(uint32_t m, uint32_t n, uint32_t k,
+                      const float *a, uint32_t lda,
+                      const float *b, uint32_t ldb, const uint32_t *b_col_offsets,
+                      float *c, uint32_t ldc,
+                      const GemmEpilogue &epilogue) {
+        CHECK(a != nullptr && b != nullptr && b_col_offsets != nullptr && c != nullptr);
+        if (m == 0 || n == 0) {
+            return;
+        }
+        if (k == 0) {
+            FillEpilogue(m, n, c, ldc, epilogue);
+            return;
+        }
+        GemmSegments segments;
+        segments.width = segments.padded_width = n;
+        SGemmParallel(m, n, k, a, lda, c, ldc, epilogue,
+                      [b, ldb, b_col_offsets](uint32_t kc, uint32_t nc, uint32_t pc, uint32_t jc, float *packed_b) {
+                          PackBGather(kc, nc, b + pc * ldb, ldb, b_col_offsets + jc, packed_b);
+                      }, segments);
+    }
+
+    void SGemmBatchedB(uint32_t batch, uint32_t m, uint32_t n, uint32_t k,
+                       const float *a, uint32_t lda,
+                       const float *b, uint32_t ldb, size_t b_batch_stride, const uint32_t *b_col_offsets,
+                       float *c, uint32_t ldc, size_t c_batch_stride,
+                       const GemmEpilogue &epilogue) {
+        CHECK(a != nullptr && b != nullptr && c != nullptr);
+        if (batch == 0 || m == 0 || n == 0) {
+            return;
+        }
+        // 单个样本或者k为0时没有可以共用的打包，逐个样本计算
+        if (batch == 1 || k == 0) {
+            for (uint32_t i = 0; i < batch; ++i) {
+                GemmEpilogue sample_epilogue = epilogue;
+                if (epilogue.residual) {
+                    sample_epilogue.residual = epilogue.residual + i * epilogue.residual_batch_stride;
+                }
+                const float *b_sample = b + i * b_batch_stride;
+                float *c_sample = c + i * c_batch_stride;
+                if (b_col_offsets) {
+                    SGemmGatherB(m, n, k, a, lda, b_sample, ldb, b_col_offsets, c_sample, ldc, sample_epilogue);
+                } else {
+                    SGemm(m, n, k, a, lda, b_sample, ldb, c_sample, ldc, sample_epilogue);
+                }
+            }
+            return;
+        }
+
+        GemmSegments segments;
+        segments.width = n;
+        segments.padded_width = (n + kGemmNR - 1) / kGemmNR * kGemmNR;
+        segments.c_stride = c_batch_stride;
+        segments.residual_stride = epilogue.residual_batch_stride;
+        const uint32_t padded_n = batch * segments.padded_width;
+        // 按样本分段打包，每段从面板的边界开始，段末不足一个面板的部分由打包函数补零
+        const auto pack_b = [&](uint32_t kc, uint32_t nc, uint32_t pc, uint32_t jc, float *packed_b) {
+            for (uint32_t col = jc; col < jc + nc;) {
+                const uint32_t sample = col / segments.padded_width;
+                const uint32_t sample_col = col % segments.padded_width;
+                const uint32_t segment_end = std::min(jc + nc, (sample + 1) * segments.padded_width);
+                const uint32_t width = std::min(segments.width, segment_end - sample * segments.padded_width) -
+                                       sample_col;
+                const float *b_sample = b + sample * b_batch_stride + pc * ldb;
+                float *packed_segment = packed_b + (col - jc) * kc;
+                if (b_col_offsets) {
+                    PackBGather(kc, width, b_sample, ldb, b_col_offsets + sample_col, packed_segment);
+                } else {
+                    PackB(kc, width, b_sample + sample_col, ldb, packed_segment);
+                }
+                col = segment_end;
+            }
+        };
+        SGemmParallel(m, padded_n, k, a, lda, c, ldc, epilogue, pack_b, segments);
+    }
+}
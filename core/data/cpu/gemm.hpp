@@ -0,0 +1,77 @@
+//
+// Created by hanke on 2024/5/6.
+//
+
+#ifndef INFERNETO_GEMM_HPP
+#define INFERNETO_GEMM_HPP
+#include <cstdint>
+#include <cstddef>
+
+namespace infer_neto {
+    /// 微内核的寄存器分块大小，一次计算 kGemmMR x kGemmNR 的输出块
+    constexpr uint32_t kGemmMR = 6;
+    constexpr uint32_t kGemmNR = 16;
+
+    /// 缓存分块大小: A块(MC x KC)驻留L2, B块(KC x NC)驻留L3, B的微面板(KC x NR)驻留L1
+    constexpr uint32_t kGemmMC = 144;
+    constexpr uint32_t kGemmKC = 256;
+    constexpr uint32_t kGemmNC = 4096;
+
+    /// 矩阵乘法的后处理，在结果写回C时一并完成
+    struct GemmEpilogue {
+        const float *bias = nullptr;      /// 按行广播的偏置，长度为m，为空时不加偏置
+        const float *residual = nullptr;  /// 与C形状相同的残差矩阵，不能与C重叠，为空时不加残差
+        uint32_t ldr = 0;                 /// 残差矩阵相邻两行之间的距离，为0时每行加同一行，可用作按列广播的偏置
+        bool relu = false;                /// 为true时在加上偏置和残差之后再做ReLU
+        size_t residual_batch_stride = 0; /// SGemmBatchedB中相邻两个样本的残差之间的距离
+    };
+
+    /**
+     * 单精度矩阵乘法 C = act(A * B + bias + residual)，所有矩阵均按行主序存储
+     * @param m 矩阵A和C的行数
+     * @param n 矩阵B和C的列数
+     * @param k 矩阵A的列数，也是矩阵B的行数
+     * @param a 矩阵A的数据
+     * @param lda 矩阵A相邻两行之间的距离
+     * @param b 矩阵B的数据
+     * @param ldb 矩阵B相邻两行之间的距离
+     * @param c 矩阵C的数据，计算结果会覆盖其中原有的值
+     * @param ldc 矩阵C相邻两行之间的距离
+     * @param epilogue 写回C时的后处理
+     */
+    void SGemm(uint32_t m, uint32_t n, uint32_t k,
+               const float *a, uint32_t lda,
+               const float *b, uint32_t ldb,
+               float *c, uint32_t ldc,
+               const GemmEpilogue &epilogue = GemmEpilogue());
+
+    /**
+     * 与SGemm相同，但B的列不要求连续，B[l][j] = b[l * ldb + b_col_offsets[j]]
+     * 可以在不复制的情况下直接对带步长的子采样视图做矩阵乘法
+     * @param b_col_offsets 长度为n，B每一列在行内的偏移
+     */
+    void SGemmGatherB(uint32_t m, uint32_t n, uint32_t k,
+                      const float *a, uint32_t lda,
+                      const float *b, uint32_t ldb, const uint32_t *b_col_offsets,
+                      float *c, uint32_t ldc,
+                      const GemmEpilogue &epilogue = GemmEpilogue());
+
+    /**
+     * 一个批次的样本共用矩阵A，第i个样本计算 C_i = act(A * B_i + bias + residual_i)
+     * 各样本的B按列拼接成一次矩阵乘法，A在整个批次中只打包一次，适合把批次合并进卷积的矩阵乘法
+     * @param batch 样本的个数
+     * @param b 第一个样本的矩阵B，第i个样本从 b + i * b_batch_stride 开始
+     * @param b_batch_stride 相邻两个样本的B之间的距离
+     * @param b_col_offsets 为空时B的列是连续的，否则与SGemmGatherB相同，所有样本共用
+     * @param c 第一个样本的矩阵C，第i个样本从 c + i * c_batch_stride 开始
+     * @param c_batch_stride 相邻两个样本的C之间的距离
+     * @param epilogue 写回C时的后处理，残差按residual_batch_stride在样本之间移动
+     */
+    void SGemmBatchedB(uint32_t batch, uint32_t m, uint32_t n, uint32_t k,
+                       const float *a, uint32_t lda,
+                       const float *b, uint32_t ldb, size_t b_batch_stride, const uint32_t *b_col_offsets,
+                       float *c, uint32_t ldc, size_t c_batch_stride,
+                       const GemmEpilogue &epilogue = GemmEpilogue());
+}
+
+#endif //INFERNETO_GEMM_HPP
@@ -0,0 +1,74 @@
+//
+// Created by hanke on 2024/5/8.
+//
+#include "im2col.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace infer_neto {
+    /**
+     * 计算卷积核某一列在输入中有效的输出列区间 [begin, end)
+     * 区间之外的输出列落在左右填充上
+     */
+    static void ValidOutputRange(uint32_t input_size, uint32_t output_size, uint32_t kernel_offset,
+                                 uint32_t padding, uint32_t stride, uint32_t &begin, uint32_t &end) {
+        // 输出位置 o 对应的输入位置为 o * stride + kernel_offset - padding
+        begin = kernel_offset >= padding ? 0 : (padding - kernel_offset + stride - 1) / stride;
+        if (input_size + padding <= kernel_offset) {
+            end = 0;
+        } else {
+            end = (input_size + padding - kernel_offset + stride - 1) / stride;
+        }
+        begin = std::min(begin, output_size);
+        end = std::max(begin, std::min(end, output_size));
+    }
+
+    void Im2Col(const float *input, uint32_t input_c, uint32_t input_h, uint32_t input_w,
+                uint32_t kernel_h, uint32_t kernel_w, uint32_t padding_h, uint32_t padding_w,
+                uint32_t stride_h, uint32_t stride_w, float *output) {
+        const uint32_t output_h = ConvOutputSize(input_h, kernel_h, padding_h, stride_h);
+        const uint32_t output_w = ConvOutputSize(input_w, kernel_w, padding_w, stride_w);
+        const uint32_t input_size = input_h * input_w;
+
+        // 每个输入通道展开成连续的 kernel_h * kernel_w 行，按通道分给多个线程
+        const size_t channel_rows = size_t(kernel_h) * kernel_w;
+        const size_t output_size = size_t(output_h) * output_w;
+        ParallelFor(input_c, ParallelGrain(channel_rows * output_size), [&](size_t c_begin, size_t c_end) {
+            for (size_t ic = c_begin; ic < c_end; ++ic) {
+                const float *channel = input + ic * input_size;
+                float *dst = output + ic * channel_rows * output_size;
+                for (uint32_t kh = 0; kh < kernel_h; ++kh) {
+                    for (uint32_t kw = 0; kw < kernel_w; ++kw) {
+                        // 有效的列区间只和kw有关，对所有输出行都相同
+                        uint32_t ow_begin = 0, ow_end = 0;
+                        ValidOutputRange(input_w, output_w, kw, padding_w, stride_w, ow_begin, ow_end);
+                        const uint32_t valid_w = ow_end - ow_begin;
+
+                        for (uint32_t oh = 0; oh < output_h; ++oh) {
+                            float *dst_row = dst + oh * output_w;
+                            const int32_t ih = int32_t(oh * stride_h + kh) - int32_t(padding_h);
+                            if (ih < 0 || ih >= int32_t(input_h) || valid_w == 0) {
+                                std::memset(dst_row, 0, output_w * sizeof(float));
+                                continue;
+                            }
+
+                            std::memset(dst_row, 0, ow_begin * sizeof(float));
+                            const float *src_row = channel + ih * input_w + (ow_begin * stride_w + kw - padding_w);
+                            if (stride_w == 1) {
+                                std::memcpy(dst_row + ow_begin, src_row, valid_w * sizeof(float));
+                            } else {
+                                float *dst_valid = dst_row + ow_begin;
+                                for (uint32_t ow = 0; ow < valid_w; ++ow) {
+                                    dst_valid[ow] = src_row[ow * stride_w];
+                                }
+                            }
+                            std::memset(dst_row + ow_end, 0, (output_w - ow_end) * sizeof(float));
+                        }
+                        dst += output_size;
+                    }
+                }
+            }
+        });
+    }
+}
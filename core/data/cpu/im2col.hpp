@@ -0,0 +1,42 @@
+//
+// Created by hanke on 2024/5/8.
+//
+
+#ifndef INFERNETO_IM2COL_HPP
+#define INFERNETO_IM2COL_HPP
+#include <cstdint>
+
+namespace infer_neto {
+    /**
+     * 计算卷积输出的尺寸
+     * @param input_size 输入的高度或宽度
+     * @param kernel_size 卷积核的高度或宽度
+     * @param padding 单侧填充的大小
+     * @param stride 步长
+     * @return 输出的高度或宽度
+     */
+    inline uint32_t ConvOutputSize(uint32_t input_size, uint32_t kernel_size, uint32_t padding, uint32_t stride) {
+        return (input_size + 2 * padding - kernel_size) / stride + 1;
+    }
+
+    /**
+     * 将CHW排布的输入展开为 [input_c * kernel_h * kernel_w, output_h * output_w] 的矩阵
+     * 矩阵的行按 (通道, 卷积核行, 卷积核列) 排列，列按输出位置排列，填充的位置写0
+     * @param input 输入数据，包含input_c个连续的 input_h x input_w 通道
+     * @param input_c 需要展开的通道数
+     * @param input_h 输入的高度
+     * @param input_w 输入的宽度
+     * @param kernel_h 卷积核的高度
+     * @param kernel_w 卷积核的宽度
+     * @param padding_h 上下方向的填充大小
+     * @param padding_w 左右方向的填充大小
+     * @param stride_h 上下方向的步长
+     * @param stride_w 左右方向的步长
+     * @param output 调用方提供的工作区，大小至少为 input_c * kernel_h * kernel_w * output_h * output_w
+     */
+    void Im2Col(const float *input, uint32_t input_c, uint32_t input_h, uint32_t input_w,
+                uint32_t kernel_h, uint32_t kernel_w, uint32_t padding_h, uint32_t padding_w,
+                uint32_t stride_h, uint32_t stride_w, float *output);
+}
+
+#endif //INFERNETO_IM2COL_HPP
@@ -5,16 +5,20 @@
 #include <random>
 #include <functional>
 #include "tensor.hpp"
-#include <omp.h>
+#include "gemm.hpp"
+#include "allocator.hpp"
+#include "elementwise.hpp"
+#include "transpose.hpp"
 #include <immintrin.h> // AVX指令集
 #include <algorithm>
+#include <numeric>
 #include <iostream>
 
 #define TILE_SIZE 16 // 定义tile尺寸，可根据实际CPU缓存调整
 namespace infer_neto {
     Tensor<float>::Tensor(uint32_t channels, uint32_t rows, uint32_t cols) {
         size_ = channels * rows * cols;
-        data_ = std::make_unique<float[]>(size_);
+        data_ = allocateData(size_, true);
         if (channels == 1 && rows == 1) {
             this->raw_shapes_ = std::vector<uint32_t>{cols};
         } else if (channels == 1) {
@@ -27,20 +31,32 @@ namespace infer_neto {
 
     Tensor<float>::Tensor(uint32_t size) {
         size_ = size;
-        data_ = std::make_unique<float[]>(size_);
+        data_ = allocateData(size_, true);
         this->raw_shapes_ = std::vector<uint32_t>{size};
         calculateStrides();
     }
 
     Tensor<float>::Tensor(uint32_t rows, uint32_t cols) {
         size_ = rows * cols;
-        data_ = std::make_unique<float[]>(rows * cols * 1);
+        data_ = allocateData(size_, true);
         this->raw_shapes_ = std::vector<uint32_t>{rows, cols};
         calculateStrides();
     }
 
-    Tensor<float>::Tensor(const std::vector<uint32_t> &shapes) {
-        CHECK(!shapes.empty() && shapes.size() <= 3);
+    Tensor<float>::Tensor(const std::vector<uint32_t> &shapes) : Tensor(shapes, kUninitialized) {
+        std::fill_n(this->data_.get(), this->size_, 0.f);
+    }
+
+    Tensor<float>::Tensor(const std::vector<uint32_t> &shapes, UninitializedTag) {
+        CHECK(!shapes.empty() && shapes.size() <= 4);
+        // 四维张量按 (batch, channels, rows, cols) 保留全部维度
+        if (shapes.size() == 4) {
+            size_ = std::accumulate(shapes.begin(), shapes.end(), 1u, std::multiplies());
+            data_ = allocateData(size_, false);
+            this->raw_shapes_ = shapes;
+            calculateStrides();
+            return;
+        }
 
         uint32_t remaining = 3 - shapes.size();
         std::vector<uint32_t> shapes_(3, 1);
@@ -50,7 +66,41 @@ namespace infer_neto {
         uint32_t rows = shapes_.at(1);
         uint32_t cols = shapes_.at(2);
         size_ = rows * cols * channels;
-        data_ = std::make_unique<float[]>(size_);
+        data_ = allocateData(size_, false);
+        if (channels == 1 && rows == 1) {
+            this->raw_shapes_ = std::vector<uint32_t>{cols};
+        } else if (channels == 1) {
+            this->raw_shapes_ = std::vector<uint32_t>{rows, cols};
+        } else {
+            this->raw_shapes_ = std::vector<uint32_t>{channels, rows, cols};
+        }
+        calculateStrides();
+    }
+
+    Tensor<float>::Tensor(float *data, const std::vector<uint32_t> &shapes)
+            : Tensor(TensorData(data, [](float *) {}), shapes) {
+    }
+
+    Tensor<float>::Tensor(TensorData data, const std::vector<uint32_t> &shapes) {
+        CHECK(data != nullptr);
+        CHECK(!shapes.empty() && shapes.size() <= 4);
+        if (shapes.size() == 4) {
+            size_ = std::accumulate(shapes.begin(), shapes.end(), 1u, std::multiplies());
+            data_ = std::move(data);
+            this->raw_shapes_ = shapes;
+            calculateStrides();
+            return;
+        }
+
+        uint32_t remaining = 3 - shapes.size();
+        std::vector<uint32_t> shapes_(3, 1);
+        std::copy(shapes.begin(), shapes.end(), shapes_.begin() + remaining);
+
+        uint32_t channels = shapes_.at(0);
+        uint32_t rows = shapes_.at(1);
+        uint32_t cols = shapes_.at(2);
+        size_ = rows * cols * channels;
+        data_ = std::move(data);
         if (channels == 1 && rows == 1) {
             this->raw_shapes_ = std::vector<uint32_t>{cols};
         } else if (channels == 1) {
@@ -67,9 +117,10 @@ namespace infer_neto {
         this->strides_ = tensor.strides_;
         this->size_ = tensor.size_;
 
-        // 为data_分配空间并进行深拷贝
-        this->data_ = std::make_unique<float[]>(size_);
-        std::copy(tensor.data_.get(), tensor.data_.get() + size_, this->data_.get());
+        // 为data_分配空间并进行深拷贝，复制得到的张量总是连续的
+        this->data_ = allocateData(size_, false);
+        tensor.packTo(this->data_.get());
+        this->calculateStrides();
     }
 
     Tensor<float>::Tensor(Tensor<float> &&tensor) noexcept {
@@ -78,6 +129,7 @@ namespace infer_neto {
             this->raw_shapes_ = std::move(tensor.raw_shapes_);
             this->strides_ = std::move(tensor.strides_);
             this->size_ = tensor.size_;
+            this->contiguous_ = tensor.contiguous_;
         }
     }
 
@@ -87,24 +139,97 @@ namespace infer_neto {
             this->raw_shapes_ = std::move(tensor.raw_shapes_);
             this->strides_ = std::move(tensor.strides_);
             this->size_ = tensor.size_;
+            this->contiguous_ = tensor.contiguous_;
         }
         return *this;
     }
 
     Tensor<float> &Tensor<float>::operator=(const Tensor &tensor) {
         if (this != &tensor) {
-            this->strides_ = tensor.strides_;
+            // 元素个数相同且自身连续时直接复制到已有的空间中，外部内存上的张量和视图仍然指向原来的数据
+            // 与tensor的数据在地址上重叠时重新分配，避免复制过程中覆盖还没有读到的元素；
+            // 同一个内存池上互不重叠的张量仍然原地复制，不会脱离内存池
+            bool overlaps = false;
+            if (this->data_ && tensor.data_ && tensor.size_ != 0) {
+                size_t source_extent = 1;
+                for (size_t i = 0; i < tensor.raw_shapes_.size(); ++i) {
+                    source_extent += size_t(tensor.raw_shapes_[i] - 1) * tensor.strides_[i];
+                }
+                const float *target_begin = this->data_.get();
+                const float *source_begin = tensor.data_.get();
+                overlaps = target_begin < source_begin + source_extent && source_begin < target_begin + this->size_;
+            }
+            if (!this->data_ || this->size_ != tensor.size_ || !this->is_contiguous() || overlaps) {
+                this->data_ = allocateData(tensor.size_, false);
+            }
             this->raw_shapes_ = tensor.raw_shapes_;
             this->size_ = tensor.size_;
-
-            // 为data_分配空间并进行深拷贝
-            this->data_ = std::make_unique<float[]>(size_);
-            std::copy(tensor.data_.get(), tensor.data_.get() + size_, this->data_.get());
+            tensor.packTo(this->data_.get());
+            this->calculateStrides();
         }
         return *this;
     }
 
 
+    namespace {
+        /// 把张量数据交还给申请时的分配器，分配器在程序退出前不会被释放，只需要保存指针
+        struct TensorDataDeleter {
+            TensorAllocator *allocator;
+            size_t bytes;
+
+            void operator()(float *ptr) const {
+                allocator->Deallocate(ptr, bytes);
+            }
+        };
+
+        /// 张量数据的shared_ptr控制块使用的缓存池，有意不析构，程序退出时仍然可以释放控制块
+        TensorAllocator &ControlBlockPool() {
+            static auto *pool = new PooledTensorAllocator(size_t(16) << 20, 4096, size_t(256) << 10);
+            return *pool;
+        }
+
+        /// 从ControlBlockPool申请控制块的标准库分配器，创建张量时不再调用全局的operator new
+        template<typename T>
+        struct ControlBlockAllocator {
+            using value_type = T;
+
+            ControlBlockAllocator() = default;
+
+            template<typename U>
+            ControlBlockAllocator(const ControlBlockAllocator<U> &) {
+            }
+
+            T *allocate(size_t n) {
+                return static_cast<T *>(ControlBlockPool().Allocate(n * sizeof(T)));
+            }
+
+            void deallocate(T *ptr, size_t n) {
+                ControlBlockPool().Deallocate(ptr, n * sizeof(T));
+            }
+
+            template<typename U>
+            bool operator==(const ControlBlockAllocator<U> &) const {
+                return true;
+            }
+
+            template<typename U>
+            bool operator!=(const ControlBlockAllocator<U> &) const {
+                return false;
+            }
+        };
+    }
+
+    TensorData Tensor<float>::allocateData(uint32_t size, bool zero_fill) {
+        // 释放时交还给申请时的分配器，中途替换分配器不影响已经创建的张量
+        TensorAllocator *allocator = CurrentTensorAllocator();
+        const size_t bytes = size_t(size) * sizeof(float);
+        float *data = static_cast<float *>(allocator->Allocate(bytes));
+        if (zero_fill) {
+            std::fill_n(data, size, 0.f);
+        }
+        return TensorData(data, TensorDataDeleter{allocator, bytes}, ControlBlockAllocator<float>());
+    }
+
     void Tensor<float>::calculateStrides() {
         strides_.resize(raw_shapes_.size());
         uint32_t stride = 1;
@@ -112,6 +237,94 @@ namespace infer_neto {
             strides_[i] = stride;
             stride *= raw_shapes_[i];
         }
+        contiguous_ = true;
+    }
+
+    void Tensor<float>::packTo(float *dst) const {
+        if (this->is_contiguous()) {
+            std::copy(this->data_.get(), this->data_.get() + size_, dst);
+            return;
+        }
+        const size_t dims = raw_shapes_.size();
+        const size_t last = dims - 1;
+        std::vector<size_t> dst_strides(dims);
+        size_t dst_stride = 1;
+        for (size_t i = dims; i-- > 0;) {
+            dst_strides[i] = dst_stride;
+            dst_stride *= raw_shapes_[i];
+        }
+
+        // 找到在原数据中步长为1的维度，它与最内层的维度组成一个二维的转置，交给分块转置处理
+        size_t unit = dims;
+        for (size_t i = 0; i < dims; ++i) {
+            if (raw_shapes_[i] > 1 && strides_[i] == 1) {
+                unit = i;
+            }
+        }
+        if (strides_[last] == 1) {
+            unit = last;
+        }
+
+        std::vector<size_t> outer_dims;
+        for (size_t i = 0; i < last; ++i) {
+            if (i != unit) {
+                outer_dims.push_back(i);
+            }
+        }
+        std::vector<uint32_t> index(outer_dims.size(), 0);
+        const float *src = this->data_.get();
+        const uint32_t cols = raw_shapes_[last];
+        while (true) {
+            size_t src_offset = 0;
+            size_t dst_offset = 0;
+            for (size_t k = 0; k < outer_dims.size(); ++k) {
+                src_offset += size_t(index[k]) * strides_[outer_dims[k]];
+                dst_offset += size_t(index[k]) * dst_strides[outer_dims[k]];
+            }
+            if (unit == last) {
+                std::copy(src + src_offset, src + src_offset + cols, dst + dst_offset);
+            } else if (unit < dims) {
+                TransposeMatrix(cols, raw_shapes_[unit], src + src_offset, strides_[last], dst + dst_offset,
+                                dst_strides[unit]);
+            } else {
+                for (uint32_t col = 0; col < cols; ++col) {
+                    dst[dst_offset + col] = src[src_offset + size_t(col) * strides_[last]];
+                }
+            }
+
+            // 按行主序推进外层维度的下标
+            size_t k = outer_dims.size();
+            while (k > 0) {
+                k -= 1;
+                if (++index[k] < raw_shapes_[outer_dims[k]]) {
+                    break;
+                }
+                index[k] = 0;
+                if (k == 0) {
+                    return;
+                }
+            }
+            if (outer_dims.empty()) {
+                return;
+            }
+        }
+    }
+
+    const std::vector<uint32_t> &Tensor<float>::strides() const { return this->strides_; }
+
+    void Tensor<float>::updateContiguous() {
+        uint32_t expected = 1;
+        for (size_t i = raw_shapes_.size(); i-- > 0;) {
+            if (raw_shapes_[i] == 1) {
+                continue;
+            }
+            if (strides_[i] != expected) {
+                this->contiguous_ = false;
+                return;
+            }
+            expected *= raw_shapes_[i];
+        }
+        this->contiguous_ = true;
     }
 
 
@@ -136,9 +349,9 @@ namespace infer_neto {
     }
 
     uint32_t Tensor<float>::channels() const {
-        if (this->raw_shapes_.size() == 3) {
-            // 对于至少有三维的张量，第一个元素是通道数
-            return this->raw_shapes_[0];
+        if (this->raw_shapes_.size() >= 3) {
+            // 对于至少有三维的张量，倒数第三个元素是通道数
+            return this->raw_shapes_[this->raw_shapes_.size() - 3];
         } else {
             // 对于二维或一维张量，我们可以认为通道数为1
             return 1;
@@ -146,67 +359,92 @@ namespace infer_neto {
     }
 
 
+    uint32_t Tensor<float>::batch_size() const {
+        // 只有四维张量带有批次维度
+        return this->raw_shapes_.size() == 4 ? this->raw_shapes_[0] : 1;
+    }
+
     void Tensor<float>::set_data(const float *&data) {
         CHECK(data);
-        std::copy(data, data + size_, this->data_.get());
+        if (this->is_contiguous()) {
+            std::copy(data, data + size_, this->data_.get());
+            return;
+        }
+        for (uint32_t i = 0; i < size_; ++i) {
+            this->data_[elementOffset(i)] = data[i];
+        }
     }
 
     bool Tensor<float>::empty() const { return !this->data_; }
 
-    float Tensor<float>::index(uint32_t offset) const {
-        CHECK(offset < size_) << "Tensor index out of bound!";
-        return this->data_[offset];
-    }
-
-    float &Tensor<float>::index(uint32_t offset) {
-        CHECK(offset < size_) << "Tensor index out of bound!";
-        return this->data_[offset];
-    }
-
     std::vector<uint32_t> Tensor<float>::shapes() const {
         CHECK(this->data_);
+        if (this->raw_shapes_.size() == 4) {
+            return this->raw_shapes_;
+        }
         return {this->channels(), this->rows(), this->cols()};
     }
-    float * Tensor<float>::data_ptr(uint32_t batch, uint32_t row, uint32_t col) const {
-        CHECK_LT(row, this->rows());
-        CHECK_LT(col, this->cols());
-        CHECK_LT(batch, this->channels());
-        return &(this->data_[(batch * this->rows() * this->cols()) + (row * this->cols()) + col]);
-    }
-
     Tensor<float> Tensor<float>::Transpose() const {
-        // 创建一个新的张量，行列互换
-        Tensor<float> transposed(this->cols(), this->rows());
-        for (uint32_t i = 0; i < this->rows(); ++i) {
-            for (uint32_t j = 0; j < this->cols(); ++j) {
-                transposed.data_[j * this->rows() + i] = this->data_[i * this->cols() + j];
-            }
+        CHECK(this->data_);
+        // 一维张量看作只有一行的矩阵，转置只交换最后两维的形状和步长
+        Tensor<float> transposed;
+        transposed.data_ = this->data_;
+        transposed.size_ = this->size_;
+        transposed.raw_shapes_ = this->raw_shapes_;
+        transposed.strides_ = this->strides_;
+        if (transposed.raw_shapes_.size() == 1) {
+            transposed.raw_shapes_.insert(transposed.raw_shapes_.begin(), 1);
+            transposed.strides_.insert(transposed.strides_.begin(), this->size_);
         }
+        const size_t dims = transposed.raw_shapes_.size();
+        std::swap(transposed.raw_shapes_[dims - 1], transposed.raw_shapes_[dims - 2]);
+        std::swap(transposed.strides_[dims - 1], transposed.strides_[dims - 2]);
+        transposed.updateContiguous();
         return transposed;
     }
+    Tensor<float> Tensor<float>::Permute(const std::vector<uint32_t> &dims) const {
+        CHECK(this->data_);
+        CHECK_EQ(dims.size(), raw_shapes_.size()) << "Permute needs one entry for each dimension.";
+        std::vector<bool> used(dims.size(), false);
+        Tensor<float> permuted;
+        permuted.data_ = this->data_;
+        permuted.size_ = this->size_;
+        permuted.raw_shapes_.resize(dims.size());
+        permuted.strides_.resize(dims.size());
+        for (size_t i = 0; i < dims.size(); ++i) {
+            CHECK(dims[i] < dims.size() && !used[dims[i]]) << "Permute dimensions must be a permutation.";
+            used[dims[i]] = true;
+            permuted.raw_shapes_[i] = raw_shapes_[dims[i]];
+            permuted.strides_[i] = strides_[dims[i]];
+        }
+        permuted.updateContiguous();
+        return permuted;
+    }
+
     Tensor<float> Tensor<float>::Gemm(const Tensor<float>& other) const {
         // 检查是否为有效的矩阵乘法条件
+        CHECK(this->raw_shapes_.size() <= 3 && other.raw_shapes_.size() <= 3);
         CHECK(this->cols() == other.rows()) << "Matrix multiplication dimension mismatch.";
+        CHECK(this->channels() == other.channels()) << "Matrix multiplication batch mismatch.";
+
+        // 转置等不连续的视图先整理成连续的数据
+        const Tensor<float> &lhs = this->Contiguous();
+        const Tensor<float> &rhs = other.Contiguous();
 
         // 初始化结果张量
         uint32_t batch_size = this->channels(); // 批次大小
         uint32_t out_rows = this->rows();
         uint32_t out_cols = other.cols();
-        Tensor<float> result(batch_size, out_rows, out_cols);
+        uint32_t inner_size = this->cols();
+        // 矩阵乘法会覆盖结果中的每个元素，不需要先清零
+        Tensor<float> result(std::vector<uint32_t>{batch_size, out_rows, out_cols}, kUninitialized);
 
-        // 执行矩阵乘法
+        // 逐批次调用分块打包后的矩阵乘法
         for (uint32_t batch = 0; batch < batch_size; batch++) {
-            for (uint32_t row = 0; row < out_rows; row++) {
-                for (uint32_t col = 0; col < out_cols; col++) {
-                    float sum = 0;
-                    for (uint32_t k = 0; k < this->cols(); k++) {
-                        float a = this->at(batch, row, k);
-                        float b = other.at(batch, k, col);
-                        sum += a * b;
-                    }
-                    result.at(batch, row, col) = sum;
-                }
-            }
+            const float *a = lhs.data_.get() + batch * out_rows * inner_size;
+            const float *b = rhs.data_.get() + batch * inner_size * out_cols;
+            float *c = result.data_.get() + batch * out_rows * out_cols;
+            SGemm(out_rows, out_cols, inner_size, a, inner_size, b, out_cols, c, out_cols);
         }
 
         return result;
@@ -216,8 +454,12 @@ namespace infer_neto {
         CHECK(this->data_);  // 确保数据不为空
 
         uint32_t total_elements = this->size();
+        if (this->is_contiguous()) {
+            ElementwiseScalar(BinaryOp::kAdd, this->data_.get(), value, this->data_.get(), total_elements);
+            return;
+        }
         for (uint32_t i = 0; i < total_elements; ++i) {
-            this->data_[i] += value;
+            this->data_[elementOffset(i)] += value;
         }
     }
     void Tensor<float>::Add(const Tensor<float>& bias) {
@@ -227,47 +469,85 @@ namespace infer_neto {
         uint32_t rows = this->rows();
         uint32_t cols = this->cols();
 
-        // 对每个批次、每行进行加法操作
+        CHECK(bias.channels() >= batch_size) << "Dimension mismatch: bias must have a row for each channel.";
+        const uint32_t col_stride = this->strides_.back();
+        const uint32_t bias_col_stride = bias.strides_.back();
+
+        // 对每个批次、每行进行加法操作，每行只计算一次起始地址
         for (uint32_t batch = 0; batch < batch_size; batch++) {
+            const float *bias_row = bias.data_ptr(batch, 0, 0);
             for (uint32_t row = 0; row < rows; row++) {
+                float *output_row = this->data_ptr(batch, row, 0);
                 for (uint32_t col = 0; col < cols; col++) {
-                    this->at(batch, row, col) += bias.at(batch, 0, col);
+                    output_row[col * col_stride] += bias_row[col * bias_col_stride];
                 }
             }
         }
     }
 
-    std::unique_ptr<float[]> &Tensor<float>::data() { return this->data_; }
+    TensorData &Tensor<float>::data() { return this->data_; }
 
-    const std::unique_ptr<float[]> &Tensor<float>::data() const { return this->data_; }
+    const TensorData &Tensor<float>::data() const { return this->data_; }
 
     float *Tensor<float>::slice(uint32_t channel) {
         CHECK_LE (channel, raw_shapes_[0]) << "Channel index out of range.";
+        CHECK(this->is_contiguous()) << "Slicing requires a contiguous tensor.";
         return this->data_.get() + channel * strides_[0];
     }
 
     float *Tensor<float>::slice(uint32_t channel) const {
         CHECK_LE (channel, raw_shapes_[0]) << "Channel index out of range.";
+        CHECK(this->is_contiguous()) << "Slicing requires a contiguous tensor.";
         return this->data_.get() + channel * strides_[0];
     }
 
-    float Tensor<float>::at(uint32_t channel, uint32_t row, uint32_t col) const {
-        CHECK_LT(row, this->rows());
-        CHECK_LT(col, this->cols());
-        CHECK_LT(channel, this->channels());
-        return this->data_[(channel * this->rows() * this->cols()) + (row * this->cols()) + col];
-    }
-
-    float &Tensor<float>::at(uint32_t channel, uint32_t row, uint32_t col) {
-        CHECK_LT(row, this->rows());
-        CHECK_LT(col, this->cols());
-        CHECK_LT(channel, this->channels());
-        return this->data_[(channel * this->rows() * this->cols()) + (row * this->cols()) + col];
+    Tensor<float> Tensor<float>::Channels(uint32_t start, uint32_t count) const {
+        CHECK(this->data_);
+        CHECK_GT(count, 0);
+        CHECK_LE(raw_shapes_.size(), 3) << "Use Batch to select a sample of a four dimensional tensor.";
+        CHECK_LE(start + count, this->channels()) << "Channel range out of range.";
+        const uint32_t rows = this->rows();
+        const uint32_t cols = this->cols();
+        const size_t dims = raw_shapes_.size();
+
+        // 通道范围的视图总是三维的，行和列的步长沿用当前张量
+        Tensor<float> channels;
+        channels.data_ = TensorData(this->data_, this->data_.get() + elementOffset(start, 0, 0));
+        channels.size_ = count * rows * cols;
+        channels.raw_shapes_ = {count, rows, cols};
+        channels.strides_ = {dims == 3 ? strides_[0] : this->size_,
+                             dims >= 2 ? strides_[dims - 2] : cols, strides_[dims - 1]};
+        channels.updateContiguous();
+        return channels;
+    }
+
+    Tensor<float> Tensor<float>::Batch(uint32_t index) const {
+        CHECK(this->data_);
+        CHECK_GE(raw_shapes_.size(), 2) << "A one dimensional tensor has no batch dimension.";
+        CHECK_LT(index, raw_shapes_[0]) << "Batch index out of range.";
+
+        // 去掉第一维，与Tensor(channels, rows, cols)相同，通道数为1时省略通道维度，行数也为1时只保留列
+        Tensor<float> sample;
+        sample.data_ = TensorData(this->data_, this->data_.get() + index * strides_[0]);
+        sample.size_ = this->size_ / raw_shapes_[0];
+        sample.raw_shapes_.assign(raw_shapes_.begin() + 1, raw_shapes_.end());
+        sample.strides_.assign(strides_.begin() + 1, strides_.end());
+        if (sample.raw_shapes_.size() == 3 && sample.raw_shapes_[0] == 1) {
+            sample.raw_shapes_.erase(sample.raw_shapes_.begin());
+            sample.strides_.erase(sample.strides_.begin());
+            if (sample.raw_shapes_[0] == 1) {
+                sample.raw_shapes_.erase(sample.raw_shapes_.begin());
+                sample.strides_.erase(sample.strides_.begin());
+            }
+        }
+        sample.updateContiguous();
+        return sample;
     }
 
     void Tensor<float>::Padding(const std::vector<uint32_t> &pads, float padding_value) {
         CHECK(this->data_) << "The data area of the tensor is empty.";
         CHECK_EQ(pads.size(), 4) << "Padding dimensions must be 4.";
+        CHECK_LE(raw_shapes_.size(), 3) << "Padding a four dimensional tensor is not supported.";
 
         uint32_t pad_rows1 = pads.at(0);  // 上方填充行数
         uint32_t pad_rows2 = pads.at(1);  // 下方填充行数
@@ -277,16 +557,17 @@ namespace infer_neto {
         uint32_t new_rows = this->rows() + pad_rows1 + pad_rows2;
         uint32_t new_cols = this->cols() + pad_cols1 + pad_cols2;
         uint32_t new_channels = this->channels();
+        const Tensor<float> &source = this->Contiguous();
 
         // 创建新的数据数组
-        std::unique_ptr<float[]> new_data = std::make_unique<float[]>(new_channels * new_rows * new_cols);
+        TensorData new_data = allocateData(new_channels * new_rows * new_cols, false);
         std::fill_n(new_data.get(), new_channels * new_rows * new_cols, padding_value);
 
         // 复制原始数据到新的数据数组中正确的位置
         for (uint32_t ch = 0; ch < new_channels; ++ch) {
             for (uint32_t r = 0; r < this->rows(); ++r) {
-                std::copy(this->data_.get() + (ch * this->rows() + r) * this->cols(),
-                          this->data_.get() + (ch * this->rows() + r + 1) * this->cols(),
+                std::copy(source.data_.get() + (ch * this->rows() + r) * this->cols(),
+                          source.data_.get() + (ch * this->rows() + r + 1) * this->cols(),
                           new_data.get() + ((ch * new_rows + r + pad_rows1) * new_cols + pad_cols1));
             }
         }
@@ -300,7 +581,13 @@ namespace infer_neto {
 
     void Tensor<float>::Fill(float value) {
         CHECK(this->data_);
-        std::fill_n(this->data_.get(), this->size_, value);
+        if (this->is_contiguous()) {
+            std::fill_n(this->data_.get(), this->size_, value);
+            return;
+        }
+        for (uint32_t i = 0; i < this->size_; ++i) {
+            this->data_[elementOffset(i)] = value;
+        }
     }
 
     void Tensor<float>::Fill(const std::vector<float> &values) {
@@ -308,8 +595,13 @@ namespace infer_neto {
         const uint32_t total_elems = this->size_;
         CHECK_EQ(values.size(), total_elems);
 
-        std::copy(values.begin(), values.end(), this->data_.get());
-
+        if (this->is_contiguous()) {
+            std::copy(values.begin(), values.end(), this->data_.get());
+            return;
+        }
+        for (uint32_t i = 0; i < total_elems; ++i) {
+            this->data_[elementOffset(i)] = values[i];
+        }
     }
 
     void Tensor<float>::Show() {
@@ -318,24 +610,25 @@ namespace infer_neto {
             return;
         }
 
+        // 四维张量逐个样本打印
+        if (this->raw_shapes_.size() == 4) {
+            for (uint32_t n = 0; n < this->batch_size(); ++n) {
+                LOG(INFO) << "Batch " << n << ":";
+                Tensor<float> sample = this->Batch(n);
+                sample.Show();
+            }
+            return;
+        }
+
         // 迭代每一个通道
         for (uint32_t c = 0; c < this->channels(); ++c) {
             LOG(INFO) << "Channel " << c << ":";
 
-            // 获取当前通道的数据指针
-            float* channel_data = this->slice(c);
-            if (!channel_data) {
-                LOG(INFO) << "  Null data for channel " << c;
-                continue;
-            }
-
             // 使用一个字符串流来收集一行的数据
             std::ostringstream stream;
             for (uint32_t r = 0; r < this->rows(); ++r) {
                 for (uint32_t col = 0; col < this->cols(); ++col) {
-                    // 根据行主顺序计算索引
-                    uint32_t index = r * this->cols() + col;
-                    stream << channel_data[index] << " ";
+                    stream << this->at(c, r, col) << " ";
                 }
                 LOG(INFO) << stream.str();
                 stream.str(""); // 清空流以便下一行使用
@@ -346,6 +639,9 @@ namespace infer_neto {
 
     void Tensor<float>::Flatten() {
         CHECK(this->data_);
+        if (!this->is_contiguous()) {
+            *this = this->Contiguous();
+        }
         this->raw_shapes_ = {this->size()};
         this->calculateStrides();
     }
@@ -359,7 +655,7 @@ namespace infer_neto {
 
         // 为每个张量元素生成随机数
         for (std::uint32_t i = 0; i < this->size_; ++i) {
-            this->data_[i] = dis(gen);
+            this->data_[elementOffset(i)] = dis(gen);
         }
     }
 
@@ -368,16 +664,9 @@ namespace infer_neto {
         this->Fill(1.f);
     }
 
-    void Tensor<float>::Transform(const std::function<float(float)> &filter) {
-        CHECK(this->data_);
-        for (uint32_t i = 0; i < this->size_; ++i) {
-            data_[i] = filter(data_[i]);
-        }
-    }
-
     const std::vector<uint32_t> &Tensor<float>::raw_shapes() const {
         CHECK(!this->raw_shapes_.empty());
-        CHECK_LE(this->raw_shapes_.size(), 3);
+        CHECK_LE(this->raw_shapes_.size(), 4);
         CHECK_GE(this->raw_shapes_.size(), 1);
         return this->raw_shapes_;
     }
@@ -387,21 +676,59 @@ namespace infer_neto {
         CHECK(!shapes.empty());
         const uint32_t origin_size = this->size_;
         const uint32_t current_size = std::accumulate(shapes.begin(), shapes.end(), 1, std::multiplies());
-        CHECK(shapes.size() <= 3);
+        CHECK(shapes.size() <= 4);
         CHECK(current_size == origin_size);
 
+        // 不连续的视图无法只改形状，先复制成连续的数据，之后不再与原来的张量共用数据
+        if (!this->is_contiguous()) {
+            *this = this->Contiguous();
+        }
         this->raw_shapes_ = shapes;
         this->calculateStrides();
     }
 
+    Tensor<float> Tensor<float>::View(const std::vector<uint32_t> &shapes) const {
+        CHECK(this->data_);
+        CHECK(this->is_contiguous()) << "Only a contiguous tensor can be viewed with another shape.";
+        Tensor<float> view;
+        view.data_ = this->data_;
+        view.size_ = this->size_;
+        view.Reshape(shapes);
+        return view;
+    }
+
+    void Tensor<float>::ShareData(const Tensor<float> &other) {
+        CHECK(other.data_);
+        CHECK_EQ(this->size_, other.size_) << "Tensors sharing data must have the same size.";
+        CHECK(other.is_contiguous()) << "Only a contiguous tensor can share its data.";
+        this->data_ = other.data_;
+        this->calculateStrides();
+    }
+
+    Tensor<float> Tensor<float>::Contiguous() const {
+        CHECK(this->data_);
+        if (this->is_contiguous()) {
+            return this->View(this->raw_shapes_);
+        }
+        Tensor<float> contiguous;
+        contiguous.data_ = allocateData(this->size_, false);
+        contiguous.size_ = this->size_;
+        contiguous.raw_shapes_ = this->raw_shapes_;
+        contiguous.calculateStrides();
+        this->packTo(contiguous.data_.get());
+        return contiguous;
+    }
+
     float *Tensor<float>::raw_ptr() {
         CHECK(this->data_);
-        return this->data_.get();;
+        CHECK(this->is_contiguous()) << "Raw pointer access requires a contiguous tensor.";
+        return this->data_.get();
     }
 
     float *Tensor<float>::raw_ptr(uint32_t offset) {
         const uint32_t size = this->size_;
         CHECK(this->data_);
+        CHECK(this->is_contiguous()) << "Raw pointer access requires a contiguous tensor.";
         CHECK_LT(offset, size);
         return this->data_.get() + offset;
     }
@@ -410,8 +737,7 @@ namespace infer_neto {
         CHECK(this->data_);
         std::vector<float> values(this->size());
 
-        std::copy(this->data_.get(), this->data_.get() + this->size(),
-                  values.begin());
+        this->packTo(values.data());
 
         return values;
     }
@@ -431,21 +757,23 @@ namespace infer_neto {
     sftensor operator-=(sftensor tensor, const float value) {
         CHECK(tensor != nullptr);
         float* data = tensor->raw_ptr();
-        for(int i = 0; i < tensor->size(); i++) {
-            data[i] -= value;
-        }
+        ElementwiseScalar(BinaryOp::kSub, data, value, data, tensor->size());
         return tensor;
     }
     void Tensor<float>::NormalizeChannel(uint32_t channel, float mean, float std) {
         CHECK_LT(channel , channels());
         float* channel_data = slice(channel);
         uint32_t area = rows() * cols();
-        for (uint32_t i = 0; i < area; ++i) {
-            channel_data[i] = (channel_data[i] - mean) / std;
-        }
+        ElementwiseScalar(BinaryOp::kSub, channel_data, mean, channel_data, area);
+        ElementwiseScalar(BinaryOp::kDiv, channel_data, std, channel_data, area);
     }
 
     void Tensor<float>::Scale(float factor) {
+        CHECK(this->data_);
+        if (this->is_contiguous()) {
+            ElementwiseScalar(BinaryOp::kMul, this->data_.get(), factor, this->data_.get(), this->size_);
+            return;
+        }
         Transform([factor](float value) { return value * factor; });
     }
 
@@ -7,7 +7,26 @@
 #include <memory>
 #include <vector>
 #include <functional>
+#include <glog/logging.h>
+
+// at、index等元素访问接口的下标检查只在定义了INFERNETO_TENSOR_CHECKS时编译进来，由CMake的同名选项控制，
+// Debug和sanitizer构建默认打开，其他构建中这些接口与对应的unchecked版本相同
+
+#ifdef INFERNETO_TENSOR_CHECKS
+#define TENSOR_CHECK(condition) CHECK(condition)
+#else
+#define TENSOR_CHECK(condition) while (false) CHECK(condition)
+#endif
+
 namespace infer_neto {
+    /// 张量的数据，多个张量可以共用同一块数据，例如展开、改变形状、转置或按通道截取得到的视图
+    /// 视图通过shared_ptr的别名构造指向自己的起始元素，同时持有整块数据的引用计数
+    using TensorData = std::shared_ptr<float[]>;
+
+    /// 创建张量时不初始化数据的标记，用于之后会被完整覆盖的张量，省去清零的开销
+    struct UninitializedTag {};
+    constexpr UninitializedTag kUninitialized{};
+
     template<typename T = float>
     class Tensor {};
 
@@ -44,10 +63,30 @@ namespace infer_neto {
 
         /**
          * 创建张量
-         * @param shapes 张量的维度
+         * @param shapes 张量的维度，最多四维，四维时为 (batch, channels, rows, cols)
          */
         explicit Tensor(const std::vector<uint32_t> &shapes);
 
+        /**
+         * 创建张量，数据不做初始化，调用方需要在读取之前写入所有元素
+         * @param shapes 张量的维度，最多四维，四维时为 (batch, channels, rows, cols)
+         */
+        explicit Tensor(const std::vector<uint32_t> &shapes, UninitializedTag);
+
+        /**
+         * 在外部内存上创建张量，张量不会释放这块内存，调用方需要保证它比张量及其视图活得更久
+         * @param data 外部内存，至少包含shapes中所有元素
+         * @param shapes 张量的维度
+         */
+        explicit Tensor(float *data, const std::vector<uint32_t> &shapes);
+
+        /**
+         * 在共享的数据上创建张量，张量持有data的引用计数，data可以是指向一块更大内存中某个位置的别名
+         * @param data 共享的数据，至少包含shapes中所有元素
+         * @param shapes 张量的维度
+         */
+        explicit Tensor(TensorData data, const std::vector<uint32_t> &shapes);
+
         Tensor(const Tensor &tensor);
 
         Tensor(Tensor &&tensor) noexcept;
@@ -74,6 +113,12 @@ namespace infer_neto {
          */
         uint32_t channels() const;
 
+        /**
+         * 返回张量的批次大小，只有四维张量的批次大小可以大于1
+         * @return 张量的批次大小
+         */
+        uint32_t batch_size() const;
+
         /**
          * 返回张量中元素的数量
          * @return 张量的元素数量
@@ -93,21 +138,35 @@ namespace infer_neto {
         bool empty() const;
 
         /**
-         * 返回张量中offset位置的元素
+         * 返回张量中按行主序第offset个元素，定义INFERNETO_TENSOR_CHECKS时检查越界
          * @param offset 需要访问的位置
          * @return offset位置的元素
          */
         float index(uint32_t offset) const;
 
         /**
-         * 返回张量中offset位置的元素
+         * 返回张量中按行主序第offset个元素，定义INFERNETO_TENSOR_CHECKS时检查越界
          * @param offset 需要访问的位置
          * @return offset位置的元素
          */
         float &index(uint32_t offset);
 
         /**
-         * 张量的尺寸大小
+         * 返回张量中按行主序第offset个元素，不做任何检查，调用方需要事先保证offset小于size()
+         * @param offset 需要访问的位置
+         * @return offset位置的元素
+         */
+        float index_unchecked(uint32_t offset) const;
+
+        /**
+         * 返回张量中按行主序第offset个元素，不做任何检查，调用方需要事先保证offset小于size()
+         * @param offset 需要访问的位置
+         * @return offset位置的元素
+         */
+        float &index_unchecked(uint32_t offset);
+
+        /**
+         * 张量的尺寸大小 (channels, rows, cols)，四维张量返回 (batch, channels, rows, cols)
          * @return 张量的尺寸大小
          */
         std::vector<uint32_t> shapes() const;
@@ -122,30 +181,58 @@ namespace infer_neto {
          * 返回张量中的数据
          * @return 张量中的数据
          */
-        std::unique_ptr<float[]> & data();
+        TensorData &data();
 
         /**
          * 返回张量中的数据
          * @return 张量中的数据
          */
-        const std::unique_ptr<float[]> & data() const;
+        const TensorData &data() const;
 
         /**
-         * 返回张量第channel通道中的数据
+         * 返回张量每一维的步长，视图的步长可以不是按行主序紧密排列的
+         * @return 张量每一维的步长，与raw_shapes一一对应
+         */
+        const std::vector<uint32_t> &strides() const;
+
+        /**
+         * 返回张量中的元素是否按行主序紧密排列，大小为1的维度不影响判断
+         * @return 张量是否连续
+         */
+        bool is_contiguous() const;
+
+        /**
+         * 返回张量第channel通道中的数据，张量需要是连续的
          * @param channel 需要返回的通道
          * @return 返回的通道
          */
         float* slice(uint32_t channel);
 
         /**
-         * 返回张量第channel通道中的数据
+         * 返回张量第channel通道中的数据，张量需要是连续的
          * @param channel 需要返回的通道
          * @return 返回的通道
          */
         float* slice(uint32_t channel) const;
 
         /**
-         * 返回特定位置的元素
+         * 返回从第start个通道开始、共count个通道的视图，与当前张量共用数据
+         * @param start 起始通道
+         * @param count 通道数
+         * @return 形状为 (count, rows, cols) 的视图
+         */
+        Tensor<float> Channels(uint32_t start, uint32_t count) const;
+
+        /**
+         * 返回第一维上第index个样本的视图，与当前张量共用数据
+         * 一个批次的样本可以放在同一块连续的内存中，各样本再以视图的形式参与计算
+         * @param index 样本的位置
+         * @return 去掉第一维之后的视图
+         */
+        Tensor<float> Batch(uint32_t index) const;
+
+        /**
+         * 返回特定位置的元素，四维张量需要先通过Batch取出样本
          * @param channel 通道
          * @param row 行数
          * @param col 列数
@@ -154,7 +241,7 @@ namespace infer_neto {
         float at(uint32_t channel, uint32_t row, uint32_t col) const;
 
         /**
-         * 返回特定位置的元素
+         * 返回特定位置的元素，四维张量需要先通过Batch取出样本
          * @param channel 通道
          * @param row 行数
          * @param col 列数
@@ -162,6 +249,24 @@ namespace infer_neto {
          */
         float &at(uint32_t channel, uint32_t row, uint32_t col);
 
+        /**
+         * 返回特定位置的元素，不做任何检查。四维张量的channel为 batch * channels 展开后的位置
+         * @param channel 通道
+         * @param row 行数
+         * @param col 列数
+         * @return 特定位置的元素
+         */
+        float at_unchecked(uint32_t channel, uint32_t row, uint32_t col) const;
+
+        /**
+         * 返回特定位置的元素，不做任何检查。四维张量的channel为 batch * channels 展开后的位置
+         * @param channel 通道
+         * @param row 行数
+         * @param col 列数
+         * @return 特定位置的元素
+         */
+        float &at_unchecked(uint32_t channel, uint32_t row, uint32_t col);
+
         /**
          * 填充张量
          * @param pads 填充张量的尺寸
@@ -215,14 +320,34 @@ namespace infer_neto {
         void Flatten();
 
         /**
-         * 对张量中的元素进行过滤
+         * 返回与当前张量共用数据的视图，只有形状不同，不复制数据，当前张量需要是连续的
+         * @param shapes 视图的形状，元素个数需要与当前张量相同
+         * @return 共用数据的视图
+         */
+        Tensor<float> View(const std::vector<uint32_t> &shapes) const;
+
+        /**
+         * 放弃自己的数据，改为与other共用数据，形状保持不变
+         * @param other 提供数据的张量，需要是连续的，元素个数需要与当前张量相同
+         */
+        void ShareData(const Tensor<float> &other);
+
+        /**
+         * 返回按行主序紧密排列的张量，当前张量已经连续时返回共用数据的视图，否则复制一份
+         * @return 连续的张量
+         */
+        Tensor<float> Contiguous() const;
+
+        /**
+         * 对张量中的元素进行过滤，filter以模板参数传入并在循环中内联，不经过std::function逐个调用
          * @param filter 过滤函数
          */
-        void Transform(const std::function<float(float)> &filter);
+        template<typename Filter>
+        void Transform(const Filter &filter);
         void NormalizeChannel(uint32_t channel, float mean, float std);
         void Scale(float factor);
         /**
-         * 返回数据的原始指针
+         * 返回数据的原始指针，张量需要是连续的
          * @return 返回数据的原始指针
          */
         float *raw_ptr();
@@ -245,17 +370,138 @@ namespace infer_neto {
         void Add(const Tensor<float> &bias);
         void AddScalar(float value);
 
+        /**
+         * 返回特定位置元素的地址，定义INFERNETO_TENSOR_CHECKS时检查越界。
+         * 内层循环可以在每个分块开始时取一次地址，再配合strides()按步长访问，省去逐元素计算偏移
+         * @param batch 通道，四维张量为 batch * channels 展开后的位置
+         * @param row 行数
+         * @param col 列数
+         * @return 元素的地址
+         */
         float * data_ptr(uint32_t batch, uint32_t row, uint32_t col) const;
+
+        /**
+         * 交换每个通道的行和列，返回与当前张量共用数据的视图，不复制数据
+         * 得到的视图一般不是连续的，需要连续数据时调用Contiguous
+         * @return 转置后的视图
+         */
         Tensor<float> Transpose() const;
+
+        /**
+         * 按dims重新排列张量的维度，返回与当前张量共用数据的视图，不复制数据
+         * 结果的第i维是当前张量的第dims[i]维，需要连续数据时调用Contiguous
+         * @param dims 维度的排列，长度与raw_shapes相同
+         * @return 重新排列维度后的视图
+         */
+        Tensor<float> Permute(const std::vector<uint32_t> &dims) const;
     private:
         std::vector<uint32_t> raw_shapes_;        // 存储形状
         std::vector<uint32_t> strides_;      // 存储步长
-        std::unique_ptr<float[]> data_;      // 张量数据
+        TensorData data_;                    // 张量数据，指向张量的第一个元素
         std::uint32_t size_{};
+        bool contiguous_ = true;             // 步长是否按行主序紧密排列，在形状或步长改变时更新
+        // 通过当前的分配器申请size个元素的数据，按kTensorAlignment对齐
+        static TensorData allocateData(uint32_t size, bool zero_fill);
         // 计算总步长
         void calculateStrides();
+        // 视图修改步长之后重新判断是否连续
+        void updateContiguous();
+        // 按步长计算 (channel, row, col) 处的元素相对data_的偏移，四维张量的channel为 batch * channels 展开后的位置
+        uint32_t elementOffset(uint32_t channel, uint32_t row, uint32_t col) const;
+        // 计算按行主序的第index个元素相对data_的偏移
+        uint32_t elementOffset(uint32_t index) const;
+        // 按行主序把所有元素紧密地复制到dst中
+        void packTo(float *dst) const;
     };
 
+    inline bool Tensor<float>::is_contiguous() const { return this->contiguous_; }
+
+    inline uint32_t Tensor<float>::elementOffset(uint32_t channel, uint32_t row, uint32_t col) const {
+        const size_t dims = raw_shapes_.size();
+        uint32_t offset = col * strides_[dims - 1];
+        if (dims >= 2) {
+            offset += row * strides_[dims - 2];
+        }
+        if (dims == 3) {
+            offset += channel * strides_[0];
+        } else if (dims == 4) {
+            // 四维张量的通道按 batch * channels 展开
+            offset += channel / raw_shapes_[1] * strides_[0] + channel % raw_shapes_[1] * strides_[1];
+        }
+        return offset;
+    }
+
+    inline uint32_t Tensor<float>::elementOffset(uint32_t index) const {
+        if (this->contiguous_) {
+            return index;
+        }
+        const uint32_t cols = this->raw_shapes_.back();
+        const uint32_t rows = this->raw_shapes_.size() >= 2 ? this->raw_shapes_[this->raw_shapes_.size() - 2] : 1;
+        return elementOffset(index / (rows * cols), index / cols % rows, index % cols);
+    }
+
+    inline float Tensor<float>::index_unchecked(uint32_t offset) const {
+        return this->data_.get()[elementOffset(offset)];
+    }
+
+    inline float &Tensor<float>::index_unchecked(uint32_t offset) {
+        return this->data_.get()[elementOffset(offset)];
+    }
+
+    inline float Tensor<float>::index(uint32_t offset) const {
+        TENSOR_CHECK(offset < size_) << "Tensor index out of bound!";
+        return index_unchecked(offset);
+    }
+
+    inline float &Tensor<float>::index(uint32_t offset) {
+        TENSOR_CHECK(offset < size_) << "Tensor index out of bound!";
+        return index_unchecked(offset);
+    }
+
+    inline float Tensor<float>::at_unchecked(uint32_t channel, uint32_t row, uint32_t col) const {
+        return this->data_.get()[elementOffset(channel, row, col)];
+    }
+
+    inline float &Tensor<float>::at_unchecked(uint32_t channel, uint32_t row, uint32_t col) {
+        return this->data_.get()[elementOffset(channel, row, col)];
+    }
+
+    inline float Tensor<float>::at(uint32_t channel, uint32_t row, uint32_t col) const {
+        TENSOR_CHECK(raw_shapes_.size() <= 3) << "Use Batch to select a sample of a four dimensional tensor.";
+        TENSOR_CHECK(row < this->rows() && col < this->cols() && channel < this->channels())
+            << "Tensor index out of bound!";
+        return at_unchecked(channel, row, col);
+    }
+
+    inline float &Tensor<float>::at(uint32_t channel, uint32_t row, uint32_t col) {
+        TENSOR_CHECK(raw_shapes_.size() <= 3) << "Use Batch to select a sample of a four dimensional tensor.";
+        TENSOR_CHECK(row < this->rows() && col < this->cols() && channel < this->channels())
+            << "Tensor index out of bound!";
+        return at_unchecked(channel, row, col);
+    }
+
+    inline float *Tensor<float>::data_ptr(uint32_t batch, uint32_t row, uint32_t col) const {
+        TENSOR_CHECK(row < this->rows() && col < this->cols() && batch < this->batch_size() * this->channels())
+            << "Tensor index out of bound!";
+        return this->data_.get() + elementOffset(batch, row, col);
+    }
+
+    template<typename Filter>
+    void Tensor<float>::Transform(const Filter &filter) {
+        CHECK(this->data_);
+        float *data = this->data_.get();
+        if (this->contiguous_) {
+            for (uint32_t i = 0; i < this->size_; ++i) {
+                data[i] = filter(data[i]);
+            }
+            return;
+        }
+        for (uint32_t i = 0; i < this->size_; ++i) {
+            float &value = data[elementOffset(i)];
+            value = filter(value);
+        }
+    }
+
     using ftensor = Tensor<float>;
     using sftensor = std::shared_ptr<Tensor<float>>;
 
@@ -2,9 +2,12 @@
 // Created by hanke on 2024/4/3.
 //
 #include <glog/logging.h>
+#include <algorithm>
 #include <valarray>
+#include "data/cpu/elementwise.hpp"
 #include "data/cpu/tensor.hpp"
 #include "data/cpu/tensor_util.hpp"
+#include "data/cpu/thread_pool.hpp"
 
 namespace infer_neto {
     bool TensorIsSame(const std::shared_ptr<Tensor<float>>& a,
@@ -14,6 +17,12 @@ namespace infer_neto {
         if (a->shapes() != b->shapes()) {
             return false;
         }
+        if (!a->is_contiguous() || !b->is_contiguous()) {
+            for (uint32_t i = 0; i < a->size(); i++) {
+                if (std::abs(a->index_unchecked(i) - b->index_unchecked(i)) > threshold) return false;
+            }
+            return true;
+        }
         float* a_data = a->data().get();
         float* b_data = b->data().get();
 
@@ -23,20 +32,160 @@ namespace infer_neto {
         return true;
     }
 
+    bool TensorShapeIsSame(const Tensor<float>& a, const Tensor<float>& b) {
+        return a.batch_size() == b.batch_size() && a.channels() == b.channels() && a.rows() == b.rows() &&
+               a.cols() == b.cols();
+    }
+
+    /// 按NumPy的规则从右对齐、补齐到四维之后的形状和步长，大小为1的维度步长记为0，广播时不移动
+    struct BroadcastLayout {
+        uint32_t shapes[4];
+        size_t strides[4];
+    };
+
+    static BroadcastLayout TensorBroadcastLayout(const Tensor<float>& tensor) {
+        const std::vector<uint32_t>& raw_shapes = tensor.raw_shapes();
+        const std::vector<uint32_t>& strides = tensor.strides();
+        const size_t offset = 4 - raw_shapes.size();
+        BroadcastLayout layout{};
+        for (size_t i = 0; i < 4; ++i) {
+            layout.shapes[i] = i < offset ? 1 : raw_shapes.at(i - offset);
+            layout.strides[i] = layout.shapes[i] == 1 ? 0 : strides.at(i - offset);
+        }
+        return layout;
+    }
+
+    static inline float BroadcastApply(BinaryOp op, float a, float b) {
+        switch (op) {
+            case BinaryOp::kAdd:
+                return a + b;
+            case BinaryOp::kSub:
+                return a - b;
+            case BinaryOp::kMul:
+                return a * b;
+            case BinaryOp::kDiv:
+                return a / b;
+        }
+        return a;
+    }
+
+    /**
+     * 计算一段长度为n的输出，三个操作数各自按步长移动，步长为0的操作数在这一段中保持不变。
+     * 常见的情况交给向量化的内核: 两边都连续时逐元素计算，一边步长为0时按标量广播计算
+     */
+    static void BroadcastRun(BinaryOp op, const float* a, size_t stride_a, const float* b, size_t stride_b,
+                             float* c, size_t stride_c, size_t n) {
+        const bool commutative = op == BinaryOp::kAdd || op == BinaryOp::kMul;
+        if (stride_c == 1 && stride_a == 1 && stride_b == 1) {
+            ElementwiseBinary(op, a, b, c, n);
+        } else if (stride_c == 1 && stride_a == 1 && stride_b == 0) {
+            ElementwiseScalar(op, a, *b, c, n);
+        } else if (stride_c == 1 && stride_a == 0 && stride_b == 1 && commutative) {
+            ElementwiseScalar(op, b, *a, c, n);
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                c[i * stride_c] = BroadcastApply(op, a[i * stride_a], b[i * stride_b]);
+            }
+        }
+    }
+
+    /**
+     * 带广播的逐元素二元运算，广播的操作数按步长0读取，不会展开成与输出相同大小的张量
+     */
+    static void TensorBroadcastBinary(BinaryOp op, const Tensor<float>& input1, const Tensor<float>& input2,
+                                      Tensor<float>& output) {
+        const BroadcastLayout a = TensorBroadcastLayout(input1);
+        const BroadcastLayout b = TensorBroadcastLayout(input2);
+        const BroadcastLayout c = TensorBroadcastLayout(output);
+        for (size_t d = 0; d < 4; ++d) {
+            CHECK((a.shapes[d] == c.shapes[d] || a.shapes[d] == 1) && (b.shapes[d] == c.shapes[d] || b.shapes[d] == 1) &&
+                  c.shapes[d] == std::max(a.shapes[d], b.shapes[d]))
+                            << "Output tensor must have the broadcast shape of the input tensors.";
+        }
+
+        // 去掉大小为1的维度，再把三个操作数在内存中都能连成一段的相邻维度合并，最内层一段越长越好
+        uint32_t shapes[4];
+        size_t strides_a[4], strides_b[4], strides_c[4];
+        size_t dims = 0;
+        for (size_t d = 0; d < 4; ++d) {
+            if (c.shapes[d] == 1) {
+                continue;
+            }
+            if (dims > 0 && strides_a[dims - 1] == a.strides[d] * c.shapes[d] &&
+                strides_b[dims - 1] == b.strides[d] * c.shapes[d] && strides_c[dims - 1] == c.strides[d] * c.shapes[d]) {
+                shapes[dims - 1] *= c.shapes[d];
+            } else {
+                shapes[dims] = c.shapes[d];
+                dims += 1;
+            }
+            strides_a[dims - 1] = a.strides[d];
+            strides_b[dims - 1] = b.strides[d];
+            strides_c[dims - 1] = c.strides[d];
+        }
+        if (dims == 0) {
+            shapes[0] = 1;
+            strides_a[0] = strides_b[0] = strides_c[0] = 1;
+            dims = 1;
+        }
+
+        const size_t inner = dims - 1;
+        const size_t run = shapes[inner];
+        size_t outer_count = 1;
+        for (size_t k = 0; k < inner; ++k) {
+            outer_count *= shapes[k];
+        }
+        const float* data_a = input1.data().get();
+        const float* data_b = input2.data().get();
+        float* data_c = output.data().get();
+        auto compute_run = [&](size_t outer) {
+            size_t offset_a = 0, offset_b = 0, offset_c = 0;
+            for (size_t k = inner; k-- > 0;) {
+                const size_t index = outer % shapes[k];
+                outer /= shapes[k];
+                offset_a += index * strides_a[k];
+                offset_b += index * strides_b[k];
+                offset_c += index * strides_c[k];
+            }
+            BroadcastRun(op, data_a + offset_a, strides_a[inner], data_b + offset_b, strides_b[inner],
+                         data_c + offset_c, strides_c[inner], run);
+        };
+
+        // 每一段较短而段数较多时按段并行，一段足够长时由内核自己并行
+        if (outer_count > 1 && run < kElementwiseParallelThreshold &&
+            outer_count * run >= kElementwiseParallelThreshold) {
+            ParallelFor(outer_count, ParallelGrain(run), [&compute_run](size_t begin, size_t end) {
+                for (size_t outer = begin; outer < end; ++outer) {
+                    compute_run(outer);
+                }
+            });
+        } else {
+            for (size_t outer = 0; outer < outer_count; ++outer) {
+                compute_run(outer);
+            }
+        }
+    }
+
+    std::vector<uint32_t> TensorBroadcastShapes(const Tensor<float>& tensor1, const Tensor<float>& tensor2) {
+        const std::vector<uint32_t>& shapes1 = tensor1.raw_shapes();
+        const std::vector<uint32_t>& shapes2 = tensor2.raw_shapes();
+        // 与Tensor::shapes()相同，至少补齐到 (channels, rows, cols) 三维
+        const size_t dims = std::max<size_t>(std::max(shapes1.size(), shapes2.size()), 3);
+        std::vector<uint32_t> shapes(dims);
+        for (size_t i = 0; i < dims; ++i) {
+            const uint32_t dim1 = i + shapes1.size() >= dims ? shapes1.at(i + shapes1.size() - dims) : 1;
+            const uint32_t dim2 = i + shapes2.size() >= dims ? shapes2.at(i + shapes2.size() - dims) : 1;
+            CHECK(dim1 == dim2 || dim1 == 1 || dim2 == 1)
+                            << "Tensors with dimension " << dim1 << " and " << dim2 << " can not be broadcast.";
+            shapes.at(i) = dim1 == 1 ? dim2 : dim1;
+        }
+        return shapes;
+    }
+
     void TensorElementAdd(const std::shared_ptr<Tensor<float>>& tensor1,
                           const std::shared_ptr<Tensor<float>>& tensor2,
                           const std::shared_ptr<Tensor<float>>& output_tensor) {
         CHECK(tensor1 != nullptr && tensor2 != nullptr && output_tensor != nullptr);
-        CHECK(tensor1->shapes() == tensor2->shapes()) << "Input tensors must have the same shapes.";
-        CHECK(tensor1->shapes() == output_tensor->shapes()) << "Output tensor must have the same shape as input tensors.";
-
-        const float* data1 = tensor1->data().get();
-        const float* data2 = tensor2->data().get();
-        float* output_data = output_tensor->data().get();
-
-        for (size_t i = 0; i < tensor1->size(); ++i) {
-            output_data[i] = data1[i] + data2[i];
-        }
+        TensorBroadcastBinary(BinaryOp::kAdd, *tensor1, *tensor2, *output_tensor);
     }
 
     void TensorElementMultiply(
@@ -44,28 +193,30 @@ namespace infer_neto {
             const std::shared_ptr<Tensor<float>>& tensor2,
             const std::shared_ptr<Tensor<float>>& output_tensor) {
         CHECK(tensor1 != nullptr && tensor2 != nullptr && output_tensor != nullptr);
-        CHECK(tensor1->shapes() == tensor2->shapes()) << "Input tensors must have the same shapes.";
-        CHECK(tensor1->shapes() == output_tensor->shapes()) << "Output tensor must have the same shape as input tensors.";
-
-        const float* data1 = tensor1->data().get();
-        const float* data2 = tensor2->data().get();
-        float* output_data = output_tensor->data().get();
+        TensorBroadcastBinary(BinaryOp::kMul, *tensor1, *tensor2, *output_tensor);
+    }
 
-        for (size_t i = 0; i < tensor1->size(); ++i) {
-            output_data[i] = data1[i] * data2[i];
+    void TensorElementSin(const std::shared_ptr<Tensor<float>>& tensor,
+                          const std::shared_ptr<Tensor<float>>& output_tensor) {
+        CHECK(tensor != nullptr && output_tensor != nullptr);
+        CHECK(TensorShapeIsSame(*tensor, *output_tensor)) << "Output tensor must have the same shape as input tensor.";
+        if (!tensor->is_contiguous() || !output_tensor->is_contiguous()) {
+            // 复制成连续的数据后再计算，保证与连续张量的近似结果一致
+            Tensor<float> result(*tensor);
+            ElementwiseUnary(UnaryOp::kSin, result.raw_ptr(), result.raw_ptr(), result.size());
+            for (uint32_t i = 0; i < result.size(); ++i) {
+                output_tensor->index_unchecked(i) = result.index_unchecked(i);
+            }
+            return;
         }
+        ElementwiseUnary(UnaryOp::kSin, tensor->data().get(), output_tensor->data().get(), tensor->size());
     }
 
     std::shared_ptr<Tensor<float>> TensorElementSin(
             const std::shared_ptr<Tensor<float>>& tensor) {
         CHECK(tensor != nullptr);
-        sftensor output_tensor = TensorCreate(tensor->shapes());
-        const float* data = tensor->data().get();
-        float* output_data = output_tensor->data().get();
-
-        for (size_t i = 0; i < tensor->size(); ++i) {
-            output_data[i] = std::sin(data[i]);
-        }
+        sftensor output_tensor = std::make_shared<Tensor<float>>(tensor->shapes(), kUninitialized);
+        TensorElementSin(tensor, output_tensor);
         return output_tensor;
     }
 
@@ -73,15 +224,9 @@ namespace infer_neto {
             const std::shared_ptr<Tensor<float>>& tensor1,
             const std::shared_ptr<Tensor<float>>& tensor2) {
         CHECK(tensor1 != nullptr && tensor2 != nullptr);
-        CHECK(tensor1->shapes() == tensor2->shapes()) << "Input tensors must have the same shapes.";
-        sftensor output_tensor = TensorCreate(tensor1->shapes());
-        const float* data1 = tensor1->data().get();
-        const float* data2 = tensor2->data().get();
-        float* output_data = output_tensor->data().get();
-
-        for (size_t i = 0; i < tensor1->size(); ++i) {
-            output_data[i] = data1[i] + data2[i];
-        }
+        sftensor output_tensor =
+                std::make_shared<Tensor<float>>(TensorBroadcastShapes(*tensor1, *tensor2), kUninitialized);
+        TensorElementAdd(tensor1, tensor2, output_tensor);
         return output_tensor;
     }
 
@@ -89,15 +234,9 @@ namespace infer_neto {
             const std::shared_ptr<Tensor<float>>& tensor1,
             const std::shared_ptr<Tensor<float>>& tensor2) {
         CHECK(tensor1 != nullptr && tensor2 != nullptr);
-        CHECK(tensor1->shapes() == tensor2->shapes()) << "Input tensors must have the same shapes.";
-        sftensor output_tensor = TensorCreate(tensor1->shapes());
-        const float* data1 = tensor1->data().get();
-        const float* data2 = tensor2->data().get();
-        float* output_data = output_tensor->data().get();
-
-        for (size_t i = 0; i < tensor1->size(); ++i) {
-            output_data[i] = data1[i] * data2[i];
-        }
+        sftensor output_tensor =
+                std::make_shared<Tensor<float>>(TensorBroadcastShapes(*tensor1, *tensor2), kUninitialized);
+        TensorElementMultiply(tensor1, tensor2, output_tensor);
         return output_tensor;
     }
 
@@ -116,15 +255,68 @@ namespace infer_neto {
 
     std::shared_ptr<Tensor<float>> TensorCreate(
             const std::vector<uint32_t>& shapes) {
-        CHECK(!shapes.empty() && shapes.size() <= 3);
+        CHECK(!shapes.empty() && shapes.size() <= 4);
         if (shapes.size() == 1) {
             return std::make_shared<Tensor<float>>(shapes.at(0));
         } else if (shapes.size() == 2) {
             return std::make_shared<Tensor<float>>(shapes.at(0), shapes.at(1));
-        } else {
+        } else if (shapes.size() == 3) {
             return std::make_shared<Tensor<float>>(shapes.at(0), shapes.at(1),
                                                    shapes.at(2));
+        } else {
+            return std::make_shared<Tensor<float>>(shapes);
+        }
+    }
+
+    std::vector<std::shared_ptr<Tensor<float>>> TensorCreateBatch(
+            uint32_t batch, const std::vector<uint32_t>& shapes, const TensorData& data) {
+        CHECK(!shapes.empty() && shapes.size() <= 3);
+        std::vector<uint32_t> batch_shapes{batch};
+        batch_shapes.insert(batch_shapes.end(), shapes.begin(), shapes.end());
+        Tensor<float> batch_tensor = data ? Tensor<float>(data, batch_shapes) : Tensor<float>(batch_shapes);
+        // 构造时开头为1的维度会被省略，这里重新设置形状以保留批次维度
+        batch_tensor.Reshape(batch_shapes);
+
+        std::vector<std::shared_ptr<Tensor<float>>> samples(batch);
+        for (uint32_t i = 0; i < batch; ++i) {
+            samples.at(i) = std::make_shared<Tensor<float>>(batch_tensor.Batch(i));
+        }
+        return samples;
+    }
+
+    size_t TensorBatchStride(const std::vector<std::shared_ptr<Tensor<float>>>& tensors,
+                             uint32_t begin, uint32_t count) {
+        if (count == 0 || begin + count > tensors.size()) {
+            return 0;
+        }
+        const std::shared_ptr<Tensor<float>>& first = tensors.at(begin);
+        if (first == nullptr || first->empty() || !first->is_contiguous()) {
+            return 0;
+        }
+        if (count == 1) {
+            return first->size();
+        }
+        const std::shared_ptr<Tensor<float>>& second = tensors.at(begin + 1);
+        if (second == nullptr || second->empty() || second->data().get() < first->data().get()) {
+            return 0;
+        }
+        const size_t stride = second->data().get() - first->data().get();
+        if (stride < first->size()) {
+            return 0;
+        }
+        for (uint32_t i = 1; i < count; ++i) {
+            const std::shared_ptr<Tensor<float>>& tensor = tensors.at(begin + i);
+            if (tensor == nullptr || tensor->empty() || !tensor->is_contiguous() ||
+                !TensorShapeIsSame(*tensor, *first) || tensor->data().get() != first->data().get() + i * stride) {
+                return 0;
+            }
+            // 分别申请的张量即使恰好等间隔也不能合并，需要是同一块数据上的视图
+            const TensorData& data = tensor->data();
+            if (data.owner_before(first->data()) || first->data().owner_before(data)) {
+                return 0;
+            }
         }
+        return stride;
     }
 
     std::shared_ptr<Tensor<float>> TensorClone(
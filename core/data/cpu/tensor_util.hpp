@@ -18,7 +18,23 @@ namespace infer_neto {
                       float threshold = 1e-5f);
 
 /**
- * 张量相加
+ * 比较张量的形状是否相同，不会申请内存
+ * @param a 输入张量1
+ * @param b 输入张量2
+ * @return 通道数、行数和列数都相同时返回true
+ */
+    bool TensorShapeIsSame(const Tensor<float>& a, const Tensor<float>& b);
+
+/**
+ * 按NumPy的规则计算两个张量广播之后的形状，维度从右对齐，对应维度相等或者其中一个为1
+ * @param tensor1 输入张量1
+ * @param tensor2 输入张量2
+ * @return 广播之后的形状，与Tensor::shapes()相同至少补齐到三维
+ */
+    std::vector<uint32_t> TensorBroadcastShapes(const Tensor<float>& tensor1, const Tensor<float>& tensor2);
+
+/**
+ * 张量相加，两个张量的形状不同时按NumPy的规则广播
  * @param tensor1 输入张量1
  * @param tensor2 输入张量2
  * @return 张量相加的结果
@@ -33,28 +49,36 @@ namespace infer_neto {
  * @return 张量相加的结果
  */
     std::shared_ptr<Tensor<float>> TensorElementSin(const std::shared_ptr<Tensor<float>>& tensor);
+
 /**
- * 张量相加
+ * 张量Sin
+ * @param tensor 输入张量
+ * @param output_tensor 输出张量
+ */
+    void TensorElementSin(const std::shared_ptr<Tensor<float>>& tensor,
+                          const std::shared_ptr<Tensor<float>>& output_tensor);
+/**
+ * 张量相加，两个张量的形状不同时按NumPy的规则广播，广播的张量不会展开复制
  * @param tensor1 输入张量1
  * @param tensor2 输入张量2
- * @param output_tensor 输出张量
+ * @param output_tensor 输出张量，形状需要与广播之后的形状相同
  */
     void TensorElementAdd(const std::shared_ptr<Tensor<float>>& tensor1,
                           const std::shared_ptr<Tensor<float>>& tensor2,
                           const std::shared_ptr<Tensor<float>>& output_tensor);
 
 /**
- * 矩阵点乘
+ * 矩阵点乘，两个张量的形状不同时按NumPy的规则广播，例如按通道缩放时第二个张量的形状为 (channels, 1, 1)
  * @param tensor1 输入张量1
  * @param tensor2 输入张量2
- * @param output_tensor 输出张量
+ * @param output_tensor 输出张量，形状需要与广播之后的形状相同
  */
     void TensorElementMultiply(const std::shared_ptr<Tensor<float>>& tensor1,
                                const std::shared_ptr<Tensor<float>>& tensor2,
                                const std::shared_ptr<Tensor<float>>& output_tensor);
 
     /**
-    * 张量相乘
+    * 张量相乘，两个张量的形状不同时按NumPy的规则广播
     * @param tensor1 输入张量1
     * @param tensor2 输入张量2
     * @return 张量相乘的结果
@@ -81,6 +105,27 @@ namespace infer_neto {
     std::shared_ptr<Tensor<float>> TensorCreate(
             const std::vector<uint32_t>& shapes);
 
+    /**
+    * 在同一块连续的内存中创建一个批次的张量，每个样本是这块内存上的视图
+    * @param batch 批次大小
+    * @param shapes 每个样本的形状
+    * @param data 共享的内存，为空时新申请一块内存；返回的张量持有它的引用计数，例如指向内存池中某个偏移的别名
+    * @return 依次排列的各个样本
+    */
+    std::vector<std::shared_ptr<Tensor<float>>> TensorCreateBatch(
+            uint32_t batch, const std::vector<uint32_t>& shapes, const TensorData& data = nullptr);
+
+    /**
+    * 如果tensors中从begin开始的count个张量形状相同、数据连续，并且在同一块内存中等间隔排列，
+    * 返回相邻两个张量起始位置之间的距离，一个批次可以据此合并为一次计算
+    * @param tensors 张量数组
+    * @param begin 起始位置
+    * @param count 张量的个数
+    * @return 相邻两个张量之间的距离，不满足条件时返回0
+    */
+    size_t TensorBatchStride(const std::vector<std::shared_ptr<Tensor<float>>>& tensors,
+                             uint32_t begin, uint32_t count);
+
     /**
      * 返回一个深拷贝后的张量
      * @param 待Clone的张量
@@ -0,0 +1,311 @@
+//
+// Created by hanke on 2024/5/17.
+//
+#include <algorithm>
+#include <cstdlib>
+#include <glog/logging.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "data/cpu/thread_pool.hpp"
+
+namespace infer_neto {
+    namespace {
+        /// 当前线程所属的线程池和在其中的序号，不在任何线程池中时为空
+        thread_local const ThreadPool *current_pool = nullptr;
+        thread_local uint32_t current_index = 0;
+        /// 当前线程正在执行ParallelFor的分块，嵌套的ParallelFor直接依次执行
+        thread_local bool in_parallel_region = false;
+
+        uint32_t DefaultIntraOpThreads() {
+            if (const char *env = std::getenv("INFERNETO_NUM_THREADS")) {
+                const long threads = std::strtol(env, nullptr, 10);
+                if (threads > 0) {
+                    return uint32_t(threads);
+                }
+                LOG(WARNING) << "Ignore invalid INFERNETO_NUM_THREADS: " << env;
+            }
+            return std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        /**
+         * 把当前线程绑定到进程可用的第index个CPU上，超过CPU数量时循环使用
+         */
+        void PinCurrentThread(uint32_t index) {
+#ifdef __linux__
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+                return;
+            }
+            const uint32_t position = index % uint32_t(CPU_COUNT(&allowed));
+            uint32_t seen = 0;
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (!CPU_ISSET(cpu, &allowed)) {
+                    continue;
+                }
+                if (seen++ == position) {
+                    cpu_set_t target;
+                    CPU_ZERO(&target);
+                    CPU_SET(cpu, &target);
+                    LOG_IF(WARNING, pthread_setaffinity_np(pthread_self(), sizeof(target), &target) != 0)
+                                    << "Failed to pin the intra-op thread " << index << " to cpu " << cpu;
+                    return;
+                }
+            }
+#endif
+        }
+
+        /**
+         * 节点内并行的线程池，一次只执行一个ParallelFor，分块按线程序号静态分配
+         */
+        class IntraOpPool {
+        public:
+            IntraOpPool(uint32_t threads, bool pin_threads) : threads_(threads) {
+                for (uint32_t i = 1; i < threads; ++i) {
+                    workers_.emplace_back([this, i, pin_threads]() {
+                        if (pin_threads) {
+                            PinCurrentThread(i);
+                        }
+                        this->WorkerLoop(i);
+                    });
+                }
+            }
+
+            ~IntraOpPool() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stop_ = true;
+                }
+                start_.notify_all();
+                for (std::thread &worker: workers_) {
+                    worker.join();
+                }
+            }
+
+            uint32_t size() const {
+                return threads_;
+            }
+
+            void Run(size_t n, size_t grain, void (*body)(const void *, size_t, size_t), const void *context) {
+                const size_t chunks = std::min<size_t>(threads_, (n + grain - 1) / grain);
+                if (chunks <= 1 || in_parallel_region || busy_.exchange(true, std::memory_order_acquire)) {
+                    body(context, 0, n);
+                    return;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    body_ = body;
+                    context_ = context;
+                    n_ = n;
+                    chunks_ = chunks;
+                    unfinished_ = uint32_t(chunks - 1);
+                    generation_ += 1;
+                }
+                start_.notify_all();
+
+                in_parallel_region = true;
+                body(context, 0, n / chunks);
+                in_parallel_region = false;
+
+                std::unique_lock<std::mutex> lock(mutex_);
+                done_.wait(lock, [this]() { return unfinished_ == 0; });
+                lock.unlock();
+                busy_.store(false, std::memory_order_release);
+            }
+
+        private:
+            void WorkerLoop(uint32_t index) {
+                in_parallel_region = true;
+                uint64_t seen = 0;
+                std::unique_lock<std::mutex> lock(mutex_);
+                while (true) {
+                    start_.wait(lock, [this, seen]() { return stop_ || generation_ != seen; });
+                    if (stop_) {
+                        return;
+                    }
+                    seen = generation_;
+                    if (index >= chunks_) {
+                        continue;
+                    }
+                    const size_t begin = n_ * index / chunks_;
+                    const size_t end = n_ * (index + 1) / chunks_;
+                    const auto body = body_;
+                    const void *context = context_;
+                    lock.unlock();
+                    body(context, begin, end);
+                    lock.lock();
+                    unfinished_ -= 1;
+                    if (unfinished_ == 0) {
+                        done_.notify_one();
+                    }
+                }
+            }
+
+            const uint32_t threads_;
+            std::vector<std::thread> workers_;
+            std::atomic<bool> busy_{false};  /// 是否有调用方正在使用线程池
+
+            std::mutex mutex_;
+            std::condition_variable start_;
+            std::condition_variable done_;
+            bool stop_ = false;
+            uint64_t generation_ = 0;  /// 每发布一次任务加一，线程据此判断是否有新任务
+            void (*body_)(const void *, size_t, size_t) = nullptr;
+            const void *context_ = nullptr;
+            size_t n_ = 0;
+            size_t chunks_ = 0;
+            uint32_t unfinished_ = 0;  /// 尚未完成的线程池分块数量
+        };
+
+        /**
+         * 当前的节点内线程池。ParallelFor只读取原子的裸指针，不经过shared_ptr的原子操作使用的全局锁；
+         * 线程池只在SetIntraOpThreads中替换和释放，此时不能有推理在进行
+         */
+        struct IntraOpPoolHolder {
+            IntraOpPoolHolder() : owner(std::make_unique<IntraOpPool>(DefaultIntraOpThreads(), false)) {
+                current.store(owner.get(), std::memory_order_release);
+            }
+
+            std::mutex mutex;                     /// 串行化SetIntraOpThreads的调用
+            std::unique_ptr<IntraOpPool> owner;   /// 持有当前的线程池，由mutex保护
+            std::atomic<IntraOpPool *> current{nullptr};
+        };
+
+        IntraOpPoolHolder &IntraOpPoolInstance() {
+            static IntraOpPoolHolder holder;
+            return holder;
+        }
+
+        IntraOpPool *CurrentIntraOpPool() {
+            return IntraOpPoolInstance().current.load(std::memory_order_acquire);
+        }
+    }
+
+    void SetIntraOpThreads(uint32_t threads, bool pin_threads) {
+        if (threads == 0) {
+            threads = DefaultIntraOpThreads();
+        }
+        IntraOpPoolHolder &holder = IntraOpPoolInstance();
+        std::unique_ptr<IntraOpPool> pool = std::make_unique<IntraOpPool>(threads, pin_threads);
+        std::lock_guard<std::mutex> lock(holder.mutex);
+        holder.current.store(pool.get(), std::memory_order_release);
+        // 原来的线程池在离开作用域时等待它的线程退出
+        holder.owner.swap(pool);
+    }
+
+    uint32_t IntraOpThreads() {
+        return CurrentIntraOpPool()->size();
+    }
+
+    void ParallelForRange(size_t n, size_t grain, void (*body)(const void *, size_t, size_t), const void *context) {
+        CHECK(body != nullptr);
+        if (n == 0) {
+            return;
+        }
+        grain = std::max<size_t>(grain, 1);
+        if (n <= grain || in_parallel_region) {
+            body(context, 0, n);
+            return;
+        }
+        CurrentIntraOpPool()->Run(n, grain, body, context);
+    }
+
+    ThreadPool::ThreadPool(uint32_t threads, const std::function<void(uint32_t)> &on_start) {
+        CHECK(threads > 0) << "The thread pool needs at least one thread";
+        for (uint32_t i = 0; i < threads; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        for (uint32_t i = 0; i < threads; ++i) {
+            threads_.emplace_back([this, i, on_start]() { this->Run(i, on_start); });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wakeup_.notify_all();
+        for (std::thread &thread: threads_) {
+            thread.join();
+        }
+    }
+
+    void ThreadPool::Submit(Task task) {
+        CHECK(task != nullptr);
+        const uint32_t index = current_pool == this ? current_index
+                                                    : next_worker_.fetch_add(1, std::memory_order_relaxed) %
+                                                      uint32_t(workers_.size());
+        // 先计数再入队，取出任务时计数不会减到0以下；计数在mutex_内增加，等待的线程不会错过唤醒
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.fetch_add(1, std::memory_order_relaxed);
+        }
+        {
+            Worker &worker = *workers_.at(index);
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.tasks.push_back(std::move(task));
+        }
+        wakeup_.notify_one();
+    }
+
+    uint32_t ThreadPool::size() const {
+        return uint32_t(workers_.size());
+    }
+
+    bool ThreadPool::PopTask(uint32_t index, Task &task) {
+        {
+            Worker &worker = *workers_.at(index);
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.tasks.size() > worker.head) {
+                task = std::move(worker.tasks.back());
+                worker.tasks.pop_back();
+                if (worker.tasks.size() == worker.head) {
+                    // clear保留容量，之后的任务不再申请内存
+                    worker.tasks.clear();
+                    worker.head = 0;
+                }
+                return true;
+            }
+        }
+        for (uint32_t offset = 1; offset < workers_.size(); ++offset) {
+            Worker &victim = *workers_.at((index + offset) % workers_.size());
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.size() > victim.head) {
+                task = std::move(victim.tasks.at(victim.head));
+                victim.head += 1;
+                if (victim.tasks.size() == victim.head) {
+                    victim.tasks.clear();
+                    victim.head = 0;
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::Run(uint32_t index, const std::function<void(uint32_t)> &on_start) {
+        current_pool = this;
+        current_index = index;
+        if (on_start) {
+            on_start(index);
+        }
+        Task task;
+        while (true) {
+            if (PopTask(index, task)) {
+                pending_.fetch_sub(1, std::memory_order_relaxed);
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            wakeup_.wait(lock, [this]() { return pending_.load(std::memory_order_relaxed) > 0 || stop_; });
+            if (stop_ && pending_.load(std::memory_order_relaxed) == 0) {
+                break;
+            }
+        }
+        current_pool = nullptr;
+    }
+}
@@ -0,0 +1,129 @@
+//
+// Created by hanke on 2024/5/17.
+//
+
+#ifndef INFERNETO_THREAD_POOL_HPP
+#define INFERNETO_THREAD_POOL_HPP
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace infer_neto {
+    /**
+     * 任务窃取的线程池，每个线程有自己的任务队列。
+     * 线程内提交的任务放入自己队列的尾部并优先从尾部取出，刚产生的数据还在缓存中；
+     * 自己的队列为空时从其他线程队列的头部窃取任务
+     */
+    class ThreadPool {
+    public:
+        using Task = std::function<void()>;
+
+        /**
+         * 创建线程池
+         * @param threads 线程数量，至少为1
+         * @param on_start 每个线程启动时调用一次，参数为线程的序号，可以为空
+         */
+        explicit ThreadPool(uint32_t threads, const std::function<void(uint32_t)> &on_start = nullptr);
+
+        /**
+         * 等待已经提交的任务全部执行完毕后退出所有线程
+         */
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        /**
+         * 提交一个任务，在池中的线程里调用时放入当前线程的队列，否则依次放入各线程的队列
+         * 队列的容量在预热之后不再增长，捕获内容不超过两个指针的任务不会申请堆内存
+         * @param task 需要执行的任务
+         */
+        void Submit(Task task);
+
+        /**
+         * 返回线程的数量
+         * @return 线程的数量
+         */
+        uint32_t size() const;
+
+    private:
+        /// 一个线程的任务队列，尾部由所属线程存取，头部供其他线程窃取
+        struct Worker {
+            std::mutex mutex;
+            std::vector<Task> tasks;
+            size_t head = 0;
+        };
+
+        bool PopTask(uint32_t index, Task &task);
+
+        void Run(uint32_t index, const std::function<void(uint32_t)> &on_start);
+
+        std::vector<std::unique_ptr<Worker>> workers_;
+        std::vector<std::thread> threads_;
+
+        std::mutex mutex_;
+        std::condition_variable wakeup_;
+        std::atomic<size_t> pending_{0};  /// 已提交尚未取出的任务数量
+        bool stop_ = false;
+        std::atomic<uint32_t> next_worker_{0};
+    };
+
+    /// 节点内并行时每个分块至少需要的计算量，更小的任务唤醒线程的代价比计算本身更大
+    constexpr size_t kParallelMinWork = size_t(1) << 15;
+
+    /**
+     * 设置节点内并行使用的线程数，所有算子共用同一个线程池，需要在没有推理进行时调用
+     * 默认的线程数取环境变量INFERNETO_NUM_THREADS，没有设置时为硬件线程数
+     * @param threads 线程数，包括调用ParallelFor的线程，为0时恢复默认值
+     * @param pin_threads 为true时把线程池中的线程依次绑定到进程可用的CPU上，调用线程不绑定，
+     * 因此第一个可用的CPU留给调用线程
+     */
+    void SetIntraOpThreads(uint32_t threads, bool pin_threads = false);
+
+    /**
+     * 返回节点内并行使用的线程数
+     * @return 线程数，包括调用ParallelFor的线程
+     */
+    uint32_t IntraOpThreads();
+
+    /**
+     * 根据每一项的计算量返回ParallelFor的最小分块
+     * @param work_per_item 每一项的计算量，大致为读写或乘加的次数
+     * @return 每个分块至少包含的项数
+     */
+    inline size_t ParallelGrain(size_t work_per_item) {
+        return work_per_item >= kParallelMinWork ? 1 : kParallelMinWork / (work_per_item == 0 ? 1 : work_per_item);
+    }
+
+    /**
+     * ParallelFor的实现，body(context, begin, end)处理 [begin, end) 中的项
+     */
+    void ParallelForRange(size_t n, size_t grain, void (*body)(const void *, size_t, size_t), const void *context);
+
+    /**
+     * 把 [0, n) 平均分成不超过线程数的连续分块，调用线程执行第一块，其余分块交给节点内的线程池。
+     * 同样的n总是得到同样的划分，每个线程处理的数据在多次推理之间保持不变；
+     * 在分块内再次调用，或者线程池正被其他线程使用时直接在当前线程中依次执行。不申请堆内存
+     * @param n 项的数量
+     * @param grain 每个分块至少包含的项数
+     * @param kernel 调用形式为 kernel(begin, end)，不同分块之间不能写同一块内存
+     */
+    template<typename Kernel>
+    void ParallelFor(size_t n, size_t grain, const Kernel &kernel) {
+        if (n == 0) {
+            return;
+        }
+        ParallelForRange(n, grain, [](const void *context, size_t begin, size_t end) {
+            (*static_cast<const Kernel *>(context))(begin, end);
+        }, &kernel);
+    }
+}
+
+#endif //INFERNETO_THREAD_POOL_HPP
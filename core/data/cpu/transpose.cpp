@@ -0,0 +1,94 @@
+//
+// Created by hanke on 2024/5/16.
+//
+#include <immintrin.h> // AVX指令集
+#include "data/cpu/transpose.hpp"
+
+namespace infer_neto {
+    /// 递归切分的终止大小，两块 32x32 的单精度矩阵共8KB，可以同时留在L1缓存中
+    constexpr uint32_t kTransposeBlock = 32;
+    constexpr uint32_t kTransposeTile = 8;
+
+#if defined(__AVX__)
+    static inline void Transpose8x8(const float *src, size_t lds, float *dst, size_t ldd) {
+        const __m256 r0 = _mm256_loadu_ps(src);
+        const __m256 r1 = _mm256_loadu_ps(src + lds);
+        const __m256 r2 = _mm256_loadu_ps(src + 2 * lds);
+        const __m256 r3 = _mm256_loadu_ps(src + 3 * lds);
+        const __m256 r4 = _mm256_loadu_ps(src + 4 * lds);
+        const __m256 r5 = _mm256_loadu_ps(src + 5 * lds);
+        const __m256 r6 = _mm256_loadu_ps(src + 6 * lds);
+        const __m256 r7 = _mm256_loadu_ps(src + 7 * lds);
+
+        // 先两两交错相邻的行，再交错成四行一组，最后交换128位的两半
+        const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+        const __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+        const __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+        const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+        const __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+        const __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+        const __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+        const __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+        const __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+        _mm256_storeu_ps(dst, _mm256_permute2f128_ps(s0, s4, 0x20));
+        _mm256_storeu_ps(dst + ldd, _mm256_permute2f128_ps(s1, s5, 0x20));
+        _mm256_storeu_ps(dst + 2 * ldd, _mm256_permute2f128_ps(s2, s6, 0x20));
+        _mm256_storeu_ps(dst + 3 * ldd, _mm256_permute2f128_ps(s3, s7, 0x20));
+        _mm256_storeu_ps(dst + 4 * ldd, _mm256_permute2f128_ps(s0, s4, 0x31));
+        _mm256_storeu_ps(dst + 5 * ldd, _mm256_permute2f128_ps(s1, s5, 0x31));
+        _mm256_storeu_ps(dst + 6 * ldd, _mm256_permute2f128_ps(s2, s6, 0x31));
+        _mm256_storeu_ps(dst + 7 * ldd, _mm256_permute2f128_ps(s3, s7, 0x31));
+    }
+#else
+    static inline void Transpose8x8(const float *src, size_t lds, float *dst, size_t ldd) {
+        for (uint32_t i = 0; i < kTransposeTile; ++i) {
+            for (uint32_t j = 0; j < kTransposeTile; ++j) {
+                dst[j * ldd + i] = src[i * lds + j];
+            }
+        }
+    }
+#endif
+
+    static void TransposeKernel(uint32_t rows, uint32_t cols, const float *src, size_t lds, float *dst, size_t ldd) {
+        const uint32_t full_rows = rows / kTransposeTile * kTransposeTile;
+        const uint32_t full_cols = cols / kTransposeTile * kTransposeTile;
+        for (uint32_t i = 0; i < full_rows; i += kTransposeTile) {
+            for (uint32_t j = 0; j < full_cols; j += kTransposeTile) {
+                Transpose8x8(src + i * lds + j, lds, dst + j * ldd + i, ldd);
+            }
+        }
+        // 不足8的边缘逐个元素处理
+        for (uint32_t i = 0; i < rows; ++i) {
+            const uint32_t start = i < full_rows ? full_cols : 0;
+            for (uint32_t j = start; j < cols; ++j) {
+                dst[j * ldd + i] = src[i * lds + j];
+            }
+        }
+    }
+
+    void TransposeMatrix(uint32_t rows, uint32_t cols, const float *src, size_t lds, float *dst, size_t ldd) {
+        if (rows <= kTransposeBlock && cols <= kTransposeBlock) {
+            TransposeKernel(rows, cols, src, lds, dst, ldd);
+            return;
+        }
+        // 沿较长的一边对半切分，切分点对齐到8x8分块
+        if (rows >= cols) {
+            const uint32_t half = (rows / 2 + kTransposeTile - 1) / kTransposeTile * kTransposeTile;
+            TransposeMatrix(half, cols, src, lds, dst, ldd);
+            TransposeMatrix(rows - half, cols, src + half * lds, lds, dst + half, ldd);
+        } else {
+            const uint32_t half = (cols / 2 + kTransposeTile - 1) / kTransposeTile * kTransposeTile;
+            TransposeMatrix(rows, half, src, lds, dst, ldd);
+            TransposeMatrix(rows, cols - half, src + half, lds, dst + half * ldd, ldd);
+        }
+    }
+}
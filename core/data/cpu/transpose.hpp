@@ -0,0 +1,24 @@
+//
+// Created by hanke on 2024/5/16.
+//
+
+#ifndef INFERNETO_TRANSPOSE_HPP
+#define INFERNETO_TRANSPOSE_HPP
+#include <cstdint>
+#include <cstddef>
+
+namespace infer_neto {
+    /**
+     * 矩阵转置 dst[j][i] = src[i][j]，按行主序存储
+     * 递归地沿较长的一边对半切分直到分块能放进L1缓存，再以8x8的AVX分块完成转置，不依赖具体的缓存大小
+     * @param rows 矩阵src的行数，也是dst的列数
+     * @param cols 矩阵src的列数，也是dst的行数
+     * @param src 输入矩阵
+     * @param lds 输入矩阵相邻两行之间的距离
+     * @param dst 输出矩阵，不能与src重叠
+     * @param ldd 输出矩阵相邻两行之间的距离
+     */
+    void TransposeMatrix(uint32_t rows, uint32_t cols, const float *src, size_t lds, float *dst, size_t ldd);
+}
+
+#endif //INFERNETO_TRANSPOSE_HPP
@@ -0,0 +1,371 @@
+//
+// Created by hanke on 2024/5/9.
+//
+#include <glog/logging.h>
+#include <algorithm>
+#include <vector>
+#include <immintrin.h> // AVX指令集
+#include "data/cpu/winograd.hpp"
+#include "data/cpu/gemm.hpp"
+#include "data/cpu/thread_pool.hpp"
+
+namespace infer_neto {
+    static uint32_t RoundUpPack(uint32_t value) {
+        return (value + kWinogradPack - 1) / kWinogradPack * kWinogradPack;
+    }
+
+    /// 8个通道组成的向量，输入输出变换都以它为单位计算
+    struct Vec8 {
+#if defined(__AVX__)
+        __m256 value;
+#else
+        float value[kWinogradPack];
+#endif
+    };
+
+#if defined(__AVX__)
+    static inline Vec8 Load8(const float *ptr) { return {_mm256_loadu_ps(ptr)}; }
+
+    static inline void Store8(float *ptr, const Vec8 &v) { _mm256_storeu_ps(ptr, v.value); }
+
+    static inline Vec8 operator+(const Vec8 &a, const Vec8 &b) { return {_mm256_add_ps(a.value, b.value)}; }
+
+    static inline Vec8 operator-(const Vec8 &a, const Vec8 &b) { return {_mm256_sub_ps(a.value, b.value)}; }
+
+    static inline Vec8 operator*(const Vec8 &a, float s) { return {_mm256_mul_ps(a.value, _mm256_set1_ps(s))}; }
+
+    static inline Vec8 Relu(const Vec8 &a) { return {_mm256_max_ps(a.value, _mm256_setzero_ps())}; }
+#else
+    static inline Vec8 Load8(const float *ptr) {
+        Vec8 v;
+        std::copy(ptr, ptr + kWinogradPack, v.value);
+        return v;
+    }
+
+    static inline void Store8(float *ptr, const Vec8 &v) { std::copy(v.value, v.value + kWinogradPack, ptr); }
+
+    static inline Vec8 operator+(const Vec8 &a, const Vec8 &b) {
+        Vec8 v;
+        for (uint32_t i = 0; i < kWinogradPack; ++i) v.value[i] = a.value[i] + b.value[i];
+        return v;
+    }
+
+    static inline Vec8 operator-(const Vec8 &a, const Vec8 &b) {
+        Vec8 v;
+        for (uint32_t i = 0; i < kWinogradPack; ++i) v.value[i] = a.value[i] - b.value[i];
+        return v;
+    }
+
+    static inline Vec8 operator*(const Vec8 &a, float s) {
+        Vec8 v;
+        for (uint32_t i = 0; i < kWinogradPack; ++i) v.value[i] = a.value[i] * s;
+        return v;
+    }
+
+    static inline Vec8 Relu(const Vec8 &a) {
+        Vec8 v;
+        for (uint32_t i = 0; i < kWinogradPack; ++i) v.value[i] = std::max(a.value[i], 0.f);
+        return v;
+    }
+#endif
+
+    /**
+     * 输入变换 V = B^T * d * B
+     * 先对每一列做一维变换，再对每一行做一维变换
+     */
+    template<uint32_t Tile>
+    static inline void InputTransform(const Vec8 (&d)[Tile + 2][Tile + 2], Vec8 (&v)[Tile + 2][Tile + 2]) {
+        constexpr uint32_t alpha = Tile + 2;
+        Vec8 t[alpha][alpha];
+        if constexpr (Tile == 2) {
+            for (uint32_t j = 0; j < alpha; ++j) {
+                t[0][j] = d[0][j] - d[2][j];
+                t[1][j] = d[1][j] + d[2][j];
+                t[2][j] = d[2][j] - d[1][j];
+                t[3][j] = d[1][j] - d[3][j];
+            }
+            for (uint32_t i = 0; i < alpha; ++i) {
+                v[i][0] = t[i][0] - t[i][2];
+                v[i][1] = t[i][1] + t[i][2];
+                v[i][2] = t[i][2] - t[i][1];
+                v[i][3] = t[i][1] - t[i][3];
+            }
+        } else {
+            for (uint32_t j = 0; j < alpha; ++j) {
+                t[0][j] = d[0][j] * 4.f - d[2][j] * 5.f + d[4][j];
+                t[1][j] = d[3][j] + d[4][j] - (d[1][j] + d[2][j]) * 4.f;
+                t[2][j] = d[4][j] - d[3][j] + (d[1][j] - d[2][j]) * 4.f;
+                t[3][j] = d[4][j] - d[2][j] + (d[3][j] - d[1][j]) * 2.f;
+                t[4][j] = d[4][j] - d[2][j] + (d[1][j] - d[3][j]) * 2.f;
+                t[5][j] = d[1][j] * 4.f - d[3][j] * 5.f + d[5][j];
+            }
+            for (uint32_t i = 0; i < alpha; ++i) {
+                v[i][0] = t[i][0] * 4.f - t[i][2] * 5.f + t[i][4];
+                v[i][1] = t[i][3] + t[i][4] - (t[i][1] + t[i][2]) * 4.f;
+                v[i][2] = t[i][4] - t[i][3] + (t[i][1] - t[i][2]) * 4.f;
+                v[i][3] = t[i][4] - t[i][2] + (t[i][3] - t[i][1]) * 2.f;
+                v[i][4] = t[i][4] - t[i][2] + (t[i][1] - t[i][3]) * 2.f;
+                v[i][5] = t[i][1] * 4.f - t[i][3] * 5.f + t[i][5];
+            }
+        }
+    }
+
+    /**
+     * 输出变换 Y = A^T * m * A
+     */
+    template<uint32_t Tile>
+    static inline void OutputTransform(const Vec8 (&m)[Tile + 2][Tile + 2], Vec8 (&y)[Tile][Tile]) {
+        constexpr uint32_t alpha = Tile + 2;
+        Vec8 t[Tile][alpha];
+        if constexpr (Tile == 2) {
+            for (uint32_t j = 0; j < alpha; ++j) {
+                t[0][j] = m[0][j] + m[1][j] + m[2][j];
+                t[1][j] = m[1][j] - m[2][j] - m[3][j];
+            }
+            for (uint32_t i = 0; i < Tile; ++i) {
+                y[i][0] = t[i][0] + t[i][1] + t[i][2];
+                y[i][1] = t[i][1] - t[i][2] - t[i][3];
+            }
+        } else {
+            for (uint32_t j = 0; j < alpha; ++j) {
+                const Vec8 sum12 = m[1][j] + m[2][j];
+                const Vec8 diff12 = m[1][j] - m[2][j];
+                const Vec8 sum34 = m[3][j] + m[4][j];
+                const Vec8 diff34 = m[3][j] - m[4][j];
+                t[0][j] = m[0][j] + sum12 + sum34;
+                t[1][j] = diff12 + diff34 * 2.f;
+                t[2][j] = sum12 + sum34 * 4.f;
+                t[3][j] = diff12 + diff34 * 8.f + m[5][j];
+            }
+            for (uint32_t i = 0; i < Tile; ++i) {
+                const Vec8 sum12 = t[i][1] + t[i][2];
+                const Vec8 diff12 = t[i][1] - t[i][2];
+                const Vec8 sum34 = t[i][3] + t[i][4];
+                const Vec8 diff34 = t[i][3] - t[i][4];
+                y[i][0] = t[i][0] + sum12 + sum34;
+                y[i][1] = diff12 + diff34 * 2.f;
+                y[i][2] = sum12 + sum34 * 4.f;
+                y[i][3] = diff12 + diff34 * 8.f + t[i][5];
+            }
+        }
+    }
+
+    size_t WinogradKernelSize(uint32_t out_c, uint32_t in_c, uint32_t output_tile) {
+        CHECK(WinogradTileSupported(output_tile)) << "Unsupported winograd output tile: " << output_tile;
+        const size_t alpha = output_tile + 2;
+        return alpha * alpha * RoundUpPack(in_c) * RoundUpPack(out_c);
+    }
+
+    void WinogradTransformKernel(const float *kernel, uint32_t out_c, uint32_t in_c, uint32_t output_tile,
+                                 float *transformed) {
+        CHECK(kernel != nullptr && transformed != nullptr);
+        CHECK(WinogradTileSupported(output_tile)) << "Unsupported winograd output tile: " << output_tile;
+        static const float g2[4][3] = {{1.f, 0.f, 0.f},
+                                       {0.5f, 0.5f, 0.5f},
+                                       {0.5f, -0.5f, 0.5f},
+                                       {0.f, 0.f, 1.f}};
+        static const float g4[6][3] = {{1.f / 4, 0.f, 0.f},
+                                       {-1.f / 6, -1.f / 6, -1.f / 6},
+                                       {-1.f / 6, 1.f / 6, -1.f / 6},
+                                       {1.f / 24, 1.f / 12, 1.f / 6},
+                                       {1.f / 24, -1.f / 12, 1.f / 6},
+                                       {0.f, 0.f, 1.f}};
+        const uint32_t alpha = output_tile + 2;
+        const float *g = output_tile == 2 ? &g2[0][0] : &g4[0][0];
+        const uint32_t in_c_pack = RoundUpPack(in_c);
+        const uint32_t out_c_pack = RoundUpPack(out_c);
+        std::fill(transformed, transformed + WinogradKernelSize(out_c, in_c, output_tile), 0.f);
+
+        std::vector<float> tmp(alpha * 3);
+        for (uint32_t oc = 0; oc < out_c; ++oc) {
+            for (uint32_t ic = 0; ic < in_c; ++ic) {
+                const float *k = kernel + (oc * in_c + ic) * 9;
+                // tmp = G * g
+                for (uint32_t i = 0; i < alpha; ++i) {
+                    for (uint32_t j = 0; j < 3; ++j) {
+                        tmp[i * 3 + j] = g[i * 3] * k[j] + g[i * 3 + 1] * k[3 + j] + g[i * 3 + 2] * k[6 + j];
+                    }
+                }
+                // U = tmp * G^T
+                for (uint32_t i = 0; i < alpha; ++i) {
+                    for (uint32_t j = 0; j < alpha; ++j) {
+                        const float value = tmp[i * 3] * g[j * 3] + tmp[i * 3 + 1] * g[j * 3 + 1] +
+                                            tmp[i * 3 + 2] * g[j * 3 + 2];
+                        transformed[((i * alpha + j) * in_c_pack + ic) * out_c_pack + oc] = value;
+                    }
+                }
+            }
+        }
+    }
+
+    template<uint32_t Tile>
+    static void WinogradConv3x3Impl(const float *input, uint32_t in_c, uint32_t input_h, uint32_t input_w,
+                                    uint32_t padding_h, uint32_t padding_w, const float *transformed_kernel,
+                                    uint32_t out_c, const float *bias, float *output,
+                                    const float *residual, bool relu) {
+        constexpr uint32_t alpha = Tile + 2;
+        constexpr uint32_t pack = kWinogradPack;
+        const uint32_t output_h = input_h + 2 * padding_h - 2;
+        const uint32_t output_w = input_w + 2 * padding_w - 2;
+        const uint32_t tiles_h = (output_h + Tile - 1) / Tile;
+        const uint32_t tiles_w = (output_w + Tile - 1) / Tile;
+        const uint32_t tiles = tiles_h * tiles_w;
+        const uint32_t in_c_pack = RoundUpPack(in_c);
+        const uint32_t out_c_pack = RoundUpPack(out_c);
+        // 补齐到完整的块，越界的位置视为填充
+        const uint32_t padded_h = tiles_h * Tile + 2;
+        const uint32_t padded_w = tiles_w * Tile + 2;
+
+        // 工作区按调用线程缓存，避免每次调用都重新申请内存；
+        // 线程池中的线程看到的是自己的thread_local变量，分块内只能通过下面取出的指针访问工作区
+        thread_local std::vector<float> packed_input;
+        thread_local std::vector<float> transformed_input;
+        thread_local std::vector<float> transformed_output;
+        thread_local std::vector<float> bias_pack;
+        const size_t packed_input_size = size_t(in_c_pack) * padded_h * padded_w;
+        const size_t transformed_input_size = size_t(alpha) * alpha * tiles * in_c_pack;
+        const size_t transformed_output_size = size_t(alpha) * alpha * tiles * out_c_pack;
+        if (packed_input.size() < packed_input_size) {
+            packed_input.resize(packed_input_size);
+        }
+        if (transformed_input.size() < transformed_input_size) {
+            transformed_input.resize(transformed_input_size);
+        }
+        if (transformed_output.size() < transformed_output_size) {
+            transformed_output.resize(transformed_output_size);
+        }
+        bias_pack.assign(out_c_pack, 0.f);
+        if (bias != nullptr) {
+            std::copy(bias, bias + out_c, bias_pack.begin());
+        }
+        const float *bias_data = bias_pack.data();
+
+        // 输入补零并按8个通道交错排布，排布为 [in_c / 8, padded_h, padded_w, 8]，每8个通道一组分给多个线程
+        float *packed = packed_input.data();
+        const size_t group_size = size_t(padded_h) * padded_w * pack;
+        ParallelFor(in_c_pack / pack, ParallelGrain(group_size), [&](size_t group_begin, size_t group_end) {
+            std::fill(packed + group_begin * group_size, packed + group_end * group_size, 0.f);
+            const uint32_t c_end = std::min(uint32_t(group_end) * pack, in_c);
+            for (uint32_t c = uint32_t(group_begin) * pack; c < c_end; ++c) {
+                const float *src = input + size_t(c) * input_h * input_w;
+                float *dst = packed + (size_t(c / pack) * padded_h * padded_w) * pack + c % pack;
+                for (uint32_t iy = 0; iy < input_h; ++iy) {
+                    float *dst_row = dst + (size_t(iy + padding_h) * padded_w + padding_w) * pack;
+                    const float *src_row = src + iy * input_w;
+                    for (uint32_t ix = 0; ix < input_w; ++ix) {
+                        dst_row[ix * pack] = src_row[ix];
+                    }
+                }
+            }
+        });
+
+        // 输入变换，结果排布为 [alpha * alpha, tiles, in_c]，按块的行分给多个线程
+        float *v_data = transformed_input.data();
+        ParallelFor(tiles_h, ParallelGrain(size_t(tiles_w) * alpha * alpha * in_c_pack), [&](size_t ty_begin, size_t ty_end) {
+            for (uint32_t ty = uint32_t(ty_begin); ty < uint32_t(ty_end); ++ty) {
+                for (uint32_t tx = 0; tx < tiles_w; ++tx) {
+                    const uint32_t tile = ty * tiles_w + tx;
+                    for (uint32_t cb = 0; cb < in_c_pack / pack; ++cb) {
+                        const float *base = packed + ((size_t(cb) * padded_h + ty * Tile) * padded_w + tx * Tile) * pack;
+                        Vec8 d[alpha][alpha];
+                        Vec8 v[alpha][alpha];
+                        for (uint32_t i = 0; i < alpha; ++i) {
+                            for (uint32_t j = 0; j < alpha; ++j) {
+                                d[i][j] = Load8(base + (i * padded_w + j) * pack);
+                            }
+                        }
+                        InputTransform<Tile>(d, v);
+                        float *dst = v_data + size_t(tile) * in_c_pack + cb * pack;
+                        for (uint32_t i = 0; i < alpha; ++i) {
+                            for (uint32_t j = 0; j < alpha; ++j) {
+                                Store8(dst + size_t(i * alpha + j) * tiles * in_c_pack, v[i][j]);
+                            }
+                        }
+                    }
+                }
+            }
+        });
+
+        // 每个Winograd域位置上 [tiles, in_c] x [in_c, out_c]，按位置分给多个线程，分块内的矩阵乘法不再并行
+        float *m_data = transformed_output.data();
+        ParallelFor(alpha * alpha, ParallelGrain(size_t(tiles) * in_c_pack * out_c_pack), [&](size_t xi_begin, size_t xi_end) {
+            for (size_t xi = xi_begin; xi < xi_end; ++xi) {
+                SGemm(tiles, out_c_pack, in_c_pack,
+                      v_data + xi * tiles * in_c_pack, in_c_pack,
+                      transformed_kernel + xi * in_c_pack * out_c_pack, out_c_pack,
+                      m_data + xi * tiles * out_c_pack, out_c_pack);
+            }
+        });
+
+        // 输出变换，加上偏置、残差和激活后写回 [out_c, output_h, output_w]，按块的行分给多个线程
+        const size_t output_plane = size_t(output_h) * output_w;
+        ParallelFor(tiles_h, ParallelGrain(size_t(tiles_w) * alpha * alpha * out_c_pack), [&](size_t ty_begin, size_t ty_end) {
+            alignas(32) float tile_output[Tile * Tile * pack];
+            for (uint32_t ty = uint32_t(ty_begin); ty < uint32_t(ty_end); ++ty) {
+                for (uint32_t tx = 0; tx < tiles_w; ++tx) {
+                    const uint32_t tile = ty * tiles_w + tx;
+                    const uint32_t valid_h = std::min(Tile, output_h - ty * Tile);
+                    const uint32_t valid_w = std::min(Tile, output_w - tx * Tile);
+                    for (uint32_t ob = 0; ob < out_c_pack / pack; ++ob) {
+                        const float *src = m_data + size_t(tile) * out_c_pack + ob * pack;
+                        Vec8 m[alpha][alpha];
+                        Vec8 y[Tile][Tile];
+                        for (uint32_t i = 0; i < alpha; ++i) {
+                            for (uint32_t j = 0; j < alpha; ++j) {
+                                m[i][j] = Load8(src + size_t(i * alpha + j) * tiles * out_c_pack);
+                            }
+                        }
+                        OutputTransform<Tile>(m, y);
+                        const Vec8 bias_vec = Load8(bias_data + ob * pack);
+                        for (uint32_t i = 0; i < Tile; ++i) {
+                            for (uint32_t j = 0; j < Tile; ++j) {
+                                // 有残差时激活要等加上残差之后再做
+                                const Vec8 value = y[i][j] + bias_vec;
+                                Store8(tile_output + (i * Tile + j) * pack, relu && !residual ? Relu(value) : value);
+                            }
+                        }
+
+                        const uint32_t channels = std::min(pack, out_c - ob * pack);
+                        for (uint32_t lane = 0; lane < channels; ++lane) {
+                            const size_t offset = (ob * pack + lane) * output_plane +
+                                                  size_t(ty * Tile) * output_w + tx * Tile;
+                            float *dst = output + offset;
+                            if (residual) {
+                                const float *res = residual + offset;
+                                for (uint32_t i = 0; i < valid_h; ++i) {
+                                    for (uint32_t j = 0; j < valid_w; ++j) {
+                                        const float value = tile_output[(i * Tile + j) * pack + lane] + res[i * output_w + j];
+                                        dst[i * output_w + j] = relu ? std::max(value, 0.f) : value;
+                                    }
+                                }
+                                continue;
+                            }
+                            for (uint32_t i = 0; i < valid_h; ++i) {
+                                for (uint32_t j = 0; j < valid_w; ++j) {
+                                    dst[i * output_w + j] = tile_output[(i * Tile + j) * pack + lane];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    void WinogradConv3x3(const float *input, uint32_t in_c, uint32_t input_h, uint32_t input_w,
+                         uint32_t padding_h, uint32_t padding_w, const float *transformed_kernel,
+                         uint32_t out_c, const float *bias, uint32_t output_tile, float *output,
+                         const float *residual, bool relu) {
+        CHECK(input != nullptr && transformed_kernel != nullptr && output != nullptr);
+        CHECK(input_h + 2 * padding_h >= 3 && input_w + 2 * padding_w >= 3)
+                        << "The input of winograd convolution is smaller than the kernel";
+        if (output_tile == 2) {
+            WinogradConv3x3Impl<2>(input, in_c, input_h, input_w, padding_h, padding_w,
+                                   transformed_kernel, out_c, bias, output, residual, relu);
+        } else {
+            CHECK(output_tile == 4) << "Unsupported winograd output tile: " << output_tile;
+            WinogradConv3x3Impl<4>(input, in_c, input_h, input_w, padding_h, padding_w,
+                                   transformed_kernel, out_c, bias, output, residual, relu);
+        }
+    }
+}
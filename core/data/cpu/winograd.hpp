@@ -0,0 +1,65 @@
+//
+// Created by hanke on 2024/5/9.
+//
+
+#ifndef INFERNETO_WINOGRAD_HPP
+#define INFERNETO_WINOGRAD_HPP
+#include <cstddef>
+#include <cstdint>
+
+namespace infer_neto {
+    /// 通道方向的向量宽度，变换时每次处理8个通道
+    constexpr uint32_t kWinogradPack = 8;
+
+    /**
+     * 判断输出块大小是否受支持
+     * @param output_tile 输出块大小，2 对应 F(2x2,3x3)，4 对应 F(4x4,3x3)
+     */
+    inline bool WinogradTileSupported(uint32_t output_tile) {
+        return output_tile == 2 || output_tile == 4;
+    }
+
+    /**
+     * 变换后卷积核所需的元素数量
+     * @param out_c 输出通道数
+     * @param in_c 输入通道数
+     * @param output_tile 输出块大小
+     */
+    size_t WinogradKernelSize(uint32_t out_c, uint32_t in_c, uint32_t output_tile);
+
+    /**
+     * 将 [out_c, in_c, 3, 3] 的卷积核变换到Winograd域 U = G * g * G^T
+     * @param kernel 卷积核数据，按 [out_c, in_c, 3, 3] 连续存放
+     * @param out_c 输出通道数
+     * @param in_c 输入通道数
+     * @param output_tile 输出块大小，2 对应 F(2x2,3x3)，4 对应 F(4x4,3x3)
+     * @param transformed 变换后的卷积核，排布为 [alpha * alpha, in_c, out_c]，其中 alpha = output_tile + 2，
+     * 通道数向上补齐到kWinogradPack的整数倍，大小由WinogradKernelSize给出
+     */
+    void WinogradTransformKernel(const float *kernel, uint32_t out_c, uint32_t in_c, uint32_t output_tile,
+                                 float *transformed);
+
+    /**
+     * 步长为1的3x3卷积的Winograd实现
+     * 输入按块变换后，每个Winograd域位置上做一次 [tiles, in_c] x [in_c, out_c] 的矩阵乘法，再变换回输出
+     * @param input 输入数据，按 [in_c, input_h, input_w] 连续存放
+     * @param in_c 输入通道数
+     * @param input_h 输入的高度
+     * @param input_w 输入的宽度
+     * @param padding_h 上下方向的填充大小
+     * @param padding_w 左右方向的填充大小
+     * @param transformed_kernel WinogradTransformKernel变换后的卷积核
+     * @param out_c 输出通道数
+     * @param bias 长度为out_c的偏置，为空时不加偏置
+     * @param output_tile 输出块大小，需要和变换卷积核时一致
+     * @param output 输出数据，按 [out_c, output_h, output_w] 连续存放
+     * @param residual 与输出排布相同的残差，在偏置之后加上，不能与输出重叠，为空时不加残差
+     * @param relu 为true时在输出变换加上偏置和残差后做ReLU
+     */
+    void WinogradConv3x3(const float *input, uint32_t in_c, uint32_t input_h, uint32_t input_w,
+                         uint32_t padding_h, uint32_t padding_w, const float *transformed_kernel,
+                         uint32_t out_c, const float *bias, uint32_t output_tile, float *output,
+                         const float *residual = nullptr, bool relu = false);
+}
+
+#endif //INFERNETO_WINOGRAD_HPP
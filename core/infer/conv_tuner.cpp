@@ -0,0 +1,150 @@
+//
+// Created by hanke on 2024/5/10.
+//
+#include "conv_tuner.hpp"
+#include <glog/logging.h>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <utility>
+
+namespace infer_neto {
+    ConvAlgorithmCache::ConvAlgorithmCache(std::string cache_path, std::string model_key)
+            : cache_path_(std::move(cache_path)), model_key_(std::move(model_key)) {}
+
+    bool ConvAlgorithmCache::Load() {
+        algorithms_.clear();
+        other_records_.clear();
+        std::ifstream file(cache_path_);
+        if (!file.is_open()) {
+            return false;
+        }
+        // 每行一条记录: <model_key> <layer_name> <algorithm>
+        std::string line;
+        while (std::getline(file, line)) {
+            std::stringstream stream(line);
+            std::string model_key;
+            std::string layer_name;
+            int algorithm = -1;
+            if (!(stream >> model_key >> layer_name >> algorithm)) {
+                continue;
+            }
+            if (model_key != model_key_) {
+                other_records_.push_back(line);
+                continue;
+            }
+            if (algorithm < int(ConvAlgorithm::kIm2ColGemm) || algorithm > int(ConvAlgorithm::kDirect)) {
+                LOG(WARNING) << "Unknown convolution algorithm " << algorithm << " in " << cache_path_;
+                continue;
+            }
+            algorithms_[layer_name] = ConvAlgorithm(algorithm);
+        }
+        return true;
+    }
+
+    bool ConvAlgorithmCache::Save() const {
+        std::ofstream file(cache_path_, std::ios::trunc);
+        if (!file.is_open()) {
+            LOG(WARNING) << "Can not write the convolution algorithm cache " << cache_path_;
+            return false;
+        }
+        for (const std::string& record : other_records_) {
+            file << record << "\n";
+        }
+        for (const auto& [layer_name, algorithm] : algorithms_) {
+            file << model_key_ << " " << layer_name << " " << int(algorithm) << "\n";
+        }
+        return file.good();
+    }
+
+    bool ConvAlgorithmCache::Find(const std::string& layer_name, ConvAlgorithm& algorithm) const {
+        const auto iter = algorithms_.find(layer_name);
+        if (iter == algorithms_.end()) {
+            return false;
+        }
+        algorithm = iter->second;
+        return true;
+    }
+
+    void ConvAlgorithmCache::Insert(const std::string& layer_name, ConvAlgorithm algorithm) {
+        algorithms_[layer_name] = algorithm;
+    }
+
+    /// 对文件内容计算64位FNV-1a哈希
+    static uint64_t HashFile(const std::string& path, uint64_t hash) {
+        std::ifstream file(path, std::ios::binary);
+        CHECK(file.is_open()) << "Can not open " << path << " to compute the model hash";
+        char buffer[1 << 16];
+        while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+            const std::streamsize count = file.gcount();
+            for (std::streamsize i = 0; i < count; ++i) {
+                hash ^= uint8_t(buffer[i]);
+                hash *= 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+
+    std::string ConvAlgorithmCache::ModelKey(const std::string& param_path, const std::string& bin_path) {
+        uint64_t hash = 14695981039346656037ull;
+        hash = HashFile(param_path, hash);
+        hash = HashFile(bin_path, hash);
+        std::stringstream key;
+        key << std::hex << hash << "/" << CpuFeatures();
+        return key.str();
+    }
+
+    std::string ConvAlgorithmCache::CpuFeatures() {
+        std::string features;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        __builtin_cpu_init();
+        const std::vector<std::pair<const char*, bool>> flags = {
+                {"avx",     bool(__builtin_cpu_supports("avx"))},
+                {"fma",     bool(__builtin_cpu_supports("fma"))},
+                {"avx2",    bool(__builtin_cpu_supports("avx2"))},
+                {"avx512f", bool(__builtin_cpu_supports("avx512f"))}};
+        for (const auto& [name, supported] : flags) {
+            if (supported) {
+                features += features.empty() ? name : std::string(",") + name;
+            }
+        }
+#endif
+        return features.empty() ? "generic" : features;
+    }
+
+    ConvAlgorithm TimeConvAlgorithms(ConvolutionLayer& layer, const std::vector<int32_t>& input_shape,
+                                     const std::vector<int32_t>& residual_shape, uint32_t repeats) {
+        CHECK(input_shape.size() == 4) << "The input shape of convolution layer should be (n, c, h, w)";
+        CHECK(repeats > 0);
+        std::vector<sftensor> inputs(1);
+        inputs.at(0) = std::make_shared<Tensor<float>>(input_shape.at(1), input_shape.at(2), input_shape.at(3));
+        inputs.at(0)->Rand();
+        if (layer.fused_residual()) {
+            CHECK(residual_shape.size() == 4) << "The residual shape of convolution layer should be (n, c, h, w)";
+            inputs.push_back(std::make_shared<Tensor<float>>(residual_shape.at(1), residual_shape.at(2),
+                                                             residual_shape.at(3)));
+            inputs.back()->Rand();
+        }
+        std::vector<sftensor> outputs(1);
+
+        ConvAlgorithm best_algorithm = ConvAlgorithm::kIm2ColGemm;
+        double best_time = std::numeric_limits<double>::max();
+        for (ConvAlgorithm algorithm : layer.CandidateAlgorithms()) {
+            layer.set_algorithm(algorithm);
+            layer.InitWinogradWeight();
+            // 第一次运行用于分配输出和工作区，不计入时间
+            CHECK(layer.Forward(inputs, outputs) == InferStatus::kInferSuccess);
+            for (uint32_t i = 0; i < repeats; ++i) {
+                const auto start = std::chrono::steady_clock::now();
+                layer.Forward(inputs, outputs);
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                if (elapsed.count() < best_time) {
+                    best_time = elapsed.count();
+                    best_algorithm = algorithm;
+                }
+            }
+        }
+        return best_algorithm;
+    }
+}
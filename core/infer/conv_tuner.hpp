@@ -0,0 +1,88 @@
+//
+// Created by hanke on 2024/5/10.
+//
+
+#ifndef INFERNETO_CONV_TUNER_HPP
+#define INFERNETO_CONV_TUNER_HPP
+#include <map>
+#include <string>
+#include <vector>
+#include "node/details/convolution.hpp"
+
+namespace infer_neto {
+/// 构建计算图时卷积计算方式的选择策略
+enum class ConvTuningMode {
+    kHeuristic = 0,  /// 根据pnnx记录的静态形状按经验规则选择
+    kTimed = 1,      /// 对每种可用的计算方式做一次短暂的试运行，选择最快的一种
+};
+
+/// 卷积计算方式的磁盘缓存，记录按模型哈希和CPU特性区分，避免每次启动都重新试运行
+class ConvAlgorithmCache {
+public:
+    /**
+     * @param cache_path 缓存文件的路径
+     * @param model_key 模型和CPU对应的键，由ModelKey生成
+     */
+    ConvAlgorithmCache(std::string cache_path, std::string model_key);
+
+    /**
+     * 从缓存文件中读取记录，文件不存在时视为空缓存
+     * @return 文件存在且读取成功时返回true
+     */
+    bool Load();
+
+    /**
+     * 将记录写回缓存文件，其他模型或CPU的记录原样保留
+     * @return 是否写入成功
+     */
+    bool Save() const;
+
+    /**
+     * 查找某个卷积层的计算方式
+     * @param layer_name 卷积层的名称
+     * @param algorithm 找到时写入对应的计算方式
+     * @return 是否找到
+     */
+    bool Find(const std::string& layer_name, ConvAlgorithm& algorithm) const;
+
+    /**
+     * 记录某个卷积层的计算方式
+     * @param layer_name 卷积层的名称
+     * @param algorithm 卷积的计算方式
+     */
+    void Insert(const std::string& layer_name, ConvAlgorithm algorithm);
+
+    /**
+     * 生成缓存的键，由模型文件内容的哈希和CPU特性组成
+     * @param param_path 计算图的结构文件
+     * @param bin_path 计算图的权重文件
+     * @return 不包含空白字符的键
+     */
+    static std::string ModelKey(const std::string& param_path, const std::string& bin_path);
+
+    /**
+     * 返回当前CPU支持的、与卷积计算相关的指令集
+     * @return 形如 avx,fma,avx2 的字符串
+     */
+    static std::string CpuFeatures();
+
+private:
+    std::string cache_path_;
+    std::string model_key_;
+    std::map<std::string, ConvAlgorithm> algorithms_;  /// 当前模型各卷积层的计算方式
+    std::vector<std::string> other_records_;           /// 其他模型或CPU的记录，保存时原样写回
+};
+
+/**
+ * 试运行卷积层每种可用的计算方式，返回最快的一种
+ * 试运行结束后卷积层的计算方式处于不确定状态，调用方需要重新设置
+ * @param layer 卷积层，权重需要已经初始化
+ * @param input_shape pnnx中记录的输入形状 (n, c, h, w)
+ * @param residual_shape 卷积层合并了残差相加时残差的形状 (n, c, h, w)，否则为空
+ * @param repeats 每种计算方式重复运行的次数，取最短的一次
+ * @return 最快的计算方式
+ */
+ConvAlgorithm TimeConvAlgorithms(ConvolutionLayer& layer, const std::vector<int32_t>& input_shape,
+                                 const std::vector<int32_t>& residual_shape = {}, uint32_t repeats = 3);
+}
+#endif //INFERNETO_CONV_TUNER_HPP
@@ -1,17 +1,43 @@
 #include "infer_ir.hpp"
+#include "infer_session.hpp"
 #include "status_code.hpp"
 #include "pnnx/ir.h"
 #include "node/abstract/node_factory.hpp"
+#include "data/cpu/tensor_util.hpp"
+#include "data/cpu/thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <deque>
 #include <iostream>
+#include <mutex>
+#include <set>
 #include <memory>
 #include <utility>
 #include <vector>
 
 namespace infer_neto {
+    /// 节点之间并行执行时的状态，线程池最后声明，析构时先等待所有线程退出
+    struct RuntimeGraph::ParallelExecutor {
+        ParallelExecutor(uint32_t threads, size_t operators)
+                : pending(new std::atomic<uint32_t>[operators]), pool(threads) {
+        }
+
+        std::unique_ptr<std::atomic<uint32_t>[]> pending; /// 每个节点尚未完成的前驱数量
+        const std::vector<std::shared_ptr<Tensor<float>>> *inputs = nullptr;
+        bool debug = false;
+
+        std::mutex mutex;
+        std::condition_variable finished;
+        uint32_t remaining = 0; /// 尚未执行完毕的节点数量，由mutex保护
+        ThreadPool pool;
+    };
+
     RuntimeGraph::RuntimeGraph(std::string param_path, std::string bin_path)
             : param_path_(std::move(param_path)), bin_path_(std::move(bin_path)) {}
 
+    RuntimeGraph::~RuntimeGraph() = default;
+
     void RuntimeGraph::set_bin_path(const std::string &bin_path) {
         this->bin_path_ = bin_path;
     }
@@ -241,7 +267,71 @@ namespace infer_neto {
         }
     }
 
-    std::vector<std::shared_ptr<Tensor<float>>> RuntimeGraph::Forward(
+    void RuntimeGraph::RunOperator(const std::shared_ptr<RuntimeOperator> &current_op,
+                                   const std::vector<std::shared_ptr<Tensor<float>>> &inputs, bool debug) {
+        if (debug) {
+            // 并行执行时多个线程同时打印，整行一次输出
+            std::cout << current_op->type + "\n" << std::flush;
+        }
+        if (current_op->type == "pnnx.Input") {
+            current_op->has_forward = true;
+            ProbeNextLayer(current_op, inputs);
+        } else if (current_op->type == "pnnx.Output") {
+            current_op->has_forward = true;
+            CHECK(current_op->input_operands_seq.size() == 1);
+            current_op->output_operands = current_op->input_operands_seq.front();
+        } else {
+            InferStatus status = current_op->layer->Forward();
+            CHECK(status == InferStatus::kInferSuccess)
+                            << current_op->layer->layer_name()
+                            << " layer forward failed, error code: " << int(status);
+            current_op->has_forward = true;
+            ProbeNextLayer(current_op, current_op->output_operands->datas);
+        }
+    }
+
+    void RuntimeGraph::ForwardParallel(const std::vector<std::shared_ptr<Tensor<float>>> &inputs, bool debug) {
+        CHECK(successors_.size() == topo_operators_.size() && predecessor_counts_.size() == topo_operators_.size())
+                        << "The dependencies of operators are not built";
+        if (executor_ == nullptr) {
+            executor_ = std::make_unique<ParallelExecutor>(inter_op_threads_, topo_operators_.size());
+        }
+        executor_->inputs = &inputs;
+        executor_->debug = debug;
+        for (uint32_t i = 0; i < topo_operators_.size(); ++i) {
+            executor_->pending[i].store(predecessor_counts_.at(i), std::memory_order_relaxed);
+        }
+        {
+            std::lock_guard<std::mutex> lock(executor_->mutex);
+            executor_->remaining = uint32_t(topo_operators_.size());
+        }
+        for (uint32_t i = 0; i < topo_operators_.size(); ++i) {
+            if (predecessor_counts_.at(i) == 0) {
+                executor_->pool.Submit([this, i]() { this->RunParallel(i); });
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(executor_->mutex);
+        executor_->finished.wait(lock, [this]() { return executor_->remaining == 0; });
+        executor_->inputs = nullptr;
+    }
+
+    void RuntimeGraph::RunParallel(uint32_t index) {
+        this->RunOperator(topo_operators_.at(index), *executor_->inputs, executor_->debug);
+        // 最后一个完成的前驱负责提交后继，acq_rel保证后继能看到所有前驱的输出
+        for (const uint32_t next : successors_.at(index)) {
+            if (executor_->pending[next].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                executor_->pool.Submit([this, next]() { this->RunParallel(next); });
+            }
+        }
+        std::lock_guard<std::mutex> lock(executor_->mutex);
+        executor_->remaining -= 1;
+        if (executor_->remaining == 0) {
+            executor_->finished.notify_one();
+        }
+    }
+
+    const std::vector<std::shared_ptr<Tensor<float>>> &RuntimeGraph::Forward(
             const std::vector<std::shared_ptr<Tensor<float>>>& inputs, bool debug) {
         // 检查当前的执行图是否已经初始化完毕
         if (graph_state_ < GraphState::Complete) {
@@ -253,26 +343,24 @@ namespace infer_neto {
         CHECK(topo_operators_.size() == operators_.size())
                         << "Build wrong topo queue";
 
+        // 批次与构建时不同，节点中的输出空间不能直接使用，交给按批次缓存中间结果的会话
+        CHECK(!inputs.empty()) << "The inputs of the graph are empty";
+        if (inputs.size() != batch_size_) {
+            if (batch_session_ == nullptr) {
+                batch_session_ = std::make_unique<RuntimeSession>(*this);
+            }
+            return batch_session_->Forward(inputs, debug);
+        }
+
         for (const auto& op : topo_operators_) {
             op->has_forward = false;
         }
 
-        for (const auto& current_op : topo_operators_) {
-            std::cout << current_op->type << std::endl;
-            if (current_op->type == "pnnx.Input") {
-                current_op->has_forward = true;
-                ProbeNextLayer(current_op, inputs);
-            } else if (current_op->type == "pnnx.Output") {
-                current_op->has_forward = true;
-                CHECK(current_op->input_operands_seq.size() == 1);
-                current_op->output_operands = current_op->input_operands_seq.front();
-            } else {
-                InferStatus status = current_op->layer->Forward();
-                CHECK(status == InferStatus::kInferSuccess)
-                                << current_op->layer->layer_name()
-                                << " layer forward failed, error code: " << int(status);
-                current_op->has_forward = true;
-                ProbeNextLayer(current_op, current_op->output_operands->datas);
+        if (inter_op_threads_ > 1) {
+            this->ForwardParallel(inputs, debug);
+        } else {
+            for (const auto& current_op : topo_operators_) {
+                this->RunOperator(current_op, inputs, debug);
             }
         }
 
@@ -289,7 +377,8 @@ namespace infer_neto {
             return output_operand->datas;
         } else {
             LOG(FATAL) << "Can not find the output operator " << output_name_;
-            return std::vector<std::shared_ptr<Tensor<float>>>{};
+            static const std::vector<std::shared_ptr<Tensor<float>>> empty_outputs;
+            return empty_outputs;
         }
     }
 
@@ -339,6 +428,16 @@ namespace infer_neto {
         RuntimeOperatorUtils::InitOperatorInput(operators_);
         RuntimeOperatorUtils::InitOperatorOutput(graph_->ops, operators_);
 
+        // 合并算子，需要在输出空间按pnnx节点的顺序初始化之后进行
+        // 先合并残差相加，其后的ReLU再合并到同一个卷积中
+        if (operator_fusion_) {
+            this->FuseResidualAdds();
+            this->FuseActivations();
+        }
+
+        // 根据静态形状为卷积节点选择计算方式
+        this->SelectConvAlgorithms();
+
         // 构建拓扑顺序
         topo_operators_.clear();
         for (const auto &[_, op] : operators_maps_) {
@@ -351,6 +450,21 @@ namespace infer_neto {
         CHECK(topo_operators_.size() == operators_.size())
                         << "Build wrong topo queue";
         std::reverse(topo_operators_.begin(), topo_operators_.end());
+        this->BuildDependencies();
+
+        // 输入节点的输出空间按构建时的批次创建，动态批次时只有一个样本
+        batch_size_ = 0;
+        for (const auto &op : topo_operators_) {
+            if (op->type == "pnnx.Input" && op->output_operands != nullptr) {
+                batch_size_ = uint32_t(op->output_operands->datas.size());
+                break;
+            }
+        }
+
+        // 按拓扑顺序规划中间结果的内存，之后Forward只使用固定大小的内存池
+        if (memory_planning_) {
+            this->PlanMemory();
+        }
 
         graph_state_ = GraphState::Complete;
         input_name_ = input_name;
@@ -361,6 +475,347 @@ namespace infer_neto {
         }
     }
 
+    void RuntimeGraph::set_conv_tuning(ConvTuningMode mode, const std::string &cache_path) {
+        this->conv_tuning_mode_ = mode;
+        this->conv_cache_path_ = cache_path;
+    }
+
+    void RuntimeGraph::set_operator_fusion(bool enable) {
+        this->operator_fusion_ = enable;
+    }
+
+    void RuntimeGraph::set_memory_planning(bool enable) {
+        this->memory_planning_ = enable;
+    }
+
+    size_t RuntimeGraph::planned_memory_bytes() const {
+        return this->planned_memory_bytes_;
+    }
+
+    size_t RuntimeGraph::naive_memory_bytes() const {
+        return this->naive_memory_bytes_;
+    }
+
+    uint32_t RuntimeGraph::batch_size() const {
+        return this->batch_size_;
+    }
+
+    void RuntimeGraph::set_inter_op_threads(uint32_t threads) {
+        if (threads != this->inter_op_threads_) {
+            this->inter_op_threads_ = threads;
+            this->executor_.reset();
+        }
+    }
+
+    uint32_t RuntimeGraph::inter_op_threads() const {
+        return this->inter_op_threads_;
+    }
+
+    void RuntimeGraph::BuildDependencies() {
+        std::map<std::string, uint32_t> topo_indices;
+        for (uint32_t i = 0; i < topo_operators_.size(); ++i) {
+            topo_indices.insert({topo_operators_.at(i)->name, i});
+        }
+        successors_.assign(topo_operators_.size(), {});
+        predecessor_counts_.assign(topo_operators_.size(), 0);
+        for (uint32_t i = 0; i < topo_operators_.size(); ++i) {
+            for (const auto &[next_name, _] : topo_operators_.at(i)->output_operators) {
+                this->AddDependency(i, topo_indices.at(next_name));
+            }
+        }
+    }
+
+    void RuntimeGraph::AddDependency(uint32_t from, uint32_t to) {
+        CHECK(from < to) << "The dependency " << from << " -> " << to << " is against the topological order";
+        std::vector<uint32_t> &successors = successors_.at(from);
+        if (std::find(successors.begin(), successors.end(), to) == successors.end()) {
+            successors.push_back(to);
+            predecessor_counts_.at(to) += 1;
+        }
+    }
+
+    void RuntimeGraph::PlanMemory() {
+        std::map<std::string, uint32_t> topo_indices;
+        for (uint32_t i = 0; i < topo_operators_.size(); ++i) {
+            topo_indices.insert({topo_operators_.at(i)->name, i});
+        }
+        const auto is_view = [](const std::shared_ptr<RuntimeOperator> &op) {
+            return op->layer != nullptr && op->layer->IsView();
+        };
+
+        // 计算图的输出，以及通过视图成为计算图输出的节点，需要在Forward返回之后继续有效
+        std::set<std::string> graph_outputs;
+        for (auto iter = topo_operators_.rbegin(); iter != topo_operators_.rend(); ++iter) {
+            const auto &op = *iter;
+            for (const auto &[next_name, next_op] : op->output_operators) {
+                if (next_op->type == "pnnx.Output" || (is_view(next_op) && graph_outputs.count(next_name))) {
+                    graph_outputs.insert(op->name);
+                }
+            }
+        }
+
+        std::vector<std::shared_ptr<RuntimeOperator>> planned_ops;
+        std::vector<MemoryBlock> blocks;
+        std::map<std::string, uint32_t> block_indices;  // 节点名称 -> 输出所在的内存块
+        std::vector<std::vector<uint32_t>> block_users;  // 读写每个内存块的节点在拓扑序中的位置
+        size_t naive_size = 0;
+        for (uint32_t i = 0; i < topo_operators_.size(); ++i) {
+            const auto &op = topo_operators_.at(i);
+            // 输入节点的输出由调用方提供，不需要规划
+            if (op->type == "pnnx.Input" || op->type == "pnnx.Output" ||
+                !op->output_operands || op->output_operands->datas.empty() || graph_outputs.count(op->name)) {
+                continue;
+            }
+            // 输出从当前节点开始存活，直到最后一个后继节点执行完毕
+            uint32_t last_use = i;
+            std::vector<uint32_t> users{i};
+            for (const auto &[next_name, _] : op->output_operators) {
+                last_use = std::max(last_use, topo_indices.at(next_name));
+                users.push_back(topo_indices.at(next_name));
+            }
+            // 视图不占用新的内存，而是延长输入所在内存块的生命周期
+            if (is_view(op)) {
+                const std::string &producer_name = op->input_operands_seq.front()->name;
+                const auto block_iter = block_indices.find(producer_name);
+                if (block_iter != block_indices.end()) {
+                    MemoryBlock &block = blocks.at(block_iter->second);
+                    block.last_use = std::max(block.last_use, last_use);
+                    block_indices.insert({op->name, block_iter->second});
+                    auto &view_users = block_users.at(block_iter->second);
+                    view_users.insert(view_users.end(), users.begin(), users.end());
+                }
+                continue;
+            }
+
+            MemoryBlock block;
+            block.first_use = i;
+            block.last_use = last_use;
+            const auto &datas = op->output_operands->datas;
+            for (const auto &data : datas) {
+                CHECK(data != nullptr && !data->empty() && TensorShapeIsSame(*data, *datas.front()))
+                                << "The output of " << op->name << " is not initialized";
+            }
+            block.size = AlignMemorySize(size_t(datas.size()) * datas.front()->size());
+            naive_size += block.size;
+            block_indices.insert({op->name, blocks.size()});
+            blocks.push_back(block);
+            block_users.push_back(std::move(users));
+            planned_ops.push_back(op);
+        }
+
+        const size_t arena_size = PlanMemoryBlocks(blocks);
+        memory_blocks_ = blocks;
+        // 拓扑序中不重叠的生命周期在并行执行时可能重叠，复用同一段内存的节点要等之前读写这段内存的节点全部完成
+        for (uint32_t i = 0; i < blocks.size(); ++i) {
+            for (uint32_t j = 0; j < blocks.size(); ++j) {
+                const MemoryBlock &before = blocks.at(i);
+                const MemoryBlock &after = blocks.at(j);
+                if (before.last_use < after.first_use && before.offset < after.offset + after.size &&
+                    after.offset < before.offset + before.size) {
+                    for (const uint32_t user : block_users.at(i)) {
+                        this->AddDependency(user, after.first_use);
+                    }
+                }
+            }
+        }
+        memory_arena_ = Tensor<float>(uint32_t(arena_size));
+        // 输出空间改为内存池上的张量，各批次紧密地依次排列，仍然可以合并为一个批次计算
+        // 张量通过别名持有内存池的引用计数，计算图销毁或重新规划后调用方持有的张量仍然有效
+        const TensorData &arena = memory_arena_.data();
+        for (uint32_t i = 0; i < planned_ops.size(); ++i) {
+            auto &datas = planned_ops.at(i)->output_operands->datas;
+            datas = TensorCreateBatch(datas.size(), datas.front()->raw_shapes(),
+                                      TensorData(arena, arena.get() + blocks.at(i).offset));
+        }
+        // 视图节点预先分配的输出空间不再需要，直接共用输入的数据
+        for (const auto &op : topo_operators_) {
+            if (!is_view(op) || !op->output_operands) {
+                continue;
+            }
+            const auto &producer = operators_maps_.at(op->input_operands_seq.front()->name);
+            if (producer->type == "pnnx.Input" || !producer->output_operands) {
+                continue;
+            }
+            auto &datas = op->output_operands->datas;
+            const auto &producer_datas = producer->output_operands->datas;
+            CHECK(datas.size() == producer_datas.size());
+            for (uint32_t i = 0; i < datas.size(); ++i) {
+                datas.at(i)->ShareData(*producer_datas.at(i));
+            }
+        }
+
+        planned_memory_bytes_ = arena_size * sizeof(float);
+        naive_memory_bytes_ = naive_size * sizeof(float);
+        LOG(INFO) << "Memory plan: " << planned_ops.size() << " operands, " << planned_memory_bytes_
+                  << " bytes planned, " << naive_memory_bytes_ << " bytes without planning";
+    }
+
+    void RuntimeGraph::FuseActivations() {
+        std::set<std::string> fused_names;
+        for (const auto &activation_op : this->operators_) {
+            if (activation_op->type != "nn.ReLU" || activation_op->input_operands_seq.size() != 1) {
+                continue;
+            }
+            const std::string &producer_name = activation_op->input_operands_seq.front()->name;
+            const auto producer_iter = operators_maps_.find(producer_name);
+            if (producer_iter == operators_maps_.end()) {
+                continue;
+            }
+            // 前驱节点的输出还被其他节点使用时，不能把激活写进它的输出
+            const std::shared_ptr<RuntimeOperator> &producer = producer_iter->second;
+            if (producer->layer == nullptr || producer->output_names.size() != 1 ||
+                producer->output_operators.size() != 1) {
+                continue;
+            }
+            if (!producer->layer->FuseActivation(activation_op->type)) {
+                continue;
+            }
+
+            // 激活节点的后继改为从前驱节点读取输入
+            producer->output_names = activation_op->output_names;
+            producer->output_operators = activation_op->output_operators;
+            for (const auto &[_, next_op] : activation_op->output_operators) {
+                auto &next_input_operands = next_op->input_operands;
+                const auto operand_iter = next_input_operands.find(activation_op->name);
+                CHECK(operand_iter != next_input_operands.end())
+                                << next_op->name << " has no input from " << activation_op->name;
+                std::shared_ptr<RuntimeOperand> operand = operand_iter->second;
+                next_input_operands.erase(operand_iter);
+                operand->name = producer->name;
+                next_input_operands.insert({producer->name, operand});
+            }
+            fused_names.insert(activation_op->name);
+            LOG(INFO) << "Fuse " << activation_op->name << " into " << producer->name;
+        }
+
+        this->RemoveOperators(fused_names);
+    }
+
+    void RuntimeGraph::FuseResidualAdds() {
+        std::set<std::string> fused_names;
+        for (const auto &add_op : this->operators_) {
+            if (add_op->type != "pnnx.Expression" || add_op->input_operands_seq.size() != 2) {
+                continue;
+            }
+            const auto expr_iter = add_op->params.find("expr");
+            if (expr_iter == add_op->params.end()) {
+                continue;
+            }
+            auto expr = std::dynamic_pointer_cast<RuntimeParameterString>(expr_iter->second);
+            if (expr == nullptr || expr->value != "add(@0,@1)") {
+                continue;
+            }
+
+            // 两个加数中任选一个只被该表达式使用的节点，另一个加数作为它的残差
+            for (uint32_t i = 0; i < 2; ++i) {
+                const std::shared_ptr<RuntimeOperand> &residual_operand = add_op->input_operands_seq.at(1 - i);
+                const std::string &producer_name = add_op->input_operands_seq.at(i)->name;
+                const auto producer_iter = operators_maps_.find(producer_name);
+                const auto residual_iter = operators_maps_.find(residual_operand->name);
+                if (producer_name == residual_operand->name || producer_iter == operators_maps_.end() ||
+                    residual_iter == operators_maps_.end()) {
+                    continue;
+                }
+                const std::shared_ptr<RuntimeOperator> &producer = producer_iter->second;
+                const std::shared_ptr<RuntimeOperator> &residual_producer = residual_iter->second;
+                if (producer->layer == nullptr || producer->output_operands == nullptr ||
+                    producer->output_names.size() != 1 || producer->output_operators.size() != 1 ||
+                    residual_operand->shapes != producer->output_operands->shapes) {
+                    continue;
+                }
+                if (!producer->layer->FuseResidualAdd()) {
+                    continue;
+                }
+
+                // 残差作为前驱节点的第二个输入，前驱节点本来就读取残差节点时共用同一个操作数
+                const auto existing_iter = producer->input_operands.find(residual_operand->name);
+                if (existing_iter != producer->input_operands.end()) {
+                    producer->input_operands_seq.push_back(existing_iter->second);
+                } else {
+                    producer->input_operands.insert({residual_operand->name, residual_operand});
+                    producer->input_operands_seq.push_back(residual_operand);
+                }
+                auto &residual_outputs = residual_producer->output_names;
+                std::replace(residual_outputs.begin(), residual_outputs.end(), add_op->name, producer->name);
+                residual_producer->output_operators.erase(add_op->name);
+                residual_producer->output_operators.insert({producer->name, producer});
+
+                // 表达式的后继改为从前驱节点读取输入
+                producer->output_names = add_op->output_names;
+                producer->output_operators = add_op->output_operators;
+                for (const auto &[_, next_op] : add_op->output_operators) {
+                    auto &next_input_operands = next_op->input_operands;
+                    const auto operand_iter = next_input_operands.find(add_op->name);
+                    CHECK(operand_iter != next_input_operands.end())
+                                    << next_op->name << " has no input from " << add_op->name;
+                    std::shared_ptr<RuntimeOperand> operand = operand_iter->second;
+                    next_input_operands.erase(operand_iter);
+                    operand->name = producer->name;
+                    next_input_operands.insert({producer->name, operand});
+                }
+                fused_names.insert(add_op->name);
+                LOG(INFO) << "Fuse " << add_op->name << " into " << producer->name;
+                break;
+            }
+        }
+        this->RemoveOperators(fused_names);
+    }
+
+    void RuntimeGraph::RemoveOperators(const std::set<std::string> &names) {
+        if (names.empty()) {
+            return;
+        }
+        for (const auto &name : names) {
+            operators_maps_.erase(name);
+        }
+        operators_.erase(std::remove_if(operators_.begin(), operators_.end(),
+                                        [&names](const std::shared_ptr<RuntimeOperator> &op) {
+                                            return names.find(op->name) != names.end();
+                                        }), operators_.end());
+    }
+
+    void RuntimeGraph::SelectConvAlgorithms() {
+        // 经验规则已经在创建卷积层时根据输入形状应用过
+        if (conv_tuning_mode_ == ConvTuningMode::kHeuristic) {
+            return;
+        }
+
+        std::unique_ptr<ConvAlgorithmCache> cache;
+        if (!conv_cache_path_.empty()) {
+            cache = std::make_unique<ConvAlgorithmCache>(
+                    conv_cache_path_, ConvAlgorithmCache::ModelKey(param_path_, bin_path_));
+            cache->Load();
+        }
+
+        bool cache_updated = false;
+        for (const auto &op : this->operators_) {
+            if (op->type != "nn.Conv2d") {
+                continue;
+            }
+            auto conv_layer = std::dynamic_pointer_cast<ConvolutionLayer>(op->layer);
+            CHECK(conv_layer != nullptr) << "The layer of " << op->name << " is not a convolution layer";
+
+            ConvAlgorithm algorithm = conv_layer->algorithm();
+            if (cache == nullptr || !cache->Find(op->name, algorithm)) {
+                CHECK(!op->input_operands_seq.empty()) << op->name << " has no input operand";
+                const auto &input_operands = op->input_operands_seq;
+                algorithm = TimeConvAlgorithms(*conv_layer, input_operands.front()->shapes,
+                                               input_operands.size() > 1 ? input_operands.back()->shapes
+                                                                         : std::vector<int32_t>{});
+                if (cache != nullptr) {
+                    cache->Insert(op->name, algorithm);
+                    cache_updated = true;
+                }
+            }
+            conv_layer->set_algorithm(algorithm);
+            conv_layer->InitWinogradWeight();
+        }
+
+        if (cache_updated) {
+            cache->Save();
+        }
+    }
+
     void RuntimeGraph::ReverseTopo(
             const std::shared_ptr<RuntimeOperator> &root_op) {
         CHECK(root_op != nullptr) << "current operator is nullptr";
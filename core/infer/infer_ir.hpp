@@ -1,15 +1,22 @@
+#ifndef INFERNETO_INFER_IR_HPP
+#define INFERNETO_INFER_IR_HPP
 #include "pnnx/ir.h"
 #include "infer_operand.hpp"
 #include "infer_op.hpp"
+#include "conv_tuner.hpp"
+#include "memory_planner.hpp"
 #include <glog/logging.h>
 #include <map>
 #include <memory>
 #include <queue>
+#include <set>
 #include <string>
 #include <vector>
 
 namespace infer_neto {
 
+    class RuntimeSession;
+
 /// 计算图结构，由多个计算节点和节点之间的数据流图组成
     class RuntimeGraph {
     public:
@@ -20,6 +27,8 @@ namespace infer_neto {
          */
         RuntimeGraph(std::string param_path, std::string bin_path);
 
+        ~RuntimeGraph();
+
         /**
          * 设置权重文件
          * @param bin_path 权重文件路径
@@ -61,6 +70,58 @@ namespace infer_neto {
 
         const std::vector<std::shared_ptr<RuntimeOperator>> &get_topo_queues() const;
 
+        /**
+         * 设置构建计算图时卷积计算方式的选择策略，需要在Build之前调用
+         * @param mode 选择策略，默认按经验规则选择
+         * @param cache_path 试运行结果的缓存文件，为空时不使用缓存
+         */
+        void set_conv_tuning(ConvTuningMode mode, const std::string &cache_path = "");
+
+        /**
+         * 设置构建计算图时是否合并算子，需要在Build之前调用
+         * @param enable 为true时把卷积或表达式之后的ReLU合并到前一个节点中，默认开启
+         */
+        void set_operator_fusion(bool enable);
+
+        /**
+         * 设置构建计算图时是否规划中间结果的内存，需要在Build之前调用
+         * @param enable 为true时生命周期不重叠的中间结果共用同一个内存池中的空间，默认开启
+         */
+        void set_memory_planning(bool enable);
+
+        /**
+         * 返回规划后内存池的大小，未规划内存时返回0
+         * @return 内存池的字节数
+         */
+        size_t planned_memory_bytes() const;
+
+        /**
+         * 返回不做规划时参与规划的中间结果各自分配内存的总大小，未规划内存时返回0
+         * @return 中间结果的总字节数
+         */
+        size_t naive_memory_bytes() const;
+
+        /**
+         * 返回构建时输入的批次大小，结构文件中的批次为动态时返回1
+         * @return 批次大小
+         */
+        uint32_t batch_size() const;
+
+        /**
+         * 设置节点之间并行执行的线程数
+         * 大于1时按依赖关系调度节点，前驱全部完成的节点立即交给任务窃取线程池执行。
+         * 节点内的并行共用同一个线程池(见SetIntraOpThreads)，线程池正被其他节点使用时该节点在自己的线程中依次计算，
+         * 因此同时运行的线程数不会超过两者之和
+         * @param threads 线程数，为0或1时按拓扑顺序依次执行节点，默认为0
+         */
+        void set_inter_op_threads(uint32_t threads);
+
+        /**
+         * 返回节点之间并行执行的线程数
+         * @return 线程数，为0时按拓扑顺序依次执行
+         */
+        uint32_t inter_op_threads() const;
+
         /**
        * 根据计算图中的计算节点来返回Layer
        * @param op 计算图中的计算节点
@@ -69,7 +130,15 @@ namespace infer_neto {
         static std::shared_ptr<Layer> CreateLayer(
                 const std::shared_ptr<RuntimeOperator> &op);
 
-        std::vector<std::shared_ptr<Tensor<float>>> Forward(
+        /**
+         * 执行一次推理，预热之后的推理不会申请堆内存
+         * 中间结果保存在计算图的节点中，同一时间只能有一个线程调用；需要同时处理多个请求时每个线程创建一个RuntimeSession
+         * 输入的批次与构建时不同时不需要重新构建，交给计算图内部的会话按拓扑顺序执行，每种批次的中间结果只在第一次遇到时创建
+         * @param inputs 计算图的输入，每个批次一个张量
+         * @param debug 为true时打印每个执行的节点
+         * @return 计算图输出节点的张量，下一次同样批次的推理时会被覆盖
+         */
+        const std::vector<std::shared_ptr<Tensor<float>>> &Forward(
                 const std::vector<std::shared_ptr<Tensor<float>>> &inputs, bool debug);
 
     private:
@@ -111,6 +180,69 @@ namespace infer_neto {
 
         void ReverseTopo(const std::shared_ptr<RuntimeOperator> &root_op);
 
+        /**
+         * 为每个卷积节点选择计算方式，试运行的结果会写入缓存
+         */
+        void SelectConvAlgorithms();
+
+        /**
+         * 将只有一个前驱的激活节点合并到前驱节点中，前驱节点的输出只被该激活节点使用时才能合并
+         * 合并后前驱节点直接连接到激活节点的后继节点，激活节点从计算图中删除
+         */
+        void FuseActivations();
+
+        /**
+         * 将两个输入的逐元素相加合并到其中一个加数的前驱节点中，另一个加数成为该节点的残差输入
+         * 残差块中第二个卷积直接输出 conv + bias + skip，省去表达式节点的内存分配和一次完整的读写
+         */
+        void FuseResidualAdds();
+
+        /**
+         * 根据拓扑顺序计算每个节点输出的生命周期，并将它们放到同一个内存池中
+         * 计算图的输出需要在Forward返回之后继续有效，不放入内存池；视图节点共用输入所在的内存块
+         */
+        void PlanMemory();
+
+        /**
+         * 根据拓扑顺序记录节点之间的数据依赖，供并行执行时统计每个节点尚未完成的前驱
+         */
+        void BuildDependencies();
+
+        /**
+         * 增加一条依赖，to需要等待from执行完毕，重复的依赖只记录一次
+         * @param from 拓扑序中前驱节点的位置
+         * @param to 拓扑序中后继节点的位置
+         */
+        void AddDependency(uint32_t from, uint32_t to);
+
+        /**
+         * 执行一个节点，并把输出传递给后继节点
+         * @param current_op 需要执行的节点
+         * @param inputs 计算图的输入
+         * @param debug 为true时打印节点的类型
+         */
+        void RunOperator(const std::shared_ptr<RuntimeOperator> &current_op,
+                         const std::vector<std::shared_ptr<Tensor<float>>> &inputs, bool debug);
+
+        /**
+         * 在线程池中按依赖关系执行所有节点，返回时全部节点已经执行完毕
+         * @param inputs 计算图的输入
+         * @param debug 为true时打印每个执行的节点
+         */
+        void ForwardParallel(const std::vector<std::shared_ptr<Tensor<float>>> &inputs, bool debug);
+
+        /**
+         * 执行拓扑序中的一个节点，之后把前驱已经全部完成的后继节点提交到线程池
+         * @param index 节点在拓扑序中的位置
+         */
+        void RunParallel(uint32_t index);
+
+        /**
+         * 从计算图中删除已经被合并的节点
+         * @param names 需要删除的节点名称
+         */
+        void RemoveOperators(const std::set<std::string> &names);
+
         /**
        * 探查下一层的计算节点
        * @param current_op 当前计算节点
@@ -139,12 +271,34 @@ namespace infer_neto {
         std::string output_name_; /// 计算图输出节点的名称
         std::string param_path_;  /// 计算图的结构文件
         std::string bin_path_;    /// 计算图的权重文件
+        ConvTuningMode conv_tuning_mode_ = ConvTuningMode::kHeuristic; /// 卷积计算方式的选择策略
+        std::string conv_cache_path_; /// 卷积计算方式的缓存文件
+        bool operator_fusion_ = true; /// 构建时是否合并算子
+        bool memory_planning_ = true; /// 构建时是否规划中间结果的内存
+        Tensor<float> memory_arena_; /// 中间结果共用的内存池
+        std::vector<MemoryBlock> memory_blocks_; /// 规划得到的内存块，first_use是写入该内存块的节点在拓扑序中的位置
+        size_t planned_memory_bytes_ = 0; /// 内存池的字节数
+        size_t naive_memory_bytes_ = 0;   /// 不做规划时中间结果的总字节数
+
+        struct ParallelExecutor;
+        uint32_t inter_op_threads_ = 0; /// 节点之间并行执行的线程数
+        std::vector<std::vector<uint32_t>> successors_; /// 拓扑序中每个节点的后继，包括复用内存带来的依赖
+        std::vector<uint32_t> predecessor_counts_;      /// 拓扑序中每个节点需要等待的前驱数量
+        std::unique_ptr<ParallelExecutor> executor_;    /// 并行执行时的线程池和计数
+
+        uint32_t batch_size_ = 0; /// 构建时输入的批次大小，动态批次按1计
+        std::unique_ptr<RuntimeSession> batch_session_; /// 批次与构建时不同的推理使用的会话，按批次缓存中间结果
 
         std::vector<std::shared_ptr<RuntimeOperator>> operators_;
         std::map<std::string, std::shared_ptr<RuntimeOperator>> operators_maps_;
         std::vector<std::shared_ptr<RuntimeOperator>> topo_operators_;
 
         std::unique_ptr<pnnx::Graph> graph_; /// pnnx的graph
+
+        /// 会话按构建好的拓扑序和内存规划创建自己的中间结果
+        friend class RuntimeSession;
     };
 
-} // namespace kuiper_infer
\ No newline at end of file
+} // namespace kuiper_infer
+
+#endif //INFERNETO_INFER_IR_HPP
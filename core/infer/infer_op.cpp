@@ -28,8 +28,8 @@ namespace infer_neto {
                     auto& input_datas = input_operand->datas;
 
                     CHECK(!input_operand_shape.empty());
-                    const int32_t batch = input_operand_shape.at(0);
-                    CHECK(batch >= 0) << "Dynamic batch size is not supported!";
+                    // 动态批次(pnnx中记为?)在构建时按一个样本准备，Forward时再按实际的批次创建
+                    const int32_t batch = input_operand_shape.at(0) < 0 ? 1 : input_operand_shape.at(0);
                     CHECK(input_operand_shape.size() == 2 ||
                           input_operand_shape.size() == 4 ||
                           input_operand_shape.size() == 3)
@@ -66,8 +66,8 @@ namespace infer_neto {
             // 得到需要初始化的输出空间
             const auto& output_tensors = runtime_op->output_operands;
             // 获取节点的输出张量应有形状
-            const int32_t batch = operand_shapes.at(0);
-            CHECK(batch >= 0) << "Dynamic batch size is not supported!";
+            // 动态批次在构建时按一个样本准备，其他批次的输出由RuntimeSession按需创建
+            const int32_t batch = operand_shapes.at(0) < 0 ? 1 : operand_shapes.at(0);
             CHECK(operand_shapes.size() == 2 || operand_shapes.size() == 4 ||
                   operand_shapes.size() == 3)
                             << "Unsupported shape sizes: " << operand_shapes.size();
@@ -81,23 +81,9 @@ namespace infer_neto {
                 output_operand->shapes = operand_shapes;
                 output_operand->type = RuntimeDataType::kTypeFloat32;
                 output_operand->name = operand->name + "_output";
-                // 输出空间初始化
-                for (int j = 0; j < batch; ++j) {
-                    if (operand_shapes.size() == 4) {
-                        sftensor output_tensor = TensorCreate(
-                                operand_shapes.at(1), operand_shapes.at(2), operand_shapes.at(3));
-                        output_operand->datas.push_back(output_tensor);
-                    } else if (operand_shapes.size() == 2) {
-                        sftensor output_tensor = TensorCreate(
-                                std::vector<uint32_t>{(uint32_t)operand_shapes.at(1)});
-                        output_operand->datas.push_back(output_tensor);
-                    } else {
-                        // current shape is 3
-                        sftensor output_tensor = TensorCreate(std::vector<uint32_t>{
-                                (uint32_t)operand_shapes.at(1), (uint32_t)operand_shapes.at(2)});
-                        output_operand->datas.push_back(output_tensor);
-                    }
-                }
+                // 输出空间初始化，整个批次位于同一块连续的内存中，每个批次是其中的一个视图
+                const std::vector<uint32_t> sample_shapes(operand_shapes.begin() + 1, operand_shapes.end());
+                output_operand->datas = TensorCreateBatch(batch, sample_shapes);
                 runtime_op->output_operands = std::move(output_operand);
             }
             else {
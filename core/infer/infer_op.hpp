@@ -46,6 +46,7 @@ namespace infer_neto {
         /**
          * 如果图是第一次运行，则根据节点输入operand的形状准备好后续Layer计算中所需要的Tensor
          * 如果图是第二次以上运行，则检查输入operand的形状和operand中张量的形状是否匹配
+         * 批次维度为动态(小于0)时按一个样本准备
          * @param operators 计算图中的计算节点
          */
         static void InitOperatorInput(
@@ -54,6 +55,7 @@ namespace infer_neto {
         /**
          * 如果图是第一次运行，则根据节点输出operand的形状准备好后续Layer计算中所需要的Tensor
          * 如果图是第二次以上运行，则检查输出operand的形状和operand中张量的形状是否匹配
+         * 批次维度为动态(小于0)时按一个样本准备
          * @param pnnx_operators pnnx图节点
          * @param operators KuiperInfer计算图中的计算节点
          */
@@ -0,0 +1,163 @@
+//
+// Created by hanke on 2024/5/18.
+//
+#include "infer_session.hpp"
+#include "data/cpu/tensor_util.hpp"
+#include "node/abstract/node.hpp"
+#include <algorithm>
+#include <iostream>
+#include <map>
+
+namespace infer_neto {
+    RuntimeSession::RuntimeSession(const RuntimeGraph &graph) : graph_(graph) {
+        CHECK(graph.graph_state_ == RuntimeGraph::GraphState::Complete)
+                        << "The graph needs to be built before creating a session";
+        const auto &topo_operators = graph.topo_operators_;
+        std::map<std::string, uint32_t> topo_indices;
+        for (uint32_t i = 0; i < topo_operators.size(); ++i) {
+            topo_indices.insert({topo_operators.at(i)->name, i});
+        }
+
+        const auto it_output = graph.operators_maps_.find(graph.output_name_);
+        CHECK(it_output != graph.operators_maps_.end()) << "Can not find the output operator " << graph.output_name_;
+
+        output_index_ = uint32_t(topo_operators.size());
+        producers_.resize(topo_operators.size());
+        for (uint32_t i = 0; i < topo_operators.size(); ++i) {
+            const auto &op = topo_operators.at(i);
+            for (const auto &input_operand : op->input_operands_seq) {
+                const auto producer_iter = topo_indices.find(input_operand->name);
+                CHECK(producer_iter != topo_indices.end() && producer_iter->second < i)
+                                << op->name << " reads from an unknown operator " << input_operand->name;
+                producers_.at(i).push_back(producer_iter->second);
+            }
+            if (op->type == "pnnx.Output") {
+                CHECK(producers_.at(i).size() == 1) << "The output operator " << op->name << " needs one input";
+                if (op == it_output->second) {
+                    output_index_ = producers_.at(i).front();
+                }
+                continue;
+            }
+            CHECK(op->output_operands != nullptr && !op->output_operands->datas.empty())
+                            << "The output of " << op->name << " is not initialized";
+        }
+        CHECK(output_index_ < topo_operators.size())
+                        << "The output operator " << graph.output_name_ << " has no producer";
+
+        // 内存规划中每个内存块的first_use就是写入它的节点
+        block_indices_.assign(topo_operators.size(), uint32_t(-1));
+        for (uint32_t i = 0; i < graph.memory_blocks_.size(); ++i) {
+            block_indices_.at(graph.memory_blocks_.at(i).first_use) = i;
+        }
+
+        batch_size_ = graph.batch_size_;
+        this->PrepareBatch(batch_size_);
+    }
+
+    RuntimeSession::BatchState &RuntimeSession::PrepareBatch(uint32_t batch) {
+        CHECK(batch > 0) << "The batch size of inputs is zero";
+        const auto state_iter = batch_states_.find(batch);
+        if (state_iter != batch_states_.end()) {
+            return *state_iter->second;
+        }
+
+        // 生命周期与构建时相同，只按批次重新计算每块内存的大小和偏移
+        const auto &topo_operators = graph_.topo_operators_;
+        std::vector<MemoryBlock> blocks = graph_.memory_blocks_;
+        for (MemoryBlock &block : blocks) {
+            const auto &datas = topo_operators.at(block.first_use)->output_operands->datas;
+            block.size = AlignMemorySize(size_t(batch) * datas.front()->size());
+        }
+        auto state = std::make_unique<BatchState>();
+        const size_t arena_size = blocks.empty() ? 0 : PlanMemoryBlocks(blocks);
+        if (arena_size != 0) {
+            state->memory_arena = Tensor<float>(uint32_t(arena_size));
+        }
+
+        state->outputs.resize(topo_operators.size());
+        state->layer_inputs.resize(topo_operators.size());
+        for (uint32_t i = 0; i < topo_operators.size(); ++i) {
+            const auto &op = topo_operators.at(i);
+            state->layer_inputs.at(i).reserve(producers_.at(i).size() * batch);
+            if (op->type == "pnnx.Output") {
+                continue;
+            }
+            auto &outputs = state->outputs.at(i);
+            if (op->type == "pnnx.Input") {
+                // 输入由每次调用提供
+                outputs.resize(batch);
+                continue;
+            }
+
+            const auto &sample = op->output_operands->datas.front();
+            const std::vector<uint32_t> &sample_shapes = sample->raw_shapes();
+            if (op->layer != nullptr && op->layer->IsView()) {
+                // 视图在执行时共用输入的数据，这里只需要形状相同的张量
+                for (uint32_t b = 0; b < batch; ++b) {
+                    outputs.push_back(std::make_shared<Tensor<float>>(sample->View(sample_shapes)));
+                }
+            } else if (block_indices_.at(i) != uint32_t(-1)) {
+                const size_t offset = blocks.at(block_indices_.at(i)).offset;
+                // 别名持有内存池的引用计数，会话销毁之后调用方持有的张量仍然有效
+                const TensorData &arena = state->memory_arena.data();
+                outputs = TensorCreateBatch(batch, sample_shapes, TensorData(arena, arena.get() + offset));
+            } else {
+                // 计算图的输出以及没有规划的中间结果，单独申请
+                outputs = TensorCreateBatch(batch, sample_shapes);
+            }
+        }
+        return *batch_states_.emplace(batch, std::move(state)).first->second;
+    }
+
+    const std::vector<std::shared_ptr<Tensor<float>>> &RuntimeSession::Forward(
+            const std::vector<std::shared_ptr<Tensor<float>>> &inputs, bool debug) {
+        CHECK(!inputs.empty()) << "The inputs of the session are empty";
+        BatchState &state = this->PrepareBatch(uint32_t(inputs.size()));
+        const auto &topo_operators = graph_.topo_operators_;
+        for (uint32_t i = 0; i < topo_operators.size(); ++i) {
+            const auto &op = topo_operators.at(i);
+            if (debug) {
+                std::cout << op->type + "\n" << std::flush;
+            }
+            if (op->type == "pnnx.Input") {
+                std::copy(inputs.begin(), inputs.end(), state.outputs.at(i).begin());
+                continue;
+            }
+            if (op->type == "pnnx.Output") {
+                continue;
+            }
+
+            // 拼接各个来源节点的输出，数组的容量在准备批次时已经预留
+            std::vector<std::shared_ptr<Tensor<float>>> &layer_inputs = state.layer_inputs.at(i);
+            layer_inputs.clear();
+            for (const uint32_t producer : producers_.at(i)) {
+                const auto &producer_outputs = state.outputs.at(producer);
+                layer_inputs.insert(layer_inputs.end(), producer_outputs.begin(), producer_outputs.end());
+            }
+            CHECK(op->layer != nullptr) << op->name << " has no layer";
+            const InferStatus status = op->layer->Forward(layer_inputs, state.outputs.at(i));
+            CHECK(status == InferStatus::kInferSuccess)
+                            << op->layer->layer_name() << " layer forward failed, error code: " << int(status);
+        }
+        // 不再持有输入张量的引用
+        for (uint32_t i = 0; i < topo_operators.size(); ++i) {
+            if (topo_operators.at(i)->type == "pnnx.Input") {
+                std::fill(state.outputs.at(i).begin(), state.outputs.at(i).end(), nullptr);
+            }
+            state.layer_inputs.at(i).clear();
+        }
+        return state.outputs.at(output_index_);
+    }
+
+    size_t RuntimeSession::memory_bytes() const {
+        size_t bytes = 0;
+        for (const auto &[_, state] : batch_states_) {
+            bytes += state->memory_arena.size() * sizeof(float);
+        }
+        return bytes;
+    }
+
+    uint32_t RuntimeSession::batch_size() const {
+        return this->batch_size_;
+    }
+}
@@ -0,0 +1,77 @@
+//
+// Created by hanke on 2024/5/18.
+//
+
+#ifndef INFERNETO_INFER_SESSION_HPP
+#define INFERNETO_INFER_SESSION_HPP
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+#include "infer_ir.hpp"
+
+namespace infer_neto {
+    /**
+     * 一次推理请求的执行上下文，持有中间结果和输出，计算节点、权重和打包后的卷积核仍然属于计算图。
+     * 同一个计算图可以创建多个会话，每个线程使用自己的会话时可以同时调用Forward，权重只有一份。
+     * 会话按拓扑顺序依次执行节点，节点内部仍然使用共享的节点内线程池。
+     * 输入的批次可以与构建时不同，每种批次第一次出现时按计算图的内存规划重新计算偏移并创建中间结果，之后直接复用
+     */
+    class RuntimeSession {
+    public:
+        /**
+         * 按计算图的内存规划创建会话自己的内存池和中间结果，预先准备构建时的批次
+         * @param graph 已经构建好的计算图，需要比会话活得更久，之后不能再修改
+         */
+        explicit RuntimeSession(const RuntimeGraph &graph);
+
+        RuntimeSession(const RuntimeSession &) = delete;
+
+        RuntimeSession &operator=(const RuntimeSession &) = delete;
+
+        /**
+         * 执行一次推理，同样批次的推理第二次起不会申请堆内存；同一个会话不能同时在多个线程中调用
+         * @param inputs 计算图的输入，每个批次一个张量，数量可以与构建时不同
+         * @param debug 为true时打印每个执行的节点
+         * @return 计算图输出节点的张量，该会话下一次同样批次的推理时会被覆盖
+         */
+        const std::vector<std::shared_ptr<Tensor<float>>> &Forward(
+                const std::vector<std::shared_ptr<Tensor<float>>> &inputs, bool debug = false);
+
+        /**
+         * 返回会话中各个批次的内存池的字节数之和，只有构建时的批次时与计算图规划的内存大小相同
+         * @return 内存池的字节数
+         */
+        size_t memory_bytes() const;
+
+        /**
+         * 返回计算图构建时输入的批次大小
+         * @return 批次大小
+         */
+        uint32_t batch_size() const;
+
+    private:
+        /// 一种批次的中间结果
+        struct BatchState {
+            Tensor<float> memory_arena; /// 该批次的内存池
+            std::vector<std::vector<std::shared_ptr<Tensor<float>>>> outputs;      /// 拓扑序中每个节点的输出
+            std::vector<std::vector<std::shared_ptr<Tensor<float>>>> layer_inputs; /// 每个节点拼接后的输入
+        };
+
+        /**
+         * 返回指定批次的中间结果，第一次遇到该批次时按计算图的内存规划创建
+         * @param batch 批次大小
+         * @return 该批次的中间结果
+         */
+        BatchState &PrepareBatch(uint32_t batch);
+
+        const RuntimeGraph &graph_;
+        std::map<uint32_t, std::unique_ptr<BatchState>> batch_states_; /// 批次大小 -> 该批次的中间结果
+        std::vector<std::vector<uint32_t>> producers_;  /// 拓扑序中每个节点各个输入的来源节点
+        std::vector<uint32_t> block_indices_;  /// 拓扑序中每个节点的输出在内存规划中的位置，没有规划时为-1
+        uint32_t output_index_ = 0; /// 计算图输出所在的节点在拓扑序中的位置
+        uint32_t batch_size_ = 0;   /// 计算图构建时输入的批次大小
+    };
+}
+
+#endif //INFERNETO_INFER_SESSION_HPP
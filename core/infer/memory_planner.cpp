@@ -0,0 +1,56 @@
+//
+// Created by hanke on 2024/5/12.
+//
+#include "memory_planner.hpp"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace infer_neto {
+size_t PlanMemoryBlocks(std::vector<MemoryBlock>& blocks) {
+    // 大的内存块先放，小的内存块更容易填进剩下的空隙
+    std::vector<size_t> order(blocks.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&blocks](size_t lhs, size_t rhs) {
+        return blocks.at(lhs).size > blocks.at(rhs).size;
+    });
+
+    size_t arena_size = 0;
+    std::vector<size_t> placed;
+    for (const size_t index : order) {
+        MemoryBlock& block = blocks.at(index);
+        // 已经放好的、与当前内存块同时存活的内存块，按偏移排序
+        std::vector<const MemoryBlock*> alive;
+        for (const size_t other : placed) {
+            const MemoryBlock& placed_block = blocks.at(other);
+            if (placed_block.first_use <= block.last_use && block.first_use <= placed_block.last_use) {
+                alive.push_back(&placed_block);
+            }
+        }
+        std::sort(alive.begin(), alive.end(), [](const MemoryBlock* lhs, const MemoryBlock* rhs) {
+            return lhs->offset < rhs->offset;
+        });
+
+        size_t best_offset = std::numeric_limits<size_t>::max();
+        size_t best_gap = std::numeric_limits<size_t>::max();
+        size_t prev_end = 0;
+        for (const MemoryBlock* other : alive) {
+            if (other->offset > prev_end) {
+                const size_t gap = other->offset - prev_end;
+                if (gap >= block.size && gap < best_gap) {
+                    best_gap = gap;
+                    best_offset = prev_end;
+                }
+            }
+            prev_end = std::max(prev_end, other->offset + other->size);
+        }
+        if (best_offset == std::numeric_limits<size_t>::max()) {
+            best_offset = prev_end;
+        }
+        block.offset = best_offset;
+        arena_size = std::max(arena_size, block.offset + block.size);
+        placed.push_back(index);
+    }
+    return arena_size;
+}
+}
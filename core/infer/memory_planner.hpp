@@ -0,0 +1,41 @@
+//
+// Created by hanke on 2024/5/12.
+//
+
+#ifndef INFERNETO_MEMORY_PLANNER_HPP
+#define INFERNETO_MEMORY_PLANNER_HPP
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace infer_neto {
+/// 内存池中偏移和大小的对齐粒度，单位为float，对应64字节
+constexpr size_t kMemoryAlignment = 16;
+
+/// 内存池中的一块内存，对应一个计算节点的输出操作数
+struct MemoryBlock {
+    size_t size = 0;         /// 需要的float个数
+    uint32_t first_use = 0;  /// 在拓扑序中写入该内存的位置
+    uint32_t last_use = 0;   /// 在拓扑序中最后一次读取该内存的位置
+    size_t offset = 0;       /// 规划得到的偏移，单位为float
+};
+
+/**
+ * 按大小从大到小依次为内存块分配偏移，生命周期有交集的内存块在内存池中不会重叠
+ * 每个内存块放入与之同时存活的内存块之间能容纳它的最小空隙中，没有合适的空隙时放在最后
+ * 生命周期是闭区间，因此节点的输入和输出不会共用同一块内存
+ * @param blocks 需要规划的内存块，偏移写回到offset中
+ * @return 内存池的大小，单位为float
+ */
+size_t PlanMemoryBlocks(std::vector<MemoryBlock>& blocks);
+
+/**
+ * 将大小向上取整到kMemoryAlignment的整数倍
+ * @param size 需要的float个数
+ * @return 对齐后的float个数
+ */
+inline size_t AlignMemorySize(size_t size) {
+    return (size + kMemoryAlignment - 1) / kMemoryAlignment * kMemoryAlignment;
+}
+}
+#endif //INFERNETO_MEMORY_PLANNER_HPP
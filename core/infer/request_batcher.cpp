@@ -0,0 +1,171 @@
+//
+// Created by hanke on 2024/5/19.
+//
+#include "request_batcher.hpp"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <glog/logging.h>
+
+namespace infer_neto {
+    RequestBatcher::RequestBatcher(const RuntimeGraph &graph, const BatchingOptions &options)
+            : session_(graph), options_(options) {
+        graph_batch_size_ = session_.batch_size();
+        CHECK(graph_batch_size_ > 0) << "The graph has no input batch";
+        const auto &topo_operators = graph.get_topo_queues();
+        const auto input_iter = std::find_if(topo_operators.begin(), topo_operators.end(), [](const auto &op) {
+            return op->type == "pnnx.Input";
+        });
+        CHECK(input_iter != topo_operators.end() && (*input_iter)->output_operands != nullptr &&
+              !(*input_iter)->output_operands->datas.empty()) << "The graph has no input operator";
+        input_shapes_ = (*input_iter)->output_operands->datas.front()->raw_shapes();
+        if (options_.max_batch_size == 0) {
+            options_.max_batch_size = graph_batch_size_;
+        }
+        inputs_.reserve(options_.max_batch_size);
+        latencies_ms_.reserve(kLatencyWindow);
+        worker_ = std::thread([this]() { this->Run(); });
+    }
+
+    RequestBatcher::~RequestBatcher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wakeup_.notify_all();
+        worker_.join();
+    }
+
+    std::future<std::shared_ptr<Tensor<float>>> RequestBatcher::Submit(std::shared_ptr<Tensor<float>> input) {
+        Request request;
+        std::future<std::shared_ptr<Tensor<float>>> result = request.result.get_future();
+        // 形状不对的请求不进入队列，只让它自己的结果带上异常，不影响同一批的其他请求
+        if (input == nullptr || input->empty() || input->raw_shapes() != input_shapes_) {
+            std::ostringstream message;
+            message << "The input of a request should have the shape (";
+            for (size_t i = 0; i < input_shapes_.size(); ++i) {
+                message << (i == 0 ? "" : ",") << input_shapes_.at(i);
+            }
+            message << ")";
+            request.result.set_exception(std::make_exception_ptr(std::invalid_argument(message.str())));
+            return result;
+        }
+        request.input = std::move(input);
+        request.submit_time = Clock::now();
+        {
+            std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+            if (!started_) {
+                started_ = true;
+                first_submit_ = request.submit_time;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            CHECK(!stop_) << "The request batcher is stopping";
+            queue_.push_back(std::move(request));
+        }
+        wakeup_.notify_one();
+        return result;
+    }
+
+    BatchingStats RequestBatcher::stats() const {
+        BatchingStats stats;
+        std::vector<double> latencies;
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            stats.requests = completed_requests_;
+            stats.batches = completed_batches_;
+            latencies = latencies_ms_;
+            if (completed_requests_ != 0) {
+                const double seconds = std::chrono::duration<double>(last_complete_ - first_submit_).count();
+                stats.throughput = seconds > 0 ? double(completed_requests_) / seconds : 0;
+            }
+        }
+        if (stats.batches != 0) {
+            stats.average_batch_size = double(stats.requests) / double(stats.batches);
+        }
+        if (!latencies.empty()) {
+            // 取最接近分位点的样本，不做插值
+            const auto percentile = [&latencies](double p) {
+                const size_t index = std::min(latencies.size() - 1, size_t(p * double(latencies.size())));
+                std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+                return latencies.at(index);
+            };
+            stats.p50_latency_ms = percentile(0.50);
+            stats.p99_latency_ms = percentile(0.99);
+        }
+        return stats;
+    }
+
+    uint32_t RequestBatcher::max_batch_size() const {
+        return options_.max_batch_size;
+    }
+
+    void RequestBatcher::Run() {
+        std::vector<Request> batch;
+        batch.reserve(options_.max_batch_size);
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wakeup_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+                if (queue_.empty()) {
+                    // stop_为true且队列已经清空
+                    return;
+                }
+                // 等待凑满一批，最早的请求到期或者队列停止时不再等待
+                const Clock::time_point deadline = queue_.front().submit_time + options_.max_delay;
+                wakeup_.wait_until(lock, deadline, [this]() {
+                    return stop_ || queue_.size() >= options_.max_batch_size;
+                });
+                const size_t count = std::min<size_t>(queue_.size(), options_.max_batch_size);
+                for (size_t i = 0; i < count; ++i) {
+                    batch.push_back(std::move(queue_.front()));
+                    queue_.pop_front();
+                }
+            }
+            this->RunBatch(batch);
+            batch.clear();
+        }
+    }
+
+    void RequestBatcher::RunBatch(std::vector<Request> &batch) {
+        CHECK(!batch.empty() && batch.size() <= options_.max_batch_size);
+        // 会话按批次大小缓存中间结果，不足一批时直接按实际的请求数推理，不需要补齐
+        inputs_.clear();
+        for (const Request &request : batch) {
+            inputs_.push_back(request.input);
+        }
+
+        const std::vector<std::shared_ptr<Tensor<float>>> &outputs = session_.Forward(inputs_);
+        inputs_.clear();
+        CHECK(outputs.size() == batch.size())
+                        << "The graph returns " << outputs.size() << " outputs for a batch of " << batch.size();
+        // 会话的输出会被下一批覆盖，交付给请求方的是各自的副本
+        std::vector<std::shared_ptr<Tensor<float>>> results;
+        results.reserve(batch.size());
+        for (uint32_t i = 0; i < batch.size(); ++i) {
+            results.push_back(std::make_shared<Tensor<float>>(*outputs.at(i)));
+        }
+
+        const Clock::time_point complete_time = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            for (const Request &request : batch) {
+                const double latency = std::chrono::duration<double, std::milli>(complete_time - request.submit_time).count();
+                if (latencies_ms_.size() < kLatencyWindow) {
+                    latencies_ms_.push_back(latency);
+                } else {
+                    latencies_ms_.at(latency_cursor_) = latency;
+                }
+                latency_cursor_ = (latency_cursor_ + 1) % kLatencyWindow;
+            }
+            completed_requests_ += batch.size();
+            completed_batches_ += 1;
+            last_complete_ = complete_time;
+        }
+        // 统计数据更新之后再交付，请求方拿到结果时统计中已经包含该请求
+        for (uint32_t i = 0; i < batch.size(); ++i) {
+            batch.at(i).result.set_value(std::move(results.at(i)));
+        }
+    }
+}
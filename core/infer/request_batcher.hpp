@@ -0,0 +1,121 @@
+//
+// Created by hanke on 2024/5/19.
+//
+
+#ifndef INFERNETO_REQUEST_BATCHER_HPP
+#define INFERNETO_REQUEST_BATCHER_HPP
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "infer_session.hpp"
+
+namespace infer_neto {
+/// 请求合批的参数
+struct BatchingOptions {
+    uint32_t max_batch_size = 0;  /// 一批最多包含的请求数，为0时取计算图构建时输入的批次大小
+    std::chrono::microseconds max_delay{2000};  /// 最早的请求最多等待多久就开始推理，不再等凑满一批
+};
+
+/// 合批队列的统计数据
+struct BatchingStats {
+    uint64_t requests = 0;          /// 已经完成的请求数
+    uint64_t batches = 0;           /// 已经执行的推理次数
+    double average_batch_size = 0;  /// 平均每次推理包含的请求数
+    double p50_latency_ms = 0;      /// 最近完成的请求中，从提交到得到结果的延迟的中位数
+    double p99_latency_ms = 0;      /// 最近完成的请求中，延迟的99分位数
+    double throughput = 0;          /// 从第一个请求提交到最后一个请求完成，平均每秒完成的请求数
+};
+
+/**
+ * 计算图之前的合批队列，把单个样本的请求攒成一批后只调用一次Forward，再把各样本的结果分别交给请求方。
+ * 队列中的请求达到一批的上限，或者最早的请求已经等待了max_delay时开始推理。
+ * 每次推理的批次就是实际的请求数，会话按批次大小缓存中间结果，一批的上限可以大于计算图构建时的批次
+ */
+class RequestBatcher {
+public:
+    /**
+     * 创建合批队列和执行推理的线程
+     * @param graph 已经构建好的计算图，需要比队列活得更久
+     * @param options 合批的参数
+     */
+    explicit RequestBatcher(const RuntimeGraph &graph, const BatchingOptions &options = BatchingOptions());
+
+    /**
+     * 执行完队列中剩余的请求后退出推理线程
+     */
+    ~RequestBatcher();
+
+    RequestBatcher(const RequestBatcher &) = delete;
+
+    RequestBatcher &operator=(const RequestBatcher &) = delete;
+
+    /**
+     * 提交一个单样本的请求，可以在多个线程中同时调用
+     * @param input 一个样本的输入，形状与计算图的输入相同，推理完成之前不能修改
+     * @return 该样本的输出，与计算图的输出相互独立；输入为空或形状不同时不会推理，get()抛出std::invalid_argument
+     */
+    std::future<std::shared_ptr<Tensor<float>>> Submit(std::shared_ptr<Tensor<float>> input);
+
+    /**
+     * 返回当前的统计数据
+     * @return 统计数据
+     */
+    BatchingStats stats() const;
+
+    /**
+     * 返回一批最多包含的请求数
+     * @return 一批的上限
+     */
+    uint32_t max_batch_size() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    /// 队列中等待推理的一个请求
+    struct Request {
+        std::shared_ptr<Tensor<float>> input;
+        std::promise<std::shared_ptr<Tensor<float>>> result;
+        Clock::time_point submit_time;
+    };
+
+    void Run();
+
+    /**
+     * 推理一批请求并交付结果
+     * @param batch 本批的请求，数量不超过一批的上限
+     */
+    void RunBatch(std::vector<Request> &batch);
+
+    RuntimeSession session_;
+    uint32_t graph_batch_size_ = 0;  /// 计算图构建时输入的批次大小
+    std::vector<uint32_t> input_shapes_;  /// 一个样本的输入形状，提交时检查
+    std::vector<std::shared_ptr<Tensor<float>>> inputs_;  /// 本批的输入，只在推理线程中使用
+    BatchingOptions options_;
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::deque<Request> queue_;  /// 等待推理的请求，由mutex_保护
+    bool stop_ = false;
+
+    /// 统计数据，由stats_mutex_保护；延迟只保留最近的kLatencyWindow个请求
+    static constexpr size_t kLatencyWindow = 4096;
+    mutable std::mutex stats_mutex_;
+    std::vector<double> latencies_ms_;
+    size_t latency_cursor_ = 0;
+    uint64_t completed_requests_ = 0;
+    uint64_t completed_batches_ = 0;
+    bool started_ = false;
+    Clock::time_point first_submit_;
+    Clock::time_point last_complete_;
+
+    std::thread worker_;  /// 最后声明，其他成员都初始化之后才启动
+};
+}
+
+#endif //INFERNETO_REQUEST_BATCHER_HPP
@@ -26,6 +26,18 @@ void Layer::set_weights(
   LOG(FATAL) << this->layer_name_ << " layer not implement yet!";
 }
 
+bool Layer::FuseActivation(const std::string& activation_type) {
+  return false;
+}
+
+bool Layer::FuseResidualAdd() {
+  return false;
+}
+
+bool Layer::IsView() const {
+  return false;
+}
+
 InferStatus Layer::Forward(
     const std::vector<std::shared_ptr<Tensor<float>>>& inputs,
     std::vector<std::shared_ptr<Tensor<float>>>& outputs) {
@@ -39,8 +51,9 @@ InferStatus Layer::Forward() {
   // 准备节点layer计算所需要的输入
   const std::vector<std::shared_ptr<RuntimeOperand>>& input_operand_datas =
       runtime_operator->input_operands_seq;
-  // layer的输入
-  std::vector<std::shared_ptr<Tensor<float>>> layer_input_datas;
+  // layer的输入，复用上一次的数组以免每次执行都申请内存
+  std::vector<std::shared_ptr<Tensor<float>>>& layer_input_datas = this->layer_input_datas_;
+  layer_input_datas.clear();
   for (const auto& input_operand_data : input_operand_datas) {
     for (const auto& input_data : input_operand_data->datas) {
       layer_input_datas.push_back(input_data);
@@ -58,6 +71,8 @@ InferStatus Layer::Forward() {
   // layer的计算结果存放在current_op->output_operands->datas中
   InferStatus status = runtime_operator->layer->Forward(
       layer_input_datas, output_operand_datas->datas);
+  // 不再持有输入张量的引用
+  layer_input_datas.clear();
   return status;
 }
 
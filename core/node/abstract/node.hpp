@@ -72,6 +72,27 @@ class Layer {
    */
   virtual void set_bias(const std::vector<float>& bias);
 
+  /**
+   * 将紧随其后的激活函数合并到该层中，在该层写回输出时一并计算
+   * @param activation_type 激活函数节点的类型，例如nn.ReLU
+   * @return 该层能够合并这种激活函数时返回true，此后该层的输出即为激活后的结果
+   */
+  virtual bool FuseActivation(const std::string& activation_type);
+
+  /**
+   * 将紧随其后的逐元素相加合并到该层中，该层写回输出时直接加上另一个加数
+   * 合并后该层输入的后一半是另一个加数，形状与该层的输出相同
+   * @return 该层能够合并逐元素相加时返回true
+   */
+  virtual bool FuseResidualAdd();
+
+  /**
+   * 返回该层的输出是否只是第一个输入的视图，例如只改变形状的展开
+   * 这样的层与输入共用数据，不需要单独的输出空间
+   * @return 输出与第一个输入共用数据时返回true
+   */
+  virtual bool IsView() const;
+
   /**
    * 返回层的名称
    * @return 层的名称
@@ -88,6 +109,9 @@ class Layer {
  protected:
   std::weak_ptr<RuntimeOperator> runtime_operator_;
   std::string layer_name_;  /// Layer的名称
+
+ private:
+  std::vector<std::shared_ptr<Tensor<float>>> layer_input_datas_;  /// Forward()中拼接的输入
 };
 
 }  // namespace kuiper_infer
@@ -5,6 +5,7 @@
 #include <cmath>
 #include "adaptive_avgpooling.hpp"
 #include "node/abstract/node_factory.hpp"
+#include "data/cpu/thread_pool.hpp"
 
 namespace infer_neto {
 InferStatus AdaptiveAveragePoolingLayer::Forward(
@@ -84,26 +85,29 @@ InferStatus AdaptiveAveragePoolingLayer::Forward(
                         << i << "th";
 
         const uint32_t pooling_size = pooling_h * pooling_w;
-        for (uint32_t ic = 0; ic < input_c; ++ic) {
-            const float*  input_channel = input_data->slice(ic);
-            float* output_channel = output_data->slice(ic);
-            for (uint32_t row = 0; row < input_h - pooling_h + 1; row += stride_h) {
-                int output_row = int(row / stride_h);
-                for (uint32_t col = 0; col < input_w - pooling_w + 1; col += stride_w) {
-                    int output_col = int(col / stride_w);
-                    float mean_value = 0.f;
-                    for (uint32_t w = 0; w < pooling_w; ++w) {
-                        for (uint32_t h = 0; h < pooling_h; ++h) {
-                            uint32_t current_row = row + h;
-                            uint32_t current_col = col + w;
-                            float current_value = input_channel[current_row * input_w + current_col];
-                            mean_value = mean_value + current_value;
+        // 按通道分给多个线程
+        ParallelFor(input_c, ParallelGrain(size_t(output_h_) * output_w_ * pooling_size), [&](size_t c_begin, size_t c_end) {
+            for (uint32_t ic = uint32_t(c_begin); ic < uint32_t(c_end); ++ic) {
+                const float*  input_channel = input_data->slice(ic);
+                float* output_channel = output_data->slice(ic);
+                for (uint32_t row = 0; row < input_h - pooling_h + 1; row += stride_h) {
+                    int output_row = int(row / stride_h);
+                    for (uint32_t col = 0; col < input_w - pooling_w + 1; col += stride_w) {
+                        int output_col = int(col / stride_w);
+                        float mean_value = 0.f;
+                        for (uint32_t w = 0; w < pooling_w; ++w) {
+                            for (uint32_t h = 0; h < pooling_h; ++h) {
+                                uint32_t current_row = row + h;
+                                uint32_t current_col = col + w;
+                                float current_value = input_channel[current_row * input_w + current_col];
+                                mean_value = mean_value + current_value;
+                            }
                         }
+                        output_channel[output_row * output_w_ + output_col] = mean_value / float(pooling_size);
                     }
-                    output_channel[output_row * output_w_ + output_col] = mean_value / float(pooling_size);
                 }
             }
-        }
+        });
     }
     return InferStatus::kInferSuccess;
 }
@@ -8,6 +8,11 @@
 #include "convolution.hpp"
 #include "node/abstract/node_factory.hpp"
 #include "infer/infer_ir.hpp"
+#include "data/cpu/gemm.hpp"
+#include "data/cpu/im2col.hpp"
+#include "data/cpu/winograd.hpp"
+#include "data/cpu/direct_conv.hpp"
+#include "data/cpu/tensor_util.hpp"
 
 namespace infer_neto {
 InferStatus ConvolutionLayer::Forward(const std::vector<std::shared_ptr<Tensor<float>>> &inputs,
@@ -17,7 +22,9 @@ InferStatus ConvolutionLayer::Forward(const std::vector<std::shared_ptr<Tensor<f
         return InferStatus::kInferFailedInputEmpty;
     }
 
-    if (inputs.size() != outputs.size()) {
+    // 合并了残差相加时，输入的后一半是与输出形状相同的残差
+    const size_t input_count = fused_residual_ ? 2 * outputs.size() : outputs.size();
+    if (inputs.size() != input_count) {
         LOG(ERROR) << "The input and output tensor array size of the convolution "
                       "layer do not match";
         return InferStatus::kInferFailedInputOutSizeMatchError;
@@ -56,22 +63,39 @@ InferStatus ConvolutionLayer::Forward(const std::vector<std::shared_ptr<Tensor<f
         CHECK(kernel->channels() == kernel_c);
     }
     const uint32_t kernel_count_group = kernel_count / groups_;
-    const uint32_t batch_size = inputs.size();
+    const uint32_t batch_size = outputs.size();
 
     if (kernel_matrix_arr_.empty()) {
         this->InitIm2ColWeight();
     }
 
-    if (!kernel_matrix_arr_.empty()) {
-        if (groups_ == 1) {
-            CHECK(kernel_matrix_arr_.size() == kernel_count_group)
-                            << "The number of kernel matrix and kernel_count_group do not match";
-        } else {
-            CHECK(kernel_matrix_arr_.size() == kernel_count)
-                            << "The number of kernel matrix and kernel_count do not match";
-        }
+    CHECK(kernel_matrix_arr_.size() == groups_)
+                    << "The number of kernel matrix and groups do not match";
+
+    const bool use_winograd = algorithm_ == ConvAlgorithm::kWinograd2x2 ||
+                              algorithm_ == ConvAlgorithm::kWinograd4x4;
+    if (use_winograd && winograd_kernel_.empty()) {
+        this->InitWinogradWeight();
+    }
+
+    // 无填充的1x1卷积不需要im2col，输入的CHW数据本身就是 [input_c, input_h * input_w] 的矩阵
+    const bool pointwise = kernel_h == 1 && kernel_w == 1 && padding_h_ == 0 && padding_w_ == 0;
+    // 整个批次的输入、输出和残差分别在同一块内存中等间隔排列时，把批次合并进矩阵乘法的列，卷积核只打包一次
+    size_t input_batch_stride = 0;
+    size_t output_batch_stride = 0;
+    size_t residual_batch_stride = 0;
+    bool fold_batch = false;
+    if (!use_winograd && algorithm_ != ConvAlgorithm::kDirect && batch_size > 1) {
+        input_batch_stride = TensorBatchStride(inputs, 0, batch_size);
+        output_batch_stride = TensorBatchStride(outputs, 0, batch_size);
+        residual_batch_stride = fused_residual_ ? TensorBatchStride(inputs, batch_size, batch_size) : 0;
+        fold_batch = input_batch_stride != 0 && output_batch_stride != 0 &&
+                     (!fused_residual_ || residual_batch_stride != 0);
     }
 
+    // 工作区按线程缓存并在多次前向之间复用，同一个卷积层可以同时在多个线程中执行
+    thread_local std::vector<float> im2col_workspace;
+    thread_local std::vector<uint32_t> pointwise_col_offsets;
     for (uint32_t i = 0; i < batch_size; ++i) {
         const std::shared_ptr<Tensor<float>>& input = inputs.at(i);
         CHECK(input != nullptr && !input->empty())
@@ -103,96 +127,131 @@ InferStatus ConvolutionLayer::Forward(const std::vector<std::shared_ptr<Tensor<f
         CHECK(input_c_group == kernel_c) << "The number of channel for the kernel "
                                             "matrix and input tensor do not match";
 
-        for (uint32_t g = 0; g < groups_; ++g) {
-            Tensor<float> input_matrix = Im2Col(input, kernel_w, kernel_h, input->cols(), input->rows(), input_c_group, g, row_len, col_len);
-            std::shared_ptr<Tensor<float>> output_tensor = outputs.at(i);
-            if (output_tensor == nullptr || output_tensor->empty()) {
-                output_tensor = std::make_shared<Tensor<float>>(kernel_count, output_h, output_w);
-                outputs.at(i) = output_tensor;
+        std::shared_ptr<Tensor<float>> output_tensor = outputs.at(i);
+        if (output_tensor == nullptr || output_tensor->empty()) {
+            output_tensor = std::make_shared<Tensor<float>>(kernel_count, output_h, output_w);
+            outputs.at(i) = output_tensor;
+        }
+
+        CHECK(output_tensor->rows() == output_h &&
+              output_tensor->cols() == output_w &&
+              output_tensor->channels() == kernel_count)
+                        << "The output tensor array in the convolution layer has an "
+                           "incorrectly sized tensor "
+                        << i << "th";
+
+        const float* residual = nullptr;
+        if (fused_residual_) {
+            const std::shared_ptr<Tensor<float>>& residual_tensor = inputs.at(batch_size + i);
+            CHECK(residual_tensor != nullptr && TensorShapeIsSame(*residual_tensor, *output_tensor))
+                            << "The residual tensor in the convolution layer has an incorrect shape " << i << "th";
+            CHECK(residual_tensor->raw_ptr() != output_tensor->raw_ptr())
+                            << "The residual tensor can not share memory with the output tensor";
+            residual = residual_tensor->raw_ptr();
+        }
+
+        if (use_winograd) {
+            const uint32_t output_tile = algorithm_ == ConvAlgorithm::kWinograd2x2 ? 2 : 4;
+            WinogradConv3x3(input->raw_ptr(), input_c, input->rows(), input->cols(), padding_h_, padding_w_,
+                            winograd_kernel_.data(), kernel_count,
+                            use_bias_ ? bias_values_.data() : nullptr, output_tile, output_tensor->raw_ptr(),
+                            residual, fused_relu_);
+            continue;
+        }
+
+        if (algorithm_ == ConvAlgorithm::kDirect) {
+            for (uint32_t g = 0; g < groups_; ++g) {
+                DirectConv2d(input->matrix_raw_ptr(g * input_c_group), input_c_group, input->rows(), input->cols(),
+                             kernel_matrix_arr_.at(g).data().get(), kernel_count_group, kernel_h, kernel_w,
+                             padding_h_, padding_w_, stride_h_, stride_w_,
+                             use_bias_ ? bias_values_.data() + g * kernel_count_group : nullptr,
+                             output_tensor->matrix_raw_ptr(g * kernel_count_group),
+                             residual ? residual + size_t(g) * kernel_count_group * col_len : nullptr, fused_relu_);
             }
+            continue;
+        }
 
-            CHECK(output_tensor->rows() == output_h &&
-                  output_tensor->cols() == output_w &&
-                  output_tensor->channels() == kernel_count)
-                            << "The output tensor array in the convolution layer has an "
-                               "incorrectly sized tensor "
-                            << i << "th";
-
-            const uint32_t kernel_count_group_start = kernel_count_group * g;
-            for (uint32_t k = 0; k < kernel_count_group; ++k) {
-                Tensor<float> kernel;
-                if (groups_ == 1) {
-                    kernel = kernel_matrix_arr_.at(k);
-                } else {
-                    kernel = kernel_matrix_arr_.at(kernel_count_group_start + k);
+        // 合并批次时在第一个样本处计算整个批次，其余样本的形状与第一个样本相同
+        if (fold_batch && i != 0) {
+            continue;
+        }
+        const uint32_t gemm_batch = fold_batch ? batch_size : 1;
+        const uint32_t input_size = input->rows() * input->cols();
+        const uint32_t* input_col_offsets = nullptr;
+        if (pointwise && (stride_h_ != 1 || stride_w_ != 1)) {
+            // 步长大于1时按输出位置记录其在输入通道内的偏移，矩阵乘法打包时直接跨步读取
+            pointwise_col_offsets.resize(col_len);
+            for (uint32_t oh = 0; oh < output_h; ++oh) {
+                for (uint32_t ow = 0; ow < output_w; ++ow) {
+                    pointwise_col_offsets.at(oh * output_w + ow) = oh * stride_h_ * input->cols() + ow * stride_w_;
                 }
-                ConvGemmBias(input_matrix, output_tensor, g, k, kernel_count_group, kernel, output_w, output_h);
+            }
+            input_col_offsets = pointwise_col_offsets.data();
+        } else if (!pointwise) {
+            // 展开后的输入矩阵写入复用的工作区，避免每次前向都重新分配
+            const size_t workspace_size = size_t(gemm_batch) * input_c_group * row_len * col_len;
+            if (im2col_workspace.size() < workspace_size) {
+                im2col_workspace.resize(workspace_size);
             }
         }
-    }
-    return InferStatus::kInferSuccess;
-}
 
-Tensor<float> ConvolutionLayer::Im2Col(sftensor input, uint32_t kernel_w,
-                                       uint32_t kernel_h, uint32_t input_w,
-                                       uint32_t input_h, uint32_t input_c_group,
-                                       uint32_t group, uint32_t row_len,
-                                       uint32_t col_len) const {
-
-    Tensor<float> input_matrix(input_c_group * row_len, col_len);
-    const uint32_t input_padded_h = input_h + 2 * padding_h_;
-    const uint32_t input_padded_w = input_w + 2 * padding_w_;
-    const float padding_value = 0.f;
-
-    for (uint32_t ic = 0; ic < input_c_group; ++ic) {
-        uint32_t current_col = 0;
-        for (uint32_t r = 0; r < input_padded_h - kernel_h + 1; r += stride_h_) {
-            for (uint32_t w = 0; w < input_padded_w - kernel_w + 1; w += stride_w_) {
-                for (uint32_t kh = 0; kh < kernel_h; ++kh) {
-                    for (uint32_t kw = 0; kw < kernel_w; ++kw) {
-                        uint32_t col_index = kh * kernel_w + kw;
-                        if ((r + kh >= padding_h_ && w + kw >= padding_w_) && (r + kh < input_h + padding_h_ && w + kw < input_w + padding_w_)) {
-                            uint32_t input_row = r + kh - padding_h_;
-                            uint32_t input_col = w + kw - padding_w_;
-                            float val = input->at(ic + group * input_c_group, input_row, input_col);
-                            input_matrix.at(0, col_index + ic * row_len, current_col) = val;
-                        } else {
-                            input_matrix.at(0, col_index + ic * row_len, current_col) = padding_value;
-                        }
-                    }
+        for (uint32_t g = 0; g < groups_; ++g) {
+            const float* input_group = input->matrix_raw_ptr(g * input_c_group);
+            const Tensor<float>& kernel = kernel_matrix_arr_.at(g);
+            if (pointwise) {
+                ConvGemmBias(input_group, input_size, input_batch_stride, input_col_offsets, output_tensor,
+                             gemm_batch, output_batch_stride, g, kernel_count_group, kernel, output_w, output_h,
+                             residual, residual_batch_stride);
+            } else {
+                // 每个样本展开后的矩阵在工作区中依次排列
+                const size_t sample_workspace = size_t(input_c_group) * row_len * col_len;
+                for (uint32_t b = 0; b < gemm_batch; ++b) {
+                    Im2Col(inputs.at(i + b)->matrix_raw_ptr(g * input_c_group), input_c_group, input->rows(),
+                           input->cols(), kernel_h, kernel_w, padding_h_, padding_w_, stride_h_, stride_w_,
+                           im2col_workspace.data() + b * sample_workspace);
                 }
-                current_col++;
+                ConvGemmBias(im2col_workspace.data(), col_len, sample_workspace, nullptr, output_tensor,
+                             gemm_batch, output_batch_stride, g, kernel_count_group, kernel, output_w, output_h,
+                             residual, residual_batch_stride);
             }
         }
     }
-    return input_matrix;
+    return InferStatus::kInferSuccess;
 }
 
-void ConvolutionLayer::ConvGemmBias(const Tensor<float>& input_matrix,
+void ConvolutionLayer::ConvGemmBias(const float* input_matrix, uint32_t input_ld, size_t input_batch_stride,
+                                    const uint32_t* input_col_offsets,
                                     const std::shared_ptr<Tensor<float>>& output_tensor,
-                                    uint32_t group, uint32_t kernel_index,
-                                    uint32_t kernel_count_group, const Tensor<float>& kernel,
-                                    uint32_t output_w, uint32_t output_h) const {
-
-
-    // 执行矩阵乘法
-    Tensor<float> output = kernel.Gemm(input_matrix);
-
-    // 添加偏置（如果使用）
-    if (this->use_bias_ && !this->bias_.empty()) {
-        std::shared_ptr<Tensor<float>> bias = this->bias_.at(kernel_index);
-        if (bias && !bias->empty()) {
-            float bias_value = bias->index(0);
-            output.AddScalar(bias_value);  // 使用前面定义的AddBias方法
-        } else {
-            LOG(FATAL) << "Bias tensor is empty or nullptr";
-        }
-    }
-    // 将计算结果复制回输出张量
-    float* dest = output_tensor->slice(kernel_index + group * kernel_count_group);
-    const float* src = output.raw_ptr();
-    std::memcpy(dest, src, output.size() * sizeof(float));
-
+                                    uint32_t batch, size_t output_batch_stride,
+                                    uint32_t group, uint32_t kernel_count_group,
+                                    const Tensor<float>& kernel,
+                                    uint32_t output_w, uint32_t output_h,
+                                    const float* residual, size_t residual_batch_stride) const {
+    const uint32_t col_len = output_h * output_w;
+    const uint32_t row_len = kernel.cols();
+    CHECK(input_matrix != nullptr && kernel.rows() == kernel_count_group)
+                    << "The kernel matrix and input matrix of the convolution layer do not match";
+
+    // 偏置以及合并进来的残差和ReLU在矩阵乘法写回时一并完成
+    GemmEpilogue epilogue;
+    epilogue.relu = this->fused_relu_;
+    if (residual != nullptr) {
+        epilogue.residual = residual + size_t(group) * kernel_count_group * col_len;
+        epilogue.ldr = col_len;
+        epilogue.residual_batch_stride = residual_batch_stride;
+    }
+    if (this->use_bias_) {
+        CHECK(bias_values_.size() == this->weights_.size())
+                        << "Bias tensor is empty or nullptr";
+        epilogue.bias = bias_values_.data() + group * kernel_count_group;
+    }
+
+    // 整组卷积核 [kernel_count_group, row_len] 与每个样本的 [row_len, col_len] 相乘，直接写入输出张量
+    float* output = output_tensor->matrix_raw_ptr(group * kernel_count_group);
+    SGemmBatchedB(batch, kernel_count_group, col_len, row_len,
+                  kernel.data().get(), row_len,
+                  input_matrix, input_ld, input_batch_stride, input_col_offsets,
+                  output, col_len, output_batch_stride, epilogue);
 }
 
 void ConvolutionLayer::InitIm2ColWeight() {
@@ -212,38 +271,151 @@ void ConvolutionLayer::InitIm2ColWeight() {
         CHECK(kernel->channels() == kernel_c);
     }
 
-    if (groups_ == 1) {
-        const uint32_t kernel_count_group = kernel_count / groups_;
-        std::vector<Tensor<float>> kernel_matrix_arr(kernel_count_group);
-        Tensor<float> kernel_matrix_c(row_len * kernel_c);
-
+    // 每组的卷积核排布为一个 [kernel_count_group, kernel_c * kernel_h * kernel_w] 的矩阵
+    const uint32_t kernel_count_group = kernel_count / groups_;
+    std::vector<Tensor<float>> kernel_matrix_arr;
+    for (uint32_t g = 0; g < groups_; ++g) {
+        Tensor<float> kernel_matrix(kernel_count_group, row_len * kernel_c);
         for (uint32_t k = 0; k < kernel_count_group; ++k) {
-            const std::shared_ptr<Tensor<float>>& kernel = this->weights_.at(k);
+            const std::shared_ptr<Tensor<float>>& kernel = this->weights_.at(k + g * kernel_count_group);
             for (uint32_t ic = 0; ic < kernel->channels(); ++ic) {
-                memcpy(kernel_matrix_c.raw_ptr() + row_len * ic,
+                memcpy(kernel_matrix.raw_ptr() + k * row_len * kernel_c + row_len * ic,
                        kernel->matrix_raw_ptr(ic), row_len * sizeof(float));
             }
-            kernel_matrix_arr.at(k) = kernel_matrix_c;
         }
-        this->kernel_matrix_arr_ = std::move(kernel_matrix_arr);
-    } else {
-        // group != 1
-        const uint32_t kernel_count_group = kernel_count / groups_;
-        std::vector<Tensor<float>> kernel_matrix_arr;
-        for (uint32_t g = 0; g < groups_; ++g) {
-            Tensor<float> kernel_matrix_c(row_len * kernel_c);
-            for (uint32_t k = 0; k < kernel_count_group; ++k) {
-                const std::shared_ptr<Tensor<float>>& kernel = this->weights_.at(k + g * kernel_count_group);
-                for (uint32_t ic = 0; ic < kernel->channels(); ++ic) {
-                    memcpy(kernel_matrix_c.raw_ptr() + row_len * ic,kernel->matrix_raw_ptr(ic), row_len * sizeof(float));
-                }
-                kernel_matrix_arr.emplace_back(kernel_matrix_c);
-            }
+        kernel_matrix_arr.push_back(std::move(kernel_matrix));
+    }
+    CHECK(kernel_matrix_arr.size() == groups_);
+    this->kernel_matrix_arr_ = std::move(kernel_matrix_arr);
+
+    // 偏置按输出通道连续排布，供矩阵乘法的后处理使用
+    if (this->use_bias_) {
+        CHECK(this->bias_.size() == kernel_count);
+        std::vector<float> bias_values(kernel_count);
+        for (uint32_t k = 0; k < kernel_count; ++k) {
+            const std::shared_ptr<Tensor<float>>& bias = this->bias_.at(k);
+            CHECK(bias != nullptr && !bias->empty()) << "Bias tensor is empty or nullptr";
+            bias_values.at(k) = bias->index(0);
         }
-        CHECK(kernel_matrix_arr.size() == kernel_count);
-        this->kernel_matrix_arr_ = std::move(kernel_matrix_arr);
+        this->bias_values_ = std::move(bias_values);
+    }
+}
+void ConvolutionLayer::InitWinogradWeight() {
+    if (algorithm_ != ConvAlgorithm::kWinograd2x2 && algorithm_ != ConvAlgorithm::kWinograd4x4) {
+        this->winograd_kernel_.clear();
+        return;
+    }
+    CHECK(this->WinogradEligible()) << "The convolution layer is not eligible for winograd";
+    const uint32_t kernel_count = this->weights_.size();
+    const uint32_t kernel_c = this->weights_.at(0)->channels();
+    const uint32_t kernel_size = kernel_c * 3 * 3;
+
+    // 卷积核先排成连续的 [out_c, in_c, 3, 3]
+    std::vector<float> kernel_values(kernel_count * kernel_size);
+    for (uint32_t k = 0; k < kernel_count; ++k) {
+        const std::shared_ptr<Tensor<float>>& kernel = this->weights_.at(k);
+        CHECK(kernel->size() == kernel_size);
+        memcpy(kernel_values.data() + k * kernel_size, kernel->raw_ptr(), kernel_size * sizeof(float));
+    }
+
+    const uint32_t output_tile = algorithm_ == ConvAlgorithm::kWinograd2x2 ? 2 : 4;
+    std::vector<float> winograd_kernel(WinogradKernelSize(kernel_count, kernel_c, output_tile));
+    WinogradTransformKernel(kernel_values.data(), kernel_count, kernel_c, output_tile, winograd_kernel.data());
+    this->winograd_kernel_ = std::move(winograd_kernel);
+}
+
+bool ConvolutionLayer::WinogradEligible() const {
+    if (this->weights_.empty() || groups_ != 1 || stride_h_ != 1 || stride_w_ != 1) {
+        return false;
+    }
+    const std::shared_ptr<Tensor<float>>& kernel = this->weights_.at(0);
+    return kernel->rows() == 3 && kernel->cols() == 3;
+}
+
+bool ConvolutionLayer::DirectPreferred() const {
+    if (groups_ == 1 || this->weights_.empty()) {
+        return false;
+    }
+    // 深度可分离卷积总是使用直接卷积，其他分组卷积在每组的输出通道或归约长度较小时使用
+    const std::shared_ptr<Tensor<float>>& kernel = this->weights_.at(0);
+    const uint32_t kernel_count_group = this->weights_.size() / groups_;
+    const uint32_t reduce_size = kernel->channels() * kernel->rows() * kernel->cols();
+    return kernel->channels() == 1 || kernel_count_group < kGemmMR || reduce_size <= kDirectConvMaxReduce;
+}
+
+ConvAlgorithm ConvolutionLayer::SelectAlgorithm(uint32_t input_h, uint32_t input_w) const {
+    if (this->DirectPreferred()) {
+        return ConvAlgorithm::kDirect;
+    }
+    if (!this->WinogradEligible() || input_h + 2 * padding_h_ < 3 || input_w + 2 * padding_w_ < 3) {
+        return ConvAlgorithm::kIm2ColGemm;
+    }
+    // 阈值来自resnet18上的测量: 28x28及以上F(4x4)最快，14x14时F(2x2)最快，7x7时im2col最快
+    const uint32_t output_size = (input_h + 2 * padding_h_ - 2) * (input_w + 2 * padding_w_ - 2);
+    if (output_size >= 20 * 20) {
+        return ConvAlgorithm::kWinograd4x4;
+    } else if (output_size >= 10 * 10) {
+        return ConvAlgorithm::kWinograd2x2;
+    }
+    return ConvAlgorithm::kIm2ColGemm;
+}
+
+std::vector<ConvAlgorithm> ConvolutionLayer::CandidateAlgorithms() const {
+    std::vector<ConvAlgorithm> algorithms{ConvAlgorithm::kIm2ColGemm};
+    if (this->WinogradEligible()) {
+        algorithms.push_back(ConvAlgorithm::kWinograd2x2);
+        algorithms.push_back(ConvAlgorithm::kWinograd4x4);
+    }
+    if (groups_ != 1) {
+        algorithms.push_back(ConvAlgorithm::kDirect);
     }
+    return algorithms;
 }
+
+void ConvolutionLayer::set_algorithm(ConvAlgorithm algorithm) {
+    if (algorithm == ConvAlgorithm::kDirect && groups_ == 1) {
+        LOG(WARNING) << "Direct convolution only supports grouped convolution, fall back to im2col";
+        algorithm = ConvAlgorithm::kIm2ColGemm;
+    } else if ((algorithm == ConvAlgorithm::kWinograd2x2 || algorithm == ConvAlgorithm::kWinograd4x4) &&
+               !this->WinogradEligible()) {
+        LOG(WARNING) << "The convolution layer is not eligible for winograd, fall back to im2col";
+        algorithm = ConvAlgorithm::kIm2ColGemm;
+    }
+    if (algorithm != algorithm_) {
+        algorithm_ = algorithm;
+        this->winograd_kernel_.clear();
+    }
+}
+
+ConvAlgorithm ConvolutionLayer::algorithm() const {
+    return algorithm_;
+}
+
+bool ConvolutionLayer::FuseActivation(const std::string& activation_type) {
+    if (activation_type != "nn.ReLU" || fused_relu_) {
+        return false;
+    }
+    fused_relu_ = true;
+    return true;
+}
+
+bool ConvolutionLayer::fused_relu() const {
+    return fused_relu_;
+}
+
+bool ConvolutionLayer::FuseResidualAdd() {
+    // ReLU已经合并时结果是 relu(conv) + residual，不能再合并
+    if (fused_residual_ || fused_relu_) {
+        return false;
+    }
+    fused_residual_ = true;
+    return true;
+}
+
+bool ConvolutionLayer::fused_residual() const {
+    return fused_residual_;
+}
+
 ParseParameterAttrStatus ConvolutionLayer::GetInstance(
         const std::shared_ptr<RuntimeOperator>& op,
         std::shared_ptr<Layer>& conv_layer) {
@@ -423,6 +595,16 @@ ParseParameterAttrStatus ConvolutionLayer::GetInstance(
             std::dynamic_pointer_cast<ConvolutionLayer>(conv_layer);
     CHECK(conv_layer_derived != nullptr);
     conv_layer_derived->InitIm2ColWeight();
+
+    // 根据计算图中记录的输入形状选择计算方式，Winograd的卷积核在加载时一并变换
+    const auto& input_operands = op->input_operands_seq;
+    if (!input_operands.empty() && input_operands.front() != nullptr &&
+        input_operands.front()->shapes.size() == 4) {
+        const std::vector<int32_t>& input_shape = input_operands.front()->shapes;
+        conv_layer_derived->set_algorithm(
+                conv_layer_derived->SelectAlgorithm(input_shape.at(2), input_shape.at(3)));
+    }
+    conv_layer_derived->InitWinogradWeight();
     return ParseParameterAttrStatus::kParameterAttrParseSuccess;
 }
 
@@ -6,6 +6,14 @@
 #define INFERNETO_CONVOLUTION_HPP
 #include "node/abstract/param_node.hpp"
 namespace infer_neto {
+/// 卷积的计算方式
+enum class ConvAlgorithm {
+    kIm2ColGemm = 0,   /// im2col展开后做矩阵乘法，适用于所有卷积
+    kWinograd2x2 = 1,  /// Winograd F(2x2,3x3)，只适用于步长为1、不分组的3x3卷积
+    kWinograd4x4 = 2,  /// Winograd F(4x4,3x3)，乘法次数更少，数值误差略大
+    kDirect = 3,       /// 按输出宽度向量化的直接卷积，只适用于分组卷积，深度可分离卷积默认使用
+};
+
 class ConvolutionLayer : public ParamLayer {
 public:
     explicit ConvolutionLayer(uint32_t output_channel, uint32_t in_channel,
@@ -27,28 +35,115 @@ public:
         if (use_bias_) {
             this->InitBiasParam(output_channel, 1, 1, 1);
         }
+        if (this->DirectPreferred()) {
+            this->algorithm_ = ConvAlgorithm::kDirect;
+        }
     };
 
     InferStatus Forward(const std::vector<std::shared_ptr<Tensor<float>>>& inputs,
                         std::vector<std::shared_ptr<Tensor<float>>>& outputs) override;
+    /**
+     * 合并紧随其后的ReLU，在矩阵乘法或卷积写回输出时一并计算
+     * @param activation_type 激活函数节点的类型，只支持nn.ReLU
+     * @return 是否合并成功
+     */
+    bool FuseActivation(const std::string& activation_type) override;
+
+    /**
+     * 返回是否已经合并了ReLU
+     * @return 已经合并时返回true
+     */
+    bool fused_relu() const;
+
+    /**
+     * 合并紧随其后的残差相加，写回输出时直接加上残差，必须在合并ReLU之前调用
+     * @return 是否合并成功
+     */
+    bool FuseResidualAdd() override;
+
+    /**
+     * 返回是否已经合并了残差相加
+     * @return 已经合并时返回true
+     */
+    bool fused_residual() const;
+
     /**
      * 初始化kernel的im2col排布
      */
     void InitIm2ColWeight();
 
+    /**
+     * 初始化Winograd域中的卷积核，只在当前计算方式为Winograd时有效
+     */
+    void InitWinogradWeight();
+
+    /**
+     * 判断该卷积能否使用Winograd计算
+     * @return 步长为1、不分组的3x3卷积返回true
+     */
+    bool WinogradEligible() const;
+
+    /**
+     * 根据卷积和输入的形状选择计算方式
+     * 输出较大时F(4x4,3x3)最快，较小时F(2x2,3x3)最快，很小时Winograd的块数太少，im2col更快
+     * @param input_h 输入的高度
+     * @param input_w 输入的宽度
+     * @return 推荐的计算方式
+     */
+    ConvAlgorithm SelectAlgorithm(uint32_t input_h, uint32_t input_w) const;
+
+    /**
+     * 返回该卷积可以使用的所有计算方式
+     * @return 可用的计算方式，im2col总是可用
+     */
+    std::vector<ConvAlgorithm> CandidateAlgorithms() const;
+
+    /**
+     * 设置卷积的计算方式，不满足Winograd或直接卷积的条件时退回im2col
+     * @param algorithm 卷积的计算方式
+     */
+    void set_algorithm(ConvAlgorithm algorithm);
+
+    /**
+     * 返回卷积的计算方式
+     * @return 卷积的计算方式
+     */
+    ConvAlgorithm algorithm() const;
+
     static ParseParameterAttrStatus GetInstance(
             const std::shared_ptr<RuntimeOperator>& op,
             std::shared_ptr<Layer>& conv_layer);
 private:
-    void ConvGemmBias(const Tensor<float>& input_matrix,
-                      const std::shared_ptr<Tensor<float>>& output_tensor,
-                      uint32_t group, uint32_t kernel_index,
-                      uint32_t kernel_count_group, const Tensor<float>& kernel,
-                      uint32_t output_w, uint32_t output_h) const;
+    /**
+     * 判断分组卷积是否应该使用直接卷积，每组的矩阵乘法过小时直接卷积更快
+     */
+    bool DirectPreferred() const;
 
-    Tensor<float> Im2Col(sftensor input, uint32_t kernel_w, uint32_t kernel_h,
-                      uint32_t input_w, uint32_t input_h, uint32_t input_c_group,
-                      uint32_t group, uint32_t row_len, uint32_t col_len) const;
+    /**
+     * 计算一组卷积核与展开后输入矩阵的乘积，并加上偏置，batch大于1时一次计算连续的多个样本
+     * @param input_matrix 第一个样本展开后的输入矩阵，形状为 [kernel.cols(), output_h * output_w]
+     * @param input_ld 输入矩阵相邻两行之间的距离
+     * @param input_batch_stride 相邻两个样本的输入矩阵之间的距离
+     * @param input_col_offsets 输入矩阵每一列在行内的偏移，为空时各列连续存放
+     * @param output_tensor 第一个样本的输出张量
+     * @param batch 样本的个数
+     * @param output_batch_stride 相邻两个样本的输出之间的距离
+     * @param group 当前计算的分组
+     * @param kernel_count_group 每组卷积核的数量
+     * @param kernel 当前分组的卷积核矩阵
+     * @param output_w 输出的宽度
+     * @param output_h 输出的高度
+     * @param residual 与输出张量排布相同的残差，为空时不加残差
+     * @param residual_batch_stride 相邻两个样本的残差之间的距离
+     */
+    void ConvGemmBias(const float* input_matrix, uint32_t input_ld, size_t input_batch_stride,
+                      const uint32_t* input_col_offsets,
+                      const std::shared_ptr<Tensor<float>>& output_tensor,
+                      uint32_t batch, size_t output_batch_stride,
+                      uint32_t group, uint32_t kernel_count_group,
+                      const Tensor<float>& kernel,
+                      uint32_t output_w, uint32_t output_h,
+                      const float* residual, size_t residual_batch_stride) const;
 
     bool use_bias_ = false;
     uint32_t groups_ = 1;
@@ -56,7 +151,12 @@ private:
     uint32_t padding_w_ = 0;
     uint32_t stride_h_ = 1;
     uint32_t stride_w_ = 1;
-    std::vector<Tensor<float>> kernel_matrix_arr_;
+    std::vector<Tensor<float>> kernel_matrix_arr_;  /// 每组一个 [out_c, in_c*kh*kw] 的卷积核矩阵
+    std::vector<float> bias_values_;               /// 按输出通道连续排布的偏置
+    ConvAlgorithm algorithm_ = ConvAlgorithm::kIm2ColGemm;
+    bool fused_relu_ = false;                      /// 是否在写回输出时一并做ReLU
+    bool fused_residual_ = false;                  /// 是否在写回输出时加上残差
+    std::vector<float> winograd_kernel_;           /// Winograd域中的卷积核，排布为 [alpha * alpha, in_c, out_c]
 
 
 };
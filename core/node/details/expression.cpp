@@ -1,13 +1,41 @@
 //
 // Created by hanke on 2024/4/25.
 //
-#include <stack>
+#include <algorithm>
 #include "expression.hpp"
 #include "node/abstract/node_factory.hpp"
 #include "data/cpu/tensor_util.hpp"
 
 namespace infer_neto{
 
+/**
+ * 判断张量的形状是否为操作数广播之后的形状，维度从右对齐并在左侧补1后逐维比较，不申请内存
+ * @param result 需要判断的张量
+ * @param tensor1 操作数1
+ * @param tensor2 操作数2，一元运算时为空
+ * @return 形状相同时返回true
+ */
+static bool IsBroadcastResult(const Tensor<float>& result, const Tensor<float>& tensor1,
+                              const Tensor<float>* tensor2) {
+    const std::vector<uint32_t>& result_shapes = result.raw_shapes();
+    const std::vector<uint32_t>& shapes1 = tensor1.raw_shapes();
+    const size_t shapes2_size = tensor2 ? tensor2->raw_shapes().size() : 0;
+    const size_t dims = std::max(std::max(result_shapes.size(), shapes1.size()), shapes2_size);
+    const auto dim_at = [dims](const std::vector<uint32_t>& shapes, size_t i) {
+        return i + shapes.size() >= dims ? shapes.at(i + shapes.size() - dims) : 1u;
+    };
+    for (size_t i = 0; i < dims; ++i) {
+        uint32_t expected = dim_at(shapes1, i);
+        if (tensor2 != nullptr && expected == 1) {
+            expected = dim_at(tensor2->raw_shapes(), i);
+        }
+        if (dim_at(result_shapes, i) != expected) {
+            return false;
+        }
+    }
+    return true;
+}
+
 
 InferStatus ExpressionLayer::Forward(
         const std::vector<std::shared_ptr<Tensor<float>>>& inputs,
@@ -24,10 +52,14 @@ InferStatus ExpressionLayer::Forward(
 
     CHECK(this->parser_ != nullptr)
                     << "The parser in the expression layer is null!";
-    this->parser_->Tokenizer(false);
-    const auto& expressions = this->parser_->tokens();
-    CHECK(!expressions.empty())
-                    << "The expression parser failed to parse " << statement_;
+    // 表达式只在第一次执行时解析，之后复用逆波兰式，多个线程同时执行时只解析一次
+    std::call_once(parse_once_, [this]() {
+        this->parser_->Tokenizer(false);
+        const auto& expressions = this->parser_->tokens();
+        CHECK(!expressions.empty())
+                        << "The expression parser failed to parse " << statement_;
+        token_nodes_ = this->parser_->Generate();
+    });
 
     for (uint32_t i = 0; i < inputs.size(); ++i) {
         const sftensor& input_data = inputs.at(i);
@@ -47,102 +79,119 @@ InferStatus ExpressionLayer::Forward(
                         << i << "th";
             return InferStatus::kInferFailedOutputEmpty;
         }
-        outputs.at(i)->Fill(0.f);
     }
 
-    std::stack<std::vector<std::shared_ptr<Tensor<float>>>> op_stack;
-    const std::vector<std::shared_ptr<TokenNode>>& token_nodes =
-            this->parser_->Generate();
-    for (const auto& token_node : token_nodes) {
-        if (token_node->num_index >= 0) {
-            // process operator
-            uint32_t start_pos = token_node->num_index * batch_size;
-            std::vector<std::shared_ptr<Tensor<float>>> input_token_nodes;
-            for (uint32_t i = 0; i < batch_size; ++i) {
-                CHECK(i + start_pos < inputs.size())
+    std::unique_ptr<Workspace> workspace = this->AcquireWorkspace();
+    std::vector<sftensor>& operand_stack = workspace->operand_stack;
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        const sftensor& output = outputs.at(i);
+        // 最后一个运算直接写入输出，中间结果写入按运算编号缓存的工作区
+        uint32_t operation_index = 0;
+        operand_stack.clear();
+        for (uint32_t t = 0; t < token_nodes_.size(); ++t) {
+            const std::shared_ptr<TokenNode>& token_node = token_nodes_.at(t);
+            if (token_node->num_index >= 0) {
+                // process operator
+                const uint32_t input_index = token_node->num_index * batch_size + i;
+                CHECK(input_index < inputs.size())
                                 << "The " << i
                                 << "th operand doesn't have appropriate number of tensors";
-                input_token_nodes.push_back(inputs.at(i + start_pos));
+                operand_stack.push_back(inputs.at(input_index));
+                continue;
             }
-            op_stack.push(input_token_nodes);
-        } else {
+
             // process operation
             const int32_t op = token_node->num_index;
             if (op != int(TokenType::TokenAdd) && op != int(TokenType::TokenMul) && op != int(TokenType::TokenSin)) {
                 LOG(FATAL) << "Unknown operator type: " << op;
             }
-            if (op == int(TokenType::TokenAdd) or op == int(TokenType::TokenMul)) {
-                CHECK(op_stack.size() >= 2) << "The number of operand is less than two";
-                std::vector<std::shared_ptr<Tensor<float>>> input_node1 = op_stack.top();
-
-                CHECK(input_node1.size() == batch_size)
-                                << "The first operand doesn't have appropriate number of tensors, "
-                                   "which need "
-                                << batch_size;
-                op_stack.pop();
-
-                std::vector<std::shared_ptr<Tensor<float>>> input_node2 = op_stack.top();
-                CHECK(input_node2.size() == batch_size)
-                                << "The second operand doesn't have appropriate number of tensors, "
-                                   "which need "
-                                << batch_size;
-                op_stack.pop();
-
-                std::vector<std::shared_ptr<Tensor<float>>> output_token_nodes(
-                        batch_size);
-                for (uint32_t i = 0; i < batch_size; ++i) {
-                    // do execution
-                    if (op == int(TokenType::TokenAdd)) {
-                        output_token_nodes.at(i) =
-                                TensorElementAdd(input_node1.at(i), input_node2.at(i));
-                    } else if (op == int(TokenType::TokenMul)) {
-                        output_token_nodes.at(i) =
-                                TensorElementMultiply(input_node1.at(i), input_node2.at(i));
-
-                    } else {
-                        LOG(FATAL) << "Unknown operator type: " << op;
-                    }
+            const uint32_t operand_count = op == int(TokenType::TokenSin) ? 1 : 2;
+            CHECK(operand_stack.size() >= operand_count)
+                            << "The number of operand is less than " << operand_count;
+            const sftensor input_node1 = operand_stack.back();
+            operand_stack.pop_back();
+            sftensor input_node2;
+            if (operand_count == 2) {
+                input_node2 = operand_stack.back();
+                operand_stack.pop_back();
+            }
+
+            sftensor result = output;
+            if (t + 1 != token_nodes_.size()) {
+                const uint32_t workspace_index = operation_index * batch_size + i;
+                if (workspace->results.size() <= workspace_index) {
+                    workspace->results.resize(workspace_index + 1);
                 }
-                op_stack.push(output_token_nodes);
+                // 二元运算的两个操作数形状不同时，中间结果的形状为广播之后的形状
+                // 工作区的形状不变时直接复用，只在重新创建时才计算广播之后的形状
+                sftensor& intermediate = workspace->results.at(workspace_index);
+                if (intermediate == nullptr || !IsBroadcastResult(*intermediate, *input_node1, input_node2.get())) {
+                    intermediate = TensorCreate(input_node2 ? TensorBroadcastShapes(*input_node1, *input_node2)
+                                                            : input_node1->shapes());
+                }
+                result = intermediate;
             }
-            else if (op == int(TokenType::TokenSin)) {
-                CHECK(!op_stack.empty()) << "The number of operand is less than two";
-                std::vector<std::shared_ptr<Tensor<float>>> input_node1 = op_stack.top();
-
-                CHECK(input_node1.size() == batch_size)
-                                << "The first operand doesn't have appropriate number of tensors, "
-                                   "which need "
-                                << batch_size;
-                op_stack.pop();
-
-
-                std::vector<std::shared_ptr<Tensor<float>>> output_token_nodes(
-                        batch_size);
-                for (uint32_t i = 0; i < batch_size; ++i) {
-                    // do execution
-                    if (op == int(TokenType::TokenSin)) {
-                        output_token_nodes.at(i) = TensorElementSin(input_node1.at(i));
-                    } else {
-                        LOG(FATAL) << "Unknown operator type: " << op;
-                    }
+            operation_index += 1;
+
+            if (op == int(TokenType::TokenSin)) {
+                TensorElementSin(input_node1, result);
+            } else {
+                if (op == int(TokenType::TokenAdd)) {
+                    TensorElementAdd(input_node1, input_node2, result);
+                } else {
+                    TensorElementMultiply(input_node1, input_node2, result);
                 }
-                op_stack.push(output_token_nodes);
             }
+            operand_stack.push_back(result);
         }
-    }
 
-    CHECK(op_stack.size() == 1)
-                    << "The expression has more than one output operand!";
-    std::vector<sftensor> output_node = op_stack.top();
-    op_stack.pop();
-    for (int i = 0; i < batch_size; ++i) {
-        CHECK(outputs.at(i) != nullptr && !outputs.at(i)->empty());
-        CHECK(outputs.at(i)->shapes() == output_node.at(i)->shapes());
-        outputs.at(i) = output_node.at(i);
+        CHECK(operand_stack.size() == 1)
+                        << "The expression has more than one output operand!";
+        // 表达式只有一个输入而没有运算时，把输入复制到输出中
+        const sftensor& result = operand_stack.back();
+        if (result != output) {
+            CHECK(result->size() == output->size());
+            std::copy(result->raw_ptr(), result->raw_ptr() + result->size(), output->raw_ptr());
+        }
+        if (fused_relu_) {
+            float* output_data = output->raw_ptr();
+            for (uint32_t j = 0; j < output->size(); ++j) {
+                output_data[j] = output_data[j] > 0.f ? output_data[j] : 0.f;
+            }
+        }
+        operand_stack.clear();
     }
+    this->ReleaseWorkspace(std::move(workspace));
     return InferStatus::kInferSuccess;
 }
 
+std::unique_ptr<ExpressionLayer::Workspace> ExpressionLayer::AcquireWorkspace() {
+    {
+        std::lock_guard<std::mutex> lock(workspace_mutex_);
+        if (!idle_workspaces_.empty()) {
+            std::unique_ptr<Workspace> workspace = std::move(idle_workspaces_.back());
+            idle_workspaces_.pop_back();
+            return workspace;
+        }
+    }
+    auto workspace = std::make_unique<Workspace>();
+    workspace->operand_stack.reserve(token_nodes_.size());
+    return workspace;
+}
+
+void ExpressionLayer::ReleaseWorkspace(std::unique_ptr<Workspace> workspace) {
+    std::lock_guard<std::mutex> lock(workspace_mutex_);
+    idle_workspaces_.push_back(std::move(workspace));
+}
+
+bool ExpressionLayer::FuseActivation(const std::string& activation_type) {
+    if (activation_type != "nn.ReLU" || fused_relu_) {
+        return false;
+    }
+    fused_relu_ = true;
+    return true;
+}
+
 ParseParameterAttrStatus ExpressionLayer::GetInstance(
     const std::shared_ptr<RuntimeOperator>& op,
     std::shared_ptr<Layer>& expression_layer) {
@@ -4,6 +4,8 @@
 
 #ifndef INFERNETO_EXPRESSION_HPP
 #define INFERNETO_EXPRESSION_HPP
+#include <memory>
+#include <mutex>
 #include <utility>
 
 #include "node/abstract/non_param_node.hpp"
@@ -19,12 +21,40 @@ public:
             const std::vector<std::shared_ptr<Tensor<float>>>& inputs,
             std::vector<std::shared_ptr<Tensor<float>>>& outputs) override;
 
+    /**
+     * 合并紧随其后的ReLU，残差块中的相加结果直接以激活后的形式写入输出
+     * @param activation_type 激活函数节点的类型，只支持nn.ReLU
+     * @return 是否合并成功
+     */
+    bool FuseActivation(const std::string& activation_type) override;
+
     static ParseParameterAttrStatus GetInstance(
             const std::shared_ptr<RuntimeOperator>& op,
             std::shared_ptr<Layer>& expression_layer);
 private:
+    /// 一次Forward使用的工作区，同时执行的每个调用各占用一份
+    struct Workspace {
+        std::vector<sftensor> results;        /// 中间结果，按运算编号和批次排列
+        std::vector<sftensor> operand_stack;  /// 计算逆波兰式时的操作数栈
+    };
+
+    /**
+     * 取出一份空闲的工作区，没有空闲的工作区时新建一份
+     */
+    std::unique_ptr<Workspace> AcquireWorkspace();
+
+    /**
+     * 归还工作区，之后的调用复用其中已经分配的中间结果
+     */
+    void ReleaseWorkspace(std::unique_ptr<Workspace> workspace);
+
     std::string statement_;
     std::unique_ptr<ExpressionParser> parser_;
+    bool fused_relu_ = false;  /// 是否对表达式的结果做ReLU
+    std::once_flag parse_once_;  /// 表达式只在第一次执行时解析一次
+    std::vector<std::shared_ptr<TokenNode>> token_nodes_;  /// 解析得到的逆波兰式
+    std::mutex workspace_mutex_;
+    std::vector<std::unique_ptr<Workspace>> idle_workspaces_;  /// 空闲的工作区，由workspace_mutex_保护
 };
 
 }
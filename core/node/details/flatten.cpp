@@ -47,26 +47,36 @@ InferStatus FlattenLayer::Forward(
             return InferStatus::kInferFailedInputEmpty;
         }
 
-        auto shapes = input->shapes();
-        shapes.insert(shapes.begin(), batch_size);
-        uint32_t elements_size = std::accumulate(shapes.begin() + start_dim, shapes.begin() + end_dim + 1, 1, std::multiplies());
+        const uint32_t dims[] = {batch_size, input->channels(), input->rows(), input->cols()};
+        uint32_t elements_size = std::accumulate(dims + start_dim, dims + end_dim + 1, 1u, std::multiplies());
 
+        // 展开只改变形状，输出与输入共用数据而不是复制一份
         std::shared_ptr<Tensor<float>> output = outputs.at(i);
-        output = TensorClone(input);
+        if (output == nullptr || output->empty()) {
+            output = std::make_shared<Tensor<float>>(input->View(input->raw_shapes()));
+            outputs.at(i) = output;
+        }
         CHECK(input->size() == output->size())
                         << "The output and input shapes of the flatten layer do "
                            "not match "
                         << i << " th";
-        outputs.at(i) = output;
+        output->ShareData(*input);
 
+        // 输出已经是展开后的形状时不再重复设置
         if (start_dim == 1 && end_dim == 3) {
-            output->Reshape({elements_size});
+            if (output->channels() != 1 || output->rows() != 1) {
+                output->Reshape({elements_size});
+            }
         } else if (start_dim == 2 && end_dim == 3) {
             uint32_t channels = input->channels();
-            output->Reshape({channels, elements_size});
+            if (output->channels() != 1 || output->rows() != channels) {
+                output->Reshape({channels, elements_size});
+            }
         } else if (start_dim == 1 && end_dim == 2) {
             uint32_t cols = input->cols();
-            output->Reshape({elements_size, cols});
+            if (output->channels() != 1 || output->cols() != cols) {
+                output->Reshape({elements_size, cols});
+            }
         } else {
             LOG(FATAL) << "Wrong flatten dim: "
                        << "start dim: " << start_dim << " end dim: " << end_dim;
@@ -75,6 +85,10 @@ InferStatus FlattenLayer::Forward(
     return InferStatus::kInferSuccess;
 }
 
+bool FlattenLayer::IsView() const {
+    return true;
+}
+
 
 ParseParameterAttrStatus FlattenLayer::CreateInstance(
         const std::shared_ptr<RuntimeOperator>& op,
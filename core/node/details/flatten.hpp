@@ -18,6 +18,12 @@ public:
             const std::vector<std::shared_ptr<Tensor<float>>>& inputs,
     std::vector<std::shared_ptr<Tensor<float>>>& outputs) override;
 
+    /**
+     * 展开只改变形状，输出直接共用输入的数据
+     * @return 总是返回true
+     */
+    bool IsView() const override;
+
     static ParseParameterAttrStatus CreateInstance(
             const std::shared_ptr<RuntimeOperator>& op,
             std::shared_ptr<Layer>& flatten_layer);
@@ -2,8 +2,9 @@
 // Created by hanke on 2024/4/26.
 //
 
-#include <iostream>
 #include "linear.hpp"
+#include "data/cpu/gemm.hpp"
+#include "data/cpu/tensor_util.hpp"
 #include "node/abstract/node_factory.hpp"
 
 namespace infer_neto {
@@ -45,27 +46,40 @@ InferStatus LinearLayer::Forward(
 
     uint32_t batch = inputs.size();
     const std::shared_ptr<Tensor<float>>& weight = weights_.front();
-
+    CHECK(weight->rows() == out_features_)
+                    << "The row of weight tensor should be same to output_features_";
+    CHECK(weight->cols() == in_features_)
+                    << "The col of weight tensor should be same to input_features_";
+    // 输出 = 输入 x 权重的转置，权重的第j行就是转置后的第j列，按列偏移直接读取而不做转置
+    CHECK(weight_col_offsets_.size() == uint32_t(out_features_));
+
+    if (use_bias_) {
+        CHECK(!this->bias_.empty() && this->bias_.size() == 1)
+                        << "The bias tensor is empty, but use_bias is true";
+        const auto& bias_data = bias_.front();
+        CHECK(!bias_data->empty() && bias_data->cols() == out_features_)
+                        << "The col of bias tensor is not same to output_features_";
+    }
+    // 输入和输出都紧密地依次排列时，整个批次的特征行合并成一次矩阵乘法
+    const bool fold_batch = batch > 1 && inputs.front() != nullptr && outputs.front() != nullptr &&
+                            TensorBatchStride(inputs, 0, batch) == inputs.front()->size() &&
+                            TensorBatchStride(outputs, 0, batch) == outputs.front()->size();
 
     for (uint32_t i = 0; i < batch; ++i) {
         const std::shared_ptr<Tensor<float>>& input = inputs.at(i);
         CHECK(input != nullptr && !input->empty())
                         << "The input tensor array in the linear layer has an empty tensor "
                         << i << " th";
-        const std::vector<uint32_t>& input_shapes = input->shapes();
-
-        const uint32_t feature_dims = input_shapes.at(1);
-        const uint32_t in_features = input_shapes.at(2);
-        CHECK(weight->rows() == out_features_)
-                        << "The row of weight tensor should be same to output_features_";
-        CHECK(weight->cols() == in_features && in_features == in_features_)
-                        << "The col of weight tensor should be same to input_features_";
-
-
+        CHECK(input->channels() == 1)
+                        << "The linear layer only support two dimension input " << i << " th";
+        const uint32_t feature_dims = input->rows();
+        const uint32_t in_features = input->cols();
+        CHECK(in_features == in_features_)
+                        << "The col of input tensor should be same to input_features_";
 
         std::shared_ptr<Tensor<float>> output = outputs.at(i);
         if (output == nullptr || output->empty()) {
-            output = std::make_shared<Tensor<float>>(1, out_features_, feature_dims);
+            output = std::make_shared<Tensor<float>>(1, feature_dims, out_features_);
             outputs.at(i) = output;
         }
         CHECK(output->channels() == 1 && output->rows() == feature_dims &&
@@ -73,27 +87,20 @@ InferStatus LinearLayer::Forward(
                         << "The row of output tensor should be same to feature_dims_ and the "
                            "col of output tensor should be same to output_features_ "
                         << i << " th";
-        const auto& output_raw_shapes = output->raw_shapes();
-        if (output_raw_shapes.size() == 2) {
-            CHECK(output_raw_shapes.at(0) == feature_dims &&
-                  output_raw_shapes.at(1) == out_features_);
-        }
-        if (output_raw_shapes.size() == 1) {
-            CHECK(output_raw_shapes.at(0) == out_features_);
-        }
 
-        Tensor<float> result = input->Gemm(weight->Transpose());
+        // 合并批次时在第一个样本处计算整个批次
+        if (fold_batch && i != 0) {
+            continue;
+        }
+        const uint32_t rows = fold_batch ? batch * feature_dims : feature_dims;
+        // 偏置按列广播，作为行距为0的残差在写回输出时加上，不再单独遍历一次输出
+        GemmEpilogue epilogue;
         if (use_bias_) {
-            CHECK(!this->bias_.empty() && this->bias_.size() == 1)
-                            << "The bias tensor is empty, but use_bias is true";
-
-            const auto& bias_data = bias_.front();
-            CHECK(!bias_data->empty() && bias_data->cols() == out_features_)
-                            << "The col of bias tensor is not same to output_features_";
-            std::cout << bias_data->channels() << " " << bias_data->rows() << " " << bias_data->cols() << " " << std::endl;
-            result.Add(*bias_data);
+            epilogue.residual = bias_.front()->raw_ptr();
+            epilogue.ldr = 0;
         }
-        *output = std::move(result);
+        SGemmGatherB(rows, out_features_, in_features, input->raw_ptr(), in_features,
+                     weight->raw_ptr(), 1, weight_col_offsets_.data(), output->raw_ptr(), out_features_, epilogue);
     }
     return InferStatus::kInferSuccess;
 }
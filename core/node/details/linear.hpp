@@ -21,6 +21,11 @@ LinearLayer(int32_t in_features, int32_t out_features, bool use_bias)
         if (use_bias) {
             this->InitBiasParam(1, 1, 1, out_features);
         }
+        // 构造时确定列偏移，Forward中只读，多个会话可以同时调用
+        weight_col_offsets_.resize(out_features_);
+        for (int32_t j = 0; j < out_features_; ++j) {
+            weight_col_offsets_.at(j) = j * in_features_;
+        }
 };
 
 InferStatus Forward(const std::vector<std::shared_ptr<Tensor<float>>> &inputs,
@@ -33,6 +38,7 @@ private:
     int32_t in_features_ = 0;
     int32_t out_features_ = 0;
     bool use_bias_ = false;
+    std::vector<uint32_t> weight_col_offsets_;  /// 转置后的权重每一列在权重中的偏移
 };
 }
 
@@ -5,6 +5,7 @@
 #include "maxpooling.hpp"
 #include "node/abstract/node_factory.hpp"
 #include "infer/infer_ir.hpp"
+#include "data/cpu/thread_pool.hpp"
 namespace infer_neto {
 InferStatus MaxPoolingLayer::Forward(const std::vector<std::shared_ptr<Tensor<float>>> &inputs,
                                      std::vector<std::shared_ptr<Tensor<float>>> &outputs) {
@@ -83,33 +84,36 @@ InferStatus MaxPoolingLayer::Forward(const std::vector<std::shared_ptr<Tensor<fl
                         << "The output tensor array in the max pooling layer "
                            "has an incorrectly sized tensor "
                         << i << "th";
-        // 开始计算逻辑
-        for (uint32_t ic = 0; ic < input_channel; ic++) {
-            const float* input_channel_data = input_data->slice(ic);
-            float* output_channel_data = output_data->slice(ic);
-            // 遍历输入tensor
-            for (uint32_t row = 0; row < input_padded_height - pooling_h + 1; row += stride_h_) {
-                int output_row = int (row / stride_h_);
-                for (uint32_t col = 0; col < input_padded_width - pooling_w + 1; col += stride_w_) {
-                    int output_col = int(col / stride_w_);
-                    float max_value = std::numeric_limits<float>::lowest();
-                    // 循环pooling核大小
-                    for (uint32_t h = 0; h < pooling_h; ++h) {
-                        for (uint32_t w = 0; w < pooling_w; ++w) {
-                            uint32_t current_row = row + h - padding_h_;
-                            uint32_t current_col = col + w - padding_w_;
-                            float current_value = std::numeric_limits<float>::lowest();  // Assume padding with lowest value
-                            if (current_row < input_height && current_col < input_width) {
-                                // Convert 2D index to 1D index for the flattened array access
-                                current_value = input_channel_data[current_row * input_width + current_col];
+        // 开始计算逻辑，按通道分给多个线程
+        const size_t channel_work = size_t(output_h) * output_w * pooling_h * pooling_w;
+        ParallelFor(input_channel, ParallelGrain(channel_work), [&](size_t c_begin, size_t c_end) {
+            for (uint32_t ic = uint32_t(c_begin); ic < uint32_t(c_end); ic++) {
+                const float* input_channel_data = input_data->slice(ic);
+                float* output_channel_data = output_data->slice(ic);
+                // 遍历输入tensor
+                for (uint32_t row = 0; row < input_padded_height - pooling_h + 1; row += stride_h_) {
+                    int output_row = int (row / stride_h_);
+                    for (uint32_t col = 0; col < input_padded_width - pooling_w + 1; col += stride_w_) {
+                        int output_col = int(col / stride_w_);
+                        float max_value = std::numeric_limits<float>::lowest();
+                        // 循环pooling核大小
+                        for (uint32_t h = 0; h < pooling_h; ++h) {
+                            for (uint32_t w = 0; w < pooling_w; ++w) {
+                                uint32_t current_row = row + h - padding_h_;
+                                uint32_t current_col = col + w - padding_w_;
+                                float current_value = std::numeric_limits<float>::lowest();  // Assume padding with lowest value
+                                if (current_row < input_height && current_col < input_width) {
+                                    // Convert 2D index to 1D index for the flattened array access
+                                    current_value = input_channel_data[current_row * input_width + current_col];
+                                }
+                                max_value = std::max(max_value, current_value);
                             }
-                            max_value = std::max(max_value, current_value);
                         }
+                        output_channel_data[output_row * output_w + output_col] = max_value;
                     }
-                    output_channel_data[output_row * output_w + output_col] = max_value;
                 }
             }
-        }
+        });
     }
     return InferStatus::kInferSuccess;
 }
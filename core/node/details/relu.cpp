@@ -22,6 +22,8 @@
 // Created by fss on 22-11-18.
 #include "relu.hpp"
 #include "node/abstract/node_factory.hpp"
+#include "data/cpu/tensor_util.hpp"
+#include "data/cpu/elementwise.hpp"
 
 namespace infer_neto {
 InferStatus ReluLayer::Forward(
@@ -48,7 +50,7 @@ InferStatus ReluLayer::Forward(
       return InferStatus::kInferFailedInputEmpty;
     }
     if (output_data != nullptr && !output_data->empty()) {
-      if (input_data->shapes() != output_data->shapes()) {
+      if (!TensorShapeIsSame(*input_data, *output_data)) {
         LOG(ERROR) << "The input and output tensor shapes of the relu "
                       "layer do not match "
                    << i << " th";
@@ -71,12 +73,18 @@ InferStatus ReluLayer::Forward(
       output = std::make_shared<Tensor<float>>(input->shapes());
       outputs.at(i) = output;
     }
-    CHECK(output->shapes() == input->shapes())
+    CHECK(TensorShapeIsSame(*output, *input))
             << "The input and output tensor shapes of the relu layer do not match "
             << i << " th";
-    for (uint32_t j = 0; j < input->size(); ++j) {
-      float value = input->index(j);
-      output->index(j) = value > 0.f ? value : 0.f;
+    const uint32_t size = input->size();
+    if (input->is_contiguous() && output->is_contiguous()) {
+      ElementwiseUnary(UnaryOp::kRelu, input->data().get(), output->data().get(), size);
+    } else {
+      // 形状已经检查过，逐元素访问时不再重复检查下标
+      for (uint32_t j = 0; j < size; ++j) {
+        const float value = input->index_unchecked(j);
+        output->index_unchecked(j) = value > 0.f ? value : 0.f;
+      }
     }
   }
   return InferStatus::kInferSuccess;
@@ -21,6 +21,8 @@
 
 // Created by fss on 22-11-18.
 #include "node/abstract/node_factory.hpp"
+#include "data/cpu/tensor_util.hpp"
+#include "data/cpu/elementwise.hpp"
 #include "sigmoid.hpp"
 #include <cmath>
 
@@ -48,7 +50,7 @@ InferStatus SigmoidLayer::Forward(const std::vector<std::shared_ptr<Tensor<float
       return InferStatus::kInferFailedInputEmpty;
     }
     if (output_data != nullptr && !output_data->empty()) {
-      if (input_data->shapes() != output_data->shapes()) {
+      if (!TensorShapeIsSame(*input_data, *output_data)) {
         LOG(ERROR) << "The input and output tensor shapes of the sigmoid "
                       "layer do not match "
                    << i << " th";
@@ -71,13 +73,19 @@ InferStatus SigmoidLayer::Forward(const std::vector<std::shared_ptr<Tensor<float
       output = std::make_shared<Tensor<float>>(input->shapes());
       outputs.at(i) = output;
     }
-    CHECK(output->shapes() == input->shapes())
+    CHECK(TensorShapeIsSame(*output, *input))
             << "The input and output tensor shapes of the sigmoid layer do not match "
             << i << " th";
-    for (uint32_t j = 0; j < input->size(); ++j) {
-      float value = input->index(j);
-
-      output->index(j) = 1 / (1.f + std::exp(-value));
+    const uint32_t size = input->size();
+    if (input->is_contiguous() && output->is_contiguous()) {
+      ElementwiseUnary(UnaryOp::kSigmoid, input->data().get(), output->data().get(), size);
+    } else {
+      // 复制成连续的数据后再计算，保证与连续张量的近似结果一致
+      Tensor<float> result(*input);
+      ElementwiseUnary(UnaryOp::kSigmoid, result.raw_ptr(), result.raw_ptr(), size);
+      for (uint32_t j = 0; j < size; ++j) {
+        output->index_unchecked(j) = result.index_unchecked(j);
+      }
     }
   }
   return InferStatus::kInferSuccess;
@@ -6,6 +6,7 @@
 #include <valarray>
 #include "softmax.hpp"
 #include "node/abstract/node_factory.hpp"
+#include "data/cpu/thread_pool.hpp"
 #define POS_INDEX(outer_size, inner_size, axis_size) \
 outer_size* axis_sizes* inner_sizes + axis_size* inner_sizes + inner_size;
 
@@ -78,8 +79,11 @@ InferStatus SoftmaxLayer::Forward(
 
         const auto& input_values = input->values();
         std::vector<float> output_values(input_values.size());
-        for (uint32_t outer_size = 0; outer_size < outer_sizes; ++outer_size) {
-            for (uint32_t inner_size = 0; inner_size < inner_sizes; ++inner_size) {
+        // 每一组沿dim轴的数据互不相关，按组分给多个线程
+        ParallelFor(size_t(outer_sizes) * inner_sizes, ParallelGrain(size_t(axis_sizes) * 3), [&](size_t begin, size_t end) {
+            for (size_t group = begin; group < end; ++group) {
+                const uint32_t outer_size = uint32_t(group / inner_sizes);
+                const uint32_t inner_size = uint32_t(group % inner_sizes);
                 float max_value = std::numeric_limits<float>::lowest();
                 // 迭代当前dim中的数据，并找到其中的最大值
                 for (uint32_t axis_size = 0; axis_size < axis_sizes; ++axis_size) {
@@ -109,7 +113,7 @@ InferStatus SoftmaxLayer::Forward(
                     output_values.at(index) = exp_sub_value / sum_value;
                 }
             }
-        }
+        });
         output->Fill(output_values);
     }
     return InferStatus::kInferSuccess;
@@ -0,0 +1,35 @@
+//
+// Created by hanke on 2024/5/20.
+//
+
+#ifndef INFERNETO_TEST_SCOPED_TEMP_FILE_HPP
+#define INFERNETO_TEST_SCOPED_TEMP_FILE_HPP
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <glog/logging.h>
+
+/// 离开作用域时删除的临时文件，文件名由mkstemp生成，并行运行的测试不会互相覆盖，断言失败时也会删除
+struct ScopedTempFile {
+    explicit ScopedTempFile(const std::string &prefix) {
+        std::string path_template = (std::filesystem::temp_directory_path() / (prefix + "XXXXXX")).string();
+        const int fd = mkstemp(path_template.data());
+        CHECK(fd >= 0) << "Failed to create a temporary file for " << prefix;
+        close(fd);
+        path = path_template;
+    }
+
+    ~ScopedTempFile() {
+        std::remove(path.c_str());
+    }
+
+    ScopedTempFile(const ScopedTempFile &) = delete;
+
+    ScopedTempFile &operator=(const ScopedTempFile &) = delete;
+
+    std::string path;
+};
+
+#endif //INFERNETO_TEST_SCOPED_TEMP_FILE_HPP
@@ -0,0 +1,167 @@
+//
+// Created by hanke on 2024/5/13.
+//
+#include "infer/infer_session.hpp"
+#include "node/details/expression.hpp"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+// 计数的全局分配器，只在g_count_allocations为true时记录分配次数
+// 替换整个测试程序的operator new和operator delete，包括nothrow的版本，所有内存都由malloc申请、free释放，
+// 否则标准库通过未替换的版本申请的内存会被这里的delete释放，sanitizer会报告申请和释放不匹配
+static std::atomic<bool> g_count_allocations{false};
+static std::atomic<uint64_t> g_allocations{0};
+
+static void *CountedAllocateNoThrow(std::size_t size, std::size_t alignment) noexcept {
+    if (g_count_allocations.load(std::memory_order_relaxed)) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (size == 0) {
+        size = 1;
+    }
+    return alignment <= alignof(std::max_align_t) ? std::malloc(size)
+                                                   : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+static void *CountedAllocate(std::size_t size, std::size_t alignment) {
+    void *ptr = CountedAllocateNoThrow(size, alignment);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new(std::size_t size) { return CountedAllocate(size, 0); }
+
+void *operator new[](std::size_t size) { return CountedAllocate(size, 0); }
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    return CountedAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    return CountedAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept { return CountedAllocateNoThrow(size, 0); }
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept { return CountedAllocateNoThrow(size, 0); }
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return CountedAllocateNoThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return CountedAllocateNoThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { std::free(ptr); }
+
+/**
+ * 预热之后统计每次推理的堆分配次数
+ * @param graph 已经构建好的计算图
+ * @param inputs 计算图的输入
+ * @return 最后一次推理中堆分配的次数
+ */
+static uint64_t CountForwardAllocations(infer_neto::RuntimeGraph &graph,
+                                        const std::vector<infer_neto::sftensor> &inputs) {
+    // 第一次推理中各层的工作区和打包缓冲区会完成分配
+    graph.Forward(inputs, false);
+    g_allocations = 0;
+    g_count_allocations = true;
+    graph.Forward(inputs, false);
+    g_count_allocations = false;
+    return g_allocations.load();
+}
+
+TEST(test_allocation, forward_without_heap_allocation) {
+    using namespace infer_neto;
+    const std::vector<std::vector<std::string>> models = {
+            {"../model_file/conv_relu_residual.pnnx.param", "../model_file/conv_relu_residual.pnnx.bin"},
+            {"../model_file/linear_head.pnnx.param", "../model_file/linear_head.pnnx.bin"},
+            {"../model_file/simple_ops.pnnx.param", "../model_file/simple_ops.pnnx.bin"}};
+    for (const auto &model : models) {
+        for (const bool fusion : {false, true}) {
+            RuntimeGraph graph(model.at(0), model.at(1));
+            graph.set_operator_fusion(fusion);
+            ASSERT_EQ(graph.Init(), true);
+            graph.Build("pnnx_input_0", "pnnx_output_0");
+
+            const auto &input_op = graph.get_topo_queues().front();
+            ASSERT_EQ(input_op->type, "pnnx.Input");
+            const auto &input_shape = input_op->output_operands->shapes;
+            std::vector<sftensor> inputs;
+            for (int32_t i = 0; i < input_shape.at(0); ++i) {
+                sftensor input = std::make_shared<Tensor<float>>(input_shape.at(1), input_shape.at(2), input_shape.at(3));
+                input->Rand();
+                inputs.push_back(input);
+            }
+            EXPECT_EQ(CountForwardAllocations(graph, inputs), 0) << model.at(0) << " fusion: " << fusion;
+
+            // 会话的推理同样不申请堆内存
+            RuntimeSession session(graph);
+            session.Forward(inputs);
+            g_allocations = 0;
+            g_count_allocations = true;
+            session.Forward(inputs);
+            g_count_allocations = false;
+            EXPECT_EQ(g_allocations.load(), 0) << model.at(0) << " session, fusion: " << fusion;
+        }
+    }
+}
+
+TEST(test_allocation, expression_without_heap_allocation) {
+    using namespace infer_neto;
+    // 多个运算的表达式，中间结果写入工作区；第二组输入中@1按通道广播
+    const std::vector<std::vector<uint32_t>> second_shapes = {{3, 8, 8}, {3, 1, 1}};
+    for (const auto &second_shape : second_shapes) {
+        ExpressionLayer layer("add(mul(@0,@1),@2)");
+        const uint32_t batch_size = 2;
+        std::vector<sftensor> inputs;
+        for (uint32_t operand = 0; operand < 3; ++operand) {
+            for (uint32_t i = 0; i < batch_size; ++i) {
+                sftensor input = operand == 1 ? std::make_shared<Tensor<float>>(second_shape)
+                                              : std::make_shared<Tensor<float>>(3, 8, 8);
+                input->Rand();
+                inputs.push_back(input);
+            }
+        }
+        std::vector<sftensor> outputs;
+        for (uint32_t i = 0; i < batch_size; ++i) {
+            outputs.push_back(std::make_shared<Tensor<float>>(3, 8, 8));
+        }
+        ASSERT_EQ(layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+        g_allocations = 0;
+        g_count_allocations = true;
+        const InferStatus status = layer.Forward(inputs, outputs);
+        g_count_allocations = false;
+        ASSERT_EQ(status, InferStatus::kInferSuccess);
+        EXPECT_EQ(g_allocations.load(), 0) << "@1 shape: " << second_shape.at(0) << "x" << second_shape.at(1);
+    }
+}
@@ -3,8 +3,13 @@
 //
 #include "node/abstract/node_factory.hpp"
 #include "node/details/convolution.hpp"
+#include "data/cpu/tensor_util.hpp"
+#include "data/cpu/thread_pool.hpp"
 #include <gtest/gtest.h>
+#include <memory>
+#include <string>
 #include <vector>
+#include <cmath>
 
 using namespace infer_neto;
 
@@ -95,4 +100,330 @@ TEST(test_registry, create_layer_groupconvforward) {
         if (output) output->Show();
         else std::cout << "Output tensor is nullptr." << std::endl;
     }
-}
\ No newline at end of file
+}
+// 直接按定义计算卷积，作为正确性对照
+static sftensor ConvReference(const sftensor& input, const std::vector<sftensor>& weights,
+                              const std::vector<float>& bias, uint32_t groups,
+                              uint32_t padding, uint32_t stride) {
+    const uint32_t kernel_count = weights.size();
+    const uint32_t kernel_c = weights.front()->channels();
+    const uint32_t kernel_h = weights.front()->rows();
+    const uint32_t kernel_w = weights.front()->cols();
+    const uint32_t output_h = (input->rows() + 2 * padding - kernel_h) / stride + 1;
+    const uint32_t output_w = (input->cols() + 2 * padding - kernel_w) / stride + 1;
+    const uint32_t kernel_count_group = kernel_count / groups;
+    sftensor output = std::make_shared<Tensor<float>>(kernel_count, output_h, output_w);
+    for (uint32_t k = 0; k < kernel_count; ++k) {
+        const uint32_t g = k / kernel_count_group;
+        for (uint32_t oh = 0; oh < output_h; ++oh) {
+            for (uint32_t ow = 0; ow < output_w; ++ow) {
+                float sum = bias.empty() ? 0.f : bias.at(k);
+                for (uint32_t ic = 0; ic < kernel_c; ++ic) {
+                    for (uint32_t kh = 0; kh < kernel_h; ++kh) {
+                        for (uint32_t kw = 0; kw < kernel_w; ++kw) {
+                            const int ih = int(oh * stride + kh) - int(padding);
+                            const int iw = int(ow * stride + kw) - int(padding);
+                            if (ih < 0 || iw < 0 || ih >= int(input->rows()) || iw >= int(input->cols())) {
+                                continue;
+                            }
+                            sum += weights.at(k)->at(ic, kh, kw) * input->at(g * kernel_c + ic, ih, iw);
+                        }
+                    }
+                }
+                output->at(k, oh, ow) = sum;
+            }
+        }
+    }
+    return output;
+}
+
+/**
+ * 创建随机的卷积核，取值在[-0.5, 0.5)之间，正负相消时更容易暴露误差
+ */
+static std::vector<sftensor> RandomConvWeights(uint32_t kernel_count, uint32_t kernel_channels,
+                                               uint32_t kernel_size) {
+    std::vector<sftensor> weights;
+    for (uint32_t k = 0; k < kernel_count; ++k) {
+        sftensor kernel = std::make_shared<Tensor<float>>(kernel_channels, kernel_size, kernel_size);
+        kernel->Rand();
+        float* kernel_data = kernel->raw_ptr();
+        for (uint32_t j = 0; j < kernel->size(); ++j) {
+            kernel_data[j] -= 0.5f;
+        }
+        weights.push_back(kernel);
+    }
+    return weights;
+}
+
+// 每个输出通道的偏置，正负交替
+static std::vector<float> ConvBias(uint32_t kernel_count) {
+    std::vector<float> bias;
+    for (uint32_t k = 0; k < kernel_count; ++k) {
+        bias.push_back(float(k % 5) - 2.f);
+    }
+    return bias;
+}
+
+/**
+ * 按给定的卷积核和偏置创建卷积层，卷积核的数量和大小从weights中得到
+ * @param bias 为空时不使用偏置
+ */
+static std::unique_ptr<ConvolutionLayer> CreateConvLayer(const std::vector<sftensor>& weights,
+                                                         const std::vector<float>& bias, uint32_t in_channel,
+                                                         uint32_t padding, uint32_t stride, uint32_t groups) {
+    const uint32_t kernel_h = weights.front()->rows();
+    const uint32_t kernel_w = weights.front()->cols();
+    auto conv_layer = std::make_unique<ConvolutionLayer>(uint32_t(weights.size()), in_channel, kernel_h, kernel_w,
+                                                         padding, padding, stride, stride, groups, !bias.empty());
+    conv_layer->set_weights(weights);
+    if (!bias.empty()) {
+        conv_layer->set_bias(bias);
+    }
+    return conv_layer;
+}
+
+// 逐元素比较，允许的误差为期望值的千分之一，期望值的绝对值小于1时按1计算
+static void ExpectTensorsNear(const sftensor& output, const Tensor<float>& expected, const std::string& message) {
+    ASSERT_NE(output, nullptr) << message;
+    ASSERT_EQ(output->shapes(), expected.shapes()) << message;
+    for (uint32_t j = 0; j < expected.size(); ++j) {
+        const float value = expected.index(j);
+        ASSERT_NEAR(output->index(j), value, 1e-3f * std::max(1.f, std::abs(value))) << message << " index: " << j;
+    }
+}
+
+static void ExpectConvNear(uint32_t in_channel, uint32_t kernel_count, uint32_t kernel_size,
+                           uint32_t padding, uint32_t stride, uint32_t groups,
+                           uint32_t input_h, uint32_t input_w, bool use_bias,
+                           bool force_im2col = false) {
+    const uint32_t batch_size = 2;
+    std::vector<sftensor> inputs(batch_size);
+    std::vector<sftensor> outputs(batch_size);
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        inputs.at(i) = std::make_shared<Tensor<float>>(in_channel, input_h, input_w);
+        inputs.at(i)->Rand();
+    }
+
+    const std::vector<sftensor> weights = RandomConvWeights(kernel_count, in_channel / groups, kernel_size);
+    const std::vector<float> bias = use_bias ? ConvBias(kernel_count) : std::vector<float>();
+    const auto conv_layer = CreateConvLayer(weights, bias, in_channel, padding, stride, groups);
+    if (force_im2col) {
+        conv_layer->set_algorithm(ConvAlgorithm::kIm2ColGemm);
+    }
+    conv_layer->InitIm2ColWeight();
+    ASSERT_EQ(conv_layer->Forward(inputs, outputs), InferStatus::kInferSuccess);
+
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        const sftensor& expected = ConvReference(inputs.at(i), weights, bias, groups, padding, stride);
+        ExpectTensorsNear(outputs.at(i), *expected, "batch: " + std::to_string(i));
+    }
+}
+
+TEST(test_registry, conv_forward_reference) {
+    ExpectConvNear(3, 8, 3, 1, 1, 1, 9, 11, true);
+    ExpectConvNear(3, 5, 7, 3, 2, 1, 17, 15, true);
+    ExpectConvNear(16, 20, 3, 1, 2, 1, 10, 10, false);
+    ExpectConvNear(16, 24, 1, 0, 1, 1, 7, 9, true);
+    ExpectConvNear(16, 24, 1, 0, 2, 1, 7, 9, true);
+    ExpectConvNear(8, 12, 1, 1, 2, 1, 6, 6, false);
+}
+
+TEST(test_registry, group_conv_forward_reference) {
+    ExpectConvNear(4, 4, 3, 0, 1, 2, 6, 6, true);
+    ExpectConvNear(8, 16, 3, 1, 1, 4, 9, 7, true);
+    ExpectConvNear(8, 8, 3, 1, 2, 8, 12, 12, true);
+    ExpectConvNear(8, 12, 1, 0, 2, 4, 9, 8, true);
+    // 同样的分组卷积走im2col
+    ExpectConvNear(4, 4, 3, 0, 1, 2, 6, 6, true, true);
+    ExpectConvNear(8, 16, 3, 1, 1, 4, 9, 7, true, true);
+    ExpectConvNear(8, 8, 3, 1, 2, 8, 12, 12, true, true);
+}
+
+TEST(test_registry, depthwise_conv_forward_reference) {
+    // 深度可分离卷积走直接卷积，宽度覆盖16个、8个以及不足8个的输出
+    ConvolutionLayer depthwise_layer(16, 16, 3, 3, 1, 1, 1, 1, 16, true);
+    ASSERT_EQ(depthwise_layer.algorithm(), ConvAlgorithm::kDirect);
+    ExpectConvNear(16, 16, 3, 1, 1, 16, 7, 29, true);
+    ExpectConvNear(16, 16, 3, 1, 2, 16, 13, 45, true);
+    ExpectConvNear(6, 12, 5, 2, 1, 6, 11, 19, false);
+    ExpectConvNear(24, 24, 3, 0, 1, 8, 5, 3, true);
+    ExpectConvNear(16, 32, 3, 1, 1, 2, 12, 23, true);
+}
+
+// Winograd与im2col两种计算方式的结果应在误差范围内一致
+static void ExpectWinogradNear(uint32_t in_channel, uint32_t kernel_count, uint32_t padding,
+                               uint32_t input_h, uint32_t input_w, ConvAlgorithm algorithm) {
+    std::vector<sftensor> inputs(1);
+    inputs.at(0) = std::make_shared<Tensor<float>>(in_channel, input_h, input_w);
+    inputs.at(0)->Rand();
+
+    const std::vector<sftensor> weights = RandomConvWeights(kernel_count, in_channel, 3);
+    const std::vector<float> bias = ConvBias(kernel_count);
+    const auto im2col_layer = CreateConvLayer(weights, bias, in_channel, padding, 1, 1);
+    const auto winograd_layer = CreateConvLayer(weights, bias, in_channel, padding, 1, 1);
+    ASSERT_TRUE(winograd_layer->WinogradEligible());
+    im2col_layer->set_algorithm(ConvAlgorithm::kIm2ColGemm);
+    winograd_layer->set_algorithm(algorithm);
+    ASSERT_EQ(winograd_layer->algorithm(), algorithm);
+    for (ConvolutionLayer* layer : {im2col_layer.get(), winograd_layer.get()}) {
+        layer->InitIm2ColWeight();
+        layer->InitWinogradWeight();
+    }
+
+    std::vector<sftensor> expected(1);
+    std::vector<sftensor> outputs(1);
+    ASSERT_EQ(im2col_layer->Forward(inputs, expected), InferStatus::kInferSuccess);
+    ASSERT_EQ(winograd_layer->Forward(inputs, outputs), InferStatus::kInferSuccess);
+    ExpectTensorsNear(outputs.at(0), *expected.at(0), "algorithm: " + std::to_string(int(algorithm)));
+}
+
+TEST(test_registry, winograd_conv_tolerance) {
+    for (ConvAlgorithm algorithm : {ConvAlgorithm::kWinograd2x2, ConvAlgorithm::kWinograd4x4}) {
+        ExpectWinogradNear(64, 64, 1, 14, 14, algorithm);
+        // 输出尺寸不是块大小的整数倍，通道数不是8的整数倍
+        ExpectWinogradNear(3, 5, 1, 9, 11, algorithm);
+        ExpectWinogradNear(13, 20, 0, 7, 10, algorithm);
+        ExpectWinogradNear(16, 8, 2, 5, 5, algorithm);
+    }
+}
+
+TEST(test_registry, winograd_conv_select) {
+    // 不满足条件的卷积退回im2col
+    ConvolutionLayer strided_layer(8, 8, 3, 3, 1, 1, 2, 2, 1, false);
+    ASSERT_FALSE(strided_layer.WinogradEligible());
+    ASSERT_EQ(strided_layer.algorithm(), ConvAlgorithm::kIm2ColGemm);
+    strided_layer.set_algorithm(ConvAlgorithm::kWinograd4x4);
+    ASSERT_EQ(strided_layer.algorithm(), ConvAlgorithm::kIm2ColGemm);
+
+    ConvolutionLayer conv_layer(8, 8, 3, 3, 1, 1, 1, 1, 1, false);
+    ASSERT_EQ(conv_layer.SelectAlgorithm(56, 56), ConvAlgorithm::kWinograd4x4);
+    ASSERT_EQ(conv_layer.SelectAlgorithm(14, 14), ConvAlgorithm::kWinograd2x2);
+    ASSERT_EQ(conv_layer.SelectAlgorithm(7, 7), ConvAlgorithm::kIm2ColGemm);
+    ASSERT_EQ(strided_layer.SelectAlgorithm(56, 56), ConvAlgorithm::kIm2ColGemm);
+
+    ConvolutionLayer group_layer(8, 8, 3, 3, 1, 1, 1, 1, 2, false);
+    ASSERT_FALSE(group_layer.WinogradEligible());
+    ConvolutionLayer pointwise_layer(8, 8, 1, 1, 0, 0, 1, 1, 1, false);
+    ASSERT_FALSE(pointwise_layer.WinogradEligible());
+}
+
+// 合并ReLU(以及残差相加)后各种计算方式的结果应等于先卷积、加残差再做ReLU
+static void ExpectFusedReluNear(uint32_t in_channel, uint32_t kernel_count, uint32_t kernel_size,
+                                uint32_t padding, uint32_t stride, uint32_t groups,
+                                uint32_t input_h, uint32_t input_w, ConvAlgorithm algorithm,
+                                bool fuse_residual = false) {
+    std::vector<sftensor> inputs(1);
+    inputs.at(0) = std::make_shared<Tensor<float>>(in_channel, input_h, input_w);
+    inputs.at(0)->Rand();
+    if (fuse_residual) {
+        const uint32_t output_h = (input_h + 2 * padding - kernel_size) / stride + 1;
+        const uint32_t output_w = (input_w + 2 * padding - kernel_size) / stride + 1;
+        inputs.push_back(std::make_shared<Tensor<float>>(kernel_count, output_h, output_w));
+        inputs.back()->Rand();
+    }
+
+    const std::vector<sftensor> weights = RandomConvWeights(kernel_count, in_channel / groups, kernel_size);
+    const std::vector<float> bias = ConvBias(kernel_count);
+    const auto conv_layer = CreateConvLayer(weights, bias, in_channel, padding, stride, groups);
+    conv_layer->set_algorithm(algorithm);
+    ASSERT_EQ(conv_layer->algorithm(), algorithm);
+    if (fuse_residual) {
+        ASSERT_TRUE(conv_layer->FuseResidualAdd());
+        ASSERT_FALSE(conv_layer->FuseResidualAdd());
+    }
+    ASSERT_TRUE(conv_layer->FuseActivation("nn.ReLU"));
+    ASSERT_FALSE(conv_layer->FuseActivation("nn.ReLU"));
+    ASSERT_FALSE(conv_layer->FuseResidualAdd());
+    ASSERT_TRUE(conv_layer->fused_relu());
+    ASSERT_EQ(conv_layer->fused_residual(), fuse_residual);
+    conv_layer->InitIm2ColWeight();
+    conv_layer->InitWinogradWeight();
+
+    std::vector<sftensor> outputs(1);
+    ASSERT_EQ(conv_layer->Forward(inputs, outputs), InferStatus::kInferSuccess);
+    const sftensor& expected = ConvReference(inputs.at(0), weights, bias, groups, padding, stride);
+    for (uint32_t j = 0; j < expected->size(); ++j) {
+        const float residual = fuse_residual ? inputs.at(1)->index(j) : 0.f;
+        expected->index(j) = std::max(expected->index(j) + residual, 0.f);
+    }
+    ExpectTensorsNear(outputs.at(0), *expected, "algorithm: " + std::to_string(int(algorithm)));
+}
+
+TEST(test_registry, conv_fused_relu) {
+    ExpectFusedReluNear(16, 20, 3, 1, 2, 1, 11, 13, ConvAlgorithm::kIm2ColGemm);
+    ExpectFusedReluNear(300, 7, 1, 0, 1, 1, 5, 6, ConvAlgorithm::kIm2ColGemm);
+    ExpectFusedReluNear(16, 24, 1, 0, 2, 1, 7, 9, ConvAlgorithm::kIm2ColGemm);
+    ExpectFusedReluNear(1, 1, 3, 1, 1, 1, 4, 37, ConvAlgorithm::kIm2ColGemm);
+    ExpectFusedReluNear(13, 20, 3, 1, 1, 1, 9, 11, ConvAlgorithm::kWinograd2x2);
+    ExpectFusedReluNear(13, 20, 3, 1, 1, 1, 9, 11, ConvAlgorithm::kWinograd4x4);
+    ExpectFusedReluNear(16, 16, 3, 1, 1, 16, 7, 29, ConvAlgorithm::kDirect);
+    ExpectFusedReluNear(8, 16, 3, 1, 2, 4, 9, 7, ConvAlgorithm::kDirect);
+}
+
+TEST(test_registry, conv_fused_residual) {
+    ExpectFusedReluNear(16, 20, 3, 1, 2, 1, 11, 13, ConvAlgorithm::kIm2ColGemm, true);
+    ExpectFusedReluNear(300, 7, 1, 0, 1, 1, 5, 6, ConvAlgorithm::kIm2ColGemm, true);
+    ExpectFusedReluNear(16, 24, 1, 0, 2, 1, 7, 9, ConvAlgorithm::kIm2ColGemm, true);
+    ExpectFusedReluNear(13, 20, 3, 1, 1, 1, 9, 11, ConvAlgorithm::kWinograd2x2, true);
+    ExpectFusedReluNear(13, 20, 3, 1, 1, 1, 9, 11, ConvAlgorithm::kWinograd4x4, true);
+    ExpectFusedReluNear(16, 16, 3, 1, 1, 16, 7, 29, ConvAlgorithm::kDirect, true);
+    ExpectFusedReluNear(8, 16, 3, 1, 2, 4, 9, 7, ConvAlgorithm::kDirect, true);
+}
+
+// 整个批次位于同一块内存中时，卷积把批次合并进一次矩阵乘法，结果应与逐个样本计算相同
+static void ExpectBatchedConvNear(uint32_t in_channel, uint32_t kernel_count, uint32_t kernel_size,
+                                  uint32_t padding, uint32_t stride, uint32_t groups,
+                                  uint32_t input_h, uint32_t input_w) {
+    const uint32_t batch_size = 3;
+    const uint32_t output_h = (input_h + 2 * padding - kernel_size) / stride + 1;
+    const uint32_t output_w = (input_w + 2 * padding - kernel_size) / stride + 1;
+    std::vector<sftensor> inputs = TensorCreateBatch(batch_size, {in_channel, input_h, input_w});
+    const std::vector<sftensor>& residuals = TensorCreateBatch(batch_size, {kernel_count, output_h, output_w});
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        inputs.at(i)->Rand();
+        residuals.at(i)->Rand();
+    }
+    inputs.insert(inputs.end(), residuals.begin(), residuals.end());
+    std::vector<sftensor> outputs = TensorCreateBatch(batch_size, {kernel_count, output_h, output_w});
+    ASSERT_EQ(TensorBatchStride(outputs, 0, batch_size), outputs.front()->size());
+
+    const std::vector<sftensor> weights = RandomConvWeights(kernel_count, in_channel / groups, kernel_size);
+    const std::vector<float> bias = ConvBias(kernel_count);
+    const auto conv_layer = CreateConvLayer(weights, bias, in_channel, padding, stride, groups);
+    conv_layer->set_algorithm(ConvAlgorithm::kIm2ColGemm);
+    ASSERT_TRUE(conv_layer->FuseResidualAdd());
+    ASSERT_TRUE(conv_layer->FuseActivation("nn.ReLU"));
+    ASSERT_EQ(conv_layer->Forward(inputs, outputs), InferStatus::kInferSuccess);
+
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        const sftensor& expected = ConvReference(inputs.at(i), weights, bias, groups, padding, stride);
+        for (uint32_t j = 0; j < expected->size(); ++j) {
+            expected->index(j) = std::max(expected->index(j) + residuals.at(i)->index(j), 0.f);
+        }
+        ExpectTensorsNear(outputs.at(i), *expected, "batch: " + std::to_string(i));
+    }
+}
+
+TEST(test_registry, conv_batched_forward) {
+    ExpectBatchedConvNear(16, 20, 3, 1, 2, 1, 11, 13);
+    ExpectBatchedConvNear(8, 16, 3, 1, 1, 4, 9, 7);
+    ExpectBatchedConvNear(300, 7, 1, 0, 1, 1, 5, 6);
+    ExpectBatchedConvNear(16, 24, 1, 0, 2, 1, 7, 9);
+    // 每个样本的列数超过一个NC分块
+    ExpectBatchedConvNear(3, 8, 3, 1, 1, 1, 67, 71);
+}
+
+TEST(test_registry, conv_intra_op_threads) {
+    // 多线程时im2col、直接卷积、Winograd和批量卷积的结果不变
+    SetIntraOpThreads(4);
+    ExpectConvNear(16, 20, 3, 1, 2, 1, 10, 10, false);
+    ExpectConvNear(16, 24, 1, 0, 1, 1, 7, 9, true);
+    ExpectConvNear(64, 64, 3, 1, 1, 64, 15, 29, true);
+    ExpectConvNear(16, 32, 3, 1, 1, 2, 12, 23, true);
+    for (ConvAlgorithm algorithm : {ConvAlgorithm::kWinograd2x2, ConvAlgorithm::kWinograd4x4}) {
+        ExpectWinogradNear(64, 64, 1, 14, 14, algorithm);
+        ExpectWinogradNear(13, 20, 0, 7, 10, algorithm);
+    }
+    ExpectBatchedConvNear(3, 8, 3, 1, 1, 1, 67, 71);
+    SetIntraOpThreads(0);
+}
@@ -259,4 +259,52 @@ TEST(test_parser, generate_sin2) {
         if (!are_equal) break;
     }
     assert(are_equal);
-}
\ No newline at end of file
+}
+TEST(test_expression, add_fused_relu) {
+    using namespace infer_neto;
+    ExpressionLayer layer("add(@0,@1)");
+    ASSERT_TRUE(layer.FuseActivation("nn.ReLU"));
+    ASSERT_FALSE(layer.FuseActivation("nn.ReLU"));
+
+    std::shared_ptr<Tensor<float>> input1 = std::make_shared<Tensor<float>>(3, 4, 5);
+    std::shared_ptr<Tensor<float>> input2 = std::make_shared<Tensor<float>>(3, 4, 5);
+    input1->Rand();
+    input2->Rand();
+    std::vector<std::shared_ptr<Tensor<float>>> inputs = {input1, input2};
+    std::vector<std::shared_ptr<Tensor<float>>> outputs(1);
+    outputs.at(0) = std::make_shared<Tensor<float>>(3, 4, 5);
+    const std::shared_ptr<Tensor<float>> output = outputs.at(0);
+
+    ASSERT_EQ(layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+    // 激活后的结果直接写入预先分配的输出张量
+    ASSERT_EQ(outputs.at(0), output);
+    for (uint32_t i = 0; i < output->size(); ++i) {
+        const float value = input1->index(i) + input2->index(i);
+        ASSERT_FLOAT_EQ(output->index(i), value > 0.f ? value : 0.f);
+    }
+}
+
+TEST(test_expression, broadcast_mul_add) {
+    using namespace infer_neto;
+    // 按通道缩放之后加上按行广播的偏置，中间结果的形状为广播之后的形状
+    ExpressionLayer layer("add(mul(@0,@1),@2)");
+    std::shared_ptr<Tensor<float>> input = std::make_shared<Tensor<float>>(3, 4, 5);
+    std::shared_ptr<Tensor<float>> scale = std::make_shared<Tensor<float>>(3, 1, 1);
+    std::shared_ptr<Tensor<float>> bias = std::make_shared<Tensor<float>>(1, 1, 5);
+    input->Rand();
+    scale->Rand();
+    bias->Rand();
+    std::vector<std::shared_ptr<Tensor<float>>> inputs = {input, scale, bias};
+    std::vector<std::shared_ptr<Tensor<float>>> outputs(1);
+    outputs.at(0) = std::make_shared<Tensor<float>>(3, 4, 5);
+
+    ASSERT_EQ(layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+    const std::shared_ptr<Tensor<float>> &output = outputs.at(0);
+    for (uint32_t c = 0; c < 3; ++c) {
+        for (uint32_t r = 0; r < 4; ++r) {
+            for (uint32_t col = 0; col < 5; ++col) {
+                ASSERT_EQ(output->at(c, r, col), input->at(c, r, col) * scale->index(c) + bias->index(col));
+            }
+        }
+    }
+}
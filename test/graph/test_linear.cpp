@@ -4,6 +4,7 @@
 #include "node/abstract/node_factory.hpp"
 #include "gtest/gtest.h"
 #include "node/details/linear.hpp"
+#include "data/cpu/tensor_util.hpp"
 
 TEST(LinearLayerTest, ForwardPass) {
     using namespace infer_neto;
@@ -59,4 +60,47 @@ TEST(LinearLayerTest, ForwardPass) {
             std::cout << "Output tensor is nullptr." << std::endl;
         }
     }
-}
\ No newline at end of file
+}
+TEST(test_linear, batched_forward) {
+    using namespace infer_neto;
+    // 整个批次紧密排列时合并成一次矩阵乘法，分散的样本逐个计算，两者都应与直接计算的结果相同
+    const uint32_t batch_size = 4;
+    const uint32_t feature_dims = 3;
+    const int32_t in_features = 37;
+    const int32_t out_features = 19;
+    std::vector<float> weight_values(in_features * out_features);
+    for (uint32_t i = 0; i < weight_values.size(); ++i) {
+        weight_values.at(i) = float(i % 11) * 0.1f - 0.5f;
+    }
+    std::vector<float> bias_values(out_features);
+    for (int32_t j = 0; j < out_features; ++j) {
+        bias_values.at(j) = float(j) * 0.25f - 2.f;
+    }
+    LinearLayer linear_layer(in_features, out_features, true);
+    linear_layer.set_weights(weight_values);
+    linear_layer.set_bias(bias_values);
+
+    const std::vector<sftensor>& inputs = TensorCreateBatch(batch_size, {feature_dims, uint32_t(in_features)});
+    std::vector<sftensor> scattered_inputs(batch_size);
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        inputs.at(i)->Rand();
+        scattered_inputs.at(i) = TensorClone(inputs.at(i));
+    }
+    std::vector<sftensor> outputs = TensorCreateBatch(batch_size, {feature_dims, uint32_t(out_features)});
+    std::vector<sftensor> scattered_outputs(batch_size);
+    ASSERT_EQ(linear_layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+    ASSERT_EQ(linear_layer.Forward(scattered_inputs, scattered_outputs), InferStatus::kInferSuccess);
+
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        for (uint32_t r = 0; r < feature_dims; ++r) {
+            for (int32_t j = 0; j < out_features; ++j) {
+                float value = bias_values.at(j);
+                for (int32_t l = 0; l < in_features; ++l) {
+                    value += inputs.at(i)->at(0, r, l) * weight_values.at(j * in_features + l);
+                }
+                ASSERT_NEAR(outputs.at(i)->at(0, r, j), value, 1e-4f * std::max(1.f, std::abs(value)));
+                ASSERT_NEAR(scattered_outputs.at(i)->at(0, r, j), value, 1e-4f * std::max(1.f, std::abs(value)));
+            }
+        }
+    }
+}
@@ -18,8 +18,6 @@ TEST(test_registry, registry1) {
 
   LayerRegisterer::CreateRegistry *registry3 = RegistryGlobal();
   LayerRegisterer::CreateRegistry *registry4 = RegistryGlobal();
-  float *a = new float{3};
-  float *b = new float{4};
   ASSERT_EQ(registry1, registry2);
 }
 
@@ -0,0 +1,157 @@
+//
+// Created by hanke on 2024/5/19.
+//
+#include "infer/request_batcher.hpp"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace infer_neto;
+
+/**
+ * 多个客户端线程同时向合批队列提交单样本的请求，等待所有结果后返回统计数据
+ * @param batcher 合批队列
+ * @param shapes 单个样本输入的形状
+ * @param clients 客户端线程数
+ * @param requests_per_client 每个客户端提交的请求数
+ * @param check 对每个请求的输入和结果做检查，可以为空
+ */
+template<typename Check>
+static BatchingStats RunLoadGenerator(RequestBatcher &batcher, const std::vector<uint32_t> &shapes,
+                                      uint32_t clients, uint32_t requests_per_client, const Check &check) {
+    std::vector<std::thread> threads;
+    for (uint32_t c = 0; c < clients; ++c) {
+        threads.emplace_back([&]() {
+            std::vector<sftensor> inputs;
+            std::vector<std::future<sftensor>> results;
+            for (uint32_t r = 0; r < requests_per_client; ++r) {
+                sftensor input = std::make_shared<Tensor<float>>(shapes);
+                input->Rand();
+                inputs.push_back(input);
+                results.push_back(batcher.Submit(input));
+            }
+            for (uint32_t r = 0; r < requests_per_client; ++r) {
+                check(inputs.at(r), results.at(r).get());
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    const BatchingStats stats = batcher.stats();
+    LOG(INFO) << "requests: " << stats.requests << " batches: " << stats.batches
+              << " average batch: " << stats.average_batch_size << " p50: " << stats.p50_latency_ms
+              << "ms p99: " << stats.p99_latency_ms << "ms throughput: " << stats.throughput << "/s";
+    return stats;
+}
+
+TEST(test_request_batcher, batch_results_match_forward) {
+    RuntimeGraph graph("../model_file/simple_ops2.pnnx.param", "../model_file/simple_ops2.pnnx.bin");
+    ASSERT_EQ(graph.Init(), true);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    // 计算图的批次为2，足够长的等待时间下请求两两合批
+    BatchingOptions options;
+    options.max_delay = std::chrono::milliseconds(50);
+    RequestBatcher batcher(graph, options);
+    ASSERT_EQ(batcher.max_batch_size(), 2);
+
+    // 每个样本单独计算作为对照，同一批中的样本互不影响
+    RuntimeSession reference(graph);
+    std::mutex reference_mutex;
+    std::atomic<uint32_t> mismatches{0};
+    const BatchingStats stats = RunLoadGenerator(
+            batcher, {3, 16, 16}, 4, 8, [&](const sftensor &input, const sftensor &result) {
+                std::lock_guard<std::mutex> lock(reference_mutex);
+                const sftensor &expected = reference.Forward({input, input}).front();
+                if (result == nullptr || result->shapes() != expected->shapes()) {
+                    mismatches.fetch_add(1);
+                    return;
+                }
+                for (uint32_t j = 0; j < expected->size(); ++j) {
+                    if (std::abs(result->index(j) - expected->index(j)) > 1e-4f * std::max(1.f, std::abs(expected->index(j)))) {
+                        mismatches.fetch_add(1);
+                        return;
+                    }
+                }
+            });
+    ASSERT_EQ(mismatches.load(), 0);
+    ASSERT_EQ(stats.requests, 32);
+    ASSERT_LT(stats.batches, 32);
+    ASSERT_LE(stats.average_batch_size, 2.0);
+    ASSERT_GT(stats.average_batch_size, 1.0);
+    ASSERT_LE(stats.p50_latency_ms, stats.p99_latency_ms);
+    ASSERT_GT(stats.throughput, 0);
+}
+
+TEST(test_request_batcher, deadline_flushes_partial_batch) {
+    RuntimeGraph graph("../model_file/simple_ops2.pnnx.param", "../model_file/simple_ops2.pnnx.bin");
+    ASSERT_EQ(graph.Init(), true);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    BatchingOptions options;
+    options.max_delay = std::chrono::milliseconds(1);
+    RequestBatcher batcher(graph, options);
+    sftensor input = std::make_shared<Tensor<float>>(3, 16, 16);
+    input->Rand();
+    // 凑不满一批时到期后单独推理
+    std::future<sftensor> result = batcher.Submit(input);
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    ASSERT_NE(result.get(), nullptr);
+    const BatchingStats stats = batcher.stats();
+    ASSERT_EQ(stats.requests, 1);
+    ASSERT_EQ(stats.batches, 1);
+    ASSERT_GE(stats.p50_latency_ms, 1.0);
+}
+
+TEST(test_request_batcher, rejects_wrong_input_shape) {
+    RuntimeGraph graph("../model_file/simple_ops2.pnnx.param", "../model_file/simple_ops2.pnnx.bin");
+    ASSERT_EQ(graph.Init(), true);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    BatchingOptions options;
+    options.max_delay = std::chrono::milliseconds(1);
+    RequestBatcher batcher(graph, options);
+    sftensor wrong_input = std::make_shared<Tensor<float>>(3, 8, 8);
+    sftensor input = std::make_shared<Tensor<float>>(3, 16, 16);
+    input->Rand();
+    // 形状不对的请求只让自己的结果失败，同时提交的正常请求照常完成
+    std::future<sftensor> wrong_result = batcher.Submit(wrong_input);
+    std::future<sftensor> result = batcher.Submit(input);
+    ASSERT_THROW(wrong_result.get(), std::invalid_argument);
+    ASSERT_THROW(batcher.Submit(nullptr).get(), std::invalid_argument);
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    ASSERT_NE(result.get(), nullptr);
+    ASSERT_EQ(batcher.stats().requests, 1);
+}
+
+TEST(test_request_batcher, resnet18_load_generator) {
+    const std::string param_path = "../model_file/resnet18_batch1.pnnx.param";
+    const std::string bin_path = "../model_file/resnet18_batch1.pnnx.bin";
+    if (!std::ifstream(bin_path).good()) {
+        GTEST_SKIP() << "The weights of resnet18 are not available: " << bin_path;
+    }
+    RuntimeGraph graph(param_path, bin_path);
+    ASSERT_EQ(graph.Init(), true);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    // 计算图按一个样本构建，一批的上限可以更大，会话按实际的批次创建中间结果
+    BatchingOptions options;
+    options.max_batch_size = 4;
+    RequestBatcher batcher(graph, options);
+    const BatchingStats stats = RunLoadGenerator(
+            batcher, {3, 224, 224}, 4, 4, [](const sftensor &, const sftensor &result) {
+                ASSERT_NE(result, nullptr);
+                ASSERT_EQ(result->size(), 1000);
+            });
+    ASSERT_EQ(stats.requests, 16);
+    ASSERT_LE(stats.p50_latency_ms, stats.p99_latency_ms);
+}
@@ -0,0 +1,181 @@
+//
+// Created by hanke on 2024/5/18.
+//
+#include "infer/infer_session.hpp"
+#include "scoped_temp_file.hpp"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace infer_neto;
+
+/**
+ * 按计算图输入节点的形状创建一组随机输入
+ */
+static std::vector<sftensor> RandomGraphInputs(const RuntimeGraph &graph) {
+    const auto &input_op = graph.get_topo_queues().front();
+    CHECK(input_op->type == "pnnx.Input");
+    const auto &input_shape = input_op->output_operands->shapes;
+    std::vector<sftensor> inputs;
+    for (int32_t i = 0; i < input_shape.at(0); ++i) {
+        sftensor input = std::make_shared<Tensor<float>>(input_shape.at(1), input_shape.at(2), input_shape.at(3));
+        input->Rand();
+        inputs.push_back(input);
+    }
+    return inputs;
+}
+
+TEST(test_session, concurrent_sessions) {
+    const std::vector<std::string> models = {"../model_file/simple_ops", "../model_file/conv_relu_residual",
+                                             "../model_file/linear_head"};
+    for (const std::string &model : models) {
+        for (const bool fusion : {false, true}) {
+            RuntimeGraph graph(model + ".pnnx.param", model + ".pnnx.bin");
+            graph.set_operator_fusion(fusion);
+            ASSERT_EQ(graph.Init(), true);
+            graph.Build("pnnx_input_0", "pnnx_output_0");
+
+            // 先用计算图依次算出每组输入的结果，输出会被下一次推理覆盖，需要复制一份
+            const uint32_t request_count = 6;
+            std::vector<std::vector<sftensor>> requests;
+            std::vector<std::vector<Tensor<float>>> expected;
+            for (uint32_t r = 0; r < request_count; ++r) {
+                requests.push_back(RandomGraphInputs(graph));
+                std::vector<Tensor<float>> outputs;
+                for (const sftensor &output : graph.Forward(requests.back(), false)) {
+                    outputs.push_back(*output);
+                }
+                expected.push_back(std::move(outputs));
+            }
+
+            // 多个线程共用同一个计算图，各自的会话同时推理
+            const uint32_t thread_count = 4;
+            std::vector<uint32_t> mismatches(thread_count, 0);
+            std::vector<std::thread> threads;
+            for (uint32_t t = 0; t < thread_count; ++t) {
+                threads.emplace_back([&, t]() {
+                    RuntimeSession session(graph);
+                    EXPECT_EQ(session.memory_bytes(), graph.planned_memory_bytes());
+                    for (uint32_t round = 0; round < 10; ++round) {
+                        const uint32_t r = (t + round) % request_count;
+                        const auto &outputs = session.Forward(requests.at(r));
+                        if (outputs.size() != expected.at(r).size()) {
+                            mismatches.at(t) += 1;
+                            continue;
+                        }
+                        for (uint32_t i = 0; i < outputs.size(); ++i) {
+                            const Tensor<float> &reference = expected.at(r).at(i);
+                            if (outputs.at(i)->shapes() != reference.shapes()) {
+                                mismatches.at(t) += 1;
+                                continue;
+                            }
+                            for (uint32_t j = 0; j < reference.size(); ++j) {
+                                const float value = reference.index(j);
+                                if (std::abs(outputs.at(i)->index(j) - value) > 1e-4f * std::max(1.f, std::abs(value))) {
+                                    mismatches.at(t) += 1;
+                                    break;
+                                }
+                            }
+                        }
+                    }
+                });
+            }
+            for (std::thread &thread : threads) {
+                thread.join();
+            }
+            for (uint32_t t = 0; t < thread_count; ++t) {
+                ASSERT_EQ(mismatches.at(t), 0) << model << " fusion: " << fusion << " thread: " << t;
+            }
+        }
+    }
+}
+
+TEST(test_session, session_outputs_are_independent) {
+    RuntimeGraph graph("../model_file/conv_relu_residual.pnnx.param", "../model_file/conv_relu_residual.pnnx.bin");
+    ASSERT_EQ(graph.Init(), true);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    RuntimeSession first(graph);
+    RuntimeSession second(graph);
+    const std::vector<sftensor> first_inputs = RandomGraphInputs(graph);
+    const std::vector<sftensor> second_inputs = RandomGraphInputs(graph);
+    const auto &first_outputs = first.Forward(first_inputs);
+    const std::vector<Tensor<float>> first_copy = {*first_outputs.front()};
+    // 另一个会话的推理不会覆盖前一个会话的输出，计算图自己的推理也不会
+    second.Forward(second_inputs);
+    graph.Forward(second_inputs, false);
+    ASSERT_NE(first_outputs.front()->raw_ptr(), second.Forward(second_inputs).front()->raw_ptr());
+    for (uint32_t j = 0; j < first_copy.front().size(); ++j) {
+        ASSERT_EQ(first_outputs.front()->index(j), first_copy.front().index(j));
+    }
+}
+
+TEST(test_session, dynamic_batch) {
+    // 把结构文件中的批次维度改为动态，权重文件不变
+    const std::string model = "../model_file/conv_relu_residual";
+    const ScopedTempFile dynamic_param_file("conv_relu_residual_dynamic.pnnx.param.");
+    const std::string &dynamic_param = dynamic_param_file.path;
+    {
+        std::ifstream in(model + ".pnnx.param");
+        ASSERT_TRUE(in.is_open());
+        std::stringstream content;
+        content << in.rdbuf();
+        std::string text = content.str();
+        // 只修改形如#0=(1,...)的操作数形状，dilation=(1,1)等参数保持不变
+        for (size_t pos = text.find("=(1,"); pos != std::string::npos; pos = text.find("=(1,", pos + 1)) {
+            if (text.at(text.rfind(' ', pos) + 1) == '#') {
+                text.replace(pos, 4, "=(?,");
+            }
+        }
+        std::ofstream out(dynamic_param);
+        out << text;
+    }
+
+    RuntimeGraph reference(model + ".pnnx.param", model + ".pnnx.bin");
+    ASSERT_EQ(reference.Init(), true);
+    reference.Build("pnnx_input_0", "pnnx_output_0");
+    RuntimeGraph graph(dynamic_param, model + ".pnnx.bin");
+    ASSERT_EQ(graph.Init(), true);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+    ASSERT_EQ(graph.batch_size(), 1);
+
+    RuntimeSession session(graph);
+    const float *batch3_output = nullptr;
+    for (const uint32_t batch : {1u, 3u, 2u, 3u}) {
+        std::vector<sftensor> inputs;
+        for (uint32_t b = 0; b < batch; ++b) {
+            sftensor input = std::make_shared<Tensor<float>>(4, 16, 16);
+            input->Rand();
+            inputs.push_back(input);
+        }
+        std::vector<Tensor<float>> graph_outputs;
+        for (const sftensor &output : graph.Forward(inputs, false)) {
+            graph_outputs.push_back(*output);
+        }
+        const auto &session_outputs = session.Forward(inputs);
+        ASSERT_EQ(graph_outputs.size(), batch);
+        ASSERT_EQ(session_outputs.size(), batch);
+        if (batch == 3) {
+            // 同样的批次复用第一次创建的中间结果
+            if (batch3_output == nullptr) {
+                batch3_output = session_outputs.front()->raw_ptr();
+            }
+            ASSERT_EQ(session_outputs.front()->raw_ptr(), batch3_output);
+        }
+        for (uint32_t b = 0; b < batch; ++b) {
+            const sftensor expected = reference.Forward({inputs.at(b)}, false).front();
+            ASSERT_EQ(graph_outputs.at(b).shapes(), expected->shapes());
+            ASSERT_EQ(session_outputs.at(b)->shapes(), expected->shapes());
+            for (uint32_t j = 0; j < expected->size(); ++j) {
+                const float value = expected->index(j);
+                ASSERT_NEAR(graph_outputs.at(b).index(j), value, 1e-4f * std::max(1.f, std::abs(value)));
+                ASSERT_NEAR(session_outputs.at(b)->index(j), value, 1e-4f * std::max(1.f, std::abs(value)));
+            }
+        }
+    }
+}
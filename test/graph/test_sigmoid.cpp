@@ -42,7 +42,8 @@ TEST(test_registry, create_layer_sigmoid_forward) {
   for (uint32_t i = 0; i < size; ++i) {
     float input_value = input_tensor->index(i);
     float output_value = output_tensor->index(i);
-    ASSERT_EQ(output_value, 1 / (1.f + std::exp(-input_value)));
+    // sigmoid使用向量化的exp近似计算
+    ASSERT_NEAR(output_value, 1 / (1.f + std::exp(-input_value)), 1e-6f);
   }
 }
 
@@ -3,9 +3,12 @@
 ////
 #include "infer/pnnx/ir.h"
 #include "infer/infer_ir.hpp"
+#include "scoped_temp_file.hpp"
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 #include <string>
+#include <cstdio>
+#include <cmath>
 
 TEST(test_ir, topo) {
     using namespace infer_neto;
@@ -107,3 +110,283 @@ TEST(test_ir, build1_output_tensors) {
         }
     }
 }
+
+TEST(test_ir, conv_tuning_cache) {
+    using namespace infer_neto;
+    std::string bin_path("../model_file/simple_ops2.pnnx.bin");
+    std::string param_path("../model_file/simple_ops2.pnnx.param");
+    const ScopedTempFile cache_file("conv_tuning_test.cache.");
+    const std::string &cache_path = cache_file.path;
+
+    // 第一次构建时试运行并写入缓存
+    RuntimeGraph tuned_graph(param_path, bin_path);
+    tuned_graph.set_conv_tuning(ConvTuningMode::kTimed, cache_path);
+    ASSERT_EQ(tuned_graph.Init(), true);
+    tuned_graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    ConvAlgorithmCache cache(cache_path, ConvAlgorithmCache::ModelKey(param_path, bin_path));
+    ASSERT_TRUE(cache.Load());
+    std::map<std::string, ConvAlgorithm> tuned_algorithms;
+    for (const auto &op : tuned_graph.operators()) {
+        if (op->type != "nn.Conv2d") {
+            continue;
+        }
+        auto conv_layer = std::dynamic_pointer_cast<ConvolutionLayer>(op->layer);
+        ASSERT_NE(conv_layer, nullptr);
+        ConvAlgorithm cached;
+        ASSERT_TRUE(cache.Find(op->name, cached));
+        ASSERT_EQ(cached, conv_layer->algorithm());
+        tuned_algorithms[op->name] = cached;
+    }
+    ASSERT_EQ(tuned_algorithms.size(), 3);
+
+    // 修改缓存中的记录，第二次构建应直接使用缓存而不是重新试运行
+    for (const auto &[name, _] : tuned_algorithms) {
+        cache.Insert(name, ConvAlgorithm::kWinograd2x2);
+    }
+    ASSERT_TRUE(cache.Save());
+    RuntimeGraph cached_graph(param_path, bin_path);
+    cached_graph.set_conv_tuning(ConvTuningMode::kTimed, cache_path);
+    ASSERT_EQ(cached_graph.Init(), true);
+    cached_graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    RuntimeGraph heuristic_graph(param_path, bin_path);
+    ASSERT_EQ(heuristic_graph.Init(), true);
+    heuristic_graph.Build("pnnx_input_0", "pnnx_output_0");
+    for (const auto &op : cached_graph.operators()) {
+        if (op->type == "nn.Conv2d") {
+            auto conv_layer = std::dynamic_pointer_cast<ConvolutionLayer>(op->layer);
+            ASSERT_EQ(conv_layer->algorithm(), ConvAlgorithm::kWinograd2x2);
+        }
+    }
+
+    // 不同计算方式的结果应在误差范围内一致
+    std::vector<sftensor> inputs;
+    for (uint32_t i = 0; i < 2; ++i) {
+        sftensor input = std::make_shared<Tensor<float>>(3, 16, 16);
+        input->Rand();
+        inputs.push_back(input);
+    }
+    const std::vector<sftensor> expected = heuristic_graph.Forward(inputs, false);
+    const std::vector<sftensor> outputs = cached_graph.Forward(inputs, false);
+    ASSERT_EQ(outputs.size(), expected.size());
+    for (uint32_t i = 0; i < outputs.size(); ++i) {
+        ASSERT_EQ(outputs.at(i)->shapes(), expected.at(i)->shapes());
+        for (uint32_t j = 0; j < expected.at(i)->size(); ++j) {
+            const float value = expected.at(i)->index(j);
+            ASSERT_NEAR(outputs.at(i)->index(j), value, 1e-3f * std::max(1.f, std::abs(value)));
+        }
+    }
+}
+
+TEST(test_ir, fuse_activations) {
+    using namespace infer_neto;
+    std::string bin_path("../model_file/conv_relu_residual.pnnx.bin");
+    std::string param_path("../model_file/conv_relu_residual.pnnx.param");
+
+    RuntimeGraph fused_graph(param_path, bin_path);
+    ASSERT_EQ(fused_graph.Init(), true);
+    fused_graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    RuntimeGraph graph(param_path, bin_path);
+    graph.set_operator_fusion(false);
+    ASSERT_EQ(graph.Init(), true);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+    ASSERT_EQ(graph.operators().size(), 9);
+
+    // 卷积之后的ReLU被合并，残差相加及其后的ReLU合并到conv2中，conv1的输出同时作为conv2的输入和残差
+    const auto &operators = fused_graph.operators();
+    ASSERT_EQ(operators.size(), 5);
+    ASSERT_EQ(fused_graph.get_topo_queues().size(), 5);
+    std::map<std::string, std::shared_ptr<RuntimeOperator>> fused_ops;
+    for (const auto &op : operators) {
+        ASSERT_NE(op->type, "nn.ReLU");
+        ASSERT_NE(op->type, "pnnx.Expression");
+        fused_ops.insert({op->name, op});
+    }
+    for (const auto &[name, fused_residual] : std::map<std::string, bool>{{"conv1", false},
+                                                                          {"conv2", true},
+                                                                          {"conv3", false}}) {
+        auto conv_layer = std::dynamic_pointer_cast<ConvolutionLayer>(fused_ops.at(name)->layer);
+        ASSERT_NE(conv_layer, nullptr);
+        ASSERT_TRUE(conv_layer->fused_relu()) << name;
+        ASSERT_EQ(conv_layer->fused_residual(), fused_residual) << name;
+    }
+    const auto &conv2 = fused_ops.at("conv2");
+    ASSERT_EQ(fused_ops.at("conv1")->output_operators.count("conv2"), 1);
+    ASSERT_EQ(conv2->input_operands_seq.size(), 2);
+    ASSERT_EQ(conv2->input_operands_seq.at(1)->name, "conv1");
+    ASSERT_EQ(conv2->output_operators.count("conv3"), 1);
+
+    std::vector<sftensor> inputs;
+    sftensor input = std::make_shared<Tensor<float>>(4, 16, 16);
+    input->Rand();
+    inputs.push_back(input);
+    const std::vector<sftensor> expected = graph.Forward(inputs, false);
+
+    // 合并残差后的卷积也可以试运行选择计算方式
+    RuntimeGraph tuned_graph(param_path, bin_path);
+    tuned_graph.set_conv_tuning(ConvTuningMode::kTimed);
+    ASSERT_EQ(tuned_graph.Init(), true);
+    tuned_graph.Build("pnnx_input_0", "pnnx_output_0");
+    for (RuntimeGraph *run_graph : {&fused_graph, &tuned_graph}) {
+        const std::vector<sftensor> outputs = run_graph->Forward(inputs, false);
+        ASSERT_EQ(outputs.size(), expected.size());
+        for (uint32_t i = 0; i < outputs.size(); ++i) {
+            ASSERT_EQ(outputs.at(i)->shapes(), expected.at(i)->shapes());
+            for (uint32_t j = 0; j < expected.at(i)->size(); ++j) {
+                const float value = expected.at(i)->index(j);
+                ASSERT_NEAR(outputs.at(i)->index(j), value, 1e-3f * std::max(1.f, std::abs(value)));
+            }
+        }
+    }
+}
+
+TEST(test_ir, plan_memory_blocks) {
+    using namespace infer_neto;
+    // 一条链上相邻的输出同时存活，间隔一个位置的输出可以共用内存
+    std::vector<MemoryBlock> blocks(4);
+    const std::vector<size_t> sizes = {64, 256, 128, 32};
+    for (uint32_t i = 0; i < blocks.size(); ++i) {
+        blocks.at(i).size = sizes.at(i);
+        blocks.at(i).first_use = i;
+        blocks.at(i).last_use = i + 1;
+    }
+    const size_t arena_size = PlanMemoryBlocks(blocks);
+    ASSERT_EQ(arena_size, 256 + 128);
+    for (uint32_t i = 0; i < blocks.size(); ++i) {
+        ASSERT_LE(blocks.at(i).offset + blocks.at(i).size, arena_size);
+        for (uint32_t j = i + 1; j < blocks.size(); ++j) {
+            const MemoryBlock &a = blocks.at(i);
+            const MemoryBlock &b = blocks.at(j);
+            if (a.first_use <= b.last_use && b.first_use <= a.last_use) {
+                ASSERT_TRUE(a.offset + a.size <= b.offset || b.offset + b.size <= a.offset) << i << " " << j;
+            }
+        }
+    }
+}
+
+TEST(test_ir, memory_planning) {
+    using namespace infer_neto;
+    std::string bin_path("../model_file/conv_relu_residual.pnnx.bin");
+    std::string param_path("../model_file/conv_relu_residual.pnnx.param");
+
+    RuntimeGraph graph(param_path, bin_path);
+    graph.set_operator_fusion(false);
+    graph.set_memory_planning(false);
+    ASSERT_EQ(graph.Init(), true);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+    ASSERT_EQ(graph.planned_memory_bytes(), 0);
+
+    RuntimeGraph planned_graph(param_path, bin_path);
+    planned_graph.set_operator_fusion(false);
+    ASSERT_EQ(planned_graph.Init(), true);
+    planned_graph.Build("pnnx_input_0", "pnnx_output_0");
+    ASSERT_GT(planned_graph.planned_memory_bytes(), 0);
+    ASSERT_LT(planned_graph.planned_memory_bytes(), planned_graph.naive_memory_bytes());
+
+    RuntimeGraph fused_graph(param_path, bin_path);
+    ASSERT_EQ(fused_graph.Init(), true);
+    fused_graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    // 共用内存后多次推理的结果不变
+    for (uint32_t run = 0; run < 2; ++run) {
+        std::vector<sftensor> inputs;
+        sftensor input = std::make_shared<Tensor<float>>(4, 16, 16);
+        input->Rand();
+        inputs.push_back(input);
+        const std::vector<sftensor> expected = graph.Forward(inputs, false);
+        for (RuntimeGraph *run_graph : {&planned_graph, &fused_graph}) {
+            const std::vector<sftensor> outputs = run_graph->Forward(inputs, false);
+            ASSERT_EQ(outputs.size(), expected.size());
+            for (uint32_t i = 0; i < outputs.size(); ++i) {
+                ASSERT_EQ(outputs.at(i)->shapes(), expected.at(i)->shapes());
+                for (uint32_t j = 0; j < expected.at(i)->size(); ++j) {
+                    const float value = expected.at(i)->index(j);
+                    ASSERT_NEAR(outputs.at(i)->index(j), value, 1e-3f * std::max(1.f, std::abs(value)));
+                }
+            }
+        }
+    }
+}
+
+TEST(test_ir, flatten_view) {
+    using namespace infer_neto;
+    std::string bin_path("../model_file/linear_head.pnnx.bin");
+    std::string param_path("../model_file/linear_head.pnnx.param");
+
+    RuntimeGraph graph(param_path, bin_path);
+    graph.set_memory_planning(false);
+    ASSERT_EQ(graph.Init(), true);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    RuntimeGraph planned_graph(param_path, bin_path);
+    ASSERT_EQ(planned_graph.Init(), true);
+    planned_graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    std::vector<sftensor> inputs;
+    sftensor input = std::make_shared<Tensor<float>>(4, 8, 8);
+    input->Rand();
+    inputs.push_back(input);
+    const std::vector<sftensor> expected = graph.Forward(inputs, false);
+    const std::vector<sftensor> outputs = planned_graph.Forward(inputs, false);
+    ASSERT_EQ(outputs.size(), expected.size());
+    for (uint32_t i = 0; i < expected.at(0)->size(); ++i) {
+        const float value = expected.at(0)->index(i);
+        ASSERT_NEAR(outputs.at(0)->index(i), value, 1e-4f * std::max(1.f, std::abs(value)));
+    }
+
+    // 展开的输出与池化的输出共用数据，只有形状不同
+    for (RuntimeGraph *run_graph : {&graph, &planned_graph}) {
+        std::map<std::string, std::shared_ptr<RuntimeOperator>> ops;
+        for (const auto &op : run_graph->operators()) {
+            ops.insert({op->name, op});
+        }
+        const sftensor &pooled = ops.at("avgpool")->output_operands->datas.front();
+        const sftensor &flattened = ops.at("torch.flatten_0")->output_operands->datas.front();
+        ASSERT_EQ(flattened->raw_ptr(), pooled->raw_ptr());
+        ASSERT_EQ(flattened->raw_shapes(), std::vector<uint32_t>{8});
+        ASSERT_EQ(pooled->channels(), 8);
+    }
+}
+
+TEST(test_ir, parallel_forward) {
+    using namespace infer_neto;
+    const std::vector<std::pair<std::string, uint32_t>> models = {{"../model_file/simple_ops",         3},
+                                                                  {"../model_file/conv_relu_residual", 4}};
+    for (const auto &[model_path, channels] : models) {
+        const std::string param_path = model_path + ".pnnx.param";
+        const std::string bin_path = model_path + ".pnnx.bin";
+        RuntimeGraph graph(param_path, bin_path);
+        ASSERT_EQ(graph.Init(), true);
+        graph.Build("pnnx_input_0", "pnnx_output_0");
+
+        // 不合并算子时分支更多，复用内存的节点之间需要额外的依赖
+        RuntimeGraph parallel_graph(param_path, bin_path);
+        parallel_graph.set_operator_fusion(false);
+        parallel_graph.set_inter_op_threads(4);
+        ASSERT_EQ(parallel_graph.inter_op_threads(), 4);
+        ASSERT_EQ(parallel_graph.Init(), true);
+        parallel_graph.Build("pnnx_input_0", "pnnx_output_0");
+
+        for (uint32_t run = 0; run < 20; ++run) {
+            std::vector<sftensor> inputs;
+            sftensor input = std::make_shared<Tensor<float>>(channels, 16, 16);
+            input->Rand();
+            inputs.push_back(input);
+            const std::vector<sftensor> expected = graph.Forward(inputs, false);
+            const std::vector<sftensor> outputs = parallel_graph.Forward(inputs, false);
+            ASSERT_EQ(outputs.size(), expected.size());
+            for (uint32_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQ(outputs.at(i)->shapes(), expected.at(i)->shapes());
+                for (uint32_t j = 0; j < expected.at(i)->size(); ++j) {
+                    const float value = expected.at(i)->index(j);
+                    ASSERT_NEAR(outputs.at(i)->index(j), value, 1e-3f * std::max(1.f, std::abs(value)));
+                }
+            }
+        }
+        for (const auto &op : parallel_graph.get_topo_queues()) {
+            ASSERT_TRUE(op->has_forward);
+        }
+    }
+}
@@ -5,8 +5,10 @@
 // Created by hanke on 2024/4/2.
 //
 #include "data/cpu/tensor.hpp"
+#include "data/cpu/allocator.hpp"
 #include <glog/logging.h>
 #include <gtest/gtest.h>
+#include <thread>
 
 TEST(test_tensor, tensor_init1D) {
     using namespace infer_neto;
@@ -81,4 +83,108 @@ TEST(test_tensor, tensor_init3D_2) {
     LOG(INFO) << "data rows: " << rows;
     LOG(INFO) << "data cols: " << cols;
     f1.Show();
-}
\ No newline at end of file
+}
+
+namespace {
+    // 统计申请和释放次数的分配器，实际的内存仍由默认分配器提供
+    class CountingAllocator : public infer_neto::AlignedTensorAllocator {
+    public:
+        void *Allocate(size_t bytes) override {
+            allocations += 1;
+            return AlignedTensorAllocator::Allocate(bytes);
+        }
+
+        void Deallocate(void *ptr, size_t bytes) override {
+            deallocations += 1;
+            AlignedTensorAllocator::Deallocate(ptr, bytes);
+        }
+
+        uint32_t allocations = 0;
+        uint32_t deallocations = 0;
+    };
+}
+
+TEST(test_tensor, tensor_aligned_allocation) {
+    using namespace infer_neto;
+    // 各种方式创建的张量数据都按kTensorAlignment对齐
+    std::vector<Tensor<float>> tensors;
+    tensors.emplace_back(3);
+    tensors.emplace_back(5, 7);
+    tensors.emplace_back(3, 5, 7);
+    tensors.emplace_back(std::vector<uint32_t>{2, 3, 5, 7});
+    tensors.emplace_back(std::vector<uint32_t>{3, 5, 7}, kUninitialized);
+    tensors.emplace_back(tensors.at(2));
+    tensors.push_back(tensors.at(2).Transpose().Contiguous());
+    for (const auto &tensor : tensors) {
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(tensor.data().get()) % kTensorAlignment, 0);
+    }
+    // 默认构造的张量清零，不初始化的张量只保证形状
+    for (uint32_t i = 0; i < tensors.at(3).size(); ++i) {
+        ASSERT_EQ(tensors.at(3).index(i), 0.f);
+    }
+    ASSERT_EQ(tensors.at(4).raw_shapes(), tensors.at(2).raw_shapes());
+
+    // 替换分配器之后新建的张量使用新的分配器，释放时交还给申请时的分配器
+    auto counting = std::make_shared<CountingAllocator>();
+    SetTensorAllocator(counting);
+    {
+        Tensor<float> f1(4, 4);
+        Tensor<float> f2(f1);
+        ASSERT_EQ(counting->allocations, 2);
+        SetTensorAllocator(nullptr);
+        Tensor<float> f3(4, 4);
+        ASSERT_EQ(counting->allocations, 2);
+    }
+    ASSERT_EQ(counting->deallocations, 2);
+    ASSERT_NE(GetTensorAllocator(), counting);
+}
+
+TEST(test_tensor, tensor_pooled_allocation) {
+    using namespace infer_neto;
+    auto pooled = std::make_shared<PooledTensorAllocator>();
+    SetTensorAllocator(pooled);
+    {
+        Tensor<float> f1(3, 32, 32);
+        ASSERT_EQ(pooled->stats().misses, 1);
+        ASSERT_EQ(pooled->stats().hits, 0);
+        ASSERT_GE(pooled->stats().bytes_in_use, f1.size() * sizeof(float));
+    }
+    ASSERT_EQ(pooled->stats().bytes_in_use, 0);
+    ASSERT_GT(pooled->stats().bytes_held, 0);
+
+    // 同一级大小的张量复用释放的内存，复用的内存仍然按要求清零
+    {
+        Tensor<float> f2(3, 31, 32);
+        ASSERT_EQ(pooled->stats().hits, 1);
+        ASSERT_EQ(pooled->stats().misses, 1);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(f2.data().get()) % kTensorAlignment, 0);
+        for (uint32_t i = 0; i < f2.size(); ++i) {
+            ASSERT_EQ(f2.index(i), 0.f);
+        }
+        f2.Fill(1.f);
+    }
+
+    // 其他线程释放的内存放回该线程的缓存，线程退出后交还给共享缓存
+    std::thread worker([]() {
+        Tensor<float> f3(3, 32, 32);
+        Tensor<float> f4(1, 8, 8);
+    });
+    worker.join();
+    ASSERT_EQ(pooled->stats().bytes_in_use, 0);
+    Tensor<float> f5(1, 8, 8);
+    ASSERT_EQ(pooled->stats().hits, 2);
+    ASSERT_EQ(pooled->stats().misses, 3);
+    SetTensorAllocator(nullptr);
+
+    // 超过max_block_bytes的申请不进入缓存
+    PooledTensorAllocator small(1024, 256, 256);
+    void *ptr = small.Allocate(512);
+    small.Deallocate(ptr, 512);
+    ASSERT_EQ(small.stats().bytes_held, 0);
+    ptr = small.Allocate(128);
+    small.Deallocate(ptr, 128);
+    ASSERT_EQ(small.stats().bytes_held, 128);
+    small.Trim();
+    ASSERT_EQ(small.stats().bytes_held, 0);
+    ASSERT_EQ(small.stats().misses, 2);
+}
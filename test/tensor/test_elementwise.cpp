@@ -0,0 +1,174 @@
+//
+// Created by hanke on 2024/5/15.
+//
+#include "data/cpu/tensor.hpp"
+#include "data/cpu/elementwise.hpp"
+#include "data/cpu/tensor_util.hpp"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <cmath>
+
+using namespace infer_neto;
+
+// 覆盖只有尾部、主循环加尾部以及多线程分块的长度
+static const std::vector<size_t> kElementwiseSizes = {3, 8, 37, kElementwiseParallelThreshold + 13};
+
+static std::vector<float> ElementwiseInput(size_t n, float low, float high) {
+    std::vector<float> values(n);
+    for (size_t i = 0; i < n; ++i) {
+        values.at(i) = low + (high - low) * float(i % 1031) / 1030.f;
+    }
+    return values;
+}
+
+TEST(test_elementwise, unary) {
+    for (size_t n : kElementwiseSizes) {
+        const std::vector<float> &x = ElementwiseInput(n, -20.f, 20.f);
+        std::vector<float> y(n);
+        ElementwiseUnary(UnaryOp::kRelu, x.data(), y.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(y.at(i), std::max(x.at(i), 0.f));
+        }
+        ElementwiseUnary(UnaryOp::kSigmoid, x.data(), y.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_NEAR(y.at(i), 1.f / (1.f + std::exp(-x.at(i))), 1e-6f);
+        }
+        ElementwiseUnary(UnaryOp::kSin, x.data(), y.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_NEAR(y.at(i), std::sin(x.at(i)), 1e-6f);
+        }
+        ElementwiseUnary(UnaryOp::kExp, x.data(), y.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            const float expected = std::exp(x.at(i));
+            ASSERT_NEAR(y.at(i), expected, 1e-6f * expected);
+        }
+    }
+
+    // 原地计算，输入与输出相同
+    std::vector<float> x = ElementwiseInput(37, -1.f, 1.f);
+    const std::vector<float> origin = x;
+    ElementwiseUnary(UnaryOp::kRelu, x.data(), x.data(), x.size());
+    for (size_t i = 0; i < x.size(); ++i) {
+        ASSERT_EQ(x.at(i), std::max(origin.at(i), 0.f));
+    }
+}
+
+TEST(test_elementwise, binary_and_scalar) {
+    for (size_t n : kElementwiseSizes) {
+        const std::vector<float> &a = ElementwiseInput(n, -3.f, 5.f);
+        const std::vector<float> &b = ElementwiseInput(n, 1.f, 2.f);
+        std::vector<float> y(n);
+        ElementwiseBinary(BinaryOp::kAdd, a.data(), b.data(), y.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(y.at(i), a.at(i) + b.at(i));
+        }
+        ElementwiseBinary(BinaryOp::kSub, a.data(), b.data(), y.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(y.at(i), a.at(i) - b.at(i));
+        }
+        ElementwiseBinary(BinaryOp::kMul, a.data(), b.data(), y.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(y.at(i), a.at(i) * b.at(i));
+        }
+        ElementwiseBinary(BinaryOp::kDiv, a.data(), b.data(), y.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(y.at(i), a.at(i) / b.at(i));
+        }
+        ElementwiseScalar(BinaryOp::kSub, a.data(), 0.5f, y.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(y.at(i), a.at(i) - 0.5f);
+        }
+        ElementwiseScalar(BinaryOp::kDiv, a.data(), 3.f, y.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(y.at(i), a.at(i) / 3.f);
+        }
+    }
+}
+
+TEST(test_elementwise, tensor_ops) {
+    Tensor<float> f1(3, 17, 19);
+    f1.Rand();
+    const Tensor<float> origin(f1);
+    f1.Scale(2.f);
+    f1.AddScalar(1.f);
+    f1.NormalizeChannel(1, 0.5f, 4.f);
+    for (uint32_t c = 0; c < 3; ++c) {
+        for (uint32_t r = 0; r < 17; ++r) {
+            for (uint32_t col = 0; col < 19; ++col) {
+                float expected = origin.at(c, r, col) * 2.f + 1.f;
+                if (c == 1) {
+                    expected = (expected - 0.5f) / 4.f;
+                }
+                ASSERT_EQ(f1.at(c, r, col), expected);
+            }
+        }
+    }
+
+    // 转置视图上按步长逐个元素计算
+    Tensor<float> f2 = f1.Transpose();
+    f2.Transform([](float value) { return value * value; });
+    f2.Scale(0.5f);
+    for (uint32_t i = 0; i < f1.size(); ++i) {
+        const float value = origin.index(i) * 2.f + 1.f;
+        const float expected = i / (17 * 19) == 1 ? (value - 0.5f) / 4.f : value;
+        ASSERT_EQ(f1.index(i), expected * expected * 0.5f);
+    }
+}
+
+// 按广播规则逐个元素计算的对照结果，输入都不超过三维
+static void ExpectBroadcastSame(const sftensor &a, const sftensor &b, bool multiply) {
+    const sftensor &result = multiply ? TensorElementMultiply(a, b) : TensorElementAdd(a, b);
+    const std::vector<uint32_t> &shapes = TensorBroadcastShapes(*a, *b);
+    ASSERT_EQ(result->shapes(), shapes);
+    const auto broadcast_at = [](const sftensor &t, uint32_t c, uint32_t r, uint32_t col) {
+        return t->at(t->channels() == 1 ? 0 : c, t->rows() == 1 ? 0 : r, t->cols() == 1 ? 0 : col);
+    };
+    for (uint32_t c = 0; c < shapes.at(0); ++c) {
+        for (uint32_t r = 0; r < shapes.at(1); ++r) {
+            for (uint32_t col = 0; col < shapes.at(2); ++col) {
+                const float x = broadcast_at(a, c, r, col);
+                const float y = broadcast_at(b, c, r, col);
+                ASSERT_EQ(result->at(c, r, col), multiply ? x * y : x + y);
+            }
+        }
+    }
+}
+
+TEST(test_elementwise, broadcast) {
+    const sftensor input = TensorCreate(8, 13, 17);
+    input->Rand();
+    // 按通道缩放，例如SE模块中的注意力权重
+    const sftensor channel_scale = TensorCreate(8, 1, 1);
+    channel_scale->Rand();
+    ExpectBroadcastSame(input, channel_scale, true);
+    ExpectBroadcastSame(channel_scale, input, true);
+    // 按行广播的偏置
+    const sftensor row_bias = TensorCreate(1, 1, 17);
+    row_bias->Rand();
+    ExpectBroadcastSame(input, row_bias, false);
+    ExpectBroadcastSame(row_bias, input, false);
+    // 标量
+    const sftensor scalar = TensorCreate(1, 1, 1);
+    scalar->Fill(3.f);
+    ExpectBroadcastSame(input, scalar, false);
+    // 两边都需要广播: (8, 1, 17) x (13, 1) -> (8, 13, 17)
+    const sftensor left = TensorCreate(8, 1, 17);
+    const sftensor right = TensorCreate(1, 13, 1);
+    left->Rand();
+    right->Rand();
+    ExpectBroadcastSame(left, right, true);
+    ExpectBroadcastSame(left, right, false);
+    // 不连续的视图参与广播
+    const sftensor transposed = std::make_shared<Tensor<float>>(TensorCreate(8, 17, 13)->Transpose());
+    transposed->Rand();
+    ExpectBroadcastSame(transposed, channel_scale, true);
+    ExpectBroadcastSame(transposed, input, false);
+
+    // 形状相同时结果与逐元素计算一致，输出也可以是已经分配好的张量
+    const sftensor other = TensorCreate(8, 13, 17);
+    other->Rand();
+    ExpectBroadcastSame(input, other, false);
+    const sftensor output = TensorCreate(8, 13, 17);
+    TensorElementMultiply(input, channel_scale, output);
+    ASSERT_TRUE(TensorIsSame(output, TensorElementMultiply(input, channel_scale)));
+}
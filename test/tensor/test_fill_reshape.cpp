@@ -2,6 +2,7 @@
 // Created by fss on 23-6-4.
 //
 #include "data/cpu/tensor.hpp"
+#include "data/cpu/tensor_util.hpp"
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 TEST(test_fill_reshape, fill1) {
@@ -31,4 +32,239 @@ TEST(test_fill_reshape, reshape1) {
   f1.Reshape({4, 3, 2});
   LOG(INFO) << "-------------------After Reshape-------------------";
   f1.Show();
-}
\ No newline at end of file
+}
+TEST(test_fill_reshape, view1) {
+  using namespace infer_neto;
+  Tensor<float> f1(2, 3, 4);
+  std::vector<float> values(2 * 3 * 4);
+  for (int i = 0; i < 24; ++i) {
+    values.at(i) = float(i + 1);
+  }
+  f1.Fill(values);
+
+  // 视图只改变形状，与原张量共用数据
+  Tensor<float> f2 = f1.View({4, 6});
+  ASSERT_EQ(f2.raw_ptr(), f1.raw_ptr());
+  ASSERT_EQ(f2.rows(), 4);
+  ASSERT_EQ(f2.cols(), 6);
+  ASSERT_EQ(f2.at(0, 1, 0), f1.at(0, 1, 2));
+  f2.at(0, 3, 5) = -1.f;
+  ASSERT_EQ(f1.at(1, 2, 3), -1.f);
+
+  // 深拷贝不再共用数据
+  Tensor<float> f3(f2);
+  ASSERT_NE(f3.raw_ptr(), f1.raw_ptr());
+
+  // 共用数据时保留自己的形状，原张量析构后数据仍然有效
+  Tensor<float> f4(24);
+  {
+    Tensor<float> f5(2, 3, 4);
+    f5.Fill(values);
+    f4.ShareData(f5);
+  }
+  ASSERT_EQ(f4.raw_shapes().size(), 1);
+  for (uint32_t i = 0; i < 24; ++i) {
+    ASSERT_EQ(f4.index(i), float(i + 1));
+  }
+}
+
+TEST(test_fill_reshape, transpose_view1) {
+  using namespace infer_neto;
+  Tensor<float> f1(2, 3, 4);
+  std::vector<float> values(2 * 3 * 4);
+  for (int i = 0; i < 24; ++i) {
+    values.at(i) = float(i + 1);
+  }
+  f1.Fill(values);
+
+  // 转置只交换每个通道的行列步长，不复制数据
+  Tensor<float> f2 = f1.Transpose();
+  ASSERT_FALSE(f2.is_contiguous());
+  ASSERT_EQ(f2.data().get(), f1.data().get());
+  ASSERT_EQ(f2.channels(), 2);
+  ASSERT_EQ(f2.rows(), 4);
+  ASSERT_EQ(f2.cols(), 3);
+  for (uint32_t c = 0; c < 2; ++c) {
+    for (uint32_t r = 0; r < 3; ++r) {
+      for (uint32_t col = 0; col < 4; ++col) {
+        ASSERT_EQ(f2.at(c, col, r), f1.at(c, r, col));
+      }
+    }
+  }
+  f2.at(1, 3, 2) = -1.f;
+  ASSERT_EQ(f1.at(1, 2, 3), -1.f);
+
+  // 按行主序读取转置后的元素，整理成连续张量后结果相同
+  const Tensor<float> &f3 = f2.Contiguous();
+  ASSERT_TRUE(f3.is_contiguous());
+  ASSERT_NE(f3.data().get(), f1.data().get());
+  for (uint32_t i = 0; i < f2.size(); ++i) {
+    ASSERT_EQ(f3.index(i), f2.index(i));
+  }
+  ASSERT_EQ(f2.index(1), f1.at(0, 1, 0));
+
+  // 两次转置回到连续的原始布局
+  Tensor<float> f4 = f2.Transpose();
+  ASSERT_TRUE(f4.is_contiguous());
+  ASSERT_EQ(f4.raw_ptr(), f1.raw_ptr());
+
+  // 一维向量转置后是一列，仍然是连续的
+  Tensor<float> f5(5);
+  Tensor<float> f6 = f5.Transpose();
+  ASSERT_EQ(f6.rows(), 5);
+  ASSERT_EQ(f6.cols(), 1);
+  ASSERT_TRUE(f6.is_contiguous());
+}
+
+TEST(test_fill_reshape, channels_view1) {
+  using namespace infer_neto;
+  Tensor<float> f1(4, 3, 2);
+  std::vector<float> values(4 * 3 * 2);
+  for (int i = 0; i < 24; ++i) {
+    values.at(i) = float(i + 1);
+  }
+  f1.Fill(values);
+
+  // 连续张量的通道范围仍然是连续的，直接指向原张量中的通道
+  Tensor<float> f2 = f1.Channels(1, 2);
+  ASSERT_TRUE(f2.is_contiguous());
+  ASSERT_EQ(f2.channels(), 2);
+  ASSERT_EQ(f2.size(), 12);
+  ASSERT_EQ(f2.raw_ptr(), f1.slice(1));
+  ASSERT_EQ(f2.index(0), 7.f);
+  f2.Fill(0.f);
+  ASSERT_EQ(f1.at(0, 2, 1), 6.f);
+  ASSERT_EQ(f1.at(1, 0, 0), 0.f);
+  ASSERT_EQ(f1.at(2, 2, 1), 0.f);
+  ASSERT_EQ(f1.at(3, 0, 0), 19.f);
+
+  // 原张量析构后视图仍然持有数据
+  Tensor<float> f3 = f1.Channels(3, 1);
+  f1 = Tensor<float>(1);
+  ASSERT_EQ(f3.index(5), 24.f);
+
+  // 转置视图的通道范围沿用转置后的步长
+  Tensor<float> f4(3, 2, 5);
+  f4.Rand();
+  Tensor<float> f5 = f4.Transpose().Channels(2, 1);
+  ASSERT_FALSE(f5.is_contiguous());
+  for (uint32_t r = 0; r < 5; ++r) {
+    for (uint32_t c = 0; c < 2; ++c) {
+      ASSERT_EQ(f5.at(0, r, c), f4.at(2, c, r));
+    }
+  }
+
+  // 逐元素运算在不连续的视图上逐个元素计算
+  const auto &input = std::make_shared<Tensor<float>>(f4.Transpose());
+  const auto &output = TensorElementAdd(input, input);
+  for (uint32_t i = 0; i < output->size(); ++i) {
+    ASSERT_EQ(output->index(i), 2 * input->index(i));
+  }
+}
+
+TEST(test_fill_reshape, batch_view1) {
+  using namespace infer_neto;
+  // 四维张量按 (batch, channels, rows, cols) 保存，每个样本是一个三维视图
+  Tensor<float> f1(std::vector<uint32_t>{2, 3, 4, 5});
+  ASSERT_EQ(f1.raw_shapes().size(), 4);
+  ASSERT_EQ(f1.batch_size(), 2);
+  ASSERT_EQ(f1.channels(), 3);
+  ASSERT_EQ(f1.rows(), 4);
+  ASSERT_EQ(f1.cols(), 5);
+  ASSERT_EQ(f1.size(), 120);
+  std::vector<float> values(120);
+  for (int i = 0; i < 120; ++i) {
+    values.at(i) = float(i);
+  }
+  f1.Fill(values);
+
+  Tensor<float> f2 = f1.Batch(1);
+  ASSERT_EQ(f2.raw_shapes(), std::vector<uint32_t>({3, 4, 5}));
+  ASSERT_EQ(f2.raw_ptr(), f1.raw_ptr() + 60);
+  ASSERT_EQ(f2.at(2, 3, 4), 119.f);
+  f2.at(0, 0, 0) = -1.f;
+  ASSERT_EQ(f1.index(60), -1.f);
+
+  // 样本的形状与直接按 (channels, rows, cols) 创建的张量一致
+  Tensor<float> f3(std::vector<uint32_t>{3, 1, 4, 5});
+  ASSERT_EQ(f3.Batch(0).raw_shapes(), Tensor<float>(1, 4, 5).raw_shapes());
+  Tensor<float> f4(std::vector<uint32_t>{3, 1, 1, 5});
+  ASSERT_EQ(f4.Batch(2).raw_shapes(), Tensor<float>(1, 1, 5).raw_shapes());
+
+  // 同一块内存中创建的一个批次等间隔排列，分散的张量不满足条件
+  const auto &samples = TensorCreateBatch(3, {2, 6});
+  ASSERT_EQ(samples.size(), 3);
+  ASSERT_EQ(samples.at(0)->raw_shapes(), std::vector<uint32_t>({2, 6}));
+  ASSERT_EQ(TensorBatchStride(samples, 0, 3), 12);
+  ASSERT_EQ(TensorBatchStride(samples, 1, 2), 12);
+  std::vector<sftensor> scattered = {TensorCreate(1, 2, 6), TensorCreate(1, 2, 6)};
+  ASSERT_EQ(TensorBatchStride(scattered, 0, 2), 0);
+
+  // 内存池上的一个批次通过别名持有内存池，内存池释放后样本和它们的视图仍然有效
+  auto arena = std::make_unique<Tensor<float>>(64);
+  arena->Fill(1.f);
+  const TensorData &arena_data = arena->data();
+  const auto arena_samples = TensorCreateBatch(2, {2, 6}, TensorData(arena_data, arena_data.get() + 16));
+  ASSERT_EQ(arena_samples.at(0)->raw_ptr(), arena->raw_ptr() + 16);
+  const Tensor<float> flat = arena_samples.at(1)->View({12});
+
+  // 同一内存池上互不重叠的张量之间复制时原地写入，仍然位于内存池中
+  arena_samples.at(0)->Fill(2.f);
+  float *target = arena_samples.at(1)->raw_ptr();
+  *arena_samples.at(1) = *arena_samples.at(0);
+  ASSERT_EQ(arena_samples.at(1)->raw_ptr(), target);
+  ASSERT_EQ(flat.index(0), 2.f);
+  // 与来源重叠时重新分配，复制的结果不受覆盖顺序影响
+  Tensor<float> overlapped(arena_data.get() + 16, {2, 6});
+  const Tensor<float> shifted(arena_data.get() + 18, {2, 6});
+  arena_samples.at(0)->Fill(std::vector<float>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}));
+  arena_samples.at(1)->Fill(std::vector<float>({12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23}));
+  overlapped = shifted;
+  ASSERT_NE(overlapped.raw_ptr(), arena_data.get() + 16);
+  for (uint32_t i = 0; i < 12; ++i) {
+    ASSERT_EQ(overlapped.index(i), float(i + 2));
+  }
+  arena_samples.at(0)->Fill(1.f);
+  arena_samples.at(1)->Fill(1.f);
+  arena.reset();
+  ASSERT_EQ(arena_samples.at(0)->index(0), 1.f);
+  ASSERT_EQ(flat.index(11), 1.f);
+}
+
+TEST(test_fill_reshape, unchecked_access1) {
+  using namespace infer_neto;
+  Tensor<float> f1(2, 3, 4);
+  std::vector<float> values(24);
+  for (int i = 0; i < 24; ++i) {
+    values.at(i) = float(i);
+  }
+  f1.Fill(values);
+
+  // 不检查下标的访问与at、index的结果相同，视图按步长访问
+  const Tensor<float> f2 = f1.Transpose();
+  for (uint32_t i = 0; i < f2.size(); ++i) {
+    ASSERT_EQ(f2.index_unchecked(i), f2.index(i));
+  }
+  for (uint32_t c = 0; c < 2; ++c) {
+    for (uint32_t r = 0; r < 4; ++r) {
+      // 每行取一次起始地址，之后按列步长访问
+      const float *row = f2.data_ptr(c, r, 0);
+      for (uint32_t col = 0; col < 3; ++col) {
+        ASSERT_EQ(row[col * f2.strides().back()], f2.at(c, r, col));
+        ASSERT_EQ(f2.at_unchecked(c, r, col), f1.at(c, col, r));
+      }
+    }
+  }
+
+  // 四维张量的通道按 batch * channels 展开
+  Tensor<float> f3(std::vector<uint32_t>{2, 3, 4, 5});
+  f3.at_unchecked(4, 2, 3) = 1.f;
+  ASSERT_EQ(f3.Batch(1).at(1, 2, 3), 1.f);
+  ASSERT_EQ(f3.data_ptr(4, 2, 3), &f3.Batch(1).at(1, 2, 3));
+
+  // 连续性随视图和Contiguous的结果一起更新
+  ASSERT_FALSE(f2.is_contiguous());
+  ASSERT_TRUE(f2.Contiguous().is_contiguous());
+  ASSERT_TRUE(f1.Channels(1, 1).is_contiguous());
+  ASSERT_FALSE(f2.Channels(0, 1).is_contiguous());
+}
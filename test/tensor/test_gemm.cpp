@@ -0,0 +1,296 @@
+//
+// Created by hanke on 2024/5/6.
+//
+#include "data/cpu/tensor.hpp"
+#include "data/cpu/gemm.hpp"
+#include "data/cpu/thread_pool.hpp"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <cmath>
+
+using namespace infer_neto;
+
+// 原先Tensor::Gemm中的朴素实现，作为正确性对照
+static Tensor<float> GemmReference(const Tensor<float> &a, const Tensor<float> &b) {
+    Tensor<float> result(a.channels(), a.rows(), b.cols());
+    for (uint32_t batch = 0; batch < a.channels(); batch++) {
+        for (uint32_t row = 0; row < a.rows(); row++) {
+            for (uint32_t col = 0; col < b.cols(); col++) {
+                float sum = 0;
+                for (uint32_t k = 0; k < a.cols(); k++) {
+                    sum += a.at(batch, row, k) * b.at(batch, k, col);
+                }
+                result.at(batch, row, col) = sum;
+            }
+        }
+    }
+    return result;
+}
+
+static void ExpectGemmNear(uint32_t m, uint32_t n, uint32_t k, uint32_t batch = 1) {
+    Tensor<float> a(batch, m, k);
+    Tensor<float> b(batch, k, n);
+    a.Rand();
+    b.Rand();
+    const Tensor<float> &expected = GemmReference(a, b);
+    const Tensor<float> &result = a.Gemm(b);
+    ASSERT_EQ(result.channels(), expected.channels());
+    ASSERT_EQ(result.rows(), expected.rows());
+    ASSERT_EQ(result.cols(), expected.cols());
+    for (uint32_t i = 0; i < expected.size(); ++i) {
+        const float tolerance = 1e-4f * std::max(1.f, std::abs(expected.index(i)));
+        ASSERT_NEAR(result.index(i), expected.index(i), tolerance)
+                                    << "m: " << m << " n: " << n << " k: " << k << " index: " << i;
+    }
+}
+
+TEST(test_gemm, gemm_small) {
+    ExpectGemmNear(1, 1, 1);
+    ExpectGemmNear(2, 3, 4);
+    ExpectGemmNear(kGemmMR, kGemmNR, 8);
+}
+
+TEST(test_gemm, gemm_edge_tiles) {
+    // 行列都不是微内核分块的整数倍
+    ExpectGemmNear(7, 13, 5);
+    ExpectGemmNear(kGemmMR + 1, kGemmNR + 1, 3);
+    ExpectGemmNear(1, 1000, 512);
+    ExpectGemmNear(1, 147, 37);
+}
+
+TEST(test_gemm, gemm_cache_blocks) {
+    // 跨越MC、KC、NC三个方向的缓存分块
+    ExpectGemmNear(kGemmMC + 5, 33, kGemmKC + 7);
+    ExpectGemmNear(13, kGemmNC + 21, 19);
+    ExpectGemmNear(64, 196, 2 * kGemmKC + 1);
+}
+
+TEST(test_gemm, gemm_batch) {
+    ExpectGemmNear(5, 17, 9, 3);
+}
+
+TEST(test_gemm, gemm_transposed_view) {
+    // 转置视图不连续，Gemm先整理成连续数据再相乘
+    Tensor<float> a(7, 5);
+    Tensor<float> b(7, 9);
+    a.Rand();
+    b.Rand();
+    const Tensor<float> &a_t = a.Transpose();
+    ASSERT_FALSE(a_t.is_contiguous());
+    const Tensor<float> &expected = GemmReference(a_t, b);
+    const Tensor<float> &result = a_t.Gemm(b);
+    ASSERT_EQ(result.rows(), 5);
+    ASSERT_EQ(result.cols(), 9);
+    for (uint32_t i = 0; i < expected.size(); ++i) {
+        ASSERT_NEAR(result.index(i), expected.index(i), 1e-4f * std::max(1.f, std::abs(expected.index(i))));
+    }
+}
+
+TEST(test_gemm, sgemm_leading_dimension) {
+    // 在更大的矩阵中计算子矩阵的乘法
+    const uint32_t m = 9, n = 21, k = 11;
+    const uint32_t lda = k + 3, ldb = n + 5, ldc = n + 2;
+    std::vector<float> a(m * lda), b(k * ldb), c(m * ldc, -1.f);
+    for (uint32_t i = 0; i < a.size(); ++i) a.at(i) = float(i % 7) - 3.f;
+    for (uint32_t i = 0; i < b.size(); ++i) b.at(i) = float(i % 5) - 2.f;
+    SGemm(m, n, k, a.data(), lda, b.data(), ldb, c.data(), ldc);
+    for (uint32_t i = 0; i < m; ++i) {
+        for (uint32_t j = 0; j < ldc; ++j) {
+            if (j >= n) {
+                ASSERT_EQ(c.at(i * ldc + j), -1.f);
+                continue;
+            }
+            float sum = 0.f;
+            for (uint32_t l = 0; l < k; ++l) {
+                sum += a.at(i * lda + l) * b.at(l * ldb + j);
+            }
+            ASSERT_FLOAT_EQ(c.at(i * ldc + j), sum);
+        }
+    }
+}
+
+TEST(test_gemm, sgemm_bias_epilogue) {
+    // 偏置按行广播，覆盖完整块、边界块、m为1以及跨KC分块的情况
+    const std::vector<std::vector<uint32_t>> shapes = {{13, 37, 5}, {1, 19, 7}, {kGemmMR, kGemmNR, kGemmKC + 3}};
+    for (const auto &shape : shapes) {
+        const uint32_t m = shape.at(0), n = shape.at(1), k = shape.at(2);
+        Tensor<float> a(m, k);
+        Tensor<float> b(k, n);
+        a.Rand();
+        b.Rand();
+        std::vector<float> bias(m);
+        for (uint32_t i = 0; i < m; ++i) bias.at(i) = float(i) - 2.5f;
+
+        std::vector<float> c(m * n);
+        GemmEpilogue epilogue;
+        epilogue.bias = bias.data();
+        SGemm(m, n, k, a.raw_ptr(), k, b.raw_ptr(), n, c.data(), n, epilogue);
+        const Tensor<float> &expected = GemmReference(a, b);
+        for (uint32_t i = 0; i < m; ++i) {
+            for (uint32_t j = 0; j < n; ++j) {
+                const float value = expected.index(i * n + j) + bias.at(i);
+                ASSERT_NEAR(c.at(i * n + j), value, 1e-4f * std::max(1.f, std::abs(value)));
+            }
+        }
+    }
+}
+
+TEST(test_gemm, sgemm_gather_columns) {
+    // B是一个 k x (h * w) 矩阵按步长2子采样得到的视图，等价于先复制出子采样矩阵再相乘
+    const uint32_t h = 9, w = 11, stride = 2;
+    const uint32_t out_h = (h - 1) / stride + 1, out_w = (w - 1) / stride + 1;
+    const uint32_t m = 13, n = out_h * out_w, k = kGemmKC + 5;
+    Tensor<float> a(m, k);
+    Tensor<float> source(k, h * w);
+    a.Rand();
+    source.Rand();
+
+    std::vector<uint32_t> offsets(n);
+    Tensor<float> b(k, n);
+    for (uint32_t oh = 0; oh < out_h; ++oh) {
+        for (uint32_t ow = 0; ow < out_w; ++ow) {
+            offsets.at(oh * out_w + ow) = oh * stride * w + ow * stride;
+        }
+    }
+    for (uint32_t l = 0; l < k; ++l) {
+        for (uint32_t j = 0; j < n; ++j) {
+            b.at(0, l, j) = source.at(0, l, offsets.at(j));
+        }
+    }
+
+    std::vector<float> bias(m, 0.5f);
+    GemmEpilogue epilogue;
+    epilogue.bias = bias.data();
+    std::vector<float> c(m * n);
+    SGemmGatherB(m, n, k, a.raw_ptr(), k, source.raw_ptr(), h * w, offsets.data(), c.data(), n, epilogue);
+    const Tensor<float> &expected = GemmReference(a, b);
+    for (uint32_t i = 0; i < m * n; ++i) {
+        const float value = expected.index(i) + 0.5f;
+        ASSERT_NEAR(c.at(i), value, 1e-4f * std::max(1.f, std::abs(value)));
+    }
+}
+
+TEST(test_gemm, sgemm_relu_epilogue) {
+    // ReLU只能在k方向的最后一个分块中完成，覆盖跨多个KC分块、边界块和m为1的情况
+    const std::vector<std::vector<uint32_t>> shapes = {{13, 37, 2 * kGemmKC + 3}, {1, 19, 7}, {kGemmMR, kGemmNR, 5}};
+    for (const auto &shape : shapes) {
+        const uint32_t m = shape.at(0), n = shape.at(1), k = shape.at(2);
+        Tensor<float> a(m, k);
+        Tensor<float> b(k, n);
+        a.Rand();
+        b.Rand();
+        std::vector<float> bias(m);
+        for (uint32_t i = 0; i < m; ++i) bias.at(i) = float(i % 3) - 1.f;
+
+        std::vector<float> c(m * n);
+        GemmEpilogue epilogue;
+        epilogue.bias = bias.data();
+        epilogue.relu = true;
+        SGemm(m, n, k, a.raw_ptr(), k, b.raw_ptr(), n, c.data(), n, epilogue);
+        const Tensor<float> &expected = GemmReference(a, b);
+        for (uint32_t i = 0; i < m; ++i) {
+            for (uint32_t j = 0; j < n; ++j) {
+                const float value = std::max(expected.index(i * n + j) + bias.at(i), 0.f);
+                ASSERT_NEAR(c.at(i * n + j), value, 1e-4f * std::max(1.f, std::abs(value)))
+                                            << "m: " << m << " n: " << n << " k: " << k;
+            }
+        }
+    }
+}
+
+TEST(test_gemm, sgemm_residual_epilogue) {
+    // 残差与C的行距不同，在偏置之后、ReLU之前加上
+    const std::vector<std::vector<uint32_t>> shapes = {{13, 37, 2 * kGemmKC + 3}, {1, 19, 7}, {kGemmMR, kGemmNR, 5}};
+    for (const auto &shape : shapes) {
+        const uint32_t m = shape.at(0), n = shape.at(1), k = shape.at(2);
+        const uint32_t ldr = n + 3;
+        Tensor<float> a(m, k);
+        Tensor<float> b(k, n);
+        a.Rand();
+        b.Rand();
+        std::vector<float> bias(m, -0.5f);
+        std::vector<float> residual(m * ldr);
+        for (uint32_t i = 0; i < residual.size(); ++i) residual.at(i) = float(i % 7) - 3.f;
+
+        std::vector<float> c(m * n);
+        GemmEpilogue epilogue;
+        epilogue.bias = bias.data();
+        epilogue.residual = residual.data();
+        epilogue.ldr = ldr;
+        epilogue.relu = true;
+        SGemm(m, n, k, a.raw_ptr(), k, b.raw_ptr(), n, c.data(), n, epilogue);
+        const Tensor<float> &expected = GemmReference(a, b);
+        for (uint32_t i = 0; i < m; ++i) {
+            for (uint32_t j = 0; j < n; ++j) {
+                const float value = std::max(expected.index(i * n + j) - 0.5f + residual.at(i * ldr + j), 0.f);
+                ASSERT_NEAR(c.at(i * n + j), value, 1e-4f * std::max(1.f, std::abs(value)))
+                                            << "m: " << m << " n: " << n << " k: " << k;
+            }
+        }
+    }
+}
+
+TEST(test_gemm, sgemm_batched_b) {
+    // 各样本的B按列拼接成一次矩阵乘法，结果应与逐个样本调用SGemm相同
+    // 覆盖列数不是kGemmNR整数倍、拼接后跨越NC分块、列偏移读取以及样本之间带间隔的情况
+    const std::vector<std::vector<uint32_t>> shapes = {{13, 37, 5, 3}, {kGemmMR, 1500, kGemmKC + 3, 3},
+                                                       {1, 19, 7, 4}, {9, kGemmNR, 11, 2}};
+    for (const auto &shape : shapes) {
+        const uint32_t m = shape.at(0), n = shape.at(1), k = shape.at(2), batch = shape.at(3);
+        for (bool gather : {false, true}) {
+            const uint32_t ldb = gather ? 2 * n : n;
+            const size_t b_stride = size_t(k) * ldb + 7, c_stride = size_t(m) * n + 5, r_stride = size_t(m) * n + 3;
+            std::vector<uint32_t> offsets(n);
+            for (uint32_t j = 0; j < n; ++j) offsets.at(j) = 2 * j + 1;
+            Tensor<float> a(m, k);
+            a.Rand();
+            std::vector<float> b(batch * b_stride), residual(batch * r_stride), bias(m);
+            for (uint32_t i = 0; i < b.size(); ++i) b.at(i) = float(i % 13) * 0.1f - 0.6f;
+            for (uint32_t i = 0; i < residual.size(); ++i) residual.at(i) = float(i % 7) - 3.f;
+            for (uint32_t i = 0; i < m; ++i) bias.at(i) = float(i % 3) - 1.f;
+
+            GemmEpilogue epilogue;
+            epilogue.bias = bias.data();
+            epilogue.residual = residual.data();
+            epilogue.ldr = n;
+            epilogue.residual_batch_stride = r_stride;
+            epilogue.relu = true;
+            std::vector<float> c(batch * c_stride, -7.f);
+            SGemmBatchedB(batch, m, n, k, a.raw_ptr(), k, b.data(), ldb, b_stride,
+                          gather ? offsets.data() : nullptr, c.data(), n, c_stride, epilogue);
+
+            for (uint32_t s = 0; s < batch; ++s) {
+                GemmEpilogue sample_epilogue = epilogue;
+                sample_epilogue.residual = residual.data() + s * r_stride;
+                std::vector<float> expected(m * n);
+                if (gather) {
+                    SGemmGatherB(m, n, k, a.raw_ptr(), k, b.data() + s * b_stride, ldb, offsets.data(),
+                                 expected.data(), n, sample_epilogue);
+                } else {
+                    SGemm(m, n, k, a.raw_ptr(), k, b.data() + s * b_stride, ldb, expected.data(), n,
+                          sample_epilogue);
+                }
+                for (uint32_t i = 0; i < m * n; ++i) {
+                    ASSERT_NEAR(c.at(s * c_stride + i), expected.at(i), 1e-4f * std::max(1.f, std::abs(expected.at(i))))
+                                                << "m: " << m << " n: " << n << " k: " << k << " batch: " << s;
+                }
+                // 样本之间的间隔不会被写入
+                if (s + 1 < batch) {
+                    ASSERT_EQ(c.at(s * c_stride + m * n), -7.f);
+                }
+            }
+        }
+    }
+}
+
+TEST(test_gemm, gemm_intra_op_threads) {
+    SetIntraOpThreads(4);
+    // 行数多时按行切分，列数多时按列切分，单行时按列分段
+    ExpectGemmNear(300, 20, 64);
+    ExpectGemmNear(8, 600, 64);
+    ExpectGemmNear(kGemmMC + 5, 33, kGemmKC + 7);
+    ExpectGemmNear(13, kGemmNC + 21, 19);
+    ExpectGemmNear(1, 1000, 512);
+    ExpectGemmNear(64, 196, 2 * kGemmKC + 1, 2);
+    SetIntraOpThreads(0);
+}
@@ -0,0 +1,62 @@
+//
+// Created by hanke on 2024/5/8.
+//
+#include "data/cpu/im2col.hpp"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace infer_neto;
+
+static void ExpectIm2ColEqual(uint32_t input_c, uint32_t input_h, uint32_t input_w,
+                              uint32_t kernel_h, uint32_t kernel_w, uint32_t padding_h, uint32_t padding_w,
+                              uint32_t stride_h, uint32_t stride_w) {
+    const uint32_t output_h = ConvOutputSize(input_h, kernel_h, padding_h, stride_h);
+    const uint32_t output_w = ConvOutputSize(input_w, kernel_w, padding_w, stride_w);
+    std::vector<float> input(input_c * input_h * input_w);
+    for (uint32_t i = 0; i < input.size(); ++i) input.at(i) = float(i + 1);
+
+    // 输出矩阵先填充非零值，检查每个位置都被写到
+    std::vector<float> output(input_c * kernel_h * kernel_w * output_h * output_w, -1.f);
+    Im2Col(input.data(), input_c, input_h, input_w, kernel_h, kernel_w,
+           padding_h, padding_w, stride_h, stride_w, output.data());
+
+    for (uint32_t ic = 0; ic < input_c; ++ic) {
+        for (uint32_t kh = 0; kh < kernel_h; ++kh) {
+            for (uint32_t kw = 0; kw < kernel_w; ++kw) {
+                const uint32_t row = (ic * kernel_h + kh) * kernel_w + kw;
+                for (uint32_t oh = 0; oh < output_h; ++oh) {
+                    for (uint32_t ow = 0; ow < output_w; ++ow) {
+                        const int ih = int(oh * stride_h + kh) - int(padding_h);
+                        const int iw = int(ow * stride_w + kw) - int(padding_w);
+                        float expected = 0.f;
+                        if (ih >= 0 && ih < int(input_h) && iw >= 0 && iw < int(input_w)) {
+                            expected = input.at((ic * input_h + ih) * input_w + iw);
+                        }
+                        ASSERT_EQ(output.at(row * output_h * output_w + oh * output_w + ow), expected)
+                                                    << "row: " << row << " oh: " << oh << " ow: " << ow;
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(test_im2col, im2col_stride1) {
+    ExpectIm2ColEqual(1, 4, 4, 3, 3, 0, 0, 1, 1);
+    ExpectIm2ColEqual(3, 7, 5, 3, 3, 1, 1, 1, 1);
+    ExpectIm2ColEqual(2, 6, 6, 1, 1, 0, 0, 1, 1);
+}
+
+TEST(test_im2col, im2col_strided) {
+    ExpectIm2ColEqual(3, 15, 15, 7, 7, 3, 3, 2, 2);
+    ExpectIm2ColEqual(2, 9, 8, 3, 3, 1, 1, 2, 2);
+    ExpectIm2ColEqual(4, 8, 8, 1, 1, 0, 0, 2, 2);
+    ExpectIm2ColEqual(2, 10, 11, 3, 2, 1, 0, 3, 2);
+}
+
+TEST(test_im2col, im2col_wide_padding) {
+    // 填充大于卷积核时，部分卷积核位置整行都落在填充上
+    ExpectIm2ColEqual(1, 3, 3, 2, 2, 3, 3, 1, 1);
+    ExpectIm2ColEqual(2, 4, 5, 3, 3, 2, 4, 2, 3);
+}
@@ -0,0 +1,84 @@
+//
+// Created by hanke on 2024/5/17.
+//
+#include "data/cpu/thread_pool.hpp"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+
+using namespace infer_neto;
+
+TEST(test_thread_pool, submit_and_steal) {
+    std::atomic<uint32_t> finished{0};
+    std::atomic<uint32_t> started{0};
+    {
+        ThreadPool pool(4, [&started](uint32_t) { started.fetch_add(1); });
+        ASSERT_EQ(pool.size(), 4);
+        // 每个任务在池中再提交子任务，子任务先进入当前线程的队列，空闲线程从中窃取
+        for (uint32_t i = 0; i < 64; ++i) {
+            pool.Submit([&pool, &finished]() {
+                for (uint32_t j = 0; j < 16; ++j) {
+                    pool.Submit([&finished]() { finished.fetch_add(1); });
+                }
+                finished.fetch_add(1);
+            });
+        }
+        // 析构时等待所有任务完成
+    }
+    ASSERT_EQ(started.load(), 4);
+    ASSERT_EQ(finished.load(), 64 * 17);
+}
+
+TEST(test_thread_pool, parallel_for) {
+    SetIntraOpThreads(4);
+    ASSERT_EQ(IntraOpThreads(), 4);
+
+    const size_t n = 1003;
+    std::vector<std::atomic<uint32_t>> visits(n);
+    std::vector<std::thread::id> owners(n);
+    ParallelFor(n, 16, [&visits, &owners](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            visits.at(i).fetch_add(1);
+            owners.at(i) = std::this_thread::get_id();
+        }
+    });
+    for (size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(visits.at(i).load(), 1) << "index: " << i;
+    }
+
+    // 同样的n得到同样的划分，分块的边界在多次调用之间不变
+    std::vector<std::pair<size_t, size_t>> first_chunks;
+    std::vector<std::pair<size_t, size_t>> second_chunks;
+    std::mutex mutex;
+    for (auto *chunks: {&first_chunks, &second_chunks}) {
+        ParallelFor(n, 16, [chunks, &mutex](size_t begin, size_t end) {
+            std::lock_guard<std::mutex> lock(mutex);
+            chunks->emplace_back(begin, end);
+        });
+        std::sort(chunks->begin(), chunks->end());
+    }
+    ASSERT_EQ(first_chunks.size(), 4);
+    ASSERT_EQ(first_chunks, second_chunks);
+
+    // 分块内嵌套的ParallelFor在当前线程中依次执行
+    std::atomic<uint32_t> nested_elsewhere{0};
+    ParallelFor(8, 1, [&nested_elsewhere](size_t, size_t) {
+        const std::thread::id outer = std::this_thread::get_id();
+        ParallelFor(64, 1, [outer, &nested_elsewhere](size_t, size_t) {
+            if (std::this_thread::get_id() != outer) {
+                nested_elsewhere.fetch_add(1);
+            }
+        });
+    });
+    ASSERT_EQ(nested_elsewhere.load(), 0);
+
+    // 小于分块大小的任务不唤醒线程池
+    const std::thread::id caller = std::this_thread::get_id();
+    ParallelFor(10, 16, [caller](size_t begin, size_t end) {
+        ASSERT_EQ(begin, 0);
+        ASSERT_EQ(end, 10);
+        ASSERT_EQ(std::this_thread::get_id(), caller);
+    });
+    SetIntraOpThreads(0);
+}
@@ -0,0 +1,76 @@
+//
+// Created by hanke on 2024/5/16.
+//
+#include "data/cpu/tensor.hpp"
+#include "data/cpu/transpose.hpp"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+using namespace infer_neto;
+
+TEST(test_transpose, transpose_matrix) {
+    // 覆盖只有边缘、整8x8分块以及需要递归切分的尺寸，输入输出都带行距
+    const std::vector<std::pair<uint32_t, uint32_t>> sizes = {{3, 5}, {8, 8}, {17, 9}, {64, 40}, {129, 70}};
+    for (const auto &[rows, cols] : sizes) {
+        const size_t lds = cols + 3;
+        const size_t ldd = rows + 5;
+        std::vector<float> src(rows * lds);
+        for (size_t i = 0; i < src.size(); ++i) {
+            src.at(i) = float(i);
+        }
+        std::vector<float> dst(cols * ldd, -1.f);
+        TransposeMatrix(rows, cols, src.data(), lds, dst.data(), ldd);
+        for (uint32_t i = 0; i < rows; ++i) {
+            for (uint32_t j = 0; j < cols; ++j) {
+                ASSERT_EQ(dst.at(j * ldd + i), src.at(i * lds + j));
+            }
+        }
+        // 行距之外的位置不被改写
+        for (uint32_t j = 0; j < cols; ++j) {
+            for (size_t i = rows; i < ldd; ++i) {
+                ASSERT_EQ(dst.at(j * ldd + i), -1.f);
+            }
+        }
+    }
+}
+
+TEST(test_transpose, permute_view) {
+    Tensor<float> f1(std::vector<uint32_t>{2, 3, 20, 13});
+    f1.Rand();
+    // (batch, channels, rows, cols) -> (batch, rows, cols, channels)
+    Tensor<float> f2 = f1.Permute({0, 2, 3, 1});
+    ASSERT_EQ(f2.raw_shapes(), std::vector<uint32_t>({2, 20, 13, 3}));
+    ASSERT_EQ(f2.data().get(), f1.data().get());
+    ASSERT_FALSE(f2.is_contiguous());
+    Tensor<float> f3 = f2.Contiguous();
+    ASSERT_TRUE(f3.is_contiguous());
+    for (uint32_t b = 0; b < 2; ++b) {
+        for (uint32_t c = 0; c < 3; ++c) {
+            for (uint32_t r = 0; r < 20; ++r) {
+                for (uint32_t col = 0; col < 13; ++col) {
+                    ASSERT_EQ(f3.raw_ptr()[((b * 20 + r) * 13 + col) * 3 + c],
+                              f1.raw_ptr()[((b * 3 + c) * 20 + r) * 13 + col]);
+                }
+            }
+        }
+    }
+
+    // 三维张量交换通道和列，再换回来与原张量相同
+    Tensor<float> f4(5, 11, 9);
+    f4.Rand();
+    Tensor<float> f5 = f4.Permute({2, 1, 0}).Contiguous();
+    ASSERT_EQ(f5.raw_shapes(), std::vector<uint32_t>({9, 11, 5}));
+    for (uint32_t c = 0; c < 5; ++c) {
+        for (uint32_t r = 0; r < 11; ++r) {
+            for (uint32_t col = 0; col < 9; ++col) {
+                ASSERT_EQ(f5.at(col, r, c), f4.at(c, r, col));
+            }
+        }
+    }
+    Tensor<float> f6 = f5.Permute({2, 1, 0}).Contiguous();
+    for (uint32_t i = 0; i < f4.size(); ++i) {
+        ASSERT_EQ(f6.index(i), f4.index(i));
+    }
+    // 恒等排列仍然是连续的
+    ASSERT_TRUE(f4.Permute({0, 1, 2}).is_contiguous());
+}